@@ -5,6 +5,11 @@ set(CMAKE_MODULE_PATH ${CMAKE_MODULE_PATH} "${CMAKE_INSTALL_PREFIX}/share/CMake"
 find_package ( nlohmann_json CONFIG REQUIRED )
 find_package ( OpenImageIO   CONFIG REQUIRED )
 find_package ( Eigen3        CONFIG REQUIRED )
+find_package ( Threads              REQUIRED )
+
+if (RTA_ENABLE_OPENCL)
+    find_package ( OpenCL REQUIRED )
+endif ()
 
 if (RTA_CENTOS7_CERES_HACK)
     find_package ( Ceres MODULE REQUIRED )
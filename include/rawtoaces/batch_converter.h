@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/image_converter.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace util
+{
+
+class JobManifest;
+class SolveAhead;
+
+/// The outcome of converting a single file as a part of a batch.
+struct BatchResult
+{
+    /// The path of the input file.
+    std::string input_filename;
+
+    /// `true` if the file has been converted successfully.
+    bool success = false;
+
+    /// `true` if the conversion of the file has not been attempted, because
+    /// an earlier file has failed and `continue_on_error` is not set.
+    bool skipped = false;
+
+    /// `true` if the conversion of the file has not been attempted, because
+    /// the job manifest records the file as converted with the same settings
+    /// since it last changed, see `ImageConverter::Settings::manifest_file`.
+    /// The up-to-date files count as `success`, and do not get reported via
+    /// the callbacks.
+    bool up_to_date = false;
+
+    /// The path of the output file. Only set if `success`.
+    std::string output_filename;
+
+    /// The solved white balance multipliers, see
+    /// `ImageConverter::get_WB_multipliers()`.
+    std::vector<double> WB_multipliers;
+
+    /// The solved input transform matrix, see
+    /// `ImageConverter::get_IDT_matrix()`.
+    std::vector<std::vector<double>> IDT_matrix;
+
+    /// The solved chromatic adaptation transform matrix, see
+    /// `ImageConverter::get_CAT_matrix()`.
+    std::vector<std::vector<double>> CAT_matrix;
+
+    /// The execution time of every stage of converting the file in
+    /// milliseconds, see `Metrics::get_times()`. Only gets filled in by the
+    /// time `BatchConverter::process` returns, and if
+    /// `BatchConverter::metrics` is set.
+    std::map<std::string, double> stage_times;
+};
+
+/// The metadata of a file read by `scan_metadata()`.
+struct ScanResult
+{
+    /// The path of the input file.
+    std::string input_filename;
+
+    /// `true` if the metadata have been read successfully.
+    bool success = false;
+
+    /// The camera make and model.
+    std::string camera_make;
+    std::string camera_model;
+
+    /// The dimensions of the image as decoded with the given settings.
+    int width  = 0;
+    int height = 0;
+
+    /// The as-shot white balance multipliers, `raw:pre_mul`.
+    std::vector<float> pre_mul;
+
+    /// The DNG version, 0 for the other formats.
+    int DNG_version = 0;
+
+    /// The illuminants of the two DNG calibrations, per the EXIF light
+    /// source tag, 0 if missing.
+    int calibration_illuminants[2] = { 0, 0 };
+
+    /// The index of the distinct setup of the file, the same for all files
+    /// scanned together sharing the transform key, see
+    /// `ImageConverter::read_transform_key()`.
+    size_t setup = 0;
+
+    /// `true` if the transform of the setup has been solved, when solving
+    /// has been requested.
+    bool solved = false;
+};
+
+/// Read only the metadata of `files` concurrently, without unpacking the
+/// sensor data, so a batch can be sized and planned without converting it.
+/// @param files the paths of the files to scan.
+/// @param settings the conversion settings; `jobs` limits the number of the
+///     threads, all hardware threads get used if not set.
+/// @param solve solve the transform of every distinct setup, once per setup.
+///     The transforms land in the caches shared within the process, and get
+///     stored in `cache_file` and in the tables of `CCT_table_directory` if
+///     set, so the later runs converting the files find them there.
+/// @result the metadata of the files, in the order of `files`.
+std::vector<ScanResult> scan_metadata(
+    const std::vector<std::string> &files,
+    const ImageConverter::Settings &settings,
+    bool                            solve = false );
+
+/// Write the results of `scan_metadata()` as a table of tab-separated
+/// values with a header line, one line per file.
+/// @param stream the stream to write to.
+/// @param results the results to write.
+/// @param solve add the column telling whether the transforms have been
+///     solved.
+void write_scan_table(
+    std::ostream                  &stream,
+    const std::vector<ScanResult> &results,
+    bool                           solve = false );
+
+/// Select the files of a shard of a batch split into `count` shards. The
+/// files get assigned to the shards by a stable hash of their paths, so
+/// every node given the same paths gets the same partition without any
+/// coordination, and a file keeps its shard when other files get added or
+/// removed.
+/// @param files the paths of all files of the batch.
+/// @param index the index of the shard, from 0 to `count - 1`.
+/// @param count the number of the shards.
+/// @result the files of the shard, in the order of `files`.
+std::vector<std::string> select_shard(
+    const std::vector<std::string> &files, size_t index, size_t count );
+
+/// Make the path of the file of a shard, e.g. `metrics.shard-1-of-4.prom`
+/// for `metrics.prom`, so the shards running on a shared filesystem do not
+/// overwrite each other's files.
+/// @param path the path of the file shared by all shards.
+/// @param index the index of the shard.
+/// @param count the number of the shards. If less than 2, `path` gets
+///     returned as is.
+/// @result the path of the file of the shard.
+std::string
+shard_filename( const std::string &path, size_t index, size_t count );
+
+/// Converts a list of files, processing up to `ImageConverter::Settings::jobs`
+/// files concurrently. Every worker thread owns an `ImageConverter`
+/// initialised with the same settings, so the per-image state is never
+/// shared, while the colour transform caches are shared between the workers.
+/// When processing sequentially with `ImageConverter::Settings::pipeline_depth`
+/// set, reading, converting and writing the files happen on separate threads
+/// instead, connected by bounded queues. With
+/// `ImageConverter::Settings::group_transforms` set, the colour transforms get
+/// solved once per group of files sharing the same setup before converting
+/// any of the files, or with `ImageConverter::Settings::solve_ahead` set, on
+/// background threads running ahead of the conversions, in the order of the
+/// files. With `ImageConverter::Settings::manifest_file` set, the
+/// outcome of every file gets recorded in the manifest as soon as known, and
+/// the files up to date according to the manifest get skipped.
+/// With `ImageConverter::Settings::shard_count` set, only the files of the
+/// shard given by `ImageConverter::Settings::shard_index` get converted, see
+/// `select_shard()`. The manifest and the metrics files then get suffixed
+/// with the shard, see `shard_filename()`, and the metrics include a summary
+/// of the shard.
+class BatchConverter
+{
+public:
+    /// The callback type used for progress reporting.
+    /// @param index the zero-based index of the file in the batch.
+    /// @param total the total number of files in the batch.
+    /// @param result the result of the file. Only `input_filename` is valid
+    ///     when the callback is invoked as `on_file_started`.
+    using Callback = std::function<void(
+        size_t index, size_t total, const BatchResult &result )>;
+
+    /// The conversion settings shared by all workers.
+    ImageConverter::Settings settings;
+
+    /// Invoked when a file gets reported as started. The callbacks are always
+    /// invoked on the calling thread in the order of the input files. When
+    /// processing sequentially, this happens right before the file gets
+    /// converted; when processing concurrently, the reports get deferred
+    /// until all preceding files have completed. When pipelining (see
+    /// `ImageConverter::Settings::pipeline_depth`), the file gets reported
+    /// after it has been written.
+    Callback on_file_started;
+
+    /// Invoked after `on_file_started` when the result of a file is known.
+    Callback on_file_finished;
+
+    /// If set, the execution time of the stages of every file and the cache
+    /// hit and miss counts of the batch get recorded into this collector.
+    /// Gets created by `process` if `ImageConverter::Settings::metrics_file`
+    /// is set, the collected metrics get written into the file at the end of
+    /// the batch.
+    std::shared_ptr<Metrics> metrics;
+
+    /// If set, the spans of the stages of every file get recorded into this
+    /// tracer. Gets created by `process` if
+    /// `ImageConverter::Settings::trace_file` is set, the spans get written
+    /// into the file at the end of the batch.
+    std::shared_ptr<Tracer> tracer;
+
+    /// Size the OpenImageIO thread pool, shared within the process, to the
+    /// threads of all concurrent conversions of `process`, if
+    /// `ImageConverter::Settings::threads` or `ImageConverter::Settings::jobs`
+    /// is set. Clear this when several batches run concurrently in the same
+    /// process, and size the pool once instead, see `ConversionServer`.
+    bool size_thread_pool = true;
+
+    /// Convert all files in `files`, or the files of the shard given in the
+    /// settings.
+    /// @param files the paths of the files to convert.
+    /// @result `true` if all files have been converted successfully.
+    bool process( const std::vector<std::string> &files );
+
+    /// The results of the last `process` call in the order of the input files,
+    /// only holding the files of the shard if sharded.
+    const std::vector<BatchResult> &get_results() const;
+
+private:
+    /// Read the metadata of the files of `_results`, and solve the colour
+    /// transform of every group of files sharing the transform key, see
+    /// `ImageConverter::read_transform_key()`. Fills in `_transforms`.
+    void plan_transforms();
+
+    /// Open the job manifest given in the settings, and mark the files of
+    /// `_results` it records as up to date.
+    /// @result `true` if the manifest has been opened successfully.
+    bool check_manifest();
+
+    /// Record the outcome of a converted file in the job manifest, if any.
+    void record_file( const BatchResult &result );
+
+    /// Convert the files of `_results` either sequentially or concurrently.
+    bool process_files();
+
+    /// Read, convert and write the files in three concurrent stages.
+    bool process_pipelined();
+
+    std::vector<BatchResult> _results;
+
+    /// The transforms planned for the files of `_results`, `nullptr` for the
+    /// files to solve the transform for when converting.
+    std::vector<std::shared_ptr<const ImageConverter::Transform>> _transforms;
+
+    /// The job manifest of the current batch, and the signature of the
+    /// settings to record in it.
+    std::shared_ptr<JobManifest> _manifest;
+    std::string                  _signature;
+
+    /// The background solver of the transforms of the upcoming files, if
+    /// `ImageConverter::Settings::solve_ahead` is set.
+    std::shared_ptr<SolveAhead> _solve_ahead;
+};
+
+} // namespace util
+} // namespace rta
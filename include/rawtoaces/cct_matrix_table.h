@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/rawtoaces_core.h>
+
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace core
+{
+
+/// A table of the white-balance multipliers and the IDT matrices of a camera
+/// solved over a range of correlated colour temperatures. Once built, the IDT
+/// matrix for any white balance gets interpolated from the neighbouring
+/// entries, without fitting. The tables can be saved to and loaded from
+/// files, so they only need to be built once per camera.
+///
+/// The illuminants used are the blackbody radiators below 4000K, and the
+/// CIE daylight illuminants from 4000K up, the same as the candidates of
+/// `SpectralSolver::find_illuminant()` matching the white balance.
+class CCTMatrixTable
+{
+public:
+    /// The solution for one colour temperature.
+    struct Entry
+    {
+        /// The correlated colour temperature in Kelvin.
+        double CCT = 0.0;
+
+        /// The white-balance multipliers, normalised to the green channel.
+        std::vector<double> WB_multipliers;
+
+        /// The 3×3 IDT matrix.
+        std::vector<std::vector<double>> IDT_matrix;
+    };
+
+    /// The camera make the table has been built for.
+    std::string camera_make;
+
+    /// The camera model the table has been built for.
+    std::string camera_model;
+
+    /// The entries in the order of increasing colour temperature.
+    std::vector<Entry> entries;
+
+    /// The illuminant type solved for a colour temperature, as accepted by
+    /// `SpectralSolver::find_illuminant()`, e.g. `3200k` or `d5500`.
+    /// @param CCT the correlated colour temperature in Kelvin.
+    /// @result the illuminant type.
+    static std::string illuminant_type( int CCT );
+
+    /// Build the table by solving the illuminants from `min_CCT` to
+    /// `max_CCT` in steps of `step`, see `SpectralSolver::solve_illuminants()`.
+    /// The `camera`, `observer` and `training_data` of the solver have to be
+    /// configured prior to this call. The `fit_mode` of the solver applies.
+    ///
+    /// @param solver the solver configured for the camera.
+    /// @param make the camera make to store in the table.
+    /// @param model the camera model to store in the table.
+    /// @param min_CCT the lowest colour temperature in Kelvin.
+    /// @param max_CCT the highest colour temperature in Kelvin.
+    /// @param step the colour temperature step in Kelvin.
+    /// @param thread_count the number of the threads to solve on, 0 to use
+    ///     all hardware threads.
+    /// @result `true` if all entries have been solved successfully.
+    bool build(
+        const SpectralSolver &solver,
+        const std::string    &make,
+        const std::string    &model,
+        int                   min_CCT      = 2000,
+        int                   max_CCT      = 12000,
+        int                   step         = 100,
+        size_t                thread_count = 0 );
+
+    /// Interpolate the IDT matrix for the given white balance. The white
+    /// balance gets projected onto the polyline through the white balances of
+    /// the entries, and the matrices of the two nearest entries get
+    /// interpolated linearly along the polyline. The white balances beyond
+    /// the ends of the table get the matrix of the end entry.
+    ///
+    /// @param WB_multipliers the white-balance multipliers, e.g. as shot.
+    /// @param out_IDT_matrix the interpolated 3×3 IDT matrix.
+    /// @param out_CCT if not `nullptr`, gets the interpolated colour
+    ///     temperature in Kelvin.
+    /// @result `false` if the table is empty or the white balance is invalid.
+    bool interpolate(
+        const std::vector<double>        &WB_multipliers,
+        std::vector<std::vector<double>> &out_IDT_matrix,
+        double                           *out_CCT = nullptr ) const;
+
+    /// Load the table from a JSON file written by `save()`.
+    /// @param path the path to the file.
+    /// @result `true` if loaded successfully.
+    bool load( const std::string &path );
+
+    /// Save the table into a JSON file.
+    /// @param path the path to the file.
+    /// @result `true` if saved successfully.
+    bool save( const std::string &path ) const;
+};
+
+} // namespace core
+} // namespace rta
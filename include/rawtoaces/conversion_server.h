@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/batch_converter.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace util
+{
+
+/// Converts the jobs submitted over a local socket, see `submit_job()`, in a
+/// long-running process. The process keeps the OpenImageIO plugins, the
+/// spectral databases and the colour transform caches loaded between the
+/// jobs, so a job only pays for converting its files. Every job carries its
+/// own command line, parsed into a fresh `ImageConverter` the same way the
+/// `rawtoaces` tool does, so the settings of one job never leak into another.
+/// The relative paths of a job get resolved against the working directory of
+/// the client submitting it. The jobs get converted on `max_jobs` worker
+/// threads, the connections beyond that wait for a free worker. The server
+/// sizes the OpenImageIO thread pool, shared by all jobs, once for `max_jobs`
+/// concurrent jobs; the `--threads` and `--jobs` options of a job only split
+/// the work of that job.
+///
+/// The server uses Unix domain sockets, and is not available on Windows.
+class ConversionServer
+{
+public:
+    /// The maximum number of the jobs converted concurrently.
+    size_t max_jobs = 1;
+
+    /// The verbosity level of the server log written to the standard output.
+    int verbosity = 0;
+
+    ConversionServer() = default;
+    ~ConversionServer();
+
+    ConversionServer( const ConversionServer & )            = delete;
+    ConversionServer &operator=( const ConversionServer & ) = delete;
+
+    /// Create the socket at `path`, so the clients can connect to it, and
+    /// load the plugins and the default spectral database. An existing socket
+    /// at `path`, left behind by a server which has not shut down cleanly,
+    /// gets replaced.
+    /// @param path the path of the socket to create.
+    /// @result `true` if listening on the socket.
+    bool listen( const std::string &path );
+
+    /// Serve the jobs submitted to the socket created by `listen()` until
+    /// `stop()` gets called. The socket gets removed on return.
+    void run();
+
+    /// `listen()` on the socket at `path`, and `run()`.
+    /// @param path the path of the socket to create.
+    /// @result `true` once stopped, `false` if failed to listen on the socket.
+    bool serve( const std::string &path );
+
+    /// Make `run()` stop accepting new jobs, and return once the accepted
+    /// jobs have been converted. Only sets a flag, so it is safe to call from
+    /// any thread or from a signal handler.
+    void stop();
+
+private:
+    /// Read the job sent over `connection`, convert it, and report the
+    /// progress and the exit status back to the client.
+    void run_job( int connection );
+
+    /// Close the listening socket, and remove it.
+    void close_socket();
+
+    int               _listener = -1;
+    std::string       _path;
+    std::atomic<bool> _stopping = false;
+};
+
+/// Submit a conversion job to the server listening at `path`, and wait until
+/// the job has been converted. The errors reported by the server, and a
+/// summary of the failed and the skipped files, get printed to the standard
+/// error and the standard output, the same way as by the `rawtoaces` tool.
+/// @param path the path of the socket of the server.
+/// @param arguments the command line arguments of the job, without the
+///     program name, the same as given to the `rawtoaces` tool.
+/// @param on_file_started invoked when the server starts converting a file,
+///     see `BatchConverter::on_file_started`.
+/// @param on_file_finished invoked when the server has converted a file,
+///     see `BatchConverter::on_file_finished`. Only `input_filename` and
+///     `success` of the result are valid.
+/// @result the exit status of the job, 0 if all files have been converted
+///     successfully, or -1 if failed to reach the server.
+int submit_job(
+    const std::string              &path,
+    const std::vector<std::string> &arguments,
+    const BatchConverter::Callback &on_file_started  = nullptr,
+    const BatchConverter::Callback &on_file_finished = nullptr );
+
+} // namespace util
+} // namespace rta
@@ -3,24 +3,70 @@
 
 #pragma once
 
+#include <rawtoaces/usage_timer.h>
+
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/argparse.h>
 
+#include <functional>
+#include <memory>
+
 namespace rta
 {
 namespace util
 {
 
+class RawReader;
+
 /// Collect all files from given `paths` into batches.
 /// For each path that is a directory, entries are created in the returned batches
 /// and fill it with the file names. Invalid paths are skipped with an error message.
 /// First batch is reserved for all paths that are files. If no such paths are provided,
 /// first batch will be empty.
 ///
+/// The files of every directory batch get sorted by path.
+///
 /// @param paths vector of paths to files or directories to process.
+/// @param recursive if `true`, the subdirectories get scanned too, adding
+///     their files to the batch of the input directory.
+/// @param thread_count the number of the threads to list the directories
+///     on, 0 to use all hardware threads.
 /// @return vector of batches, where each batch contains files from one input path.
-std::vector<std::vector<std::string>>
-collect_image_files( const std::vector<std::string> &paths );
+std::vector<std::vector<std::string>> collect_image_files(
+    const std::vector<std::string> &paths,
+    bool                            recursive    = false,
+    size_t                          thread_count = 1 );
+
+/// The callback type used by `scan_image_files()`.
+/// @param batch the index of the batch the file belongs to, as returned by
+///     `collect_image_files()`.
+/// @param path the path of the file found.
+using ScanCallback =
+    std::function<void( size_t batch, const std::string &path )>;
+
+/// Scan `paths` for image files the same way as `collect_image_files()`, but
+/// report every file to `on_file` as soon as its directory has been listed,
+/// so that processing can start before the scan finishes. The directories
+/// get listed concurrently, `on_file` gets invoked on the scanning threads,
+/// one call at a time, with the files in no particular order.
+///
+/// The file names get filtered by the supported RAW extensions first, so
+/// only the candidate files and the entries to recurse into get their types
+/// checked, which come from the directory listing itself on most file
+/// systems. The symbolic links to directories are not followed.
+///
+/// @param paths vector of paths to files or directories to process.
+/// @param on_file the callback invoked for every file found.
+/// @param recursive if `true`, the subdirectories get scanned too.
+/// @param thread_count the number of the threads to list the directories
+///     on, 0 to use all hardware threads.
+/// @return the number of batches, including the first one reserved for the
+///     paths that are files.
+size_t scan_image_files(
+    const std::vector<std::string> &paths,
+    const ScanCallback             &on_file,
+    bool                            recursive    = false,
+    size_t                          thread_count = 1 );
 
 class ImageConverter
 {
@@ -104,6 +150,29 @@ public:
         /// folder.
         std::string illuminant;
 
+        /// Fit the spectral IDT matrices using the analytic Jacobian and
+        /// looser tolerances, starting from the matrix solved for the
+        /// closest illuminant of the same camera, see
+        /// `core::SpectralSolver::FitMode::Fast`. The matrices match the
+        /// reference fit within 1e-5 per element. The fast and the reference
+        /// matrices get cached separately, including in `cache_file`.
+        bool fast_fit = false;
+
+        /// Interpolate the spectral IDT matrix for the white balance from a
+        /// per-camera table of the matrices solved over a range of colour
+        /// temperatures, instead of fitting the matrix of the illuminant
+        /// best matching the white balance. The table only gets built once
+        /// per camera, see `core::CCTMatrixTable`, after that no fitting is
+        /// needed. Only used when `WB_method` == `WBMethod::Metadata` and
+        /// `matrix_method` == `MatrixMethod::Spectral`. Note that the custom
+        /// illuminants stored in the database are not in the table.
+        bool use_CCT_table = false;
+
+        /// The directory to load the colour temperature tables from, and to
+        /// save the tables built to, see `use_CCT_table`. Leave empty to
+        /// only keep the tables in memory.
+        std::string CCT_table_directory;
+
         /// Highlight headroom factor.
         float headroom = 6.0;
 
@@ -147,6 +216,16 @@ public:
         /// Decode the image at half size resolution.
         bool half_size = false;
 
+        /// If greater than 1, convert a low resolution proxy of the image for
+        /// a quick preview, downscaled by this integer factor. Even factors
+        /// decode the image at half size, skipping demosaicing, odd factors
+        /// use the 'linear' demosaicing; `half_size` and
+        /// `demosaic_algorithm` are ignored. The rest of the factor gets
+        /// applied by `apply_downscale` before the colour transform. The
+        /// proxies get written as in `OutputProfile::Intermediate`, and are
+        /// never streamed, ignoring `memory_limit`.
+        int proxy = 0;
+
         /// Highlight recovery mode, as supported by OpenImageIO/Libraw
         /// 0 = clip, 1 = unclip, 2 = blend, 3..9 = rebuild.
         int highlight_mode = 0;
@@ -192,6 +271,194 @@ public:
         /// The directory to write the output files to.
         std::string output_dir;
 
+        /// Scan the input directories recursively, see
+        /// `collect_image_files()`. The output files of the subdirectories
+        /// get written relative to their own input directories.
+        bool recursive = false;
+
+        /// The enumerator containing all supported output file profiles.
+        enum class OutputProfile
+        {
+            /// Write ACES Container files conforming to SMPTE ST 2065-4:
+            /// uncompressed half-float scanline OpenEXR files.
+            Strict,
+            /// Write half-float OpenEXR files using `compression`,
+            /// `tile_size` and `write_threads`, trading CPU time for smaller
+            /// files. These files are not ST 2065-4 compliant, so are not
+            /// marked as ACES Container files.
+            Intermediate
+        };
+
+        /// The selected output file profile.
+        OutputProfile output_profile = OutputProfile::Strict;
+
+        /// The OpenEXR compression to use in `OutputProfile::Intermediate`,
+        /// like 'zip', 'piz', or 'dwaa'. The compression level can be
+        /// appended for the formats supporting it, like 'dwaa:45'.
+        std::string compression = "zip";
+
+        /// The size of the tiles to write in `OutputProfile::Intermediate`.
+        /// 0 means writing scanlines.
+        int tile_size = 0;
+
+        /// The number of threads used to compress an output file in
+        /// `OutputProfile::Intermediate`. 0 means using the OpenImageIO
+        /// default.
+        int write_threads = 0;
+
+        /// An output file written from the decoded image, see `outputs`.
+        struct Output
+        {
+            /// The suffix of the output file name, replacing the extension
+            /// of the input file, the same as `_aces` of the default output.
+            std::string suffix = "_aces";
+
+            /// The region of the image to write: x, y, width and height in
+            /// the pixels of the image written by the default output, i.e.
+            /// after the crop and the `proxy` downscale. The region gets
+            /// written as an image of its own, with the display window
+            /// matching the region. Zero width or height writes the whole
+            /// image, as the default output does.
+            int region[4] = { 0, 0, 0, 0 };
+
+            /// If greater than 1, downscale the output by this integer
+            /// factor, the same way as `apply_downscale()`. The downscaled
+            /// outputs get written as in `OutputProfile::Intermediate`, the
+            /// same as the proxies.
+            int scale = 1;
+
+            /// If not empty, write the output as in
+            /// `OutputProfile::Intermediate`, using this compression instead
+            /// of `compression`.
+            std::string compression;
+        };
+
+        /// The output files to write from each image. All outputs share the
+        /// decoded image and the solved transform, so an image only gets
+        /// decoded once however many outputs it has, and the colour
+        /// transform only gets applied to the region of each output. The
+        /// suffixes must be distinct. If empty, the default output gets
+        /// written, the same as a single `Output` with the default values.
+        /// The images with outputs are never streamed, ignoring
+        /// `memory_limit`.
+        std::vector<Output> outputs;
+
+        /// The number of files to convert concurrently when processing a
+        /// batch. Each worker uses its own converter, the colour transform
+        /// caches are shared between the workers. Values less than 2 process
+        /// the files sequentially.
+        int jobs = 1;
+
+        /// The number of threads each conversion uses for decoding, for
+        /// processing the pixels, and for solving the colour transforms. 0
+        /// splits the hardware threads evenly between the `jobs` concurrent
+        /// conversions, so a batch does not oversubscribe the machine, see
+        /// `conversion_threads()`. `BatchConverter` sizes the OpenImageIO
+        /// thread pool to `jobs` times this, unless run by a
+        /// `ConversionServer`. Ceres only fits the IDT matrix on more than
+        /// one thread if this is set.
+        int threads = 0;
+
+        /// Keep converting the remaining files of a batch if a file fails to
+        /// convert. If not set, the batch stops at the first failure.
+        bool continue_on_error = false;
+
+        /// The path to a job manifest file recording the outcome of every
+        /// file of a batch along with the size and the modification time of
+        /// the input file and a signature of the settings, see
+        /// `BatchConverter`. When the batch gets run again, the files
+        /// converted successfully with the same settings since they last
+        /// changed get skipped without being opened. Leave empty to convert
+        /// all files.
+        std::string manifest_file;
+
+        /// The index of the shard of a batch to convert, from 0 to
+        /// `shard_count - 1`, see `BatchConverter`.
+        int shard_index = 0;
+
+        /// The number of the shards to split a batch into, so that several
+        /// nodes given the same files can each convert a part of the batch
+        /// without any coordination. Values less than 2 convert all files.
+        int shard_count = 1;
+
+        /// The number of images which can wait between the read, convert and
+        /// write stages when processing a batch sequentially. If not 0, the
+        /// next files get read and the previous files get written while the
+        /// current file is being converted, overlapping the file I/O with the
+        /// processing. Only used if `jobs` is less than 2, and neither
+        /// `memory_limit` nor `outputs` is set.
+        int pipeline_depth = 0;
+
+        /// Plan a batch before converting it: read the metadata of all files
+        /// concurrently, group the files by the camera, the as-shot white
+        /// balance and the DNG calibration metadata, and solve the colour
+        /// transform once per group. The files then get converted with the
+        /// transform of their group, so the cost of solving scales with the
+        /// number of distinct setups rather than the number of files.
+        bool group_transforms = false;
+
+        /// The number of background threads solving the colour transforms
+        /// of the upcoming files of a batch ahead of their conversion, in
+        /// the order of the files, see `BatchConverter`. The conversions then
+        /// find the transforms in the caches instead of waiting for the
+        /// spectral solver. Every distinct transform key, see
+        /// `read_transform_key()`, only gets solved once. Not used if
+        /// `group_transforms` or `disable_cache` is set. 0 disables.
+        int solve_ahead = 0;
+
+        /// The amount of memory in megabytes to use for the pixel buffers
+        /// when converting an image. If not 0, `process_image()` streams the
+        /// image from the decoder to the output file in horizontal strips
+        /// fitting into this budget, instead of loading the whole frame.
+        /// Note that the raw decoder still keeps its own copy of the decoded
+        /// image. 0 means no limit.
+        int memory_limit = 0;
+
+        /// The amount of memory in megabytes to keep for reuse in the pool of
+        /// the pixel buffers shared within the process. If not 0, the pixel
+        /// buffers of the decoded, the converted and the streamed images get
+        /// borrowed from the pool and returned to it after each file, so a
+        /// batch of images of the same size only allocates its buffers for
+        /// the first files. The buffer filled by `read_image()` or
+        /// `process_memory()` then stays valid until the next call of these
+        /// methods, or until the converter gets destroyed, unless its memory
+        /// gets taken over via `detach_buffer()`.
+        int buffer_pool = 0;
+
+        /// Back the pixel buffers allocated for the pool with transparent
+        /// huge pages, where supported by the system, reducing the page
+        /// faults and the TLB misses of the large images. Only used if
+        /// `buffer_pool` is set.
+        bool huge_pages = false;
+
+        /// Run the colour transform stage on a GPU via OpenCL, if rawtoaces
+        /// was built with `RTA_ENABLE_OPENCL` and a GPU is available. Falls
+        /// back to the CPU otherwise, and for the transforms not converting
+        /// float pixels to half floats. The results match the CPU within
+        /// the half float precision.
+        bool use_gpu = false;
+
+        /// The enumerator containing the ways of reading the raw files.
+        enum class IOMode
+        {
+            /// Read the whole file into memory with a single read, and decode
+            /// it from there.
+            Buffered,
+            /// Map the file into memory, hinting the system to read it ahead
+            /// sequentially, and decode it straight from the mapped pages,
+            /// saving the copy out of the page cache. Best for the files on
+            /// fast local storage.
+            Mapped,
+            /// Let the raw decoder read the file itself.
+            Direct
+        };
+
+        /// The way of reading the raw files. The file gets read only once
+        /// in `IOMode::Buffered` and `IOMode::Mapped`, even though the
+        /// decoder gets opened twice, once for the metadata and then for
+        /// the pixels.
+        IOMode io_mode = IOMode::Buffered;
+
         //////////////
         // Diagnostic:
 
@@ -201,6 +468,24 @@ public:
         /// Disable caching.
         bool disable_cache = false;
 
+        /// The path to a file to persistently store the solved colour
+        /// transforms in, shared between runs and processes. Leave empty to
+        /// only cache the transforms in memory.
+        std::string cache_file;
+
+        /// The path to a file to write the execution time of every stage of
+        /// processing each file, the aggregate histograms of the stages and
+        /// the cache hit and miss counts to at the end of a batch, see
+        /// `BatchConverter`. Files with the `.prom` extension get written in
+        /// the Prometheus text format, others in the JSON lines format.
+        std::string metrics_file;
+
+        /// The path to a file to write the spans of the processing stages of
+        /// every file to at the end of a batch, see `BatchConverter`, in the
+        /// Chrome trace event format. The spans record the thread every stage
+        /// has run on, and whether the colour transform caches have been hit.
+        std::string trace_file;
+
         /// Verbosity level.
         int verbosity = 0;
     };
@@ -208,6 +493,34 @@ public:
     /// The conversion settings.
     Settings settings;
 
+    /// If set, the execution time of the image processing stages of every
+    /// file gets recorded into this collector. Can be shared between
+    /// converters running concurrently.
+    std::shared_ptr<Metrics> metrics;
+
+    /// If set, the spans of the image processing stages of every file get
+    /// recorded into this tracer. Can be shared between converters running
+    /// concurrently.
+    std::shared_ptr<Tracer> tracer;
+
+    /// A colour transform solved by `configure()`, along with the matrix
+    /// method resolved for the file.
+    struct Transform
+    {
+        Settings::MatrixMethod           matrix_method =
+            Settings::MatrixMethod::Auto;
+        std::vector<double>              WB_multipliers;
+        std::vector<std::vector<double>> IDT_matrix;
+        std::vector<std::vector<double>> CAT_matrix;
+    };
+
+    /// If set, `configure()` applies this transform instead of solving one
+    /// for the file, skipping the spectral data look-ups and the colour
+    /// transform caches altogether. The transform must have been solved with
+    /// the same settings for a file having the same transform key, see
+    /// `read_transform_key()` and `get_transform()`.
+    std::shared_ptr<const Transform> transform;
+
     /// Initialise the parser object with all the command line parameters
     /// used by this tool. The method also sets the help and usage strings.
     /// The parser object can be amended by the calling code afterwards if
@@ -229,11 +542,15 @@ public:
     /// Collects all camera raw formats supported by this version.
     std::vector<std::string> get_supported_formats() const;
 
-    /// Collects all illuminants supported by this version.
+    /// Collects all illuminants supported by this version. Only the headers
+    /// of the data files get parsed, and the listing is cached until any of
+    /// the database directories changes.
     std::vector<std::string> get_supported_illuminants() const;
 
     /// Collects all camera models for which spectral sensitivity data is
-    /// available in the database.
+    /// available in the database. Only the headers of the data files get
+    /// parsed, and the listing is cached until any of the database
+    /// directories changes.
     std::vector<std::string> get_supported_cameras() const;
 
     /// Configures the converter using the requested white balance and colour
@@ -252,6 +569,27 @@ public:
     bool configure(
         const std::string &input_filename, OIIO::ParamValueList &options );
 
+    /// Configures the converter as `configure(input_filename, options)` does,
+    /// reading the raw image from memory instead of a file, e.g. an object
+    /// fetched from a storage service. The memory does not get copied, so
+    /// it must stay valid until the pixels get decoded by `load_image`.
+    /// @param name
+    ///    A name to identify the image by, to pass to `load_image` as the
+    ///    path, and to use in the messages.
+    /// @param data
+    ///    The content of the raw image file.
+    /// @param size
+    ///    The size of `data` in bytes.
+    /// @param options
+    ///    Conversion hints to be passed to OIIO when reading the image.
+    /// @result
+    ///    `true` if configured successfully.
+    bool configure(
+        const std::string    &name,
+        const void           *data,
+        size_t                size,
+        OIIO::ParamValueList &options );
+
     /// Configures the converter using the requested white balance and colour
     /// matrix method, and the metadata of the given OIIO::ImageSpec object.
     /// Use this method if you already have an image read from file to save
@@ -270,6 +608,9 @@ public:
     /// Load an image from a given `path` into a `buffer` using the `hints`
     /// calculated by the `configure` method. The hints can be manually
     /// modified prior to invoking this method.
+    /// If `path` is the file previously given to
+    /// `configure(input_filename, options)`, the reader opened there gets
+    /// reused, so the file is only read from storage once.
     bool load_image(
         const std::string          &path,
         const OIIO::ParamValueList &hints,
@@ -298,6 +639,22 @@ public:
     bool apply_scale(
         OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi = {} );
 
+    /// Apply the colour space conversion matrix (or matrices) and the
+    /// headroom scale in a single pass. This is equivalent to calling
+    /// `apply_matrix` followed by `apply_scale`, but all stages get
+    /// pre-multiplied into one matrix, so the pixels are only visited once.
+    /// @param dst
+    ///     Destination image buffer. If initialised with a different pixel
+    ///     format than `src`, e.g. `HALF`, the conversion happens in the same
+    ///     pass.
+    /// @param src
+    ///     Source image buffer, can be the same as `dst` for in-place
+    ///     conversion.
+    /// @result
+    ///    `true` if applied successfully.
+    bool apply_transform(
+        OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi = {} );
+
     /// Apply the cropping mode as specified in crop_mode.
     /// @param dst
     ///     Destination image buffer.
@@ -309,6 +666,21 @@ public:
     bool apply_crop(
         OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi = {} );
 
+    /// Downscale the image by an integer factor, averaging each block of
+    /// `factor`×`factor` pixels into one. The data and the display windows
+    /// get scaled by the same factor, the incomplete blocks at the right
+    /// and bottom edges get discarded.
+    /// @param dst
+    ///     Destination image buffer, gets reallocated as `FLOAT`.
+    /// @param src
+    ///     Source image buffer, can be the same as `dst`.
+    /// @param factor
+    ///     The downscale factor. Values less than 2 copy the image.
+    /// @result
+    ///    `true` if applied successfully.
+    bool apply_downscale(
+        OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, int factor );
+
     /// Make output file path and check if it is writable.
     /// @param path
     ///     A reference to a variable containing the input file path. The output file path gets generated
@@ -321,7 +693,8 @@ public:
     bool
     make_output_path( std::string &path, const std::string &suffix = "_aces" );
 
-    /// Saves the image into ACES Container.
+    /// Saves the image into ACES Container, or into the file format defined
+    /// by `Settings::output_profile`.
     /// @param output_filename
     ///     Full path to the file to be saved.
     /// @param buf
@@ -331,15 +704,191 @@ public:
     bool
     save_image( const std::string &output_filename, const OIIO::ImageBuf &buf );
 
+    /// Convert the image at `input_filename` and save it into ACES Container
+    /// at `output_filename`, streaming the pixels in horizontal strips, so
+    /// the whole frame never gets loaded into memory. This is equivalent to
+    /// calling `load_image`->`apply_transform`->`apply_crop`->`save_image`,
+    /// but only the rows within the crop area get converted. The strips are
+    /// sized to fit into `Settings::memory_limit`, or 64 megabytes if no limit
+    /// is set.
+    /// @param input_filename
+    ///     Full path to the file to be converted, previously given to
+    ///     `configure`.
+    /// @param hints
+    ///     The decoding hints calculated by `configure`.
+    /// @param output_filename
+    ///     Full path to the file to be saved.
+    /// @result
+    ///    `true` if converted successfully.
+    bool stream_image(
+        const std::string          &input_filename,
+        const OIIO::ParamValueList &hints,
+        const std::string          &output_filename );
+
+    /// The first stage of `process_image`: validate the input file, make the
+    /// output file path, configure the converter and load the image.
+    /// Together with `convert_image` and `write_image`, this allows running
+    /// the stages of `process_image` separately, e.g. to overlap reading and
+    /// writing files with converting others.
+    /// @param input_filename
+    ///     Full path to the file to be converted.
+    /// @param output_filename
+    ///     Receives the full path of the file to save the result to.
+    /// @param buffer
+    ///     Receives the loaded image.
+    /// @result
+    ///    `true` if loaded successfully.
+    bool read_image(
+        const std::string &input_filename,
+        std::string       &output_filename,
+        OIIO::ImageBuf    &buffer );
+
+    /// The second stage of `process_image`: apply the transform and the
+    /// crop to the image loaded by `read_image`, converting it to half
+    /// floats, downscaling it first if `Settings::proxy` is set. Must be
+    /// called before configuring this converter again.
+    /// @param input_filename
+    ///     Full path to the converted file, used for reporting.
+    /// @param buffer
+    ///     The image buffer to convert in-place.
+    /// @result
+    ///    `true` if converted successfully.
+    bool
+    convert_image( const std::string &input_filename, OIIO::ImageBuf &buffer );
+
+    /// The last stage of `process_image`: save the image converted by
+    /// `convert_image`.
+    /// @param input_filename
+    ///     Full path to the converted file, used for reporting.
+    /// @param output_filename
+    ///     Full path to the file to be saved, as given by `read_image`.
+    /// @param buffer
+    ///     The converted image buffer.
+    /// @result
+    ///    `true` if saved successfully.
+    bool write_image(
+        const std::string    &input_filename,
+        const std::string    &output_filename,
+        const OIIO::ImageBuf &buffer );
+
+    /// Convert the image loaded by `read_image` into one of
+    /// `Settings::outputs`: downscale the region of the output, and apply the
+    /// transform and the crop to it, converting it to half floats. Only the
+    /// pixels within the region get processed, and `buffer` stays intact, so
+    /// it can feed the other outputs. The `Settings::proxy` downscale is
+    /// expected to have been applied to `buffer` already.
+    /// @param input_filename
+    ///     Full path to the converted file, used for reporting.
+    /// @param buffer
+    ///     The image loaded by `read_image`.
+    /// @param output
+    ///     The output to convert the image for.
+    /// @param result
+    ///     Receives the converted image.
+    /// @result
+    ///    `true` if converted successfully.
+    bool convert_output(
+        const std::string      &input_filename,
+        const OIIO::ImageBuf   &buffer,
+        const Settings::Output &output,
+        OIIO::ImageBuf         &result );
+
+    /// Save an image converted by `convert_output`, the same way as
+    /// `save_image`, using the compression of `output`.
+    /// @param output_filename
+    ///     Full path to the file to be saved.
+    /// @param buf
+    ///     Image buffer to be saved.
+    /// @param output
+    ///     The output the image has been converted for.
+    /// @result
+    ///    `true` if saved successfully.
+    bool save_output(
+        const std::string      &output_filename,
+        const OIIO::ImageBuf   &buf,
+        const Settings::Output &output );
+
     /// A convenience single-call method to process an image. This is equivalent to calling the following
-    /// methods sequentially: `make_output_path`->`configure`->`apply_matrix`->
-    /// `apply_scale`->`apply_crop`->`save`.
+    /// methods sequentially: `make_output_path`->`configure`->`load_image`->
+    /// `apply_transform`->`apply_crop`->`save_image`, or
+    /// `make_output_path`->`configure`->`stream_image` if
+    /// `Settings::memory_limit` is set and `Settings::proxy` is not. If
+    /// `Settings::outputs` is set, the image gets loaded once, and
+    /// `convert_output`->`save_output` gets called for every output.
     /// @param input_filename
     ///     Full path to the file to be converted.
     /// @result
     ///    `true` if processed successfully.
     bool process_image( const std::string &input_filename );
 
+    /// Convert a raw image held in memory into a buffer, without touching
+    /// the filesystem. This is equivalent to calling
+    /// `configure(name, data, size, options)`->`load_image`->`convert_image`,
+    /// leaving the half-float ACES pixels in `buffer` instead of saving them.
+    /// The output file settings and `Settings::memory_limit` do not apply.
+    /// @param name
+    ///    A name to identify the image by in the messages and the timings.
+    /// @param data
+    ///    The content of the raw image file.
+    /// @param size
+    ///    The size of `data` in bytes.
+    /// @param buffer
+    ///    Receives the converted image.
+    /// @result
+    ///    `true` if converted successfully.
+    bool process_memory(
+        const std::string &name,
+        const void        *data,
+        size_t             size,
+        OIIO::ImageBuf    &buffer );
+
+    /// Read only the metadata of a file, without unpacking the sensor data.
+    /// The metadata get amended the same way as by `configure()`.
+    /// @param input_filename
+    ///    Full path to the file to read.
+    /// @param image_spec
+    ///    Receives the metadata.
+    /// @result
+    ///    `true` if the metadata have been read successfully.
+    bool read_metadata(
+        const std::string &input_filename, OIIO::ImageSpec &image_spec ) const;
+
+    /// Read only the metadata of a file, and build the key identifying the
+    /// colour transform the file needs: the camera make and model, the
+    /// as-shot white balance and the DNG calibration metadata. The files
+    /// having the same key get the same transform with the same settings.
+    /// @param input_filename
+    ///    Full path to the file to read.
+    /// @param key
+    ///    Receives the transform key.
+    /// @result
+    ///    `true` if the metadata have been read successfully.
+    bool read_transform_key(
+        const std::string &input_filename, std::string &key ) const;
+
+    /// Build the transform key of a file, see `read_transform_key()`, from
+    /// the metadata read by `read_metadata()`.
+    /// @param image_spec
+    ///    The metadata of the file.
+    /// @result
+    ///    The transform key.
+    static std::string transform_key( const OIIO::ImageSpec &image_spec );
+
+    /// Read only the metadata of a file, and solve its colour transform the
+    /// same way `configure()` does, without preparing the file for reading
+    /// the pixels. The solved transform lands in the caches shared within
+    /// the process, so the conversion of the file, and of the other files
+    /// needing the same transform, finds it there.
+    /// @param input_filename
+    ///    Full path to the file to read.
+    /// @result
+    ///    `true` if the transform has been solved successfully.
+    bool solve_transform( const std::string &input_filename );
+
+    /// Get the colour transform solved by the last `configure()` call.
+    /// @result the solved transform.
+    Transform get_transform() const;
+
     /// Get the solved white balance multipliers of the currently processed
     /// image. The multipliers become available after calling either of the
     /// two `configure` methods.
@@ -358,12 +907,78 @@ public:
     /// @result a reference to the matrix.
     const std::vector<std::vector<double>> &get_CAT_matrix() const;
 
+    /// Get the path of the output file of the currently processed image.
+    /// The path becomes available after calling either `process_image` or
+    /// `read_image`, and is empty if the path could not be made.
+    /// @result a reference to the path.
+    const std::string &get_output_filename() const;
+
+    /// Take over the memory of `buffer` borrowed from the pool, see
+    /// `Settings::buffer_pool`, so it stays valid after the next image gets
+    /// converted. The memory goes back to the pool once the returned pointer
+    /// gets released, `buffer` must not be used after that.
+    /// @param buffer
+    ///     A buffer filled by this converter.
+    /// @result
+    ///     The memory holding the pixels of `buffer`, or `nullptr` if it has
+    ///     not been borrowed from the pool, in which case `buffer` owns its
+    ///     pixels.
+    std::shared_ptr<void> detach_buffer( const OIIO::ImageBuf &buffer );
+
+    /// Return the memory borrowed from the pool for the buffers of the
+    /// current image, see `Settings::buffer_pool`, except the memory taken
+    /// over via `detach_buffer()`. The buffers filled by this converter must
+    /// not be used afterwards.
+    void release_buffers();
+
 private:
+    bool configure_reader(
+        const std::shared_ptr<RawReader> &raw_reader,
+        OIIO::ImageSpec                  &image_spec,
+        OIIO::ParamValueList             &options );
+
+    bool prepare_image(
+        const std::string    &input_filename,
+        std::string          &output_filename,
+        OIIO::ParamValueList &hints );
+
+    // Write all `Settings::outputs` of the image at `input_filename`.
+    bool process_outputs( const std::string &input_filename );
+
+    // Reset `buffer` to hold the pixels of `spec` without initialising them,
+    // borrowing the memory from the pool if `Settings::buffer_pool` is set.
+    void allocate_buffer( const OIIO::ImageSpec &spec, OIIO::ImageBuf &buffer );
+
+    // Return the memory of `buffer` to the pool if it has been borrowed.
+    void release_buffer( const OIIO::ImageBuf &buffer );
+
+    // Allocate `size` bytes, borrowed from the pool if `Settings::buffer_pool`
+    // is set.
+    std::shared_ptr<void> allocate_memory( size_t size );
+
     // Solved transform of the current image.
     std::vector<std::vector<double>> _idt_matrix;
     std::vector<std::vector<double>> _cat_matrix;
     std::vector<double>              _wb_multipliers;
+    Settings::MatrixMethod           _matrix_method =
+        Settings::MatrixMethod::Auto;
+
+    // The output file of the current image, made by `prepare_image`.
+    std::string _output_filename;
+
+    // The reader opened by `configure`, consumed by `load_image`.
+    std::shared_ptr<RawReader> _raw_reader;
+
+    // The memory borrowed from the pool for the buffers of the current image.
+    std::vector<std::shared_ptr<void>> _buffers;
 };
 
+/// The number of the threads a single conversion with `settings` uses:
+/// `Settings::threads` if set, otherwise the hardware threads divided
+/// between the `Settings::jobs` concurrent conversions, at least 1.
+/// @param settings the conversion settings.
+/// @result the number of the threads.
+int conversion_threads( const ImageConverter::Settings &settings );
+
 } //namespace util
 } //namespace rta
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace rta
+{
+namespace core
+{
+
+/// A read-only memory mapping of a whole file. The pages of the file get
+/// shared between all processes mapping it, so the data only gets loaded
+/// into memory once per machine.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile( const MappedFile & )            = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+
+    /// Map the file at `path`.
+    /// @param path the path of the file to map.
+    /// @param sequential hint the system to read the whole file ahead, for
+    ///     the files read mostly front to back once mapped.
+    /// @result `true` if mapped successfully.
+    bool open( const std::string &path, bool sequential = false );
+
+    /// Unmap the file.
+    void close();
+
+    /// The content of the mapped file, or `nullptr` if not mapped.
+    const unsigned char *data() const;
+
+    /// The size of the mapped file in bytes.
+    size_t size() const;
+
+private:
+    const unsigned char *_data = nullptr;
+    size_t               _size = 0;
+};
+
+} // namespace core
+} // namespace rta
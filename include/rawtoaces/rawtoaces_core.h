@@ -4,6 +4,7 @@
 #pragma once
 
 #include <rawtoaces/spectral_data.h>
+#include <rawtoaces/spectral_database.h>
 
 namespace rta
 {
@@ -73,6 +74,38 @@ public:
     /// in-place place via `solver.training_data.load()`.
     SpectralData training_data;
 
+    /// The pre-built index of the spectral database. If set, the
+    /// `find_camera()`, `find_illuminant()` and `load_spectral_data()` methods
+    /// look up the data in the index instead of scanning the search
+    /// directories.
+    std::shared_ptr<const SpectralDatabase> database;
+
+    /// The method of fitting the IDT matrix in `calculate_IDT_matrix()`.
+    enum class FitMode
+    {
+        /// Fit using the automatic differentiation and the tight tolerances
+        /// the reference matrices have been calculated with.
+        Reference,
+
+        /// Fit using the analytic Jacobian of the cost, with the residual
+        /// count fixed at compile time for the standard 190-patch training
+        /// set, and looser tolerances. The matrices match the reference ones
+        /// within 1e-5 per element, at a fraction of the cost.
+        Fast
+    };
+
+    /// The method of fitting the IDT matrix.
+    FitMode fit_mode = FitMode::Reference;
+
+    /// The IDT matrix to start fitting from, e.g. the matrix solved for a
+    /// similar illuminant. The identity matrix is used if empty.
+    std::vector<std::vector<double>> IDT_start;
+
+    /// The number of the threads Ceres evaluates the cost on when fitting
+    /// the IDT matrix in `calculate_IDT_matrix()`. The fits of
+    /// `solve_illuminants()` run on a single thread each.
+    int thread_count = 1;
+
     /// Initialize SpectralSolver with database search path.
     /// Sets up internal data structures including IDT matrix and white balance multipliers
     /// with neutral values. Initializes verbosity level to 0 for silent operation.
@@ -150,6 +183,47 @@ public:
     /// @pre camera, illuminant, observer, and training_data must be properly loaded
     bool calculate_IDT_matrix();
 
+    /// The white-balance multipliers and the IDT matrix solved for an
+    /// illuminant by `solve_illuminants()`.
+    struct IlluminantSolution
+    {
+        /// The illuminant type, as requested.
+        std::string illuminant;
+
+        /// `true` if the illuminant has been found and the matrix fitted.
+        bool success = false;
+
+        /// The white-balance multipliers, see `get_WB_multipliers()`.
+        std::vector<double> WB_multipliers;
+
+        /// The 3×3 IDT matrix, see `get_IDT_matrix()`.
+        std::vector<std::vector<double>> IDT_matrix;
+    };
+
+    /// Solve the white-balance multipliers and the IDT matrices of the camera
+    /// under each of the given illuminants, e.g. a sweep of colour
+    /// temperatures. This gives the same results as calling
+    /// `find_illuminant()`, `calculate_WB()` and `calculate_IDT_matrix()` for
+    /// every illuminant, but the training patches get weighted by the camera
+    /// and observer curves only once for the whole batch, and the matrices
+    /// get fitted in parallel. The state of the solver is not modified.
+    /// The `camera`, `observer` and `training_data` have to be configured
+    /// prior to this call. `fit_mode` and `IDT_start` apply to every fit.
+    ///
+    /// @param illuminants the illuminant types, as accepted by
+    /// `find_illuminant()`, e.g. `d55`, `3200k`
+    /// @param out_solutions the solutions, one per illuminant, in the order
+    /// of `illuminants`
+    /// @param thread_count the number of the threads to fit the matrices on,
+    /// 0 to use all hardware threads
+    /// @return `true` if all illuminants have been solved successfully,
+    /// `false` otherwise
+    /// @pre camera, observer, and training_data must be properly loaded
+    bool solve_illuminants(
+        const std::vector<std::string>  &illuminants,
+        std::vector<IlluminantSolution> &out_solutions,
+        size_t                           thread_count = 0 ) const;
+
     /// Get the matrix calculated using `calculate_IDT_matrix()`.
     /// This function returns a reference to the 3×3 IDT matrix that transforms camera
     /// RGB values to standardized color space. The matrix is computed by curve fitting
@@ -172,8 +246,7 @@ public:
     int verbosity = 0;
 
 private:
-    std::vector<std::string>  _search_directories;
-    std::vector<SpectralData> _all_illuminants;
+    std::vector<std::string> _search_directories;
 
     std::vector<double>              _wb_multipliers;
     std::vector<std::vector<double>> _idt_matrix;
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 #include <map>
@@ -93,6 +94,30 @@ struct Spectrum
     double max() const;
 };
 
+/// Multiply two spectra per-element and integrate the product, without
+/// allocating the intermediate spectrum. Same as `( lhs * rhs ).integrate()`,
+/// up to the rounding of the summation.
+/// @param lhs the first spectrum.
+/// @param rhs the second spectrum, must have the same shape as `lhs`.
+/// @result the integral of the product.
+double multiply_integrate( const Spectrum &lhs, const Spectrum &rhs );
+
+/// Multiply each of `spectra` by each of the three `weights` spectra
+/// per-element, and integrate the products. All products of a spectrum get
+/// calculated in a single pass over its samples.
+/// @param spectra the spectra to integrate, e.g. the training patches.
+/// @param weights_0 the first weights spectrum, e.g. the R channel.
+/// @param weights_1 the second weights spectrum, e.g. the G channel.
+/// @param weights_2 the third weights spectrum, e.g. the B channel.
+/// @param out_integrals receives the integrals, a row for each of
+///     `spectra`. Passing the same vector again reuses its storage.
+void multiply_integrate(
+    const std::vector<Spectrum>        &spectra,
+    const Spectrum                     &weights_0,
+    const Spectrum                     &weights_1,
+    const Spectrum                     &weights_2,
+    std::vector<std::array<double, 3>> &out_integrals );
+
 /// A data-class for storing spectral data, based on the file format used in
 /// [rawtoaces-data](https://github.com/AcademySoftwareFoundation/rawtoaces-data).
 struct SpectralData
@@ -130,6 +155,15 @@ struct SpectralData
 
     bool load( const std::string &path, bool reshape = true );
 
+    /// Load only the header of a spectral data file, e.g. to list the
+    /// cameras and the illuminants in a database. The file gets parsed as a
+    /// stream, which stops at the end of the `header` object, without
+    /// building the document in memory. The fields stored outside of the
+    /// header, like `units`, and the spectral data are left empty.
+    /// @param path the path to the file.
+    /// @result `true` if loaded successfully.
+    bool load_header( const std::string &path );
+
     /// A convenience operator returning the `Spectrum` of a given channel name
     /// in the "main" data set.
     /// @param name the channel name in the "main" data set to return.
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/spectral_data.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace core
+{
+
+class MappedDatabase;
+
+/// An index of the spectral data files stored in a database, mapping the
+/// camera make and model, and the illuminant type to the parsed
+/// `SpectralData`. The files only get parsed once, and the look-ups are done
+/// without traversing the database directories. Use `SpectralDatabase::get()`
+/// to obtain an instance shared within the process.
+///
+/// If a database directory contains an index file (see `write_index()`), the
+/// headers of the files get read from the index, so only the files actually
+/// used get parsed. The entries of the index file get ignored if the
+/// corresponding data file has been modified since the index was written.
+///
+/// If a database directory contains a compiled database (see
+/// `write_binary()`), the files get memory-mapped from it instead, so neither
+/// the index nor the data files need parsing. The pages of the compiled
+/// database are shared between all processes using it. The compiled entries
+/// get ignored the same way as the index entries if the data file has been
+/// modified.
+class SpectralDatabase
+{
+public:
+    /// The name of the index file in the root of a database directory.
+    static const std::string index_filename;
+
+    /// The name of the compiled database file in the root of a database
+    /// directory.
+    static const std::string binary_filename;
+
+    /// Build the index of the spectral data files in `search_directories`.
+    /// The directories are searched in order, the first file found for a
+    /// given camera or illuminant takes precedence.
+    /// @param search_directories the database search path.
+    SpectralDatabase( const std::vector<std::string> &search_directories );
+
+    /// Get the index of the database in `search_directories` shared within
+    /// the process. The index gets rebuilt if the modification time of any
+    /// of the database directories has changed since the index was built,
+    /// i.e. a data file has been added, removed or renamed. Editing a data
+    /// file in place does not touch the directory, use `is_up_to_date()` to
+    /// check for that explicitly.
+    /// @param search_directories the database search path.
+    /// @param verbosity if greater than 0, the missing database directories
+    ///     get reported.
+    /// @result the shared index.
+    static std::shared_ptr<const SpectralDatabase> get(
+        const std::vector<std::string> &search_directories,
+        int                             verbosity = 0 );
+
+    /// Find a camera by make and model, case-insensitive.
+    /// @param make the camera make.
+    /// @param model the camera model.
+    /// @result the spectral data of the camera, or `nullptr` if not found.
+    std::shared_ptr<const SpectralData>
+    find_camera( const std::string &make, const std::string &model ) const;
+
+    /// Find an illuminant stored in the database by type, case-insensitive.
+    /// The built-in illuminant types are not included.
+    /// @param type the illuminant type.
+    /// @result the spectral data of the illuminant, or `nullptr` if not found.
+    std::shared_ptr<const SpectralData>
+    find_illuminant( const std::string &type ) const;
+
+    /// Get all illuminants stored in the database, in the search order.
+    /// @result the spectral data of the illuminants.
+    std::vector<std::shared_ptr<const SpectralData>> illuminants() const;
+
+    /// Find a data file by its path relative to the database directory,
+    /// e.g. `cmf/cmf_1931.json`. Only the camera, illuminant, cmf and
+    /// training data files are indexed.
+    /// @param relative_path the path relative to the database directory.
+    /// @result the spectral data of the file, or `nullptr` if not found.
+    std::shared_ptr<const SpectralData>
+    find_file( const std::string &relative_path ) const;
+
+    /// Check if the data files have changed since the index was built. This
+    /// stats every data file in the database.
+    /// @result `true` if none of the files has been added, removed or
+    ///     modified.
+    bool is_up_to_date() const;
+
+    /// Write the index file into a database directory, so the future
+    /// instances can skip parsing all files in the directory.
+    /// @param directory the database directory to index.
+    /// @result `true` if written successfully.
+    static bool write_index( const std::string &directory );
+
+    /// Write the compiled database into a database directory. All data
+    /// files in the directory get parsed, reshaped to
+    /// `Spectrum::ReferenceShape` and stored in a binary file, which the
+    /// future instances memory-map instead of parsing the files.
+    /// @param directory the database directory to compile.
+    /// @result `true` if written successfully.
+    static bool write_binary( const std::string &directory );
+
+private:
+    struct Entry
+    {
+        std::string path;
+        std::string data_type;
+        std::string manufacturer;
+        std::string model;
+        std::string type;
+
+        /// The compiled database holding the entry, if any.
+        const MappedDatabase *binary       = nullptr;
+        size_t                binary_index = 0;
+
+        mutable std::shared_ptr<const SpectralData> data;
+    };
+
+    struct FileState
+    {
+        std::string directory;
+        std::string data_type;
+        std::string path;
+        uintmax_t   size = 0;
+        long long   time = 0;
+
+        /// Only compares the path, size and modification time.
+        bool operator==( const FileState &other ) const;
+    };
+
+    static std::vector<FileState>
+    list_files( const std::vector<std::string> &search_directories );
+
+    static std::vector<long long> list_directory_times(
+        const std::vector<std::string> &search_directories );
+
+    std::shared_ptr<const SpectralData> load( const Entry &entry ) const;
+
+    std::vector<std::string>                           _search_directories;
+    std::vector<long long>                             _directory_times;
+    std::vector<FileState>                             _files;
+    std::vector<std::shared_ptr<const MappedDatabase>> _binaries;
+    std::vector<Entry>                                 _entries;
+    std::map<std::string, size_t>                      _cameras;
+    std::map<std::string, size_t>                      _illuminants;
+    std::map<std::string, size_t>                      _paths;
+    mutable std::mutex                                 _mutex;
+};
+
+} // namespace core
+} // namespace rta
@@ -3,13 +3,228 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace rta
 {
 namespace util
 {
 
+/// A thread-safe collector of the execution time of the image processing
+/// stages and of event counts, e.g. cache hits and misses. The stage
+/// durations are kept per file, and aggregated per stage into histograms, so
+/// they can be exported in a machine-readable format at the end of a batch.
+class Metrics
+{
+public:
+    /// The labels distinguishing the counters of the same name, e.g.
+    /// `{ { "cache", "illuminant from WB" } }`.
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    /// The upper bounds of the histogram buckets in milliseconds.
+    static const std::vector<double> bucket_bounds;
+
+    /// A histogram of the durations of a stage.
+    struct Histogram
+    {
+        /// The number of the samples falling into each bucket of
+        /// `bucket_bounds`, not cumulative. The last item counts the samples
+        /// beyond the last bound.
+        std::vector<uint64_t> buckets =
+            std::vector<uint64_t>( bucket_bounds.size() + 1, 0 );
+
+        uint64_t count = 0;
+        double   sum   = 0.0;
+        double   min   = 0.0;
+        double   max   = 0.0;
+
+        /// Add a sample in milliseconds.
+        void add( double value );
+    };
+
+    /// The name of the histogram aggregating the total time of every file,
+    /// i.e. the sum of all stages of the file.
+    static const std::string total_stage;
+
+    /// Record the duration of a stage of processing a file. The durations
+    /// of the same stage of the same file accumulate.
+    /// @param path the path of the file processed.
+    /// @param stage the name of the stage, e.g. `read`.
+    /// @param msec the duration in milliseconds.
+    void
+    add_time( const std::string &path, const std::string &stage, double msec );
+
+    /// Increment a counter.
+    /// @param name the name of the counter, e.g. `cache_hits`.
+    /// @param labels the labels of the counter.
+    /// @param value the value to add.
+    void add_count(
+        const std::string &name, const Labels &labels, uint64_t value );
+
+    /// The histogram of a stage aggregated over all files, including
+    /// `total_stage`.
+    Histogram get_histogram( const std::string &stage ) const;
+
+    /// The duration of every stage of processing a file in milliseconds.
+    std::map<std::string, double> get_times( const std::string &path ) const;
+
+    /// The value of a counter, 0 if never incremented.
+    uint64_t
+    get_count( const std::string &name, const Labels &labels = {} ) const;
+
+    /// Write the metrics in the JSON lines format: one object per file,
+    /// followed by one object per stage histogram and one per counter.
+    void write_json_lines( std::ostream &stream ) const;
+
+    /// Write the metrics in the Prometheus text exposition format.
+    void write_prometheus( std::ostream &stream ) const;
+
+    /// Write the metrics into a file, in the Prometheus text format if the
+    /// file has the `.prom` extension, in the JSON lines format otherwise.
+    /// @result `true` if written successfully.
+    bool save( const std::string &path ) const;
+
+    /// Discard all collected data.
+    void clear();
+
+private:
+    /// The histograms of all stages, including `total_stage`.
+    /// The caller must hold the lock.
+    std::map<std::string, Histogram> aggregate() const;
+
+    mutable std::mutex       _mutex;
+    std::vector<std::string> _files;
+
+    std::map<std::string, std::map<std::string, double>> _times;
+    std::map<std::pair<std::string, Labels>, uint64_t>   _counts;
+};
+
+/// A thread-safe collector of the spans of the image processing stages, e.g.
+/// reading a file or solving its colour transform, written in the Chrome
+/// trace event format, which can be viewed in `chrome://tracing` or in the
+/// Perfetto UI. Unlike `Metrics`, the spans keep the thread and the time
+/// every stage has run at, so the stalls of the concurrent conversions show.
+///
+/// The spans get recorded by `TraceSpan` and `UsageTimer` into the tracer of
+/// the calling thread, set by `Tracer::Scope`.
+class Tracer
+{
+public:
+    /// A stage of processing a file.
+    struct Span
+    {
+        /// The name of the stage, e.g. `read`.
+        std::string name;
+
+        /// The category of the stage, e.g. `cache`.
+        std::string category;
+
+        /// The path of the file processed.
+        std::string file;
+
+        /// The thread the stage has run on, see `thread_id()`.
+        uint64_t thread = 0;
+
+        /// The start of the stage in microseconds since the tracer has been
+        /// created, see `timestamp()`.
+        double start = 0.0;
+
+        /// The duration of the stage in microseconds.
+        double duration = 0.0;
+
+        /// Additional details of the stage, e.g. `{ { "cache", "hit" } }`.
+        Metrics::Labels args;
+    };
+
+    /// Makes `tracer` the tracer of the calling thread until going out of
+    /// scope, when the previous one gets restored.
+    class Scope
+    {
+    public:
+        /// @param tracer the tracer to record the spans into, or `nullptr`
+        ///     to stop recording.
+        /// @param file the path of the file processed, recorded in the spans.
+        Scope( Tracer *tracer, const std::string &file );
+        ~Scope();
+
+        Scope( const Scope & )            = delete;
+        Scope &operator=( const Scope & ) = delete;
+
+    private:
+        Tracer     *_tracer;
+        std::string _file;
+    };
+
+    Tracer();
+
+    /// The tracer of the calling thread, or `nullptr` if not tracing.
+    static Tracer *current();
+
+    /// The path of the file processed by the calling thread, as given to
+    /// the innermost `Scope`.
+    static const std::string &current_file();
+
+    /// A small number identifying the calling thread, assigned in the order
+    /// the threads first ask for it.
+    static uint64_t thread_id();
+
+    /// The time passed since the tracer has been created until `time` in
+    /// microseconds.
+    double timestamp( std::chrono::steady_clock::time_point time ) const;
+
+    /// Record a span.
+    void add( Span span );
+
+    /// All spans recorded, in the order they have ended.
+    std::vector<Span> get_spans() const;
+
+    /// Write the spans as the complete events of the Chrome trace event
+    /// format.
+    void write_json( std::ostream &stream ) const;
+
+    /// Write the spans into a file, see `write_json()`.
+    /// @result `true` if written successfully.
+    bool save( const std::string &path ) const;
+
+    /// Discard all recorded spans.
+    void clear();
+
+private:
+    mutable std::mutex                    _mutex;
+    std::vector<Span>                     _spans;
+    std::chrono::steady_clock::time_point _start_time;
+};
+
+/// Records a span lasting from its creation until going out of scope into
+/// the tracer of the calling thread, see `Tracer::Scope`. Does nothing if
+/// the thread is not tracing.
+class TraceSpan
+{
+public:
+    /// @param name the name of the stage.
+    /// @param category the category of the stage.
+    TraceSpan( const std::string &name, const std::string &category );
+    ~TraceSpan();
+
+    TraceSpan( const TraceSpan & )            = delete;
+    TraceSpan &operator=( const TraceSpan & ) = delete;
+
+    /// Add a detail of the stage to the span.
+    void set_arg( const std::string &key, const std::string &value );
+
+private:
+    Tracer                               *_tracer;
+    Tracer::Span                          _span;
+    std::chrono::steady_clock::time_point _start_time;
+};
+
 /// A helper class for tracking and reporting execution time.
 class UsageTimer
 {
@@ -17,18 +232,39 @@ public:
     /// Set to `true` to enable tracking.
     bool enabled = false;
 
+    /// If set, the durations get recorded into this collector by the
+    /// `print()` overload taking a stage name, whether `enabled` is set or
+    /// not.
+    Metrics *metrics = nullptr;
+
     /// Reset the usage timer.
     void reset();
 
+    /// The time passed since the last invocation of `reset()` in
+    /// milliseconds.
+    double elapsed() const;
+
     /// Print a message for a given path with the addition of the time
     /// passed since the last invocation of `reset()`.
     /// @param path The file math to print.
     /// @param message The message to print.
     void print( const std::string &path, const std::string &message ) const;
 
+    /// Print a message as above, and record the time passed since the last
+    /// invocation of `reset()` into `metrics` under the name of the stage.
+    /// If the calling thread is tracing, also record a span of the stage
+    /// into its tracer, see `Tracer::Scope`.
+    /// @param path The file math to print.
+    /// @param message The message to print.
+    /// @param stage The name of the stage to record the time under.
+    void print(
+        const std::string &path,
+        const std::string &message,
+        const std::string &stage ) const;
+
 private:
-    double _start_time  = 0.0;
-    bool   _initialized = false;
+    std::chrono::steady_clock::time_point _start_time;
+    bool                                  _initialized = false;
 };
 
 } //namespace util
@@ -2,23 +2,77 @@
 // Copyright Contributors to the rawtoaces Project.
 
 #include "py_util.h"
+#include <nanobind/stl/map.h>
 #include <nanobind/stl/string.h>
 #include <nanobind/stl/vector.h>
 #include <nanobind/ndarray.h>
+#include <rawtoaces/batch_converter.h>
 #include <rawtoaces/image_converter.h>
 
+#include <memory>
+#include <stdexcept>
+
 using namespace rta::util;
 
+/// The owner of the pixels wrapped by a NumPy array: the buffer, and the
+/// memory borrowed from the pool if any, released after the buffer.
+struct ArrayOwner
+{
+    std::shared_ptr<void>           memory;
+    std::unique_ptr<OIIO::ImageBuf> buffer;
+};
+
+/// Wrap the pixels of a `buffer` converted by `converter` into a NumPy array
+/// of the shape (height, width, channels) without copying them. The array
+/// takes over the ownership of the buffer, and of its memory if borrowed
+/// from the pool, so the array stays valid whatever the converter does
+/// next. Must be called holding the GIL.
+nanobind::ndarray<nanobind::numpy>
+to_array( ImageConverter &converter, std::unique_ptr<OIIO::ImageBuf> buffer )
+{
+    const OIIO::ImageSpec &spec = buffer->spec();
+
+    const size_t shape[3] = { static_cast<size_t>( spec.height ),
+                              static_cast<size_t>( spec.width ),
+                              static_cast<size_t>( spec.nchannels ) };
+
+    // `ImageConverter::convert_image()` always produces half floats.
+    const nanobind::dlpack::dtype dtype = {
+        static_cast<uint8_t>( nanobind::dlpack::dtype_code::Float ), 16, 1
+    };
+
+    void *data    = buffer->localpixels();
+    auto  owner   = new ArrayOwner;
+    owner->memory = converter.detach_buffer( *buffer );
+    owner->buffer = std::move( buffer );
+
+    nanobind::capsule capsule( owner, []( void *pointer ) noexcept {
+        delete static_cast<ArrayOwner *>( pointer );
+    } );
+
+    return nanobind::ndarray<nanobind::numpy>(
+        data, 3, shape, capsule, nullptr, dtype );
+}
+
 void util_bindings( nanobind::module_ &m )
 {
-    m.def( "collect_image_files", &collect_image_files );
+    m.def(
+        "collect_image_files",
+        &collect_image_files,
+        nanobind::arg( "paths" ),
+        nanobind::arg( "recursive" )    = false,
+        nanobind::arg( "thread_count" ) = 1,
+        nanobind::call_guard<nanobind::gil_scoped_release>() );
 
     nanobind::class_<ImageConverter> image_converter( m, "ImageConverter" );
 
     image_converter.def( nanobind::init<>() );
 
     image_converter.def_rw( "settings", &ImageConverter::settings );
-    image_converter.def( "process_image", &ImageConverter::process_image );
+    image_converter.def(
+        "process_image",
+        &ImageConverter::process_image,
+        nanobind::call_guard<nanobind::gil_scoped_release>() );
     image_converter.def(
         "get_WB_multipliers", &ImageConverter::get_WB_multipliers );
     image_converter.def( "get_IDT_matrix", &ImageConverter::get_IDT_matrix );
@@ -28,7 +82,51 @@ void util_bindings( nanobind::module_ &m )
         []( ImageConverter &converter, const std::string &input_filename ) {
             OIIO::ParamValueList options;
             return converter.configure( input_filename, options );
+        },
+        nanobind::call_guard<nanobind::gil_scoped_release>() );
+    image_converter.def(
+        "convert",
+        []( ImageConverter &converter, const std::string &input_filename ) {
+            auto buffer = std::make_unique<OIIO::ImageBuf>();
+            bool result;
+            {
+                nanobind::gil_scoped_release release;
+
+                // The memory of the previous images not taken over by their
+                // arrays can go back to the pool.
+                converter.release_buffers();
+
+                OIIO::ParamValueList hints;
+                result = converter.configure( input_filename, hints ) &&
+                         converter.load_image(
+                             input_filename, hints, *buffer ) &&
+                         converter.convert_image( input_filename, *buffer );
+            }
+            if ( !result )
+                throw std::runtime_error(
+                    "Failed to convert the file: " + input_filename );
+            return to_array( converter, std::move( buffer ) );
         } );
+    image_converter.def(
+        "convert_memory",
+        []( ImageConverter        &converter,
+            const nanobind::bytes &data,
+            const std::string     &name ) {
+            auto buffer = std::make_unique<OIIO::ImageBuf>();
+            bool result;
+            {
+                // The bytes object stays alive for the duration of the call.
+                nanobind::gil_scoped_release release;
+                result = converter.process_memory(
+                    name, data.c_str(), data.size(), *buffer );
+            }
+            if ( !result )
+                throw std::runtime_error(
+                    "Failed to convert the image: " + name );
+            return to_array( converter, std::move( buffer ) );
+        },
+        nanobind::arg( "data" ),
+        nanobind::arg( "name" ) = "<memory>" );
     image_converter.def(
         "get_supported_formats", &ImageConverter::get_supported_formats );
     image_converter.def(
@@ -46,6 +144,11 @@ void util_bindings( nanobind::module_ &m )
         "matrix_method", &ImageConverter::Settings::matrix_method );
     settings.def_rw( "crop_mode", &ImageConverter::Settings::crop_mode );
     settings.def_rw( "illuminant", &ImageConverter::Settings::illuminant );
+    settings.def_rw( "fast_fit", &ImageConverter::Settings::fast_fit );
+    settings.def_rw(
+        "use_CCT_table", &ImageConverter::Settings::use_CCT_table );
+    settings.def_rw(
+        "CCT_table_directory", &ImageConverter::Settings::CCT_table_directory );
     settings.def_rw( "headroom", &ImageConverter::Settings::headroom );
     settings.def_rw(
         "custom_camera_make", &ImageConverter::Settings::custom_camera_make );
@@ -59,6 +162,7 @@ void util_bindings( nanobind::module_ &m )
     settings.def_rw(
         "saturation_level", &ImageConverter::Settings::saturation_level );
     settings.def_rw( "half_size", &ImageConverter::Settings::half_size );
+    settings.def_rw( "proxy", &ImageConverter::Settings::proxy );
     settings.def_rw(
         "highlight_mode", &ImageConverter::Settings::highlight_mode );
     settings.def_rw( "flip", &ImageConverter::Settings::flip );
@@ -73,7 +177,38 @@ void util_bindings( nanobind::module_ &m )
     settings.def_rw( "overwrite", &ImageConverter::Settings::overwrite );
     settings.def_rw( "create_dirs", &ImageConverter::Settings::create_dirs );
     settings.def_rw( "output_dir", &ImageConverter::Settings::output_dir );
+    settings.def_rw( "recursive", &ImageConverter::Settings::recursive );
+    settings.def_rw(
+        "output_profile", &ImageConverter::Settings::output_profile );
+    settings.def_rw( "compression", &ImageConverter::Settings::compression );
+    settings.def_rw( "tile_size", &ImageConverter::Settings::tile_size );
+    settings.def_rw(
+        "write_threads", &ImageConverter::Settings::write_threads );
+    settings.def_rw( "outputs", &ImageConverter::Settings::outputs );
+    settings.def_rw( "jobs", &ImageConverter::Settings::jobs );
+    settings.def_rw(
+        "continue_on_error", &ImageConverter::Settings::continue_on_error );
+    settings.def_rw(
+        "manifest_file", &ImageConverter::Settings::manifest_file );
+    settings.def_rw( "threads", &ImageConverter::Settings::threads );
+    settings.def_rw( "shard_index", &ImageConverter::Settings::shard_index );
+    settings.def_rw( "shard_count", &ImageConverter::Settings::shard_count );
+    settings.def_rw(
+        "pipeline_depth", &ImageConverter::Settings::pipeline_depth );
+    settings.def_rw(
+        "group_transforms", &ImageConverter::Settings::group_transforms );
+    settings.def_rw( "solve_ahead", &ImageConverter::Settings::solve_ahead );
+    settings.def_rw( "memory_limit", &ImageConverter::Settings::memory_limit );
+    settings.def_rw( "buffer_pool", &ImageConverter::Settings::buffer_pool );
+    settings.def_rw( "huge_pages", &ImageConverter::Settings::huge_pages );
+    settings.def_rw( "use_gpu", &ImageConverter::Settings::use_gpu );
+    settings.def_rw( "io_mode", &ImageConverter::Settings::io_mode );
     settings.def_rw( "use_timing", &ImageConverter::Settings::use_timing );
+    settings.def_rw(
+        "disable_cache", &ImageConverter::Settings::disable_cache );
+    settings.def_rw( "cache_file", &ImageConverter::Settings::cache_file );
+    settings.def_rw( "metrics_file", &ImageConverter::Settings::metrics_file );
+    settings.def_rw( "trace_file", &ImageConverter::Settings::trace_file );
     settings.def_rw( "verbosity", &ImageConverter::Settings::verbosity );
 
     settings.def_prop_rw(
@@ -224,4 +359,83 @@ void util_bindings( nanobind::module_ &m )
         .value( "Soft", ImageConverter::Settings::CropMode::Soft )
         .value( "Hard", ImageConverter::Settings::CropMode::Hard )
         .export_values();
+
+    nanobind::enum_<ImageConverter::Settings::OutputProfile>(
+        settings, "OutputProfile" )
+        .value( "Strict", ImageConverter::Settings::OutputProfile::Strict )
+        .value(
+            "Intermediate",
+            ImageConverter::Settings::OutputProfile::Intermediate )
+        .export_values();
+
+    nanobind::class_<ImageConverter::Settings::Output> output(
+        settings, "Output" );
+
+    output.def( nanobind::init<>() );
+    output.def_rw( "suffix", &ImageConverter::Settings::Output::suffix );
+    output.def_rw( "scale", &ImageConverter::Settings::Output::scale );
+    output.def_rw(
+        "compression", &ImageConverter::Settings::Output::compression );
+    output.def_prop_rw(
+        "region",
+        []( const ImageConverter::Settings::Output &output ) {
+            std::vector<int> result( 4 );
+            for ( size_t i = 0; i < 4; i++ )
+                result[i] = output.region[i];
+            return result;
+        },
+        []( ImageConverter::Settings::Output &output,
+            const std::vector<int> &region ) {
+            if ( region.size() == 4 )
+            {
+                for ( size_t i = 0; i < 4; i++ )
+                    output.region[i] = region[i];
+            }
+            else
+            {
+                throw std::invalid_argument(
+                    "The array must contain 4 elements." );
+            }
+        } );
+
+    nanobind::enum_<ImageConverter::Settings::IOMode>( settings, "IOMode" )
+        .value( "Buffered", ImageConverter::Settings::IOMode::Buffered )
+        .value( "Mapped", ImageConverter::Settings::IOMode::Mapped )
+        .value( "Direct", ImageConverter::Settings::IOMode::Direct )
+        .export_values();
+
+    nanobind::class_<BatchResult> batch_result( m, "BatchResult" );
+
+    batch_result.def_ro( "input_filename", &BatchResult::input_filename );
+    batch_result.def_ro( "success", &BatchResult::success );
+    batch_result.def_ro( "skipped", &BatchResult::skipped );
+    batch_result.def_ro( "up_to_date", &BatchResult::up_to_date );
+    batch_result.def_ro( "output_filename", &BatchResult::output_filename );
+    batch_result.def_ro( "WB_multipliers", &BatchResult::WB_multipliers );
+    batch_result.def_ro( "IDT_matrix", &BatchResult::IDT_matrix );
+    batch_result.def_ro( "CAT_matrix", &BatchResult::CAT_matrix );
+    batch_result.def_ro( "stage_times", &BatchResult::stage_times );
+
+    // The whole batch runs on native threads with the GIL released, see
+    // `BatchConverter`. A `jobs` value of 0 keeps `settings.jobs`.
+    m.def(
+        "convert_batch",
+        []( const std::vector<std::string> &files,
+            const ImageConverter::Settings &settings,
+            int                             jobs ) {
+            BatchConverter batch_converter;
+            batch_converter.settings = settings;
+            batch_converter.metrics  = std::make_shared<Metrics>();
+            if ( jobs > 0 )
+                batch_converter.settings.jobs = jobs;
+
+            {
+                nanobind::gil_scoped_release release;
+                batch_converter.process( files );
+            }
+            return batch_converter.get_results();
+        },
+        nanobind::arg( "files" ),
+        nanobind::arg( "settings" ),
+        nanobind::arg( "jobs" ) = 0 );
 }
@@ -2,7 +2,10 @@
 // Copyright Contributors to the rawtoaces Project.
 
 #include <rawtoaces/image_converter.h>
+#include <rawtoaces/batch_converter.h>
+#include <rawtoaces/conversion_server.h>
 
+#include <csignal>
 #include <set>
 
 int main( int argc, const char *argv[] )
@@ -13,12 +16,73 @@ int main( int argc, const char *argv[] )
     _putenv( (char *)"TZ=UTC" );
 #endif
 
+    auto on_file_started =
+        []( size_t index, size_t total, const rta::util::BatchResult &result ) {
+            std::cout << "[" << index + 1 << "/" << total
+                      << "] Processing file: " << result.input_filename
+                      << std::endl;
+        };
+
+    auto on_file_finished =
+        []( size_t index, size_t total, const rta::util::BatchResult &result ) {
+            if ( !result.success )
+            {
+                std::cerr << "Failed on file [" << index + 1 << "/" << total
+                          << "]: " << result.input_filename << std::endl;
+            }
+        };
+
+    // Submitting a job to a server only needs the socket, so skip setting up
+    // the converter, and pass the rest of the arguments to the server as is.
+    for ( int i = 1; i + 1 < argc; i++ )
+    {
+        if ( std::string( argv[i] ) == "--submit" )
+        {
+            std::vector<std::string> arguments( argv + 1, argv + i );
+            arguments.insert( arguments.end(), argv + i + 2, argv + argc );
+            int status = rta::util::submit_job(
+                argv[i + 1], arguments, on_file_started, on_file_finished );
+            return status == 0 ? 0 : 1;
+        }
+    }
+
     rta::util::ImageConverter converter;
 
     OIIO::ArgParse arg_parser;
     arg_parser.arg( "filename" ).action( OIIO::ArgParse::append() ).hidden();
     converter.init_parser( arg_parser );
 
+    arg_parser.arg( "--serve" )
+        .help(
+            "Keep running, converting the jobs submitted via --submit over "
+            "the local socket at PATH, up to --jobs at a time. The plugins, "
+            "the databases and the caches stay loaded between the jobs." )
+        .metavar( "PATH" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--submit" )
+        .help(
+            "Convert the files on the server listening on the local socket "
+            "at PATH, see --serve. All other options apply to the job." )
+        .metavar( "PATH" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--scan" )
+        .help(
+            "Only read the metadata of the input files, without decoding the "
+            "pixels, and print a table of the camera, the dimensions, the "
+            "as-shot white balance, the DNG calibration illuminants and the "
+            "distinct setup of every file. The files get read on --jobs "
+            "threads, or on all hardware threads by default." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--presolve" )
+        .help(
+            "With --scan, also solve the colour transform of every distinct "
+            "setup, so the later conversions find it in --cache-file or in "
+            "the tables of --cct-table-dir, if given." )
+        .action( OIIO::ArgParse::store_true() );
+
     arg_parser.parse_args( argc, argv );
 
     if ( !converter.parse_parameters( arg_parser ) )
@@ -26,6 +90,20 @@ int main( int argc, const char *argv[] )
         return 1;
     }
 
+    std::string serve_path = arg_parser["serve"].get();
+    if ( !serve_path.empty() )
+    {
+        static rta::util::ConversionServer server;
+        server.max_jobs  = static_cast<size_t>( converter.settings.jobs );
+        server.verbosity = std::max( converter.settings.verbosity, 1 );
+
+        auto stop = []( int ) { server.stop(); };
+        std::signal( SIGINT, stop );
+        std::signal( SIGTERM, stop );
+
+        return server.serve( serve_path ) ? 0 : 1;
+    }
+
     auto files = arg_parser["filename"].as_vec<std::string>();
     if ( files.empty() || ( files.size() == 1 && files[0] == "" ) )
     {
@@ -33,40 +111,73 @@ int main( int argc, const char *argv[] )
         return 1;
     }
 
-    // Gather all the raw images from arg list
+    // Gather all the raw images from arg list, listing the directories on
+    // all hardware threads.
     std::vector<std::vector<std::string>> batches =
-        rta::util::collect_image_files( files ); // LCOV_EXCL_LINE
-
-    // Process raw files
-    bool empty  = true;
-    bool result = true;
-
-    size_t file_index  = 0;
-    size_t total_files = 0;
+        rta::util::collect_image_files(
+            files, converter.settings.recursive, 0 ); // LCOV_EXCL_LINE
 
+    std::vector<std::string> input_files;
     for ( auto const &batch: batches )
-        total_files += batch.size();
+        input_files.insert( input_files.end(), batch.begin(), batch.end() );
 
-    for ( auto const &batch: batches )
+    if ( arg_parser["scan"].get<int>() )
     {
-        for ( auto const &input_filename: batch )
-        {
-            ++file_index;
-            std::cout << "[" << file_index << "/" << total_files
-                      << "] Processing file: " << input_filename << std::endl;
+        bool presolve = arg_parser["presolve"].get<int>();
+        auto results  = rta::util::scan_metadata(
+            input_files, converter.settings, presolve );
+        rta::util::write_scan_table( std::cout, results, presolve );
 
-            empty  = false;
-            result = converter.process_image( input_filename );
-            if ( !result )
+        bool result = true;
+        for ( auto const &scan_result: results )
+        {
+            if ( !scan_result.success )
             {
-                std::cerr << "Failed on file [" << file_index << "/"
-                          << total_files << "]: " << input_filename
-                          << std::endl;
-                break;
+                std::cerr << "Failed to read the metadata of the file: "
+                          << scan_result.input_filename << std::endl;
+                result = false;
             }
+            else if ( presolve && !scan_result.solved )
+            {
+                result = false;
+            }
+        }
+        return result ? 0 : 1;
+    }
+
+    // Process raw files
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings = converter.settings;
+
+    batch_converter.on_file_started  = on_file_started;
+    batch_converter.on_file_finished = on_file_finished;
+
+    bool empty  = input_files.empty();
+    bool result = batch_converter.process( input_files );
+
+    size_t up_to_date = 0;
+    for ( auto const &file_result: batch_converter.get_results() )
+    {
+        if ( file_result.up_to_date )
+            ++up_to_date;
+    }
+    if ( up_to_date > 0 )
+    {
+        std::cout << "Skipped " << up_to_date << " of "
+                  << batch_converter.get_results().size()
+                  << " files, as they are up to date." << std::endl;
+    }
+
+    if ( !result && converter.settings.continue_on_error )
+    {
+        size_t failed = 0;
+        for ( auto const &file_result: batch_converter.get_results() )
+        {
+            if ( !file_result.success )
+                ++failed;
         }
-        if ( !result )
-            break;
+        std::cerr << failed << " of " << batch_converter.get_results().size()
+                  << " files failed to convert." << std::endl;
     }
 
     if ( empty )
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <string>
+
+#ifdef WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#    include <psapi.h>
+#else
+#    include <sys/resource.h>
+#endif
+
+namespace rta
+{
+namespace bench
+{
+
+Result summarise( const std::string &name, std::vector<double> samples )
+{
+    Result result;
+    result.name       = name;
+    result.iterations = samples.size();
+
+    if ( samples.empty() )
+        return result;
+
+    std::sort( samples.begin(), samples.end() );
+
+    const size_t count = samples.size();
+    result.min         = samples.front();
+    result.max         = samples.back();
+    result.mean =
+        std::accumulate( samples.begin(), samples.end(), 0.0 ) / count;
+
+    if ( count % 2 )
+        result.median = samples[count / 2];
+    else
+        result.median = 0.5 * ( samples[count / 2 - 1] + samples[count / 2] );
+
+    double variance = 0.0;
+    for ( double sample: samples )
+        variance += ( sample - result.mean ) * ( sample - result.mean );
+    if ( count > 1 )
+        variance /= count - 1;
+    result.stddev = std::sqrt( variance );
+
+    return result;
+}
+
+size_t peak_rss()
+{
+#ifdef __linux__
+    // Unlike `ru_maxrss`, the high-water mark in the status file gets reset
+    // by `reset_peak_rss()`.
+    std::ifstream status( "/proc/self/status" );
+    std::string   line;
+    while ( std::getline( status, line ) )
+    {
+        if ( line.compare( 0, 6, "VmHWM:" ) == 0 )
+        {
+            // Reported in kilobytes.
+            return std::stoull( line.substr( 6 ) ) * 1024;
+        }
+    }
+#endif
+
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if ( !GetProcessMemoryInfo(
+             GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return 0;
+#    ifdef __APPLE__
+    return static_cast<size_t>( usage.ru_maxrss );
+#    else
+    // Reported in kilobytes everywhere but on macOS.
+    return static_cast<size_t>( usage.ru_maxrss ) * 1024;
+#    endif
+#endif
+}
+
+bool reset_peak_rss()
+{
+#ifdef __linux__
+    std::ofstream clear_refs( "/proc/self/clear_refs" );
+    clear_refs << "5";
+    clear_refs.flush();
+    return static_cast<bool>( clear_refs );
+#else
+    return false;
+#endif
+}
+
+std::vector<Regression> find_regressions(
+    const nlohmann::json &results,
+    const nlohmann::json &baseline,
+    double                threshold )
+{
+    std::vector<Regression> regressions;
+    if ( !results.contains( "benchmarks" ) ||
+         !baseline.contains( "benchmarks" ) )
+    {
+        return regressions;
+    }
+
+    for ( const auto &result: results["benchmarks"] )
+    {
+        const auto &name = result.value( "name", "" );
+        for ( const auto &base: baseline["benchmarks"] )
+        {
+            if ( base.value( "name", "" ) != name )
+                continue;
+
+            for ( const char *metric: { "median", "peak_rss" } )
+            {
+                const double expected = base.value( metric, 0.0 );
+                const double value    = result.value( metric, 0.0 );
+                if ( expected > 0.0 && value > expected * ( 1.0 + threshold ) )
+                    regressions.push_back( { name, metric, expected, value } );
+            }
+            break;
+        }
+    }
+
+    return regressions;
+}
+
+void Benchmark::add(
+    const std::string &name, const Function &function, const Function &setup )
+{
+    _entries.push_back( { name, function, setup } );
+}
+
+const std::vector<Result> &Benchmark::run( std::ostream &log )
+{
+    using clock = std::chrono::steady_clock;
+
+    _results.clear();
+
+    for ( const auto &entry: _entries )
+    {
+        if ( !filter.empty() && entry.name.find( filter ) == std::string::npos )
+            continue;
+
+        log << "Running " << entry.name << "..." << std::endl;
+
+        // Without the reset, the peak of the process would only carry over
+        // the largest of the earlier benchmarks.
+        const bool measure_rss = reset_peak_rss();
+
+        for ( size_t i = 0; i < warmup; i++ )
+        {
+            if ( entry.setup )
+                entry.setup();
+            entry.function();
+        }
+
+        std::vector<double> samples;
+        samples.reserve( iterations );
+        for ( size_t i = 0; i < iterations; i++ )
+        {
+            if ( entry.setup )
+                entry.setup();
+
+            auto start = clock::now();
+            entry.function();
+            auto end = clock::now();
+
+            samples.push_back(
+                std::chrono::duration<double>( end - start ).count() );
+        }
+
+        _results.push_back( summarise( entry.name, samples ) );
+        _results.back().peak_rss = measure_rss ? peak_rss() : 0;
+    }
+
+    return _results;
+}
+
+void Benchmark::print( std::ostream &stream ) const
+{
+    size_t width = 9;
+    for ( const auto &result: _results )
+        width = std::max( width, result.name.size() );
+
+    char line[256];
+    snprintf(
+        line,
+        sizeof( line ),
+        "%-*s %12s %12s %12s %12s %12s",
+        static_cast<int>( width ),
+        "benchmark",
+        "min, ms",
+        "median, ms",
+        "mean, ms",
+        "max, ms",
+        "stddev, ms" );
+    stream << line << std::endl;
+
+    for ( const auto &result: _results )
+    {
+        snprintf(
+            line,
+            sizeof( line ),
+            "%-*s %12.4f %12.4f %12.4f %12.4f %12.4f",
+            static_cast<int>( width ),
+            result.name.c_str(),
+            result.min * 1e3,
+            result.median * 1e3,
+            result.mean * 1e3,
+            result.max * 1e3,
+            result.stddev * 1e3 );
+        stream << line << std::endl;
+    }
+}
+
+nlohmann::json Benchmark::to_json() const
+{
+    nlohmann::json benchmarks = nlohmann::json::array();
+    for ( const auto &result: _results )
+    {
+        nlohmann::json item;
+        item["name"]       = result.name;
+        item["iterations"] = result.iterations;
+        item["min"]        = result.min;
+        item["max"]        = result.max;
+        item["mean"]       = result.mean;
+        item["median"]     = result.median;
+        item["stddev"]     = result.stddev;
+        item["peak_rss"]   = result.peak_rss;
+        benchmarks.push_back( item );
+    }
+
+    nlohmann::json json;
+    json["unit"]        = "seconds";
+    json["memory_unit"] = "bytes";
+    json["warmup"]      = warmup;
+    json["benchmarks"]  = benchmarks;
+    return json;
+}
+
+} // namespace bench
+} // namespace rta
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace bench
+{
+
+/// The timing statistics of a benchmark, in seconds per iteration.
+struct Result
+{
+    std::string name;
+    size_t      iterations = 0;
+    double      min        = 0.0;
+    double      max        = 0.0;
+    double      mean       = 0.0;
+    double      median     = 0.0;
+    double      stddev     = 0.0;
+
+    /// The peak resident set size of the process while running the
+    /// benchmark in bytes, 0 where the peak can not be reset between the
+    /// benchmarks, see `reset_peak_rss()`.
+    size_t peak_rss = 0;
+};
+
+/// A benchmark slower, or using more memory, than its baseline by more than
+/// the threshold, see `find_regressions()`.
+struct Regression
+{
+    std::string name;
+    /// The regressed statistic, `median` or `peak_rss`.
+    std::string metric;
+    double      baseline = 0.0;
+    double      value    = 0.0;
+};
+
+/// Calculate the statistics of the timing `samples` of a benchmark.
+/// @param name the name of the benchmark.
+/// @param samples the duration of every iteration in seconds.
+/// @result the statistics.
+Result summarise( const std::string &name, std::vector<double> samples );
+
+/// The peak resident set size of the process so far, or since the last
+/// `reset_peak_rss()`.
+/// @result the size in bytes, or 0 if not available on this platform.
+size_t peak_rss();
+
+/// Reset the peak resident set size of the process to the current one, so
+/// that `peak_rss()` measures the following code only. Only supported on
+/// Linux, via `/proc/self/clear_refs`.
+/// @result `true` if successful.
+bool reset_peak_rss();
+
+/// Compare the results of a run against a baseline, both in the format of
+/// `Benchmark::to_json()`. The benchmarks missing from either are ignored, so
+/// are the statistics of 0 in the baseline.
+/// @param results the results of the run.
+/// @param baseline the results of the baseline run.
+/// @param threshold the relative increase of the median time or the peak
+///     resident set size of a benchmark over its baseline counted as a
+///     regression, e.g. 0.25 for 25%.
+/// @result the regressions found.
+std::vector<Regression> find_regressions(
+    const nlohmann::json &results,
+    const nlohmann::json &baseline,
+    double                threshold );
+
+/// A minimal micro-benchmark runner. Every benchmark gets run for a number of
+/// untimed warm-up iterations, followed by the timed iterations, each timed
+/// separately, so the spread of the samples can be reported along with the
+/// average.
+class Benchmark
+{
+public:
+    using Function = std::function<void()>;
+
+    /// The number of timed iterations of every benchmark.
+    size_t iterations = 20;
+
+    /// The number of untimed iterations run before the timed ones.
+    size_t warmup = 2;
+
+    /// If not empty, only the benchmarks having this string in their names
+    /// get run.
+    std::string filter;
+
+    /// Register a benchmark.
+    /// @param name the unique name of the benchmark.
+    /// @param function the code to time.
+    /// @param setup if given, invoked before every iteration without being
+    ///     timed, e.g. to reset the state modified by `function`.
+    void
+    add( const std::string &name,
+         const Function    &function,
+         const Function    &setup = nullptr );
+
+    /// Run the registered benchmarks matching `filter` in the order of
+    /// registration.
+    /// @param log the stream to print the progress to.
+    /// @result the results of the benchmarks run.
+    const std::vector<Result> &run( std::ostream &log );
+
+    /// Print the results of the last `run` as a table.
+    void print( std::ostream &stream ) const;
+
+    /// The results of the last `run` in the JSON format.
+    nlohmann::json to_json() const;
+
+private:
+    struct Entry
+    {
+        std::string name;
+        Function    function;
+        Function    setup;
+    };
+
+    std::vector<Entry>  _entries;
+    std::vector<Result> _results;
+};
+
+} // namespace bench
+} // namespace rta
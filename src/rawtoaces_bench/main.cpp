@@ -0,0 +1,441 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "benchmark.h"
+
+#include <rawtoaces/image_converter.h>
+#include <rawtoaces/rawtoaces_core.h>
+
+#include <OpenImageIO/argparse.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+using rta::bench::Benchmark;
+using rta::util::ImageConverter;
+
+/// The image resolutions the image processing stages get benchmarked at.
+const std::vector<std::pair<int, int>> image_sizes = { { 1920, 1080 },
+                                                       { 4000, 3000 },
+                                                       { 6000, 4000 } };
+
+/// The white balance weights matching the Nikon D200 camera in daylight.
+const std::vector<double> white_balance = { 1.79488, 1, 1.39779 };
+
+/// The DNG metadata of a Blackmagic Cinema Camera, the same as in the DNG
+/// solver tests.
+rta::core::Metadata make_metadata()
+{
+    rta::core::Metadata metadata;
+    metadata.baseline_exposure = 2.4;
+    metadata.neutral_RGB       = { 0.6289999865031245, 1, 0.79040003045288199 };
+
+    metadata.calibration[0].illuminant        = 17;
+    metadata.calibration[1].illuminant        = 21;
+    metadata.calibration[0].XYZ_to_RGB_matrix = {
+        1.3119699954986572,   -0.49678999185562134, 0.011559999547898769,
+        -0.41723001003265381, 1.4423700571060181,   0.045279998332262039,
+        0.067230001091957092, 0.21709999442100525,  0.72650998830795288
+    };
+    metadata.calibration[1].XYZ_to_RGB_matrix = {
+        1.0088499784469604,    -0.27351000905036926, -0.082580000162124634,
+        -0.48996999859809875,  1.3444099426269531,   0.11174000054597855,
+        -0.064060002565383911, 0.32997000217437744,  0.5391700267791748
+    };
+    return metadata;
+}
+
+/// Register the benchmarks of the spectral solver, using the database in
+/// `data_dir`.
+/// @result `false` if the database does not have the data needed.
+bool add_spectral_benchmarks(
+    Benchmark &benchmark, const std::string &data_dir )
+{
+    const std::string training_path =
+        data_dir + "/training/training_spectral.json";
+    const std::string observer_path = data_dir + "/cmf/cmf_1931.json";
+
+    if ( !std::filesystem::exists( training_path ) ||
+         !std::filesystem::exists( observer_path ) )
+    {
+        std::cerr << "WARNING: No spectral data found in '" << data_dir
+                  << "', skipping the spectral solver benchmarks. "
+                  << "Use --data-dir to specify the database location."
+                  << std::endl;
+        return false;
+    }
+
+    benchmark.add( "SpectralData::load(training)", [training_path]() {
+        rta::core::SpectralData data;
+        data.load( training_path );
+    } );
+
+    benchmark.add( "SpectralData::load(observer)", [observer_path]() {
+        rta::core::SpectralData data;
+        data.load( observer_path );
+    } );
+
+    auto solver = std::make_shared<rta::core::SpectralSolver>(
+        std::vector<std::string>{ data_dir } );
+    solver->database = rta::core::SpectralDatabase::get( { data_dir } );
+    if ( !solver->find_camera( "nikon", "d200" ) ||
+         !solver->load_spectral_data( observer_path, solver->observer ) ||
+         !solver->load_spectral_data( training_path, solver->training_data ) )
+    {
+        std::cerr << "WARNING: Failed to configure the spectral solver, "
+                  << "skipping the spectral solver benchmarks." << std::endl;
+        return false;
+    }
+
+    benchmark.add( "SpectralSolver::find_illuminant(wb)", [solver]() {
+        solver->find_illuminant( white_balance );
+    } );
+
+    benchmark.add(
+        "SpectralSolver::calculate_IDT_matrix",
+        [solver]() { solver->calculate_IDT_matrix(); },
+        [solver]() { solver->find_illuminant( white_balance ); } );
+
+    return true;
+}
+
+/// Register the benchmarks of the metadata solver.
+void add_metadata_benchmarks( Benchmark &benchmark )
+{
+    auto metadata = std::make_shared<rta::core::Metadata>( make_metadata() );
+
+    benchmark.add( "MetadataSolver::calculate_IDT_matrix", [metadata]() {
+        rta::core::MetadataSolver solver( *metadata );
+        solver.calculate_IDT_matrix();
+    } );
+}
+
+/// Register the benchmarks of the image processing stages for an image of
+/// `width` by `height` pixels.
+/// @result `false` if the converter failed to configure.
+bool add_image_benchmarks(
+    Benchmark         &benchmark,
+    int                width,
+    int                height,
+    const std::string &output_dir )
+{
+    const std::string size =
+        std::to_string( width ) + "x" + std::to_string( height );
+
+    // Crop the borders, like the default crop of the raw files does.
+    OIIO::ImageSpec spec( width, height, 3, OIIO::TypeDesc::FLOAT );
+    spec.full_x             = width / 50;
+    spec.full_y             = height / 50;
+    spec.full_width         = width - 2 * spec.full_x;
+    spec.full_height        = height - 2 * spec.full_y;
+    spec["raw:dng:version"] = 0;
+
+    auto converter = std::make_shared<ImageConverter>();
+    converter->settings.WB_method = ImageConverter::Settings::WBMethod::Custom;
+    converter->settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Custom;
+    converter->settings.crop_mode = ImageConverter::Settings::CropMode::Hard;
+
+    OIIO::ParamValueList options;
+    if ( !converter->configure( spec, options ) )
+    {
+        std::cerr << "ERROR: Failed to configure the converter." << std::endl;
+        return false;
+    }
+
+    auto src = std::make_shared<OIIO::ImageBuf>( spec );
+    auto dst = std::make_shared<OIIO::ImageBuf>( spec );
+    OIIO::ImageBufAlgo::noise( *src, "uniform", 0.0f, 1.0f );
+
+    OIIO::ImageSpec half_spec = spec;
+    half_spec.set_format( OIIO::TypeDesc::HALF );
+    auto half = std::make_shared<OIIO::ImageBuf>( half_spec );
+
+    benchmark.add( "ImageConverter::apply_matrix(" + size + ")", [=]() {
+        converter->apply_matrix( *dst, *src );
+    } );
+
+    benchmark.add( "ImageConverter::apply_scale(" + size + ")", [=]() {
+        converter->apply_scale( *dst, *src );
+    } );
+
+    benchmark.add( "ImageConverter::apply_transform(" + size + ")", [=]() {
+        converter->apply_transform( *half, *src );
+    } );
+
+    benchmark.add(
+        "ImageConverter::apply_transform(float, " + size + ")",
+        [=]() { converter->apply_transform( *dst, *src ); } );
+
+    benchmark.add( "ImageConverter::apply_crop(" + size + ")", [=]() {
+        OIIO::ImageBuf cropped;
+        converter->apply_crop( cropped, *src );
+    } );
+
+    const std::string path = output_dir + "/rawtoaces_bench_" + size + ".exr";
+
+    benchmark.add(
+        "ImageConverter::save_image(strict, " + size + ")",
+        [=]() { converter->save_image( path, *half ); },
+        [=]() {
+            converter->settings.output_profile =
+                ImageConverter::Settings::OutputProfile::Strict;
+        } );
+
+    benchmark.add(
+        "ImageConverter::save_image(zip, " + size + ")",
+        [=]() { converter->save_image( path, *half ); },
+        [=]() {
+            converter->settings.output_profile =
+                ImageConverter::Settings::OutputProfile::Intermediate;
+            converter->settings.compression = "zip";
+        } );
+
+    return true;
+}
+
+/// Register the benchmarks converting every image in `images_dir` end to
+/// end, from the raw file to the output file, using the database in
+/// `data_dir`. The colour transforms get solved on the warm-up iterations,
+/// so the timed iterations measure the cached conversions of a batch.
+/// @param converters receives the converters of the benchmarks, to remove
+///     their output files after the run.
+/// @result `false` if the directory could not be listed.
+bool add_file_benchmarks(
+    Benchmark                                    &benchmark,
+    const std::string                            &images_dir,
+    const std::string                            &data_dir,
+    const std::string                            &output_dir,
+    std::vector<std::shared_ptr<ImageConverter>> &converters )
+{
+    std::vector<std::string> files;
+    std::error_code          ec;
+    for ( const auto &entry:
+          std::filesystem::directory_iterator( images_dir, ec ) )
+    {
+        if ( entry.is_regular_file() )
+            files.push_back( entry.path().string() );
+    }
+    if ( ec )
+    {
+        std::cerr << "ERROR: Failed to list the images in '" << images_dir
+                  << "': " << ec.message() << std::endl;
+        return false;
+    }
+    std::sort( files.begin(), files.end() );
+
+    for ( const auto &file: files )
+    {
+        auto converter = std::make_shared<ImageConverter>();
+        converter->settings.WB_method =
+            ImageConverter::Settings::WBMethod::Metadata;
+        converter->settings.matrix_method =
+            ImageConverter::Settings::MatrixMethod::Auto;
+        converter->settings.database_directories = { data_dir };
+        converter->settings.output_dir           = output_dir;
+        converter->settings.overwrite            = true;
+        converters.push_back( converter );
+
+        const std::string name =
+            std::filesystem::path( file ).filename().string();
+        benchmark.add(
+            "ImageConverter::process_image(" + name + ")",
+            [converter, file]() { converter->process_image( file ); } );
+    }
+
+    return true;
+}
+
+int main( int argc, const char *argv[] )
+{
+    Benchmark benchmark;
+
+    OIIO::ArgParse arg_parser;
+    arg_parser.intro(
+        "rawtoaces_bench -- micro-benchmarks of the rawtoaces hot paths" );
+    arg_parser.usage( "rawtoaces_bench [options]" );
+
+    arg_parser.arg( "--iterations" )
+        .help( "The number of timed iterations of every benchmark." )
+        .metavar( "VAL" )
+        .defaultval( 20 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--warmup" )
+        .help( "The number of untimed iterations before the timed ones." )
+        .metavar( "VAL" )
+        .defaultval( 2 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--filter" )
+        .help( "Only run the benchmarks having this string in their names." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--json" )
+        .help( "Write the results into this file in the JSON format." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--data-dir" )
+        .help( "Directory containing the rawtoaces database." )
+        .metavar( "STR" )
+        .defaultval( RTA_BENCH_DATA_PATH )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--output-dir" )
+        .help(
+            "The directory to write the image files to. Defaults to the "
+            "temporary directory." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--images-dir" )
+        .help(
+            "A directory of raw images to benchmark converting end to end, "
+            "in addition to the synthetic frames." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--baseline" )
+        .help(
+            "Compare the results against this file saved by --json on an "
+            "earlier run, failing if any benchmark got slower, or the "
+            "process used more memory, by more than --threshold. The "
+            "comparison gets skipped if the file does not exist, exiting "
+            "with the code 77." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--threshold" )
+        .help(
+            "The relative increase of the median time or the peak memory "
+            "usage of a benchmark over the --baseline failing the run." )
+        .metavar( "VAL" )
+        .defaultval( 0.25f )
+        .action( OIIO::ArgParse::store<float>() );
+
+    if ( arg_parser.parse_args( argc, argv ) < 0 )
+        return 1;
+
+    const int iterations = arg_parser["iterations"].get<int>();
+    const int warmup     = arg_parser["warmup"].get<int>();
+    if ( iterations < 1 || warmup < 0 )
+    {
+        std::cerr << "The number of iterations must be positive, and the "
+                  << "number of warm-up iterations must not be negative."
+                  << std::endl;
+        return 1;
+    }
+
+    benchmark.iterations = static_cast<size_t>( iterations );
+    benchmark.warmup     = static_cast<size_t>( warmup );
+    benchmark.filter     = arg_parser["filter"].get();
+
+    std::string output_dir = arg_parser["output-dir"].get();
+    if ( output_dir.empty() )
+        output_dir = std::filesystem::temp_directory_path().string();
+
+    add_spectral_benchmarks( benchmark, arg_parser["data-dir"].get() );
+    add_metadata_benchmarks( benchmark );
+    for ( const auto &[width, height]: image_sizes )
+    {
+        if ( !add_image_benchmarks( benchmark, width, height, output_dir ) )
+            return 1;
+    }
+
+    std::vector<std::shared_ptr<ImageConverter>> file_converters;
+
+    const std::string images_dir = arg_parser["images-dir"].get();
+    if ( !images_dir.empty() && !add_file_benchmarks(
+                                    benchmark,
+                                    images_dir,
+                                    arg_parser["data-dir"].get(),
+                                    output_dir,
+                                    file_converters ) )
+    {
+        return 1;
+    }
+
+    benchmark.run( std::cerr );
+    benchmark.print( std::cout );
+
+    nlohmann::json json       = benchmark.to_json();
+    json["rawtoaces_version"] = RAWTOACES_VERSION;
+
+    const std::string json_path = arg_parser["json"].get();
+    if ( !json_path.empty() )
+    {
+        std::ofstream file( json_path );
+        file << json.dump( 4 ) << std::endl;
+        if ( !file )
+        {
+            std::cerr << "ERROR: Failed to write the results into "
+                      << json_path << "." << std::endl;
+            return 1;
+        }
+    }
+
+    for ( const auto &[width, height]: image_sizes )
+    {
+        std::error_code ec;
+        std::filesystem::remove(
+            output_dir + "/rawtoaces_bench_" + std::to_string( width ) + "x" +
+                std::to_string( height ) + ".exr",
+            ec );
+    }
+    for ( const auto &converter: file_converters )
+    {
+        std::error_code ec;
+        if ( !converter->get_output_filename().empty() )
+            std::filesystem::remove( converter->get_output_filename(), ec );
+    }
+
+    const std::string baseline_path = arg_parser["baseline"].get();
+    if ( !baseline_path.empty() )
+    {
+        std::ifstream file( baseline_path );
+        if ( !file )
+        {
+            std::cerr << "WARNING: No baseline found at " << baseline_path
+                      << ", skipping the comparison. Save the results of a "
+                      << "reference run there via --json to create it."
+                      << std::endl;
+            // Reported as skipped by ctest, see `SKIP_RETURN_CODE`.
+            return 77;
+        }
+
+        nlohmann::json baseline =
+            nlohmann::json::parse( file, nullptr, false );
+        if ( baseline.is_discarded() )
+        {
+            std::cerr << "ERROR: Failed to parse the baseline "
+                      << baseline_path << "." << std::endl;
+            return 1;
+        }
+
+        const float threshold   = arg_parser["threshold"].get<float>();
+        const auto  regressions = rta::bench::find_regressions(
+            json, baseline, static_cast<double>( threshold ) );
+        for ( const auto &regression: regressions )
+        {
+            std::cerr << "REGRESSION: " << regression.name << ": "
+                      << regression.metric << " " << regression.value
+                      << " exceeds the baseline " << regression.baseline
+                      << " by more than " << threshold * 100.0f << "%."
+                      << std::endl;
+        }
+        if ( !regressions.empty() )
+            return 1;
+
+        std::cerr << "No regressions against " << baseline_path << "."
+                  << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include <rawtoaces/cct_matrix_table.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+namespace rta
+{
+namespace core
+{
+
+/// The version of the table file format, see `CCTMatrixTable::save()`.
+static const int table_file_version = 1;
+
+/// The position of a white balance in the plane of the red and blue
+/// chromaticities as seen by the camera, independent of the normalisation
+/// of the multipliers.
+static std::pair<double, double>
+WB_chromaticity( const std::vector<double> &WB_multipliers )
+{
+    return { std::log( WB_multipliers[0] / WB_multipliers[1] ),
+             std::log( WB_multipliers[2] / WB_multipliers[1] ) };
+}
+
+std::string CCTMatrixTable::illuminant_type( int CCT )
+{
+    if ( CCT < 4000 )
+        return std::to_string( CCT ) + "k";
+    return "d" + std::to_string( CCT );
+}
+
+bool CCTMatrixTable::build(
+    const SpectralSolver &solver,
+    const std::string    &make,
+    const std::string    &model,
+    int                   min_CCT,
+    int                   max_CCT,
+    int                   step,
+    size_t                thread_count )
+{
+    entries.clear();
+    camera_make  = make;
+    camera_model = model;
+
+    if ( min_CCT < 1500 || max_CCT > 25000 || min_CCT > max_CCT || step <= 0 )
+    {
+        std::cerr << "ERROR: The colour temperature range of the table must "
+                  << "be within 1500K to 25000K, with a positive step."
+                  << std::endl;
+        return false;
+    }
+
+    std::vector<int>         CCTs;
+    std::vector<std::string> illuminants;
+    for ( int CCT = min_CCT; CCT <= max_CCT; CCT += step )
+    {
+        CCTs.push_back( CCT );
+        illuminants.push_back( illuminant_type( CCT ) );
+    }
+
+    std::vector<SpectralSolver::IlluminantSolution> solutions;
+    if ( !solver.solve_illuminants( illuminants, solutions, thread_count ) )
+    {
+        std::cerr << "ERROR: Failed to build the colour temperature table "
+                  << "for camera make: '" << make << "', model: '" << model
+                  << "'." << std::endl;
+        return false;
+    }
+
+    entries.resize( solutions.size() );
+    for ( size_t i = 0; i < solutions.size(); i++ )
+    {
+        entries[i].CCT            = CCTs[i];
+        entries[i].WB_multipliers = solutions[i].WB_multipliers;
+        entries[i].IDT_matrix     = solutions[i].IDT_matrix;
+    }
+    return true;
+}
+
+bool CCTMatrixTable::interpolate(
+    const std::vector<double>        &WB_multipliers,
+    std::vector<std::vector<double>> &out_IDT_matrix,
+    double                           *out_CCT ) const
+{
+    if ( entries.empty() || WB_multipliers.size() < 3 ||
+         WB_multipliers[0] <= 0.0 || WB_multipliers[1] <= 0.0 ||
+         WB_multipliers[2] <= 0.0 )
+    {
+        return false;
+    }
+
+    const auto point = WB_chromaticity( WB_multipliers );
+
+    // Find the closest point on the polyline through the entries.
+    size_t best_index    = 0;
+    double best_t        = 0.0;
+    double best_distance = -1.0;
+
+    auto previous = WB_chromaticity( entries[0].WB_multipliers );
+    for ( size_t i = 0; i + 1 < entries.size(); i++ )
+    {
+        const auto next = WB_chromaticity( entries[i + 1].WB_multipliers );
+
+        const double dx     = next.first - previous.first;
+        const double dy     = next.second - previous.second;
+        const double length = dx * dx + dy * dy;
+
+        double t = 0.0;
+        if ( length > 0.0 )
+        {
+            t = ( ( point.first - previous.first ) * dx +
+                  ( point.second - previous.second ) * dy ) /
+                length;
+            t = std::clamp( t, 0.0, 1.0 );
+        }
+
+        const double ex       = previous.first + t * dx - point.first;
+        const double ey       = previous.second + t * dy - point.second;
+        const double distance = ex * ex + ey * ey;
+        if ( best_distance < 0.0 || distance < best_distance )
+        {
+            best_index    = i;
+            best_t        = t;
+            best_distance = distance;
+        }
+
+        previous = next;
+    }
+
+    const size_t next_index = std::min( best_index + 1, entries.size() - 1 );
+    const Entry &first      = entries[best_index];
+    const Entry &second     = entries[next_index];
+
+    out_IDT_matrix.assign( 3, std::vector<double>( 3 ) );
+    for ( size_t row = 0; row < 3; row++ )
+        for ( size_t col = 0; col < 3; col++ )
+            out_IDT_matrix[row][col] =
+                ( 1.0 - best_t ) * first.IDT_matrix[row][col] +
+                best_t * second.IDT_matrix[row][col];
+
+    if ( out_CCT )
+    {
+        // Interpolate in mireds, as the entries are closer to uniformly
+        // spaced in mireds than in Kelvin along the locus.
+        const double mired =
+            ( 1.0 - best_t ) * 1e6 / first.CCT + best_t * 1e6 / second.CCT;
+        *out_CCT = 1e6 / mired;
+    }
+
+    return true;
+}
+
+bool CCTMatrixTable::load( const std::string &path )
+{
+    std::ifstream file( path );
+    if ( !file.is_open() )
+    {
+        std::cerr << "ERROR: Failed to open the colour temperature table "
+                  << path << "." << std::endl;
+        return false;
+    }
+
+    CCTMatrixTable table;
+    try
+    {
+        nlohmann::json json = nlohmann::json::parse( file );
+        if ( json.at( "version" ).get<int>() != table_file_version )
+        {
+            std::cerr << "ERROR: Unsupported version of the colour "
+                      << "temperature table " << path << "." << std::endl;
+            return false;
+        }
+
+        table.camera_make  = json.at( "camera_make" ).get<std::string>();
+        table.camera_model = json.at( "camera_model" ).get<std::string>();
+        for ( const auto &item: json.at( "entries" ) )
+        {
+            Entry entry;
+            entry.CCT = item.at( "cct" ).get<double>();
+            entry.WB_multipliers =
+                item.at( "wb_multipliers" ).get<std::vector<double>>();
+            entry.IDT_matrix = item.at( "idt_matrix" )
+                                   .get<std::vector<std::vector<double>>>();
+
+            bool valid = entry.CCT > 0.0 && entry.WB_multipliers.size() == 3 &&
+                         entry.IDT_matrix.size() == 3;
+            for ( const auto &row: entry.IDT_matrix )
+                valid &= row.size() == 3;
+            if ( !valid )
+            {
+                std::cerr << "ERROR: Invalid entry in the colour temperature "
+                          << "table " << path << "." << std::endl;
+                return false;
+            }
+
+            table.entries.push_back( entry );
+        }
+    }
+    catch ( const std::exception &error )
+    {
+        std::cerr << "ERROR: Failed to parse the colour temperature table "
+                  << path << ": " << error.what() << std::endl;
+        return false;
+    }
+
+    std::sort(
+        table.entries.begin(),
+        table.entries.end(),
+        []( const Entry &a, const Entry &b ) { return a.CCT < b.CCT; } );
+
+    *this = table;
+    return true;
+}
+
+bool CCTMatrixTable::save( const std::string &path ) const
+{
+    nlohmann::json items = nlohmann::json::array();
+    for ( const auto &entry: entries )
+    {
+        nlohmann::json item;
+        item["cct"]            = entry.CCT;
+        item["wb_multipliers"] = entry.WB_multipliers;
+        item["idt_matrix"]     = entry.IDT_matrix;
+        items.push_back( item );
+    }
+
+    nlohmann::json json;
+    json["version"]      = table_file_version;
+    json["camera_make"]  = camera_make;
+    json["camera_model"] = camera_model;
+    json["entries"]      = items;
+
+    std::ofstream file( path );
+    if ( !file.is_open() )
+    {
+        std::cerr << "ERROR: Failed to write the colour temperature table "
+                  << path << "." << std::endl;
+        return false;
+    }
+
+    file << json.dump( 4 ) << std::endl;
+    return static_cast<bool>( file );
+}
+
+} // namespace core
+} // namespace rta
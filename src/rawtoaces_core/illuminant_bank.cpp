@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include <rawtoaces/rawtoaces_core.h>
+#include "rawtoaces_core_priv.h"
+#include "illuminant_bank.h"
+
+#include <utility>
+
+namespace rta
+{
+namespace core
+{
+
+/// The key identifying a camera by its spectral sensitivity data.
+static std::vector<double> camera_key( const SpectralData &camera )
+{
+    std::vector<double> key;
+    for ( const char *channel: { "R", "G", "B" } )
+    {
+        const Spectrum &spectrum = camera[channel];
+        key.push_back( spectrum.shape.first );
+        key.push_back( spectrum.shape.last );
+        key.push_back( spectrum.shape.step );
+        key.push_back( static_cast<double>( spectrum.values.size() ) );
+        key.insert( key.end(), spectrum.values.begin(), spectrum.values.end() );
+    }
+    return key;
+}
+
+IlluminantBank::IlluminantBank( const SpectralDatabase &database )
+{
+    // Daylight - pre-calculate
+    for ( int cct = 4000; cct <= 25000; cct += 500 )
+    {
+        SpectralData     &illuminant = _illuminants.emplace_back();
+        const std::string type       = "d" + std::to_string( cct / 100 );
+        generate_illuminant( cct, type, true, illuminant );
+    }
+
+    // Blackbody - pre-calculate
+    for ( int cct = 1500; cct < 4000; cct += 500 )
+    {
+        SpectralData     &illuminant = _illuminants.emplace_back();
+        const std::string type       = std::to_string( cct ) + "k";
+        generate_illuminant( cct, type, false, illuminant );
+    }
+
+    for ( const auto &illuminant: database.illuminants() )
+        _illuminants.push_back( *illuminant );
+}
+
+std::shared_ptr<const IlluminantBank>
+IlluminantBank::get( const std::shared_ptr<const SpectralDatabase> &database )
+{
+    static std::mutex mutex;
+    static std::vector<std::pair<
+        std::weak_ptr<const SpectralDatabase>,
+        std::shared_ptr<const IlluminantBank>>>
+        banks;
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    // Drop the banks of the databases which have been rebuilt since.
+    for ( auto iter = banks.begin(); iter != banks.end(); )
+    {
+        if ( iter->first.expired() )
+            iter = banks.erase( iter );
+        else
+            ++iter;
+    }
+
+    for ( const auto &bank: banks )
+    {
+        if ( bank.first.lock() == database )
+            return bank.second;
+    }
+
+    auto bank = std::make_shared<const IlluminantBank>( *database );
+    banks.emplace_back( database, bank );
+    return bank;
+}
+
+const std::vector<SpectralData> &IlluminantBank::illuminants() const
+{
+    return _illuminants;
+}
+
+std::shared_ptr<const std::vector<IlluminantBank::Response>>
+IlluminantBank::responses( const SpectralData &camera ) const
+{
+    auto key = camera_key( camera );
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    auto &result = _responses[key];
+    if ( !result )
+    {
+        const Spectrum &camera_r = camera["R"];
+        const Spectrum &camera_g = camera["G"];
+        const Spectrum &camera_b = camera["B"];
+
+        auto responses = std::make_shared<std::vector<Response>>();
+        responses->reserve( _illuminants.size() );
+
+        for ( const auto &illuminant: _illuminants )
+        {
+            // Same as _calculate_WB(), which the search used to call for
+            // every illuminant.
+            SpectralData scaled = illuminant;
+            scale_illuminant( camera, scaled );
+            const Spectrum &power = scaled["power"];
+
+            responses->push_back( { multiply_integrate( camera_r, power ),
+                                    multiply_integrate( camera_g, power ),
+                                    multiply_integrate( camera_b, power ) } );
+        }
+        result = responses;
+    }
+    return result;
+}
+
+} // namespace core
+} // namespace rta
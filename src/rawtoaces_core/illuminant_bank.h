@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/spectral_database.h>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rta
+{
+namespace core
+{
+
+/// The immutable set of the candidate illuminants searched by
+/// `SpectralSolver::find_illuminant()` when matching white-balancing
+/// weights: the generated daylight and blackbody illuminants, followed by
+/// the illuminants stored in the database. The bank is shared within the
+/// process, and also holds the pre-integrated responses of every camera it
+/// has been used with, so the search does not need to touch the spectra.
+class IlluminantBank
+{
+public:
+    /// The camera R, G, B channels integrated with the power spectrum of an
+    /// illuminant scaled by `scale_illuminant()`.
+    using Response = std::array<double, 3>;
+
+    /// Build the bank for the illuminants stored in `database`.
+    IlluminantBank( const SpectralDatabase &database );
+
+    /// Get the bank shared within the process for `database`.
+    /// @param database the spectral database.
+    /// @result the shared bank.
+    static std::shared_ptr<const IlluminantBank>
+    get( const std::shared_ptr<const SpectralDatabase> &database );
+
+    /// The unscaled illuminants, in the search order.
+    const std::vector<SpectralData> &illuminants() const;
+
+    /// Get the responses of `camera` to all illuminants, in the same order as
+    /// `illuminants()`. The responses get calculated on the first call for
+    /// a given camera and reused after that.
+    /// @param camera the camera spectral data, having the R, G and B channels.
+    /// @result the responses.
+    std::shared_ptr<const std::vector<Response>>
+    responses( const SpectralData &camera ) const;
+
+private:
+    std::vector<SpectralData> _illuminants;
+
+    mutable std::mutex _mutex;
+    mutable std::map<
+        std::vector<double>,
+        std::shared_ptr<const std::vector<Response>>>
+        _responses;
+};
+
+} // namespace core
+} // namespace rta
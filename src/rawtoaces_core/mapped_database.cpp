@@ -0,0 +1,398 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "mapped_database.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace rta
+{
+namespace core
+{
+
+// The layout of the compiled database file. All numbers are stored in the
+// native byte order, the files are meant to be compiled on the machines
+// using them. The records get copied out of the mapping with `memcpy()`, so
+// the offsets need no particular alignment.
+//
+//     FileHeader
+//     EntryRecord[entry_count]
+//     ChannelRecord[channel_count]
+//     double[sample_count]
+//     char[string_size], null-terminated strings, starting with an empty one
+
+static const char     file_magic[8]      = "RTASPDB";
+static const uint32_t file_byte_order    = 0x01020304;
+static const uint32_t file_version       = 1;
+static const size_t   header_field_count = 16;
+
+/// The string fields of `SpectralData` in the order they get stored.
+static std::string SpectralData::*const header_fields[header_field_count] = {
+    &SpectralData::manufacturer,          &SpectralData::model,
+    &SpectralData::type,                  &SpectralData::description,
+    &SpectralData::document_creator,      &SpectralData::unique_identifier,
+    &SpectralData::measurement_equipment, &SpectralData::laboratory,
+    &SpectralData::creation_date,         &SpectralData::comments,
+    &SpectralData::license,               &SpectralData::units,
+    &SpectralData::reflection_geometry,   &SpectralData::transmission_geometry,
+    &SpectralData::bandwidth_FWHM,        &SpectralData::bandwidth_corrected
+};
+
+struct FileHeader
+{
+    char     magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    float    reference_shape[3];
+    uint32_t reserved;
+    uint64_t entry_count;
+    uint64_t entry_offset;
+    uint64_t channel_count;
+    uint64_t channel_offset;
+    uint64_t sample_count;
+    uint64_t sample_offset;
+    uint64_t string_size;
+    uint64_t string_offset;
+};
+
+struct EntryRecord
+{
+    uint64_t path;
+    uint64_t data_type;
+    uint64_t header[header_field_count];
+    uint64_t file_size;
+    int64_t  file_time;
+    uint64_t first_channel;
+    uint64_t channel_count;
+};
+
+struct ChannelRecord
+{
+    uint64_t set_name;
+    uint64_t channel_name;
+    float    shape[3];
+    uint32_t reserved;
+    uint64_t first_sample;
+    uint64_t sample_count;
+};
+
+/// Read a record out of the mapped file.
+template <typename T> static T read_record( const unsigned char *data )
+{
+    T result;
+    std::memcpy( &result, data, sizeof( T ) );
+    return result;
+}
+
+/// Check if `count` items of `item_size` bytes starting at `offset` fit into
+/// a file of `file_size` bytes.
+static bool
+fits( uint64_t offset, uint64_t count, size_t item_size, size_t file_size )
+{
+    if ( offset > file_size )
+        return false;
+    return count <= ( file_size - offset ) / item_size;
+}
+
+/// Collects the deduplicated strings of the file being written.
+class StringTable
+{
+public:
+    StringTable() { _data.push_back( 0 ); }
+
+    uint64_t add( const std::string &string )
+    {
+        if ( string.empty() )
+            return 0;
+
+        auto iter = _offsets.find( string );
+        if ( iter != _offsets.end() )
+            return iter->second;
+
+        uint64_t offset = _data.size();
+        _data.insert( _data.end(), string.begin(), string.end() );
+        _data.push_back( 0 );
+        _offsets.emplace( string, offset );
+        return offset;
+    }
+
+    const std::vector<char> &data() const { return _data; }
+
+private:
+    std::vector<char>               _data;
+    std::map<std::string, uint64_t> _offsets;
+};
+
+bool MappedDatabase::write(
+    const std::string &path, const std::vector<Item> &items )
+{
+    StringTable                strings;
+    std::vector<EntryRecord>   entries;
+    std::vector<ChannelRecord> channels;
+    std::vector<double>        samples;
+
+    for ( const auto &item: items )
+    {
+        EntryRecord entry   = {};
+        entry.path          = strings.add( item.path );
+        entry.data_type     = strings.add( item.data_type );
+        entry.file_size     = item.size;
+        entry.file_time     = item.time;
+        entry.first_channel = channels.size();
+        for ( size_t i = 0; i < header_field_count; i++ )
+            entry.header[i] = strings.add( item.data.*header_fields[i] );
+
+        for ( const auto &[set_name, set]: item.data.data )
+        {
+            for ( const auto &[channel_name, spectrum]: set )
+            {
+                ChannelRecord channel = {};
+                channel.set_name      = strings.add( set_name );
+                channel.channel_name  = strings.add( channel_name );
+                channel.shape[0]      = spectrum.shape.first;
+                channel.shape[1]      = spectrum.shape.last;
+                channel.shape[2]      = spectrum.shape.step;
+                channel.first_sample  = samples.size();
+                channel.sample_count  = spectrum.values.size();
+                samples.insert(
+                    samples.end(),
+                    spectrum.values.begin(),
+                    spectrum.values.end() );
+                channels.push_back( channel );
+            }
+        }
+
+        entry.channel_count = channels.size() - entry.first_channel;
+        entries.push_back( entry );
+    }
+
+    FileHeader header = {};
+    std::memcpy( header.magic, file_magic, sizeof( file_magic ) );
+    header.byte_order         = file_byte_order;
+    header.version            = file_version;
+    header.reference_shape[0] = Spectrum::ReferenceShape.first;
+    header.reference_shape[1] = Spectrum::ReferenceShape.last;
+    header.reference_shape[2] = Spectrum::ReferenceShape.step;
+    header.entry_count        = entries.size();
+    header.entry_offset       = sizeof( FileHeader );
+    header.channel_count      = channels.size();
+    header.channel_offset =
+        header.entry_offset + entries.size() * sizeof( EntryRecord );
+    header.sample_count = samples.size();
+    header.sample_offset =
+        header.channel_offset + channels.size() * sizeof( ChannelRecord );
+    header.string_size = strings.data().size();
+    header.string_offset =
+        header.sample_offset + samples.size() * sizeof( double );
+
+    // Write into a temporary file first, so the processes mapping the
+    // database never see a partially written file.
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file( temp_path, std::ios::binary | std::ios::trunc );
+        if ( !file.is_open() )
+        {
+            std::cerr << "ERROR: Failed to write the compiled database "
+                      << path << "." << std::endl;
+            return false;
+        }
+
+        file.write(
+            reinterpret_cast<const char *>( &header ), sizeof( header ) );
+        file.write(
+            reinterpret_cast<const char *>( entries.data() ),
+            entries.size() * sizeof( EntryRecord ) );
+        file.write(
+            reinterpret_cast<const char *>( channels.data() ),
+            channels.size() * sizeof( ChannelRecord ) );
+        file.write(
+            reinterpret_cast<const char *>( samples.data() ),
+            samples.size() * sizeof( double ) );
+        file.write( strings.data().data(), strings.data().size() );
+
+        file.close();
+        if ( !file )
+        {
+            std::cerr << "ERROR: Failed to write the compiled database "
+                      << path << "." << std::endl;
+            std::error_code ec;
+            std::filesystem::remove( temp_path, ec );
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename( temp_path, path, ec );
+    if ( ec )
+    {
+        std::cerr << "ERROR: Failed to write the compiled database " << path
+                  << ": " << ec.message() << std::endl;
+        std::filesystem::remove( temp_path, ec );
+        return false;
+    }
+    return true;
+}
+
+bool MappedDatabase::open( const std::string &path )
+{
+    _paths.clear();
+    if ( !_file.open( path ) )
+        return false;
+
+    auto reject = [this, &path]( const char *reason ) {
+        std::cerr << "WARNING: Ignoring the compiled database " << path << ": "
+                  << reason << std::endl;
+        _file.close();
+        _paths.clear();
+        return false;
+    };
+
+    const unsigned char *data = _file.data();
+    const size_t         size = _file.size();
+    if ( size < sizeof( FileHeader ) )
+        return reject( "the file is truncated." );
+
+    const auto header = read_record<FileHeader>( data );
+    if ( std::memcmp( header.magic, file_magic, sizeof( file_magic ) ) != 0 ||
+         header.byte_order != file_byte_order )
+        return reject( "unknown file format." );
+    if ( header.version != file_version )
+        return reject( "unsupported version." );
+    if ( header.reference_shape[0] != Spectrum::ReferenceShape.first ||
+         header.reference_shape[1] != Spectrum::ReferenceShape.last ||
+         header.reference_shape[2] != Spectrum::ReferenceShape.step )
+        return reject( "compiled for another reference shape." );
+
+    if ( !fits(
+             header.entry_offset,
+             header.entry_count,
+             sizeof( EntryRecord ),
+             size ) ||
+         !fits(
+             header.channel_offset,
+             header.channel_count,
+             sizeof( ChannelRecord ),
+             size ) ||
+         !fits(
+             header.sample_offset,
+             header.sample_count,
+             sizeof( double ),
+             size ) ||
+         !fits( header.string_offset, header.string_size, 1, size ) ||
+         header.string_size == 0 ||
+         data[header.string_offset + header.string_size - 1] != 0 )
+        return reject( "the file is truncated." );
+
+    // Validate all records once, so the accessors need no checks.
+    auto valid_string = [&header]( uint64_t offset ) {
+        return offset < header.string_size;
+    };
+
+    for ( uint64_t i = 0; i < header.channel_count; i++ )
+    {
+        const auto channel = read_record<ChannelRecord>(
+            data + header.channel_offset + i * sizeof( ChannelRecord ) );
+        if ( !valid_string( channel.set_name ) ||
+             !valid_string( channel.channel_name ) ||
+             channel.first_sample > header.sample_count ||
+             channel.sample_count > header.sample_count - channel.first_sample )
+            return reject( "invalid channel record." );
+    }
+
+    for ( uint64_t i = 0; i < header.entry_count; i++ )
+    {
+        const auto entry = read_record<EntryRecord>(
+            data + header.entry_offset + i * sizeof( EntryRecord ) );
+
+        bool valid = valid_string( entry.path ) &&
+                     valid_string( entry.data_type ) &&
+                     entry.first_channel <= header.channel_count &&
+                     entry.channel_count <=
+                         header.channel_count - entry.first_channel;
+        for ( size_t j = 0; j < header_field_count; j++ )
+            valid &= valid_string( entry.header[j] );
+        if ( !valid )
+            return reject( "invalid entry record." );
+
+        _paths.emplace( string( entry.path ), i );
+    }
+
+    return true;
+}
+
+size_t MappedDatabase::size() const
+{
+    if ( !_file.data() )
+        return 0;
+    return read_record<FileHeader>( _file.data() ).entry_count;
+}
+
+size_t MappedDatabase::find( const std::string &path ) const
+{
+    auto iter = _paths.find( path );
+    return iter != _paths.end() ? iter->second : size();
+}
+
+const char *MappedDatabase::string( uint64_t offset ) const
+{
+    const auto header = read_record<FileHeader>( _file.data() );
+    return reinterpret_cast<const char *>(
+        _file.data() + header.string_offset + offset );
+}
+
+MappedDatabase::Item MappedDatabase::item( size_t index ) const
+{
+    const auto header = read_record<FileHeader>( _file.data() );
+    const auto entry  = read_record<EntryRecord>(
+        _file.data() + header.entry_offset + index * sizeof( EntryRecord ) );
+
+    Item result;
+    result.path      = string( entry.path );
+    result.data_type = string( entry.data_type );
+    result.size      = entry.file_size;
+    result.time      = entry.file_time;
+    for ( size_t i = 0; i < header_field_count; i++ )
+        result.data.*header_fields[i] = string( entry.header[i] );
+    return result;
+}
+
+void MappedDatabase::decode( size_t index, SpectralData &data ) const
+{
+    const auto header = read_record<FileHeader>( _file.data() );
+    const auto entry  = read_record<EntryRecord>(
+        _file.data() + header.entry_offset + index * sizeof( EntryRecord ) );
+
+    data = item( index ).data;
+    for ( uint64_t i = 0; i < entry.channel_count; i++ )
+    {
+        const auto channel = read_record<ChannelRecord>(
+            _file.data() + header.channel_offset +
+            ( entry.first_channel + i ) * sizeof( ChannelRecord ) );
+
+        Spectrum::Shape shape;
+        shape.first = channel.shape[0];
+        shape.last  = channel.shape[1];
+        shape.step  = channel.shape[2];
+
+        Spectrum spectrum( 0, Spectrum::EmptyShape );
+        spectrum.shape = shape;
+        spectrum.values.resize( channel.sample_count );
+        if ( channel.sample_count )
+        {
+            std::memcpy(
+                spectrum.values.data(),
+                _file.data() + header.sample_offset +
+                    channel.first_sample * sizeof( double ),
+                channel.sample_count * sizeof( double ) );
+        }
+
+        data.data[string( channel.set_name )].emplace_back(
+            string( channel.channel_name ), spectrum );
+    }
+}
+
+} // namespace core
+} // namespace rta
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/mapped_file.h>
+#include <rawtoaces/spectral_data.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace core
+{
+
+/// A compiled spectral database: a read-only binary file holding the parsed
+/// spectral data files of a database directory, reshaped to
+/// `Spectrum::ReferenceShape`, along with the index of the files. The file
+/// gets memory-mapped, and only the data sets actually used get decoded.
+/// See `SpectralDatabase::write_binary()`.
+class MappedDatabase
+{
+public:
+    /// A data file stored in the compiled database.
+    struct Item
+    {
+        /// The path of the file relative to the database directory, e.g.
+        /// `camera/nikon_d200.json`.
+        std::string path;
+
+        /// The data type of the file, e.g. `camera`.
+        std::string data_type;
+
+        /// The size of the file when compiled.
+        uintmax_t size = 0;
+
+        /// The modification time of the file when compiled.
+        long long time = 0;
+
+        /// The parsed content. Only the header strings are filled in by
+        /// `item()`, see `decode()`.
+        SpectralData data;
+    };
+
+    /// Write a compiled database file.
+    /// @param path the path of the file to write.
+    /// @param items the data files to store, with the spectra reshaped to
+    ///     `Spectrum::ReferenceShape`.
+    /// @result `true` if written successfully.
+    static bool
+    write( const std::string &path, const std::vector<Item> &items );
+
+    /// Map a compiled database file and validate its layout. The files
+    /// written by another version of the format, or for another
+    /// `Spectrum::ReferenceShape`, get rejected.
+    /// @param path the path of the file to map.
+    /// @result `true` if mapped successfully.
+    bool open( const std::string &path );
+
+    /// The number of the data files stored.
+    size_t size() const;
+
+    /// Find a data file by its relative path.
+    /// @param path the path relative to the database directory.
+    /// @result the index of the file, or `size()` if not found.
+    size_t find( const std::string &path ) const;
+
+    /// Get the description of a stored file without decoding its spectra.
+    /// @param index the index of the file.
+    /// @result the file description, with the spectral data left empty.
+    Item item( size_t index ) const;
+
+    /// Decode a stored file, including its spectra.
+    /// @param index the index of the file.
+    /// @param data the spectral data to fill in.
+    void decode( size_t index, SpectralData &data ) const;
+
+private:
+    const char *string( uint64_t offset ) const;
+
+    MappedFile                    _file;
+    std::map<std::string, size_t> _paths;
+};
+
+} // namespace core
+} // namespace rta
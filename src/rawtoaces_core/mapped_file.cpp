@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include <rawtoaces/mapped_file.h>
+
+#ifdef WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace rta
+{
+namespace core
+{
+
+#ifdef WIN32
+bool MappedFile::open( const std::string &path, bool sequential )
+{
+    close();
+
+    // The sequential scan flag makes the system read ahead more aggressively
+    // when the mapped pages fault in.
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if ( sequential )
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+
+    HANDLE file = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        flags,
+        nullptr );
+    if ( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER size;
+    if ( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    HANDLE mapping =
+        CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    CloseHandle( file );
+    if ( !mapping )
+        return false;
+
+    void *data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( mapping );
+    if ( !data )
+        return false;
+
+    _data = static_cast<const unsigned char *>( data );
+    _size = static_cast<size_t>( size.QuadPart );
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( _data )
+        UnmapViewOfFile( _data );
+    _data = nullptr;
+    _size = 0;
+}
+#else
+bool MappedFile::open( const std::string &path, bool sequential )
+{
+    close();
+
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || info.st_size == 0 )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    size_t size = static_cast<size_t>( info.st_size );
+    void  *data = mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( data == MAP_FAILED )
+        return false;
+
+    // Start reading the whole file ahead now, overlapping the storage with
+    // the processing. These are only hints, a failure is harmless.
+    if ( sequential )
+    {
+        madvise( data, size, MADV_SEQUENTIAL );
+        madvise( data, size, MADV_WILLNEED );
+    }
+
+    _data = static_cast<const unsigned char *>( data );
+    _size = size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( _data )
+        munmap( const_cast<unsigned char *>( _data ), _size );
+    _data = nullptr;
+    _size = 0;
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+const unsigned char *MappedFile::data() const
+{
+    return _data;
+}
+
+size_t MappedFile::size() const
+{
+    return _size;
+}
+
+} // namespace core
+} // namespace rta
@@ -5,6 +5,7 @@
 
 #include "define.h"
 
+#include <array>
 #include <cfloat>
 
 #include <Eigen/Core>
@@ -18,6 +19,194 @@ namespace rta
 namespace core
 {
 
+// Fixed-size 3x3 matrix and vector types
+
+/// A 3-element vector, e.g. a colour triplet. The functions below are
+/// templated on the scalar type, so they can be used with `ceres::Jet`.
+template <typename T> using Vec3 = std::array<T, 3>;
+
+/// A 3×3 matrix, stored row by row.
+template <typename T> using Mat3 = std::array<Vec3<T>, 3>;
+
+template <typename T> constexpr Mat3<T> identity3()
+{
+    return { { { T( 1 ), T( 0 ), T( 0 ) },
+               { T( 0 ), T( 1 ), T( 0 ) },
+               { T( 0 ), T( 0 ), T( 1 ) } } };
+}
+
+template <typename T> constexpr Mat3<T> diagonal( const Vec3<T> &vct )
+{
+    return { { { vct[0], T( 0 ), T( 0 ) },
+               { T( 0 ), vct[1], T( 0 ) },
+               { T( 0 ), T( 0 ), vct[2] } } };
+}
+
+template <typename T> constexpr Mat3<T> transpose( const Mat3<T> &mtx )
+{
+    return { { { mtx[0][0], mtx[1][0], mtx[2][0] },
+               { mtx[0][1], mtx[1][1], mtx[2][1] },
+               { mtx[0][2], mtx[1][2], mtx[2][2] } } };
+}
+
+/// Matrix-matrix product `mtx1 * mtx2`.
+template <typename T>
+constexpr Mat3<T> multiply( const Mat3<T> &mtx1, const Mat3<T> &mtx2 )
+{
+    Mat3<T> result = {};
+    for ( size_t i = 0; i < 3; i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            result[i][j] = mtx1[i][0] * mtx2[0][j] + mtx1[i][1] * mtx2[1][j] +
+                           mtx1[i][2] * mtx2[2][j];
+    return result;
+}
+
+/// Matrix-vector product `mtx * vct`, treating `vct` as a column.
+template <typename T>
+constexpr Vec3<T> multiply( const Mat3<T> &mtx, const Vec3<T> &vct )
+{
+    Vec3<T> result = {};
+    for ( size_t i = 0; i < 3; i++ )
+        result[i] =
+            mtx[i][0] * vct[0] + mtx[i][1] * vct[1] + mtx[i][2] * vct[2];
+    return result;
+}
+
+/// Vector-matrix product `vct * mtx`, treating `vct` as a row.
+template <typename T>
+constexpr Vec3<T> multiply( const Vec3<T> &vct, const Mat3<T> &mtx )
+{
+    Vec3<T> result = {};
+    for ( size_t j = 0; j < 3; j++ )
+        result[j] =
+            vct[0] * mtx[0][j] + vct[1] * mtx[1][j] + vct[2] * mtx[2][j];
+    return result;
+}
+
+template <typename T> constexpr Mat3<T> scale( const Mat3<T> &mtx, T factor )
+{
+    Mat3<T> result = mtx;
+    for ( auto &row: result )
+        for ( auto &value: row )
+            value *= factor;
+    return result;
+}
+
+template <typename T> constexpr Vec3<T> scale( const Vec3<T> &vct, T factor )
+{
+    return { vct[0] * factor, vct[1] * factor, vct[2] * factor };
+}
+
+/// Linear interpolation `mtx1 + ( mtx2 - mtx1 ) * weight`.
+template <typename T>
+constexpr Mat3<T> lerp( const Mat3<T> &mtx1, const Mat3<T> &mtx2, T weight )
+{
+    Mat3<T> result = {};
+    for ( size_t i = 0; i < 3; i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            result[i][j] = ( mtx2[i][j] - mtx1[i][j] ) * weight + mtx1[i][j];
+    return result;
+}
+
+template <typename T> constexpr T sum( const Mat3<T> &mtx )
+{
+    T result = T( 0 );
+    for ( const auto &row: mtx )
+        for ( const auto &value: row )
+            result += value;
+    return result;
+}
+
+template <typename T> constexpr T determinant( const Mat3<T> &mtx )
+{
+    return mtx[0][0] * ( mtx[1][1] * mtx[2][2] - mtx[1][2] * mtx[2][1] ) -
+           mtx[0][1] * ( mtx[1][0] * mtx[2][2] - mtx[1][2] * mtx[2][0] ) +
+           mtx[0][2] * ( mtx[1][0] * mtx[2][1] - mtx[1][1] * mtx[2][0] );
+}
+
+/// Invert the matrix using the cofactor expansion. The matrix must not be
+/// singular.
+template <typename T> constexpr Mat3<T> invert( const Mat3<T> &mtx )
+{
+    Mat3<T> cofactors = {};
+    cofactors[0][0]   = mtx[1][1] * mtx[2][2] - mtx[1][2] * mtx[2][1];
+    cofactors[0][1]   = mtx[1][2] * mtx[2][0] - mtx[1][0] * mtx[2][2];
+    cofactors[0][2]   = mtx[1][0] * mtx[2][1] - mtx[1][1] * mtx[2][0];
+    cofactors[1][0]   = mtx[0][2] * mtx[2][1] - mtx[0][1] * mtx[2][2];
+    cofactors[1][1]   = mtx[0][0] * mtx[2][2] - mtx[0][2] * mtx[2][0];
+    cofactors[1][2]   = mtx[0][1] * mtx[2][0] - mtx[0][0] * mtx[2][1];
+    cofactors[2][0]   = mtx[0][1] * mtx[1][2] - mtx[0][2] * mtx[1][1];
+    cofactors[2][1]   = mtx[0][2] * mtx[1][0] - mtx[0][0] * mtx[1][2];
+    cofactors[2][2]   = mtx[0][0] * mtx[1][1] - mtx[0][1] * mtx[1][0];
+
+    T det = mtx[0][0] * cofactors[0][0] + mtx[0][1] * cofactors[0][1] +
+            mtx[0][2] * cofactors[0][2];
+    T inv_det = T( 1 ) / det;
+
+    // The inverse is the transposed cofactor matrix divided by determinant.
+    return scale( transpose( cofactors ), inv_det );
+}
+
+// Conversions from and to the vector-based types used by the public API.
+
+template <typename T> Vec3<T> to_Vec3( const vector<T> &vct )
+{
+    assert( vct.size() == 3 );
+    return { vct[0], vct[1], vct[2] };
+}
+
+/// Convert a 3×3 matrix stored row by row in a flat 9-element vector.
+template <typename T> Mat3<T> to_Mat3( const vector<T> &vct )
+{
+    assert( vct.size() == 9 );
+    return { { { vct[0], vct[1], vct[2] },
+               { vct[3], vct[4], vct[5] },
+               { vct[6], vct[7], vct[8] } } };
+}
+
+template <typename T> Mat3<T> to_Mat3( const vector<vector<T>> &vMtx )
+{
+    assert( vMtx.size() == 3 );
+    Mat3<T> result = {};
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        assert( vMtx[i].size() == 3 );
+        for ( size_t j = 0; j < 3; j++ )
+            result[i][j] = vMtx[i][j];
+    }
+    return result;
+}
+
+template <typename T> Mat3<T> to_Mat3( const T ( &mtx )[3][3] )
+{
+    return { { { mtx[0][0], mtx[0][1], mtx[0][2] },
+               { mtx[1][0], mtx[1][1], mtx[1][2] },
+               { mtx[2][0], mtx[2][1], mtx[2][2] } } };
+}
+
+template <typename T> vector<T> to_vector( const Vec3<T> &vct )
+{
+    return vector<T>( vct.begin(), vct.end() );
+}
+
+template <typename T> vector<vector<T>> to_vector( const Mat3<T> &mtx )
+{
+    vector<vector<T>> result( 3 );
+    for ( size_t i = 0; i < 3; i++ )
+        result[i] = to_vector( mtx[i] );
+    return result;
+}
+
+/// Convert to a flat 9-element vector, storing the matrix row by row.
+template <typename T> vector<T> to_flat_vector( const Mat3<T> &mtx )
+{
+    vector<T> result;
+    result.reserve( 9 );
+    for ( const auto &row: mtx )
+        result.insert( result.end(), row.begin(), row.end() );
+    return result;
+}
+
 // Non-class functions
 
 template <typename T> int isSquare( const vector<vector<T>> &vm )
@@ -412,6 +601,35 @@ template <typename T> vector<T> XYZ_to_uv( const vector<T> &XYZ )
     return uvScale;
 }
 
+template <typename T>
+Mat3<T>
+calculate_CAT( const Vec3<T> &src_white_XYZ, const Vec3<T> &dst_white_XYZ )
+{
+    // clang-format off
+    // Color Adaptation Matrices - CAT02 (default)
+    static const Mat3<T> CAT02 = { {
+        { T(  0.7328 ), T( 0.4296 ), T( -0.1624 ) },
+        { T( -0.7036 ), T( 1.6975 ), T(  0.0061 ) },
+        { T(  0.0030 ), T( 0.0136 ), T(  0.9834 ) }
+    } };
+
+    static const Mat3<T> CAT02_inv = { {
+        { T(  1.0961238208355142    ), T( -0.27886900021828726  ), T( 0.18274517938277304  ) },
+        { T(  0.45436904197535921   ), T(  0.47353315430741177  ), T( 0.072097803717229125 ) },
+        { T( -0.0096276087384293551 ), T( -0.0056980312161134198 ), T( 1.0153256399545427   ) }
+    } };
+    // clang-format on
+
+    Vec3<T> src_white_LMS = multiply( CAT02, src_white_XYZ );
+    Vec3<T> dst_white_LMS = multiply( CAT02, dst_white_XYZ );
+
+    Mat3<T> mat = diagonal<T>( { dst_white_LMS[0] / src_white_LMS[0],
+                                 dst_white_LMS[1] / src_white_LMS[1],
+                                 dst_white_LMS[2] / src_white_LMS[2] } );
+
+    return multiply( CAT02_inv, multiply( mat, CAT02 ) );
+}
+
 template <typename T>
 std::vector<std::vector<T>> calculate_CAT(
     const std::vector<T> &src_white_XYZ, const std::vector<T> &dst_white_XYZ )
@@ -419,31 +637,44 @@ std::vector<std::vector<T>> calculate_CAT(
     assert( src_white_XYZ.size() == 3 );
     assert( dst_white_XYZ.size() == 3 );
 
-    // clang-format off
-    // Color Adaptation Matrices - CAT02 (default)
-    static const std::vector<std::vector<double>> CAT02 = {
-        {  0.7328, 0.4296, -0.1624 },
-        { -0.7036, 1.6975,  0.0061 },
-        {  0.0030, 0.0136,  0.9834 }
-    };
-    
-    static const std::vector<std::vector<double>> CAT02_inv = {
-        {  1.0961238208355142,    -0.27886900021828726,   0.18274517938277304 },
-        {  0.45436904197535921,    0.47353315430741177,   0.072097803717229125 },
-        { -0.0096276087384293551, -0.0056980312161134198, 1.0153256399545427 }
-    };
-    // clang-format on
+    return to_vector(
+        calculate_CAT( to_Vec3( src_white_XYZ ), to_Vec3( dst_white_XYZ ) ) );
+}
 
-    std::vector<double> src_white_LMS = mulVector( src_white_XYZ, CAT02 );
-    std::vector<double> dst_white_LMS = mulVector( dst_white_XYZ, CAT02 );
+/// The cube root of `x`. Faster and more accurate than
+/// `pow( x, 1.0 / 3.0 )`, as 1/3 is not exactly representable.
+inline double LAB_cbrt( double x )
+{
+    return std::cbrt( x );
+}
 
-    std::vector<std::vector<double>> mat( 3, std::vector<double>( 3, 0 ) );
-    for ( size_t i = 0; i < 3; i++ )
-        mat[i][i] = dst_white_LMS[i] / src_white_LMS[i];
+/// The cube root of a positive `ceres::Jet`. The derivative reuses the root,
+/// as d/dx x^(1/3) = x^(1/3) / 3x, so only a single root gets calculated.
+template <typename T, int N>
+ceres::Jet<T, N> LAB_cbrt( const ceres::Jet<T, N> &x )
+{
+    const T root = LAB_cbrt( x.a );
+    return ceres::Jet<T, N>( root, x.v * ( root / ( T( 3.0 ) * x.a ) ) );
+}
 
-    mat = mulVector( mat, transposeVec( CAT02 ) );
-    mat = mulVector( CAT02_inv, transposeVec( mat ) );
-    return mat;
+/// The transfer function of CIE LAB, applied to an XYZ component divided by
+/// the same component of the white point.
+template <typename T> T LAB_transfer( const T &t )
+{
+    if ( t > T( e ) )
+        return LAB_cbrt( t );
+    return T( k ) * t + T( 16.0 / 116.0 );
+}
+
+template <typename T> Vec3<T> XYZ_to_LAB( const Vec3<T> &XYZ )
+{
+    Vec3<T> tmpXYZ;
+    for ( size_t j = 0; j < 3; j++ )
+        tmpXYZ[j] = LAB_transfer( XYZ[j] / ACES_white_point_XYZ[j] );
+
+    return { T( 116.0 ) * tmpXYZ[1] - T( 16.0 ),
+             T( 500.0 ) * ( tmpXYZ[0] - tmpXYZ[1] ),
+             T( 200.0 ) * ( tmpXYZ[1] - tmpXYZ[2] ) };
 }
 
 template <typename T>
@@ -451,26 +682,20 @@ vector<vector<T>> XYZ_to_LAB( const vector<vector<T>> &XYZ )
 {
     assert( !XYZ.empty() );
     assert( XYZ[0].size() == 3 );
-    T add = T( 16.0 / 116.0 );
 
-    vector<vector<T>> tmpXYZ( XYZ.size(), vector<T>( 3, T( 1.0 ) ) );
+    vector<vector<T>> outCalcLab( XYZ.size() );
     for ( size_t i = 0; i < XYZ.size(); i++ )
-        for ( size_t j = 0; j < 3; j++ )
-        {
-            tmpXYZ[i][j] = XYZ[i][j] / ACES_white_point_XYZ[j];
-            if ( tmpXYZ[i][j] > T( e ) )
-                tmpXYZ[i][j] = ceres::pow( tmpXYZ[i][j], T( 1.0 / 3.0 ) );
-            else
-                tmpXYZ[i][j] = T( k ) * tmpXYZ[i][j] + add;
-        }
+        outCalcLab[i] = to_vector( XYZ_to_LAB( to_Vec3( XYZ[i] ) ) );
 
-    vector<vector<T>> outCalcLab( XYZ.size(), vector<T>( 3 ) );
+    return outCalcLab;
+}
+
+template <typename T>
+vector<Vec3<T>> XYZ_to_LAB( const vector<Vec3<T>> &XYZ )
+{
+    vector<Vec3<T>> outCalcLab( XYZ.size() );
     for ( size_t i = 0; i < XYZ.size(); i++ )
-    {
-        outCalcLab[i][0] = T( 116.0 ) * tmpXYZ[i][1] - T( 16.0 );
-        outCalcLab[i][1] = T( 500.0 ) * ( tmpXYZ[i][0] - tmpXYZ[i][1] );
-        outCalcLab[i][2] = T( 200.0 ) * ( tmpXYZ[i][1] - tmpXYZ[i][2] );
-    }
+        outCalcLab[i] = XYZ_to_LAB( XYZ[i] );
 
     return outCalcLab;
 }
@@ -3,9 +3,15 @@
 
 #include <rawtoaces/rawtoaces_core.h>
 #include "rawtoaces_core_priv.h"
+#include "illuminant_bank.h"
 #include "mathOps.h"
 #include "define.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+
 using namespace ceres;
 
 namespace rta
@@ -202,7 +208,8 @@ void scale_illuminant( const SpectralData &camera, SpectralData &illuminant )
     const Spectrum &camera_spectrum     = camera[max_channel];
     Spectrum       &illuminant_spectrum = illuminant["power"];
 
-    double scale = 1.0 / ( camera_spectrum * illuminant_spectrum ).integrate();
+    double scale =
+        1.0 / multiply_integrate( camera_spectrum, illuminant_spectrum );
     illuminant_spectrum *= scale;
 }
 
@@ -265,6 +272,16 @@ bool SpectralSolver::load_spectral_data(
     }
     else
     {
+        if ( database )
+        {
+            auto data = database->find_file( path.generic_string() );
+            if ( data )
+            {
+                out_data = *data;
+                return true;
+            }
+        }
+
         for ( const auto &directory: _search_directories )
         {
             std::filesystem::path search_path( directory );
@@ -292,6 +309,15 @@ bool SpectralSolver::find_camera(
         return true;
     }
 
+    if ( database )
+    {
+        auto data = database->find_camera( make, model );
+        if ( !data )
+            return false;
+        camera = *data;
+        return true;
+    }
+
     auto camera_files = collect_data_files( "camera" );
 
     for ( const auto &camera_file: camera_files )
@@ -338,6 +364,14 @@ bool SpectralSolver::find_illuminant( const std::string &type )
         generate_illuminant( cct, illuminant_type, false, illuminant );
         return true;
     }
+    else if ( database )
+    {
+        auto data = database->find_illuminant( type );
+        if ( !data )
+            return false;
+        illuminant = *data;
+        return true;
+    }
     else
     {
         auto illuminant_files = collect_data_files( "illuminant" );
@@ -365,53 +399,43 @@ bool SpectralSolver::find_illuminant( const vector<double> &wb )
         return false;
     }
 
-    if ( _all_illuminants.empty() )
-    {
-        // Daylight - pre-calculate
-        for ( int cct = 4000; cct <= 25000; cct += 500 )
-        {
-            SpectralData     &illuminant_data = _all_illuminants.emplace_back();
-            const std::string type = "d" + std::to_string( cct / 100 );
-            generate_illuminant( cct, type, true, illuminant_data );
-        }
-
-        // Blackbody - pre-calculate
-        for ( int cct = 1500; cct < 4000; cct += 500 )
-        {
-            SpectralData     &illuminant_data = _all_illuminants.emplace_back();
-            const std::string type            = std::to_string( cct ) + "k";
-            generate_illuminant( cct, type, false, illuminant_data );
-        }
-
-        auto illuminant_files = collect_data_files( "illuminant" );
-
-        for ( const auto &illuminant_file: illuminant_files )
-        {
-            SpectralData &illuminant_data = _all_illuminants.emplace_back();
-            if ( !illuminant_data.load( illuminant_file ) )
-            {
-                _all_illuminants.pop_back();
-                continue;
-            }
-        }
-    }
+    auto spectral_database =
+        database ? database
+                 : SpectralDatabase::get( _search_directories, verbosity );
+    auto bank      = IlluminantBank::get( spectral_database );
+    auto responses = bank->responses( camera );
 
     // SSE: Sum of Squared Errors
-    double sse = max_double_value;
+    double sse  = max_double_value;
+    size_t best = 0;
 
-    for ( auto &current_illuminant: _all_illuminants )
+    for ( size_t i = 0; i < responses->size(); i++ )
     {
-        vector<double> wb_tmp  = _calculate_WB( camera, current_illuminant );
-        double         sse_tmp = calculate_SSE( wb_tmp, wb );
+        const auto &response = ( *responses )[i];
+
+        double wb_r = response[1] / response[0];
+        double wb_b = response[1] / response[2];
+
+        double error_r = wb_r / wb[0] - 1.0;
+        double error_g = 1.0 / wb[1] - 1.0;
+        double error_b = wb_b / wb[2] - 1.0;
+        double sse_tmp =
+            error_r * error_r + error_g * error_g + error_b * error_b;
 
         if ( sse_tmp < sse )
         {
-            sse             = sse_tmp;
-            illuminant      = current_illuminant;
-            _wb_multipliers = wb_tmp;
+            sse  = sse_tmp;
+            best = i;
         }
     }
 
+    const auto &response = ( *responses )[best];
+    _wb_multipliers      = { response[1] / response[0],
+                             1.0,
+                             response[1] / response[2] };
+    illuminant           = bank->illuminants()[best];
+    scale_illuminant( camera, illuminant );
+
     if ( verbosity > 1 )
         std::cerr << "The illuminant calculated to be the best match to the "
                   << "camera metadata is '" << illuminant.type << "'."
@@ -458,9 +482,9 @@ calculate_CM( const SpectralData &camera, const SpectralData &illuminant )
     const Spectrum &camera_b            = camera["B"];
     const Spectrum &illuminant_spectrum = illuminant["power"];
 
-    double r = ( camera_r * illuminant_spectrum ).integrate();
-    double g = ( camera_g * illuminant_spectrum ).integrate();
-    double b = ( camera_b * illuminant_spectrum ).integrate();
+    double r = multiply_integrate( camera_r, illuminant_spectrum );
+    double g = multiply_integrate( camera_g, illuminant_spectrum );
+    double b = multiply_integrate( camera_b, illuminant_spectrum );
 
     double max = std::max( { r, g, b } );
 
@@ -513,9 +537,9 @@ _calculate_WB( const SpectralData &camera, SpectralData &illuminant )
     const Spectrum &camera_b            = camera["B"];
     const Spectrum &illuminant_spectrum = illuminant["power"];
 
-    double r = ( camera_r * illuminant_spectrum ).integrate();
-    double g = ( camera_g * illuminant_spectrum ).integrate();
-    double b = ( camera_b * illuminant_spectrum ).integrate();
+    double r = multiply_integrate( camera_r, illuminant_spectrum );
+    double g = multiply_integrate( camera_g, illuminant_spectrum );
+    double b = multiply_integrate( camera_b, illuminant_spectrum );
 
     // Normalise to the green channel.
     std::vector<double> wb = { g / r, 1.0, g / b };
@@ -532,7 +556,7 @@ _calculate_WB( const SpectralData &camera, SpectralData &illuminant )
 /// @param illuminant Illuminant data containing power spectrum information
 /// @param training_illuminants Training patches transformed by illuminant (from calculate_TI)
 /// @return 2D vector containing XYZ values for each training patch
-std::vector<std::vector<double>> calculate_XYZ(
+std::vector<std::array<double, 3>> calculate_XYZ(
     const SpectralData          &observer,
     const SpectralData          &illuminant,
     const std::vector<Spectrum> &training_illuminants )
@@ -540,37 +564,58 @@ std::vector<std::vector<double>> calculate_XYZ(
     assert( training_illuminants.size() > 0 );
     assert( training_illuminants[0].values.size() == 81 );
 
+    std::vector<std::array<double, 3>> XYZ;
+    multiply_integrate(
+        training_illuminants,
+        observer["X"],
+        observer["Y"],
+        observer["Z"],
+        XYZ );
+    adapt_XYZ( observer, illuminant, XYZ );
+    return XYZ;
+}
+
+/// Normalise the XYZ tristimulus values of the training patches to the
+/// luminance of the illuminant, and adapt them from the white point of the
+/// illuminant to the ACES white point. See `calculate_XYZ()`.
+///
+/// @param observer CIE 1931 color matching functions (X, Y, Z)
+/// @param illuminant Illuminant data containing power spectrum information
+/// @param XYZ The XYZ values of the training patches (modified in-place)
+void adapt_XYZ(
+    const SpectralData                 &observer,
+    const SpectralData                 &illuminant,
+    std::vector<std::array<double, 3>> &XYZ )
+{
     std::vector<double> reference_white_point(
         ACES_white_point_XYZ, ACES_white_point_XYZ + 3 );
-    std::vector<std::vector<double>> XYZ;
 
     const Spectrum &observer_x          = observer["X"];
     const Spectrum &observer_y          = observer["Y"];
     const Spectrum &observer_z          = observer["Z"];
     const Spectrum &illuminant_spectrum = illuminant["power"];
 
-    double scale = 1.0 / ( observer_y * illuminant_spectrum ).integrate();
+    double y     = multiply_integrate( observer_y, illuminant_spectrum );
+    double scale = 1.0 / y;
 
-    for ( auto &training_illuminant: training_illuminants )
+    for ( auto &xyz: XYZ )
     {
-        auto &xyz = XYZ.emplace_back( 3 );
-        xyz[0]    = ( training_illuminant * observer_x ).integrate() * scale;
-        xyz[1]    = ( training_illuminant * observer_y ).integrate() * scale;
-        xyz[2]    = ( training_illuminant * observer_z ).integrate() * scale;
+        xyz[0] *= scale;
+        xyz[1] *= scale;
+        xyz[2] *= scale;
     }
 
     std::vector<double> source_white_point( 3 );
-    double              y = ( observer_y * illuminant_spectrum ).integrate();
     source_white_point[0] =
-        ( observer_x * illuminant_spectrum ).integrate() / y;
+        multiply_integrate( observer_x, illuminant_spectrum ) / y;
     source_white_point[1] = 1.0;
     source_white_point[2] =
-        ( observer_z * illuminant_spectrum ).integrate() / y;
+        multiply_integrate( observer_z, illuminant_spectrum ) / y;
 
-    XYZ = mulVector(
-        XYZ, calculate_CAT( source_white_point, reference_white_point ) );
-
-    return XYZ;
+    Mat3<double> CAT_matrix = calculate_CAT(
+        to_Vec3( source_white_point ), to_Vec3( reference_white_point ) );
+    for ( auto &xyz: XYZ )
+        xyz = multiply( CAT_matrix, xyz );
 }
 
 /// Calculate white-balanced linearized camera RGB responses from training illuminant data.
@@ -583,7 +628,7 @@ std::vector<std::vector<double>> calculate_XYZ(
 /// @param WB_multipliers White balance multipliers from calculate_WB function
 /// @param training_illuminants Training patches transformed by illuminant (from calculate_TI)
 /// @return 2D vector containing RGB values for each training patch
-std::vector<std::vector<double>> calculate_RGB(
+std::vector<std::array<double, 3>> calculate_RGB(
     const SpectralData          &camera,
     const std::vector<double>   &WB_multipliers,
     const std::vector<Spectrum> &training_illuminants )
@@ -595,21 +640,70 @@ std::vector<std::vector<double>> calculate_RGB(
     const Spectrum &camera_g = camera["G"];
     const Spectrum &camera_b = camera["B"];
 
-    std::vector<std::vector<double>> RGB;
-    for ( auto &training_illuminant: training_illuminants )
+    std::vector<std::array<double, 3>> RGB;
+    multiply_integrate(
+        training_illuminants, camera_r, camera_g, camera_b, RGB );
+    for ( auto &rgb: RGB )
     {
-        auto &rgb = RGB.emplace_back( 3 );
-        rgb[0] =
-            ( training_illuminant * camera_r ).integrate() * WB_multipliers[0];
-        rgb[1] =
-            ( training_illuminant * camera_g ).integrate() * WB_multipliers[1];
-        rgb[2] =
-            ( training_illuminant * camera_b ).integrate() * WB_multipliers[2];
+        rgb[0] *= WB_multipliers[0];
+        rgb[1] *= WB_multipliers[1];
+        rgb[2] *= WB_multipliers[2];
     }
 
     return RGB;
 }
 
+IDTTrainingSet::IDTTrainingSet(
+    const std::vector<std::array<double, 3>> &RGB,
+    const std::vector<std::array<double, 3>> &LAB )
+{
+    assert( RGB.size() == LAB.size() );
+
+    for ( size_t j = 0; j < 3; j++ )
+    {
+        this->RGB[j].resize( RGB.size() );
+        this->LAB[j].resize( LAB.size() );
+        for ( size_t i = 0; i < RGB.size(); i++ )
+        {
+            this->RGB[j][i] = RGB[i][j];
+            this->LAB[j][i] = LAB[i][j];
+        }
+    }
+}
+
+/// The matrix converting the camera RGB responses to XYZ divided by the ACES
+/// white point, for the 6 IDT matrix parameters `beta_params`: the IDT matrix
+/// followed by the ACES RGB to XYZ matrix, which gets pre-multiplied once per
+/// evaluation, so every patch only takes a single matrix product before the
+/// LAB transfer function.
+template <typename T>
+Mat3<T> calculate_normalised_IDT_to_XYZ( const T *beta_params )
+{
+    const Mat3<T> BV = { { { beta_params[0],
+                             beta_params[1],
+                             1.0 - beta_params[0] - beta_params[1] },
+                           { beta_params[2],
+                             beta_params[3],
+                             1.0 - beta_params[2] - beta_params[3] },
+                           { beta_params[4],
+                             beta_params[5],
+                             1.0 - beta_params[4] - beta_params[5] } } };
+
+    Mat3<T> result;
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        for ( size_t j = 0; j < 3; j++ )
+        {
+            result[i][j] = ( BV[0][j] * acesrgb_XYZ_3[i][0] +
+                             BV[1][j] * acesrgb_XYZ_3[i][1] +
+                             BV[2][j] * acesrgb_XYZ_3[i][2] ) /
+                           ACES_white_point_XYZ[i];
+        }
+    }
+
+    return result;
+}
+
 /// Cost function object for IDT matrix optimization using Ceres solver.
 /// This struct implements the objective function for curve fitting between camera RGB
 /// responses and target LAB values. It's used to find the optimal 6-parameter IDT
@@ -618,18 +712,184 @@ std::vector<std::vector<double>> calculate_RGB(
 struct IDTOptimizationCost
 {
     IDTOptimizationCost(
-        const std::vector<std::vector<double>> &RGB,
-        const std::vector<std::vector<double>> &out_LAB )
-        : _in_RGB( RGB ), _out_LAB( out_LAB )
+        const std::vector<std::array<double, 3>> &RGB,
+        const std::vector<std::array<double, 3>> &out_LAB )
+        : _patches( RGB, out_LAB )
     {}
 
     template <typename T>
     bool operator()( const T *beta_params, T *residuals ) const;
 
-    const std::vector<std::vector<double>> _in_RGB;
-    const std::vector<std::vector<double>> _out_LAB;
+    const IDTTrainingSet _patches;
+};
+
+/// Evaluate the residuals of `IDTOptimizationCost`, and optionally their
+/// derivatives with respect to the 6 IDT matrix parameters, calculated
+/// analytically instead of via the automatic differentiation.
+///
+/// @param patches Camera RGB responses and target LAB values for training
+/// patches
+/// @param beta_params 6-element array of IDT matrix parameters
+/// @param residuals Output array of LAB differences, 3 per patch
+/// @param jacobian If not `nullptr`, the output row-major Jacobian matrix
+/// of 3 rows per patch and 6 columns
+void evaluate_IDT_cost(
+    const IDTTrainingSet &patches,
+    const double         *beta_params,
+    double               *residuals,
+    double               *jacobian )
+{
+    const Mat3<double> MBV = calculate_normalised_IDT_to_XYZ( beta_params );
+
+    // The ACES RGB to XYZ matrix divided by the white point, the derivative
+    // of the normalised XYZ with respect to the output of the IDT matrix.
+    Mat3<double> M;
+    for ( size_t i = 0; i < 3; i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            M[i][j] = acesrgb_XYZ_3[i][j] / ACES_white_point_XYZ[i];
+
+    const double *R = patches.RGB[0].data();
+    const double *G = patches.RGB[1].data();
+    const double *B = patches.RGB[2].data();
+
+    for ( size_t i = 0; i < patches.size(); i++ )
+    {
+        // The LAB companding function of every normalised XYZ component
+        // and its derivative with respect to the component.
+        double f[3], df[3];
+        for ( size_t j = 0; j < 3; j++ )
+        {
+            const double t =
+                MBV[j][0] * R[i] + MBV[j][1] * G[i] + MBV[j][2] * B[i];
+            if ( t > e )
+            {
+                f[j]  = LAB_cbrt( t );
+                df[j] = f[j] / ( 3.0 * t );
+            }
+            else
+            {
+                f[j]  = k * t + 16.0 / 116.0;
+                df[j] = k;
+            }
+        }
+
+        double *r = residuals + i * 3;
+        r[0]      = patches.LAB[0][i] - ( 116.0 * f[1] - 16.0 );
+        r[1]      = patches.LAB[1][i] - 500.0 * ( f[0] - f[1] );
+        r[2]      = patches.LAB[2][i] - 200.0 * ( f[1] - f[2] );
+
+        if ( !jacobian )
+            continue;
+
+        // Row `row` of the IDT matrix only depends on the parameters
+        // `2 * row` and `2 * row + 1`, weighting `R - B` and `G - B`.
+        const double dv[2] = { R[i] - B[i], G[i] - B[i] };
+
+        double *J = jacobian + i * 3 * 6;
+        for ( size_t row = 0; row < 3; row++ )
+        {
+            for ( size_t col = 0; col < 2; col++ )
+            {
+                const size_t p = row * 2 + col;
+
+                double dF[3];
+                for ( size_t j = 0; j < 3; j++ )
+                    dF[j] = df[j] * M[j][row] * dv[col];
+
+                J[0 * 6 + p] = -116.0 * dF[1];
+                J[1 * 6 + p] = -500.0 * ( dF[0] - dF[1] );
+                J[2 * 6 + p] = -200.0 * ( dF[1] - dF[2] );
+            }
+        }
+    }
+}
+
+/// The number of patches in the standard training data set,
+/// `training/training_spectral.json`.
+const int standard_training_patch_count = 190;
+
+/// The IDT optimization cost with the analytic Jacobian, for any number of
+/// training patches.
+class IDTAnalyticCost : public ceres::CostFunction
+{
+public:
+    IDTAnalyticCost(
+        const std::vector<std::array<double, 3>> &RGB,
+        const std::vector<std::array<double, 3>> &out_LAB )
+        : _patches( RGB, out_LAB )
+    {
+        set_num_residuals( int( RGB.size() * 3 ) );
+        mutable_parameter_block_sizes()->push_back( 6 );
+    }
+
+    bool Evaluate(
+        double const *const *parameters,
+        double              *residuals,
+        double             **jacobians ) const override
+    {
+        evaluate_IDT_cost(
+            _patches,
+            parameters[0],
+            residuals,
+            jacobians ? jacobians[0] : nullptr );
+        return true;
+    }
+
+private:
+    const IDTTrainingSet _patches;
+};
+
+/// The IDT optimization cost with the analytic Jacobian, with the number of
+/// residuals fixed at compile time for the standard training data set.
+class IDTFixedSizeCost
+    : public ceres::SizedCostFunction<3 * standard_training_patch_count, 6>
+{
+public:
+    IDTFixedSizeCost(
+        const std::vector<std::array<double, 3>> &RGB,
+        const std::vector<std::array<double, 3>> &out_LAB )
+        : _patches( RGB, out_LAB )
+    {
+        assert( RGB.size() == standard_training_patch_count );
+    }
+
+    bool Evaluate(
+        double const *const *parameters,
+        double              *residuals,
+        double             **jacobians ) const override
+    {
+        evaluate_IDT_cost(
+            _patches,
+            parameters[0],
+            residuals,
+            jacobians ? jacobians[0] : nullptr );
+        return true;
+    }
+
+private:
+    const IDTTrainingSet _patches;
 };
 
+ceres::CostFunction *create_IDT_cost_function(
+    const std::vector<std::array<double, 3>> &RGB,
+    const std::vector<std::array<double, 3>> &out_LAB,
+    bool                                      fast )
+{
+    if ( !fast )
+    {
+        using AutoDiffCost =
+            AutoDiffCostFunction<IDTOptimizationCost, ceres::DYNAMIC, 6>;
+        return new AutoDiffCost(
+            new IDTOptimizationCost( RGB, out_LAB ),
+            int( RGB.size() * 3 ) );
+    }
+
+    if ( RGB.size() == standard_training_patch_count )
+        return new IDTFixedSizeCost( RGB, out_LAB );
+
+    return new IDTAnalyticCost( RGB, out_LAB );
+}
+
 /// Perform curve fitting optimization to find optimal IDT matrix parameters.
 /// This function uses the Ceres optimization library to find the best 6-parameter
 /// IDT matrix that minimizes the difference between camera RGB responses and
@@ -645,30 +905,48 @@ struct IDTOptimizationCost
 /// - 2: Full optimization report and progress output
 /// - 3: Detailed progress with minimizer output to stdout
 /// @param out_IDT_matrix Output IDT matrix computed from optimized parameters
+/// @param fast Use the analytic Jacobian and the tolerances of
+/// `SpectralSolver::FitMode::Fast` instead of the reference settings
 /// @return true if optimization succeeded, false otherwise
 bool curveFit(
-    const std::vector<std::vector<double>> &RGB,
-    const std::vector<std::vector<double>> &XYZ,
-    double                                 *beta_params,
-    int                                     verbosity,
-    std::vector<std::vector<double>>       &out_IDT_matrix )
+    const std::vector<std::array<double, 3>> &RGB,
+    const std::vector<std::array<double, 3>> &XYZ,
+    double                                   *beta_params,
+    int                                       verbosity,
+    std::vector<std::vector<double>>         &out_IDT_matrix,
+    bool                                      fast,
+    int                                       thread_count )
 {
-    Problem                problem;
-    vector<vector<double>> out_LAB = XYZ_to_LAB( XYZ );
+    Problem                            problem;
+    std::vector<std::array<double, 3>> out_LAB = XYZ_to_LAB( XYZ );
 
     CostFunction *cost_function =
-        new AutoDiffCostFunction<IDTOptimizationCost, ceres::DYNAMIC, 6>(
-            new IDTOptimizationCost( RGB, out_LAB ),
-            int( RGB.size() * ( RGB[0].size() ) ) );
+        create_IDT_cost_function( RGB, out_LAB, fast );
 
     problem.AddResidualBlock( cost_function, NULL, beta_params );
 
     ceres::Solver::Options options;
-    options.linear_solver_type        = ceres::DENSE_QR;
-    options.parameter_tolerance       = 1e-17;
-    options.function_tolerance        = 1e-17;
-    options.min_line_search_step_size = 1e-17;
-    options.max_num_iterations        = 300;
+    if ( fast )
+    {
+        // The reference tolerances are well below the numerical noise of the
+        // cost, so most of the iterations do not improve the result. These
+        // still match the reference matrix within 1e-5, see
+        // `SpectralSolver::FitMode::Fast`.
+        options.linear_solver_type  = ceres::DENSE_NORMAL_CHOLESKY;
+        options.parameter_tolerance = 1e-10;
+        options.function_tolerance  = 1e-12;
+        options.max_num_iterations  = 100;
+    }
+    else
+    {
+        options.linear_solver_type        = ceres::DENSE_QR;
+        options.parameter_tolerance       = 1e-17;
+        options.function_tolerance        = 1e-17;
+        options.min_line_search_step_size = 1e-17;
+        options.max_num_iterations        = 300;
+    }
+
+    options.num_threads = std::max( thread_count, 1 );
 
     if ( verbosity > 2 )
         options.minimizer_progress_to_stdout = true;
@@ -712,6 +990,38 @@ bool curveFit(
     return false;
 }
 
+/// Get the parameters of the IDT matrix fit to start from.
+///
+/// @param IDT_start The 3×3 matrix to start from, or empty to start from
+/// the identity matrix
+/// @param beta_params Output 6-element parameter array of the fit
+/// @return `true` if the matrix is valid, `false` otherwise
+static bool IDT_start_to_beta_params(
+    const std::vector<std::vector<double>> &IDT_start, double *beta_params )
+{
+    const double identity[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    std::copy( identity, identity + 6, beta_params );
+
+    if ( IDT_start.empty() )
+        return true;
+
+    if ( IDT_start.size() != 3 || IDT_start[0].size() != 3 ||
+         IDT_start[1].size() != 3 || IDT_start[2].size() != 3 )
+    {
+        std::cerr << "ERROR: the starting IDT matrix must be 3x3."
+                  << std::endl;
+        return false;
+    }
+
+    // The third column is implied by the rows summing up to 1.
+    for ( size_t row = 0; row < 3; row++ )
+    {
+        beta_params[row * 2]     = IDT_start[row][0];
+        beta_params[row * 2 + 1] = IDT_start[row][1];
+    }
+    return true;
+}
+
 bool SpectralSolver::calculate_IDT_matrix()
 {
     if ( camera.data.count( "main" ) == 0 ||
@@ -748,13 +1058,199 @@ bool SpectralSolver::calculate_IDT_matrix()
         return false;
     }
 
-    double beta_params_start[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    double beta_params_start[6];
+    if ( !IDT_start_to_beta_params( IDT_start, beta_params_start ) )
+        return false;
 
     auto TI  = calculate_TI( illuminant, training_data );
     auto RGB = calculate_RGB( camera, _wb_multipliers, TI );
     auto XYZ = calculate_XYZ( observer, illuminant, TI );
 
-    return curveFit( RGB, XYZ, beta_params_start, verbosity, _idt_matrix );
+    return curveFit(
+        RGB,
+        XYZ,
+        beta_params_start,
+        verbosity,
+        _idt_matrix,
+        fit_mode == FitMode::Fast,
+        thread_count );
+}
+
+/// The training patches weighted by the camera and the observer curves,
+/// shared by all fits of `SpectralSolver::solve_illuminants()`. The
+/// responses to a patch under an illuminant only take a dot product per
+/// channel then, without weighting the patch by the illuminant first.
+struct WeightedTrainingPatches
+{
+    WeightedTrainingPatches(
+        const SpectralData &camera,
+        const SpectralData &observer,
+        const SpectralData &training_data )
+    {
+        const auto &patches = training_data.data.at( "main" );
+        camera_weighted.reserve( patches.size() );
+        observer_weighted.reserve( patches.size() );
+
+        for ( const auto &[name, patch]: patches )
+        {
+            camera_weighted.push_back( { patch * camera["R"],
+                                         patch * camera["G"],
+                                         patch * camera["B"] } );
+            observer_weighted.push_back( { patch * observer["X"],
+                                           patch * observer["Y"],
+                                           patch * observer["Z"] } );
+        }
+    }
+
+    /// Calculate the white-balanced camera RGB responses to the patches
+    /// under the illuminant, the same as `calculate_RGB()`. The storage of
+    /// `out_RGB` gets reused.
+    void RGB(
+        const Spectrum                     &illuminant,
+        const std::vector<double>          &WB,
+        std::vector<std::array<double, 3>> &out_RGB ) const
+    {
+        out_RGB.resize( camera_weighted.size() );
+        for ( size_t i = 0; i < camera_weighted.size(); i++ )
+            for ( size_t j = 0; j < 3; j++ )
+                out_RGB[i][j] =
+                    multiply_integrate( camera_weighted[i][j], illuminant ) *
+                    WB[j];
+    }
+
+    /// Calculate the XYZ values of the patches under the illuminant, before
+    /// the normalisation and the chromatic adaptation of `adapt_XYZ()`. The
+    /// storage of `out_XYZ` gets reused.
+    void XYZ(
+        const Spectrum                     &illuminant,
+        std::vector<std::array<double, 3>> &out_XYZ ) const
+    {
+        out_XYZ.resize( observer_weighted.size() );
+        for ( size_t i = 0; i < observer_weighted.size(); i++ )
+            for ( size_t j = 0; j < 3; j++ )
+                out_XYZ[i][j] =
+                    multiply_integrate( observer_weighted[i][j], illuminant );
+    }
+
+    std::vector<std::array<Spectrum, 3>> camera_weighted;
+    std::vector<std::array<Spectrum, 3>> observer_weighted;
+};
+
+bool SpectralSolver::solve_illuminants(
+    const std::vector<std::string>  &illuminants,
+    std::vector<IlluminantSolution> &out_solutions,
+    size_t                           thread_count ) const
+{
+    out_solutions.clear();
+
+    if ( camera.data.count( "main" ) == 0 ||
+         camera.data.at( "main" ).size() != 3 )
+    {
+        std::cerr << "ERROR: camera needs to be initialised prior to calling "
+                  << "SpectralSolver::solve_illuminants()" << std::endl;
+        return false;
+    }
+
+    if ( observer.data.count( "main" ) == 0 ||
+         observer.data.at( "main" ).size() != 3 )
+    {
+        std::cerr << "ERROR: observer needs to be initialised prior to calling "
+                  << "SpectralSolver::solve_illuminants()" << std::endl;
+        return false;
+    }
+
+    if ( training_data.data.count( "main" ) == 0 ||
+         training_data.data.at( "main" ).empty() )
+    {
+        std::cerr << "ERROR: training data needs to be initialised prior to "
+                  << "calling SpectralSolver::solve_illuminants()"
+                  << std::endl;
+        return false;
+    }
+
+    double beta_params_start[6];
+    if ( !IDT_start_to_beta_params( IDT_start, beta_params_start ) )
+        return false;
+
+    // Index the database once, instead of every lookup of a custom
+    // illuminant scanning the search directories.
+    auto spectral_database =
+        database ? database
+                 : SpectralDatabase::get( _search_directories, verbosity );
+
+    const WeightedTrainingPatches patches( camera, observer, training_data );
+
+    out_solutions.resize( illuminants.size() );
+
+    auto solve = [&]( size_t                              index,
+                      std::vector<std::array<double, 3>> &RGB,
+                      std::vector<std::array<double, 3>> &XYZ ) {
+        IlluminantSolution &solution = out_solutions[index];
+        solution.illuminant          = illuminants[index];
+
+        SpectralSolver lookup( _search_directories );
+        lookup.database  = spectral_database;
+        lookup.verbosity = verbosity;
+        if ( solution.illuminant.empty() ||
+             !lookup.find_illuminant( solution.illuminant ) )
+        {
+            std::cerr << "ERROR: Failed to find the illuminant '"
+                      << solution.illuminant << "'." << std::endl;
+            return;
+        }
+
+        solution.WB_multipliers = _calculate_WB( camera, lookup.illuminant );
+
+        const Spectrum &spectrum = lookup.illuminant["power"];
+
+        patches.RGB( spectrum, solution.WB_multipliers, RGB );
+        patches.XYZ( spectrum, XYZ );
+        adapt_XYZ( observer, lookup.illuminant, XYZ );
+
+        double beta_params[6];
+        std::copy( beta_params_start, beta_params_start + 6, beta_params );
+
+        solution.IDT_matrix.assign( 3, std::vector<double>( 3 ) );
+        solution.success = curveFit(
+            RGB,
+            XYZ,
+            beta_params,
+            verbosity,
+            solution.IDT_matrix,
+            fit_mode == FitMode::Fast );
+    };
+
+    if ( thread_count == 0 )
+        thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+    thread_count = std::min( thread_count, illuminants.size() );
+
+    std::atomic<size_t> next_index( 0 );
+    auto                worker = [&]() {
+        // Reuse the storage of the responses of the patches for all the
+        // illuminants solved on the thread.
+        std::vector<std::array<double, 3>> RGB, XYZ;
+
+        size_t index;
+        while ( ( index = next_index++ ) < illuminants.size() )
+            solve( index, RGB, XYZ );
+    };
+
+    std::vector<std::thread> workers;
+    for ( size_t i = 0; i < thread_count; i++ )
+    {
+        workers.emplace_back( worker );
+    }
+    for ( auto &thread: workers )
+    {
+        thread.join();
+    }
+
+    bool result = true;
+    for ( const auto &solution: out_solutions )
+    {
+        result &= solution.success;
+    }
+    return result;
 }
 
 //	=====================================================================
@@ -813,17 +1309,21 @@ double mired_to_CCT( const double mired )
 /// @param target_uvt Target point coordinates in CIE 1960 UCS space with temperature [u, v, t]
 /// @return Distance between the two points in UCS color space
 /// @pre source_uv.size() >= 2, target_uvt.size() >= 3
+static double
+robertson_length( double u, double v, const double *target_uvt )
+{
+    double t       = target_uvt[2];
+    double sign    = t < 0 ? -1.0 : t > 0 ? 1.0 : 0.0;
+    double slope_u = -sign / std::sqrt( 1 + t * t );
+    double slope_v = t * slope_u;
+
+    return slope_u * ( v - target_uvt[1] ) - slope_v * ( u - target_uvt[0] );
+}
+
 double robertson_length(
     const vector<double> &source_uv, const vector<double> &target_uvt )
 {
-    double         t    = target_uvt[2];
-    double         sign = t < 0 ? -1.0 : t > 0 ? 1.0 : 0.0;
-    vector<double> slope( 2 );
-    slope[0] = -sign / std::sqrt( 1 + t * t );
-    slope[1] = t * slope[0];
-
-    vector<double> target_uv( target_uvt.begin(), target_uvt.begin() + 2 );
-    return cross2d_scalar( slope, subVectors( source_uv, target_uv ) );
+    return robertson_length( source_uv[0], source_uv[1], target_uvt.data() );
 }
 
 /// Convert EXIF light source tag to correlated color temperature.
@@ -866,21 +1366,21 @@ double light_source_to_color_temp( const unsigned short tag )
 ///
 /// @param XYZ XYZ color values [X, Y, Z]
 /// @return Correlated color temperature in Kelvin
-double XYZ_to_color_temperature( const vector<double> &XYZ )
+static double XYZ_to_color_temperature( const Vec3<double> &XYZ )
 {
-    vector<double> uv                  = XYZ_to_uv( XYZ );
-    int            num_robertson_table = countSize( robertson_uvt_table );
-    int            i;
+    double scale = 1.0 / ( XYZ[0] + 15 * XYZ[1] + 3 * XYZ[2] );
+    double u     = 4.0 * XYZ[0] * scale;
+    double v     = 6.0 * XYZ[1] * scale;
+
+    int num_robertson_table = countSize( robertson_uvt_table );
+    int i;
 
     double mired;
     double distance_this = 0.0, distance_prev = 0.0;
 
     for ( i = 0; i < num_robertson_table; i++ )
     {
-        vector<double> robertson(
-            robertson_uvt_table[i],
-            robertson_uvt_table[i] + countSize( robertson_uvt_table[i] ) );
-        distance_this = robertson_length( uv, robertson );
+        distance_this = robertson_length( u, v, robertson_uvt_table[i] );
         if ( distance_this <= 0.0 )
         {
             break;
@@ -905,6 +1405,11 @@ double XYZ_to_color_temperature( const vector<double> &XYZ )
     return cct;
 }
 
+double XYZ_to_color_temperature( const vector<double> &XYZ )
+{
+    return XYZ_to_color_temperature( to_Vec3( XYZ ) );
+}
+
 /// Calculate weighted interpolation between two camera matrices based on Mired values.
 /// This function performs linear interpolation between two camera transformation matrices
 /// based on the position of a target Mired value between two reference Mired values.
@@ -918,6 +1423,22 @@ double XYZ_to_color_temperature( const vector<double> &XYZ )
 /// @param matrix_end Second camera transformation matrix
 /// @return Interpolated camera transformation matrix
 /// @pre mired_start != mired_end to avoid division by zero
+static Mat3<double> XYZ_to_camera_weighted_matrix(
+    double              mired_target,
+    double              mired_start,
+    double              mired_end,
+    const Mat3<double> &matrix_start,
+    const Mat3<double> &matrix_end )
+{
+    double weight = std::max(
+        0.0,
+        std::min(
+            1.0,
+            ( mired_start - mired_target ) / ( mired_start - mired_end ) ) );
+
+    return lerp( matrix_start, matrix_end, weight );
+}
+
 vector<double> XYZ_to_camera_weighted_matrix(
     const double              &mired_target,
     const double              &mired_start,
@@ -925,24 +1446,114 @@ vector<double> XYZ_to_camera_weighted_matrix(
     const std::vector<double> &matrix_start,
     const std::vector<double> &matrix_end )
 {
+    return to_flat_vector( XYZ_to_camera_weighted_matrix(
+        mired_target,
+        mired_start,
+        mired_end,
+        to_Mat3( matrix_start ),
+        to_Mat3( matrix_end ) ) );
+}
 
-    double weight = std::max(
-        0.0,
-        std::min(
-            1.0,
-            ( mired_start - mired_target ) / ( mired_start - mired_end ) ) );
-    vector<double> result = subVectors( matrix_end, matrix_start );
-    scaleVector( result, weight );
-    result = addVectors( result, matrix_start );
+/// Find a root of `function` within the bracket [`a`, `b`] using Brent's
+/// method, which combines the inverse quadratic interpolation and the secant
+/// steps with bisection, so it converges as fast as the interpolation allows
+/// while never leaving the bracket.
+///
+/// @param function the function to find a root of
+/// @param a one end of the bracket
+/// @param b the other end of the bracket
+/// @param fa the value of the function at `a`
+/// @param fb the value of the function at `b`
+/// @param tolerance the width of the bracket to stop at
+/// @return the end of the final bracket closer to the root
+/// @pre `fa` and `fb` must not have the same sign
+template <typename F>
+static double find_root(
+    const F &function,
+    double   a,
+    double   b,
+    double   fa,
+    double   fb,
+    double   tolerance )
+{
+    const int max_iterations = 100;
 
-    return result;
+    if ( std::fabs( fa ) < std::fabs( fb ) )
+    {
+        std::swap( a, b );
+        std::swap( fa, fb );
+    }
+
+    double c = a, fc = fa, d = a;
+    bool   bisected = true;
+
+    for ( int i = 0; i < max_iterations; i++ )
+    {
+        if ( fb == 0.0 || std::fabs( b - a ) <= tolerance )
+            break;
+
+        double s;
+        if ( fa != fc && fb != fc )
+        {
+            s = a * fb * fc / ( ( fa - fb ) * ( fa - fc ) ) +
+                b * fa * fc / ( ( fb - fa ) * ( fb - fc ) ) +
+                c * fa * fb / ( ( fc - fa ) * ( fc - fb ) );
+        }
+        else
+        {
+            s = b - fb * ( b - a ) / ( fb - fa );
+        }
+
+        // Fall back to bisection when the interpolated point lands outside
+        // of the bracket, or the interpolation does not converge fast enough.
+        const double previous_step = bisected ? b - c : c - d;
+        if ( ( s - ( 3.0 * a + b ) / 4.0 ) * ( s - b ) >= 0.0 ||
+             std::fabs( s - b ) >= std::fabs( previous_step ) / 2.0 ||
+             std::fabs( previous_step ) < tolerance )
+        {
+            s        = ( a + b ) / 2.0;
+            bisected = true;
+        }
+        else
+        {
+            bisected = false;
+        }
+
+        const double fs = function( s );
+        d               = c;
+        c               = b;
+        fc              = fb;
+
+        if ( fa * fs < 0.0 )
+        {
+            b  = s;
+            fb = fs;
+        }
+        else
+        {
+            a  = s;
+            fa = fs;
+        }
+
+        if ( std::fabs( fa ) < std::fabs( fb ) )
+        {
+            std::swap( a, b );
+            std::swap( fa, fb );
+        }
+    }
+
+    return b;
 }
 
-/// Find the optimal XYZ to camera transformation matrix using iterative optimization.
-/// This function determines the best camera transformation matrix by iteratively
-/// searching through Mired values to find the one that minimizes the error between
-/// predicted and actual neutral RGB values. It uses a binary search approach with
-/// error minimization to find the optimal color temperature calibration point.
+/// Find the optimal XYZ to camera transformation matrix.
+/// This function determines the camera transformation matrix interpolated at
+/// the Mired value, which the white point of the neutral RGB values
+/// transformed by that same matrix corresponds to. The range between the
+/// calibration illuminants gets searched in steps for a sign change of the
+/// difference between the two, falling back to the step with the smallest
+/// difference if there is none. When the calibration illuminants bracket a
+/// root of the difference, the root gets found using Brent's method, and only
+/// the steps around it get evaluated.
 ///
 /// The function interpolates between two calibration matrices based on the estimated
 /// optimal Mired value, ensuring accurate color transformations for the given
@@ -979,58 +1590,127 @@ vector<double> find_XYZ_to_camera_matrix(
     double max_mired = CCT_to_mired( 2000.0 );
     double min_mired = CCT_to_mired( 50000.0 );
 
-    const std::vector<double> &matrix_start =
-        metadata.calibration[0].XYZ_to_RGB_matrix;
-    const std::vector<double> &matrix_end =
-        metadata.calibration[1].XYZ_to_RGB_matrix;
+    const Mat3<double> matrix_start =
+        to_Mat3( metadata.calibration[0].XYZ_to_RGB_matrix );
+    const Mat3<double> matrix_end =
+        to_Mat3( metadata.calibration[1].XYZ_to_RGB_matrix );
+    const Vec3<double> neutral = to_Vec3( neutral_RGB );
 
     double low_mired =
         std::clamp( std::min( mir1, mir2 ), min_mired, max_mired );
     double high_mired =
         std::clamp( std::max( mir1, mir2 ), min_mired, max_mired );
-    double mired_step = std::max( 5.0, ( high_mired - low_mired ) / 50.0 );
 
-    double last_mired = 0.0, estimated_mired = 0.0, current_error = 0.0,
-           last_error = 0.0, smallest_error = 0.0;
+    // The difference between the Mired value to interpolate the matrices at,
+    // and the Mired value of the white point it produces.
+    auto error = [&]( double mired ) {
+        Mat3<double> XYZ_to_camera = XYZ_to_camera_weighted_matrix(
+            mired, mir1, mir2, matrix_start, matrix_end );
+        return mired - CCT_to_mired( XYZ_to_color_temperature(
+                           multiply( invert( XYZ_to_camera ), neutral ) ) );
+    };
 
-    double current_mired = low_mired;
-    while ( current_mired < high_mired )
-    {
-        current_error =
-            current_mired -
-            CCT_to_mired( XYZ_to_color_temperature( mulVector(
-                invertV( XYZ_to_camera_weighted_matrix(
-                    current_mired, mir1, mir2, matrix_start, matrix_end ) ),
-                neutral_RGB ) ) );
+    // The precision of the Mired value found, well below the precision of
+    // the colour temperatures in the metadata.
+    const double tolerance = 1e-6;
+
+    // The range gets searched in steps from `low_mired`, stopping at the
+    // first step where the difference changes its sign, and extrapolating
+    // from there. If there is none, the step with the smallest difference
+    // gets used.
+    const double mired_step =
+        std::max( 5.0, ( high_mired - low_mired ) / 50.0 );
+
+    auto extrapolate = []( double last_mired,
+                           double last_error,
+                           double current_mired,
+                           double current_error ) {
+        return current_mired +
+               ( current_error / ( current_error - last_error ) *
+                 ( current_mired - last_mired ) );
+    };
 
-        if ( std::fabs( current_error - 0.0 ) <= 1e-09 )
-        {
-            estimated_mired = current_mired;
-            break;
-        }
-        if ( std::fabs( current_mired - low_mired - 0.0 ) > 1e-09 &&
-             current_error * last_error <= 0.0 )
-        {
-            estimated_mired = current_mired +
-                              ( current_error / ( current_error - last_error ) *
-                                ( current_mired - last_mired ) );
-            break;
-        }
-        if ( std::fabs( current_mired - low_mired ) <= 1e-09 ||
-             std::fabs( current_error ) < std::fabs( smallest_error ) )
+    auto search_in_steps = [&]() {
+        double estimated_mired = 0.0, last_mired = 0.0, last_error = 0.0,
+               smallest_error = 0.0;
+
+        for ( double current_mired = low_mired; current_mired < high_mired;
+              current_mired += mired_step )
         {
-            estimated_mired = current_mired;
-            smallest_error  = current_error;
+            double current_error = error( current_mired );
+
+            if ( std::fabs( current_error ) <= 1e-09 )
+                return current_mired;
+            if ( current_mired != low_mired &&
+                 current_error * last_error <= 0.0 )
+            {
+                return extrapolate(
+                    last_mired, last_error, current_mired, current_error );
+            }
+            if ( current_mired == low_mired ||
+                 std::fabs( current_error ) < std::fabs( smallest_error ) )
+            {
+                estimated_mired = current_mired;
+                smallest_error  = current_error;
+            }
+
+            last_error = current_error;
+            last_mired = current_mired;
         }
+        return estimated_mired;
+    };
 
-        last_error = current_error;
-        last_mired = current_mired;
+    double estimated_mired = 0.0;
+    bool   found           = false;
 
-        current_mired += mired_step;
+    // If the calibration illuminants bracket a root of the difference, the
+    // root tells the step the search stops at, so only the steps around it
+    // need to be evaluated.
+    if ( low_mired < high_mired )
+    {
+        double low_error  = error( low_mired );
+        double high_error = error( high_mired );
+
+        if ( low_error * high_error <= 0.0 )
+        {
+            double root = find_root(
+                error,
+                low_mired,
+                high_mired,
+                low_error,
+                high_error,
+                tolerance );
+
+            double steps =
+                std::max( 1.0, std::ceil( ( root - low_mired ) / mired_step ) );
+            double current_mired = low_mired + steps * mired_step;
+            double last_mired    = current_mired - mired_step;
+
+            if ( current_mired < high_mired )
+            {
+                double last_error =
+                    steps > 1.0 ? error( last_mired ) : low_error;
+                double current_error = error( current_mired );
+
+                found = true;
+                if ( std::fabs( last_error ) <= 1e-09 )
+                    estimated_mired = last_mired;
+                else if ( std::fabs( current_error ) <= 1e-09 )
+                    estimated_mired = current_mired;
+                else if ( current_error * last_error <= 0.0 )
+                    estimated_mired = extrapolate(
+                        last_mired, last_error, current_mired, current_error );
+                else
+                    found = false;
+            }
+        }
     }
 
-    return XYZ_to_camera_weighted_matrix(
-        estimated_mired, mir1, mir2, matrix_start, matrix_end );
+    if ( !found )
+        estimated_mired = search_in_steps();
+
+    return to_flat_vector( XYZ_to_camera_weighted_matrix(
+        estimated_mired, mir1, mir2, matrix_start, matrix_end ) );
 }
 
 /// Convert correlated color temperature to CIE XYZ color values.
@@ -1101,33 +1781,30 @@ vector<double> color_temperature_to_XYZ( const double &cct )
 /// @param chromaticities Array of 4 xy chromaticity coordinates [R, G, B, W]
 /// @return 3×3 RGB to XYZ transformation matrix as a flattened vector
 /// @pre chromaticities must contain exactly 4 xy coordinate pairs
-vector<double> matrix_RGB_to_XYZ( const double chromaticities[][2] )
+static Mat3<double> RGB_to_XYZ( const double chromaticities[][2] )
 {
-    vector<double> red_XYZ =
-        xy_to_XYZ( vector<double>( chromaticities[0], chromaticities[0] + 2 ) );
-    vector<double> green_XYZ =
-        xy_to_XYZ( vector<double>( chromaticities[1], chromaticities[1] + 2 ) );
-    vector<double> blue_XYZ =
-        xy_to_XYZ( vector<double>( chromaticities[2], chromaticities[2] + 2 ) );
-    vector<double> white_XYZ =
-        xy_to_XYZ( vector<double>( chromaticities[3], chromaticities[3] + 2 ) );
-
-    vector<double> rgb_matrix( 9 );
+    auto xy_to_XYZ = []( const double xy[2] ) -> Vec3<double> {
+        return { xy[0], xy[1], 1 - xy[0] - xy[1] };
+    };
+
+    Vec3<double> red_XYZ   = xy_to_XYZ( chromaticities[0] );
+    Vec3<double> green_XYZ = xy_to_XYZ( chromaticities[1] );
+    Vec3<double> blue_XYZ  = xy_to_XYZ( chromaticities[2] );
+    Vec3<double> white_XYZ = xy_to_XYZ( chromaticities[3] );
+
+    Mat3<double> rgb_matrix;
     for ( int i = 0; i < 3; i++ )
-    {
-        rgb_matrix[0 + i * 3] = red_XYZ[i];
-        rgb_matrix[1 + i * 3] = green_XYZ[i];
-        rgb_matrix[2 + i * 3] = blue_XYZ[i];
-    }
+        rgb_matrix[i] = { red_XYZ[i], green_XYZ[i], blue_XYZ[i] };
 
-    scaleVector( white_XYZ, 1.0 / white_XYZ[1] );
+    white_XYZ = scale( white_XYZ, 1.0 / white_XYZ[1] );
 
-    vector<double> channel_gains =
-        mulVector( invertV( rgb_matrix ), white_XYZ, 3 );
-    vector<double> color_matrix =
-        mulVector( rgb_matrix, diagV( channel_gains ), 3 );
+    Vec3<double> channel_gains = multiply( invert( rgb_matrix ), white_XYZ );
+    return multiply( rgb_matrix, diagonal( channel_gains ) );
+}
 
-    return color_matrix;
+vector<double> matrix_RGB_to_XYZ( const double chromaticities[][2] )
+{
+    return to_flat_vector( RGB_to_XYZ( chromaticities ) );
 }
 
 /// Calculate camera XYZ transformation matrix and white point from metadata.
@@ -1149,73 +1826,65 @@ void get_camera_XYZ_matrix_and_white_point(
     std::vector<double> &out_camera_to_XYZ_matrix,
     std::vector<double> &out_camera_XYZ_white_point )
 {
-    out_camera_to_XYZ_matrix =
-        invertV( find_XYZ_to_camera_matrix( metadata, metadata.neutral_RGB ) );
-    assert( std::fabs( sumVector( out_camera_to_XYZ_matrix ) - 0.0 ) > 1e-09 );
+    Mat3<double> camera_to_XYZ_matrix = invert( to_Mat3(
+        find_XYZ_to_camera_matrix( metadata, metadata.neutral_RGB ) ) );
+    assert( std::fabs( sum( camera_to_XYZ_matrix ) - 0.0 ) > 1e-09 );
 
-    scaleVector(
-        out_camera_to_XYZ_matrix, std::pow( 2.0, metadata.baseline_exposure ) );
+    camera_to_XYZ_matrix = scale(
+        camera_to_XYZ_matrix, std::pow( 2.0, metadata.baseline_exposure ) );
 
+    Vec3<double> camera_XYZ_white_point;
     if ( metadata.neutral_RGB.size() > 0 )
     {
-        out_camera_XYZ_white_point =
-            mulVector( out_camera_to_XYZ_matrix, metadata.neutral_RGB );
+        camera_XYZ_white_point = multiply(
+            camera_to_XYZ_matrix, to_Vec3( metadata.neutral_RGB ) );
     }
     else
     {
-        out_camera_XYZ_white_point = color_temperature_to_XYZ(
-            light_source_to_color_temp( metadata.calibration[0].illuminant ) );
+        double cct =
+            light_source_to_color_temp( metadata.calibration[0].illuminant );
+        camera_XYZ_white_point = to_Vec3( color_temperature_to_XYZ( cct ) );
     }
 
-    scaleVector(
-        out_camera_XYZ_white_point, 1.0 / out_camera_XYZ_white_point[1] );
-    assert( sumVector( out_camera_XYZ_white_point ) != 0 );
+    camera_XYZ_white_point =
+        scale( camera_XYZ_white_point, 1.0 / camera_XYZ_white_point[1] );
+    assert(
+        camera_XYZ_white_point[0] + camera_XYZ_white_point[1] +
+            camera_XYZ_white_point[2] !=
+        0 );
+
+    out_camera_to_XYZ_matrix   = to_flat_vector( camera_to_XYZ_matrix );
+    out_camera_XYZ_white_point = to_vector( camera_XYZ_white_point );
 }
 
 vector<vector<double>> MetadataSolver::calculate_CAT_matrix()
 {
-    vector<double>      deviceWhiteV( 3, 1.0 );
     std::vector<double> camera_to_XYZ_matrix;
     std::vector<double> camera_XYZ_white_point;
     get_camera_XYZ_matrix_and_white_point(
         _metadata, camera_to_XYZ_matrix, camera_XYZ_white_point );
-    vector<double> output_RGB_to_XYZ_matrix =
-        matrix_RGB_to_XYZ( chromaticitiesACES );
-    vector<double> output_XYZ_white_point =
-        mulVector( output_RGB_to_XYZ_matrix, deviceWhiteV );
-    vector<vector<double>> CAT_matrix =
-        calculate_CAT( camera_XYZ_white_point, output_XYZ_white_point );
-
-    return CAT_matrix;
+
+    const Vec3<double> device_white           = { 1.0, 1.0, 1.0 };
+    Vec3<double>       output_XYZ_white_point = multiply(
+        RGB_to_XYZ( chromaticitiesACES ), device_white );
+
+    return to_vector( calculate_CAT(
+        to_Vec3( camera_XYZ_white_point ), output_XYZ_white_point ) );
 }
 
 vector<vector<double>> MetadataSolver::calculate_IDT_matrix()
 {
     // 1. Obtains the CAT matrix for white point adaptation
-    vector<vector<double>> CAT_matrix = calculate_CAT_matrix();
+    Mat3<double> CAT_matrix = to_Mat3( calculate_CAT_matrix() );
 
-    // 2. Converts the CAT matrix to a flattened format for matrix multiplication
-    vector<double> XYZ_D65_acesrgb( 9 ), CAT( 9 );
-    for ( size_t i = 0; i < 3; i++ )
-        for ( size_t j = 0; j < 3; j++ )
-        {
-            XYZ_D65_acesrgb[i * 3 + j] = XYZ_D65_acesrgb_3[i][j];
-            CAT[i * 3 + j]             = CAT_matrix[i][j];
-        }
+    // 2. Multiplies the D65 ACES RGB to XYZ matrix with the CAT matrix
+    Mat3<double> DNG_IDT_matrix =
+        multiply( to_Mat3( XYZ_D65_acesrgb_3 ), CAT_matrix );
 
-    // 3. Multiplies the D65 ACES RGB to XYZ matrix with the CAT matrix
-    vector<double> matrix = mulVector( XYZ_D65_acesrgb, CAT, 3 );
+    // 3. Validates the matrix properties (non-zero determinant)
+    assert( std::fabs( sum( DNG_IDT_matrix ) - 0.0 ) > 1e-09 );
 
-    // 4. Reshapes the result into a 3×3 transformation matrix
-    vector<vector<double>> DNG_IDT_matrix( 3, vector<double>( 3 ) );
-    for ( size_t i = 0; i < 3; i++ )
-        for ( size_t j = 0; j < 3; j++ )
-            DNG_IDT_matrix[i][j] = matrix[i * 3 + j];
-
-    // 5. Validates the matrix properties (non-zero determinant)
-    assert( std::fabs( sumVectorM( DNG_IDT_matrix ) - 0.0 ) > 1e-09 );
-
-    return DNG_IDT_matrix;
+    return to_vector( DNG_IDT_matrix );
 }
 
 /// Cost function operator for Ceres optimization of IDT matrix parameters.
@@ -1237,16 +1906,29 @@ vector<vector<double>> MetadataSolver::calculate_IDT_matrix()
 template <typename T>
 bool IDTOptimizationCost::operator()( const T *beta_params, T *residuals ) const
 {
-    vector<vector<T>> RGB_copy( _in_RGB.size(), vector<T>( 3 ) );
-    for ( size_t i = 0; i < _in_RGB.size(); i++ )
-        for ( size_t j = 0; j < 3; j++ )
-            RGB_copy[i][j] = T( _in_RGB[i][j] );
+    // Same as XYZ_to_LAB( getCalcXYZt( RGB, beta_params ) ), without
+    // allocating any temporaries. The matrix gets applied to the patches as
+    // they are, so the Jets only get created for the products.
+    const Mat3<T> MBV = calculate_normalised_IDT_to_XYZ( beta_params );
 
-    vector<vector<T>> out_calc_LAB =
-        XYZ_to_LAB( getCalcXYZt( RGB_copy, beta_params ) );
-    for ( size_t i = 0; i < _in_RGB.size(); i++ )
+    const double *R = _patches.RGB[0].data();
+    const double *G = _patches.RGB[1].data();
+    const double *B = _patches.RGB[2].data();
+
+    for ( size_t i = 0; i < _patches.size(); i++ )
+    {
+        T f[3];
         for ( size_t j = 0; j < 3; j++ )
-            residuals[i * 3 + j] = _out_LAB[i][j] - out_calc_LAB[i][j];
+        {
+            f[j] = LAB_transfer(
+                MBV[j][0] * R[i] + MBV[j][1] * G[i] + MBV[j][2] * B[i] );
+        }
+
+        T *r = residuals + i * 3;
+        r[0] = _patches.LAB[0][i] - ( 116.0 * f[1] - 16.0 );
+        r[1] = _patches.LAB[1][i] - 500.0 * ( f[0] - f[1] );
+        r[2] = _patches.LAB[2][i] - 200.0 * ( f[1] - f[2] );
+    }
 
     return true;
 }
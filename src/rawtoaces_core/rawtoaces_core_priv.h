@@ -6,6 +6,11 @@
 // Contains the declarations of the private functions,
 // exposed here for unit-testing.
 
+namespace ceres
+{
+class CostFunction;
+} // namespace ceres
+
 namespace rta
 {
 namespace core
@@ -13,6 +18,12 @@ namespace core
 
 std::vector<double> CCT_to_xy( const double &cctd );
 
+void generate_illuminant(
+    int                cct,
+    const std::string &type,
+    bool               is_daylight,
+    SpectralData      &illuminant );
+
 void scale_illuminant( const SpectralData &camera, SpectralData &illuminant );
 
 std::vector<double>
@@ -24,22 +35,59 @@ std::vector<Spectrum> calculate_TI(
 std::vector<double>
 _calculate_WB( const SpectralData &camera, SpectralData &illuminant );
 
-std::vector<std::vector<double>> calculate_XYZ(
+std::vector<std::array<double, 3>> calculate_XYZ(
     const SpectralData          &observer,
     const SpectralData          &illuminant,
     const std::vector<Spectrum> &TI );
 
-std::vector<std::vector<double>> calculate_RGB(
+void adapt_XYZ(
+    const SpectralData                 &observer,
+    const SpectralData                 &illuminant,
+    std::vector<std::array<double, 3>> &XYZ );
+
+std::vector<std::array<double, 3>> calculate_RGB(
     const SpectralData          &camera,
     const std::vector<double>   &WB_multipliers,
     const std::vector<Spectrum> &TI );
 
 bool curveFit(
-    const std::vector<std::vector<double>> &RGB,
-    const std::vector<std::vector<double>> &XYZ,
-    double                                 *B,
-    int                                     verbosity,
-    std::vector<std::vector<double>>       &out_IDT_matrix );
+    const std::vector<std::array<double, 3>> &RGB,
+    const std::vector<std::array<double, 3>> &XYZ,
+    double                                   *B,
+    int                                       verbosity,
+    std::vector<std::vector<double>>         &out_IDT_matrix,
+    bool                                      fast         = false,
+    int                                       thread_count = 1 );
+
+/// The training patches of the IDT matrix fitting in the structure-of-arrays
+/// layout, so evaluating the cost walks a few contiguous arrays instead of a
+/// vector per patch.
+struct IDTTrainingSet
+{
+    IDTTrainingSet(
+        const std::vector<std::array<double, 3>> &RGB,
+        const std::vector<std::array<double, 3>> &LAB );
+
+    /// The number of the patches.
+    size_t size() const { return RGB[0].size(); }
+
+    /// The camera RGB responses, one array per channel.
+    std::vector<double> RGB[3];
+
+    /// The target LAB values, one array per component.
+    std::vector<double> LAB[3];
+};
+
+void evaluate_IDT_cost(
+    const IDTTrainingSet &patches,
+    const double         *beta_params,
+    double               *residuals,
+    double               *jacobian );
+
+ceres::CostFunction *create_IDT_cost_function(
+    const std::vector<std::array<double, 3>> &RGB,
+    const std::vector<std::array<double, 3>> &out_LAB,
+    bool                                      fast );
 
 double CCT_to_mired( const double cct );
 double mired_to_CCT( const double mired );
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <nlohmann/json.hpp>
 
 namespace rta
@@ -166,6 +167,102 @@ double Spectrum::max() const
     return *std::max_element( values.begin(), values.end() );
 }
 
+// The kernels below keep several independent partial sums, so the compiler
+// can vectorise the loops without relaxing the floating point semantics.
+
+/// The sum of the per-element products of `a` and `b`.
+static double dot( const double *a, const double *b, size_t size )
+{
+    double sum[4] = { 0, 0, 0, 0 };
+
+    size_t i = 0;
+    for ( ; i + 4 <= size; i += 4 )
+    {
+        sum[0] += a[i + 0] * b[i + 0];
+        sum[1] += a[i + 1] * b[i + 1];
+        sum[2] += a[i + 2] * b[i + 2];
+        sum[3] += a[i + 3] * b[i + 3];
+    }
+    for ( ; i < size; i++ )
+        sum[0] += a[i] * b[i];
+
+    return ( sum[0] + sum[1] ) + ( sum[2] + sum[3] );
+}
+
+/// The sums of the per-element products of `a` with each of `b0`, `b1` and
+/// `b2`, reading `a` only once.
+static void dot3(
+    const double *a,
+    const double *b0,
+    const double *b1,
+    const double *b2,
+    size_t        size,
+    double       *result )
+{
+    double sum0[2] = { 0, 0 };
+    double sum1[2] = { 0, 0 };
+    double sum2[2] = { 0, 0 };
+
+    size_t i = 0;
+    for ( ; i + 2 <= size; i += 2 )
+    {
+        sum0[0] += a[i + 0] * b0[i + 0];
+        sum0[1] += a[i + 1] * b0[i + 1];
+        sum1[0] += a[i + 0] * b1[i + 0];
+        sum1[1] += a[i + 1] * b1[i + 1];
+        sum2[0] += a[i + 0] * b2[i + 0];
+        sum2[1] += a[i + 1] * b2[i + 1];
+    }
+    for ( ; i < size; i++ )
+    {
+        sum0[0] += a[i] * b0[i];
+        sum1[0] += a[i] * b1[i];
+        sum2[0] += a[i] * b2[i];
+    }
+
+    result[0] = sum0[0] + sum0[1];
+    result[1] = sum1[0] + sum1[1];
+    result[2] = sum2[0] + sum2[1];
+}
+
+double multiply_integrate( const Spectrum &lhs, const Spectrum &rhs )
+{
+    assert( lhs.shape == rhs.shape );
+    assert( lhs.values.size() == rhs.values.size() );
+
+    return dot( lhs.values.data(), rhs.values.data(), lhs.values.size() );
+}
+
+void multiply_integrate(
+    const std::vector<Spectrum>        &spectra,
+    const Spectrum                     &weights_0,
+    const Spectrum                     &weights_1,
+    const Spectrum                     &weights_2,
+    std::vector<std::array<double, 3>> &out_integrals )
+{
+    assert( weights_0.shape == weights_1.shape );
+    assert( weights_0.shape == weights_2.shape );
+    assert( weights_0.values.size() == weights_1.values.size() );
+    assert( weights_0.values.size() == weights_2.values.size() );
+
+    out_integrals.resize( spectra.size() );
+
+    for ( size_t i = 0; i < spectra.size(); i++ )
+    {
+        const Spectrum &spectrum = spectra[i];
+        assert( spectrum.shape == weights_0.shape );
+        assert( spectrum.values.size() == weights_0.values.size() );
+
+        dot3(
+            spectrum.values.data(),
+            weights_0.values.data(),
+            weights_1.values.data(),
+            weights_2.values.data(),
+            spectrum.values.size(),
+            out_integrals[i].data() );
+    }
+}
+
 inline void
 parse_string( nlohmann::json &j, std::string &dst, const std::string &key )
 {
@@ -335,6 +432,132 @@ bool SpectralData::load( const std::string &path, bool reshape )
     return true;
 }
 
+/// A streaming JSON parser collecting the string values of the `header`
+/// object of a spectral data file. Stops parsing at the end of the header.
+class HeaderParser : public nlohmann::json_sax<nlohmann::json>
+{
+public:
+    /// The string values of the header, keyed by name.
+    std::map<std::string, std::string> values;
+
+    /// The parse error if any.
+    std::string error;
+
+    bool null() override { return true; }
+    bool boolean( bool ) override { return true; }
+    bool number_integer( number_integer_t ) override { return true; }
+    bool number_unsigned( number_unsigned_t ) override { return true; }
+    bool number_float( number_float_t, const string_t & ) override
+    {
+        return true;
+    }
+    bool binary( binary_t & ) override { return true; }
+
+    bool string( string_t &value ) override
+    {
+        if ( _in_header && _depth == 2 )
+            values[_key] = value;
+        return true;
+    }
+
+    bool start_object( std::size_t ) override
+    {
+        _depth++;
+        if ( _depth == 2 && _key == "header" )
+            _in_header = true;
+        return true;
+    }
+
+    bool end_object() override
+    {
+        if ( _in_header && _depth == 2 )
+        {
+            // Returning `false` stops the parser.
+            return false;
+        }
+        _depth--;
+        return true;
+    }
+
+    bool start_array( std::size_t ) override
+    {
+        _depth++;
+        return true;
+    }
+
+    bool end_array() override
+    {
+        _depth--;
+        return true;
+    }
+
+    bool key( string_t &value ) override
+    {
+        if ( _depth == 1 || ( _in_header && _depth == 2 ) )
+            _key = value;
+        return true;
+    }
+
+    bool parse_error(
+        std::size_t,
+        const std::string &,
+        const nlohmann::detail::exception &exception ) override
+    {
+        error = exception.what();
+        return false;
+    }
+
+private:
+    size_t      _depth     = 0;
+    bool        _in_header = false;
+    std::string _key;
+};
+
+bool SpectralData::load_header( const std::string &path )
+{
+    // Reset all in case the object has been initialised before.
+    *this = SpectralData();
+
+    std::ifstream i( path );
+    if ( !i.is_open() )
+    {
+        std::cerr << "Error: Failed to open file " << path << "." << std::endl;
+        return false;
+    }
+
+    HeaderParser parser;
+    nlohmann::json::sax_parse( i, &parser );
+    if ( !parser.error.empty() )
+    {
+        std::cerr << "Error: JSON parsing of " << path
+                  << " failed with error: " << parser.error << std::endl;
+        return false;
+    }
+
+    auto value = [&parser]( const std::string &key ) {
+        auto iter = parser.values.find( key );
+        return iter != parser.values.end() ? iter->second : std::string();
+    };
+
+    manufacturer          = value( "manufacturer" );
+    model                 = value( "model" );
+    type                  = value( "type" );
+    description           = value( "description" );
+    document_creator      = value( "document_creator" );
+    unique_identifier     = value( "unique_identifier" );
+    measurement_equipment = value( "measurement_equipment" );
+    laboratory            = value( "laboratory" );
+    creation_date         = value( "document_creation_date" );
+    comments              = value( "comments" );
+    license               = value( "license" );
+
+    // Same as in `load()`.
+    if ( type.empty() && value( "schema_version" ) == "0.1.0" )
+        type = value( "illuminant" );
+
+    return true;
+}
+
 Spectrum &SpectralData::get( std::string set_name, std::string channel_name )
 {
     if ( data.count( set_name ) != 1 )
@@ -0,0 +1,502 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include <rawtoaces/spectral_database.h>
+
+#include "mapped_database.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+namespace rta
+{
+namespace core
+{
+
+const std::string SpectralDatabase::index_filename  = "index.json";
+const std::string SpectralDatabase::binary_filename = "database.bin";
+
+/// The data types indexed by the database, in the order they get scanned.
+/// Only the cameras and the illuminants get looked up by their headers, the
+/// rest only by path.
+static const std::vector<std::string> indexed_data_types = {
+    "camera", "illuminant", "cmf", "training"
+};
+
+/// The data types searched by `SpectralSolver::collect_data_files()`.
+static const std::vector<std::string> searched_data_types = { "camera",
+                                                              "illuminant" };
+
+static std::string to_lower( const std::string &str )
+{
+    std::string result = str;
+    std::transform(
+        result.begin(), result.end(), result.begin(), []( unsigned char c ) {
+            return static_cast<char>( std::tolower( c ) );
+        } );
+    return result;
+}
+
+static std::string
+camera_key( const std::string &make, const std::string &model )
+{
+    return to_lower( make ) + "\n" + to_lower( model );
+}
+
+/// The path of a data file relative to the database directory, as stored in
+/// the index file.
+static std::string
+relative_path( const std::string &data_type, const std::string &path )
+{
+    return data_type + "/" + std::filesystem::path( path ).filename().string();
+}
+
+/// Report the missing database directories the same way
+/// `SpectralSolver::collect_data_files()` does.
+static void
+report_missing_directories( const std::vector<std::string> &directories )
+{
+    for ( const auto &directory: directories )
+    {
+        if ( !std::filesystem::is_directory( directory ) )
+        {
+            std::cerr << "WARNING: Database location '" << directory
+                      << "' is not a directory." << std::endl;
+            continue;
+        }
+
+        for ( const auto &data_type: searched_data_types )
+        {
+            std::filesystem::path type_path( directory );
+            type_path.append( data_type );
+            if ( !std::filesystem::exists( type_path ) )
+            {
+                std::cerr << "WARNING: Directory '" << type_path.string()
+                          << "' does not exist." << std::endl;
+            }
+        }
+    }
+}
+
+bool SpectralDatabase::FileState::operator==( const FileState &other ) const
+{
+    return path == other.path && size == other.size && time == other.time;
+}
+
+std::vector<SpectralDatabase::FileState> SpectralDatabase::list_files(
+    const std::vector<std::string> &search_directories )
+{
+    std::vector<FileState> result;
+
+    for ( const auto &directory: search_directories )
+    {
+        std::error_code ec;
+        if ( !std::filesystem::is_directory( directory, ec ) )
+            continue;
+
+        for ( const auto &data_type: indexed_data_types )
+        {
+            std::filesystem::path type_path( directory );
+            type_path.append( data_type );
+            if ( !std::filesystem::exists( type_path, ec ) )
+                continue;
+
+            auto it = std::filesystem::directory_iterator( type_path, ec );
+            if ( ec )
+                continue;
+
+            for ( const auto &filename: it )
+            {
+                auto path = filename.path();
+                if ( path.extension() != ".json" )
+                    continue;
+
+                FileState &state = result.emplace_back();
+                state.directory  = directory;
+                state.data_type  = data_type;
+                state.path       = path.string();
+                state.size       = std::filesystem::file_size( path, ec );
+                state.time       = static_cast<long long>(
+                    std::filesystem::last_write_time( path, ec )
+                        .time_since_epoch()
+                        .count() );
+            }
+        }
+    }
+
+    return result;
+}
+
+/// The modification times of the database directories and of their data type
+/// directories, 0 for the missing ones.
+std::vector<long long> SpectralDatabase::list_directory_times(
+    const std::vector<std::string> &search_directories )
+{
+    std::vector<long long> result;
+
+    auto add_time = [&result]( const std::filesystem::path &path ) {
+        std::error_code ec;
+        auto            time = std::filesystem::last_write_time( path, ec );
+        if ( ec )
+            result.push_back( 0 );
+        else
+            result.push_back( time.time_since_epoch().count() );
+    };
+
+    for ( const auto &directory: search_directories )
+    {
+        add_time( directory );
+        for ( const auto &data_type: indexed_data_types )
+        {
+            std::filesystem::path type_path( directory );
+            type_path.append( data_type );
+            add_time( type_path );
+        }
+    }
+
+    return result;
+}
+
+/// Read the index file of a database directory.
+/// @result the index entries keyed by the relative path of the data file.
+static std::map<std::string, nlohmann::json>
+read_index_file( const std::string &directory )
+{
+    std::map<std::string, nlohmann::json> result;
+
+    std::filesystem::path index_path( directory );
+    index_path.append( SpectralDatabase::index_filename );
+
+    std::ifstream file( index_path );
+    if ( !file.is_open() )
+        return result;
+
+    try
+    {
+        nlohmann::json index = nlohmann::json::parse( file );
+        for ( const auto &item: index.at( "files" ) )
+        {
+            result[item.at( "path" ).get<std::string>()] = item;
+        }
+    }
+    catch ( const std::exception &error )
+    {
+        std::cerr << "WARNING: Ignoring the database index "
+                  << index_path.string() << ": " << error.what() << std::endl;
+        result.clear();
+    }
+
+    return result;
+}
+
+/// Map the compiled database of a database directory.
+/// @result the compiled database, or `nullptr` if missing or invalid.
+static std::shared_ptr<const MappedDatabase>
+open_binary_file( const std::string &directory )
+{
+    std::filesystem::path binary_path( directory );
+    binary_path.append( SpectralDatabase::binary_filename );
+
+    auto binary = std::make_shared<MappedDatabase>();
+    if ( !binary->open( binary_path.string() ) )
+        return nullptr;
+    return binary;
+}
+
+SpectralDatabase::SpectralDatabase(
+    const std::vector<std::string> &search_directories )
+    : _search_directories( search_directories )
+    , _directory_times( list_directory_times( search_directories ) )
+    , _files( list_files( search_directories ) )
+{
+    std::map<std::string, std::map<std::string, nlohmann::json>> indices;
+    std::map<std::string, std::shared_ptr<const MappedDatabase>> binaries;
+
+    for ( const auto &file: _files )
+    {
+        auto binary_iter = binaries.find( file.directory );
+        if ( binary_iter == binaries.end() )
+        {
+            auto binary = open_binary_file( file.directory );
+            if ( binary )
+                _binaries.push_back( binary );
+            binary_iter = binaries.emplace( file.directory, binary ).first;
+        }
+
+        auto index_iter = indices.find( file.directory );
+        if ( index_iter == indices.end() )
+        {
+            // The index is not needed if the directory has been compiled.
+            std::map<std::string, nlohmann::json> index;
+            if ( !binary_iter->second )
+                index = read_index_file( file.directory );
+            index_iter = indices.emplace( file.directory, index ).first;
+        }
+
+        Entry entry;
+        entry.path      = file.path;
+        entry.data_type = file.data_type;
+
+        const auto *binary   = binary_iter->second.get();
+        auto        relative = relative_path( file.data_type, file.path );
+        bool        indexed  = false;
+        if ( binary )
+        {
+            size_t binary_index = binary->find( relative );
+            if ( binary_index < binary->size() )
+            {
+                auto item = binary->item( binary_index );
+                if ( item.size == file.size && item.time == file.time )
+                {
+                    entry.manufacturer = item.data.manufacturer;
+                    entry.model        = item.data.model;
+                    entry.type         = item.data.type;
+                    entry.binary       = binary;
+                    entry.binary_index = binary_index;
+                    indexed            = true;
+                }
+            }
+        }
+
+        const auto &items     = index_iter->second;
+        auto        item_iter = items.find( relative );
+        if ( !indexed && item_iter != items.end() )
+        {
+            const nlohmann::json &item = item_iter->second;
+            try
+            {
+                if ( item.at( "size" ).get<uintmax_t>() == file.size &&
+                     item.at( "time" ).get<long long>() == file.time )
+                {
+                    entry.manufacturer =
+                        item.at( "manufacturer" ).get<std::string>();
+                    entry.model = item.at( "model" ).get<std::string>();
+                    entry.type  = item.at( "type" ).get<std::string>();
+                    indexed     = true;
+                }
+            }
+            catch ( const std::exception & )
+            {
+                // Fall back to parsing the file below.
+            }
+        }
+
+        // The files only looked up by path get parsed on first use.
+        bool by_path_only =
+            file.data_type != "camera" && file.data_type != "illuminant";
+
+        if ( !indexed && !by_path_only )
+        {
+            auto data = std::make_shared<SpectralData>();
+            if ( !data->load( file.path ) )
+                continue;
+
+            entry.manufacturer = data->manufacturer;
+            entry.model        = data->model;
+            entry.type         = data->type;
+            entry.data         = data;
+        }
+
+        size_t index = _entries.size();
+        _entries.push_back( entry );
+
+        // The first file found for a key takes precedence, same as in the
+        // sequential search done by SpectralSolver.
+        _paths.emplace( relative, index );
+        if ( file.data_type == "camera" )
+        {
+            _cameras.emplace(
+                camera_key( entry.manufacturer, entry.model ), index );
+        }
+        else if ( file.data_type == "illuminant" )
+        {
+            _illuminants.emplace( to_lower( entry.type ), index );
+        }
+    }
+}
+
+std::shared_ptr<const SpectralDatabase> SpectralDatabase::get(
+    const std::vector<std::string> &search_directories, int verbosity )
+{
+    static std::mutex mutex;
+    static std::map<
+        std::vector<std::string>,
+        std::shared_ptr<const SpectralDatabase>>
+        databases;
+
+    if ( verbosity > 0 )
+        report_missing_directories( search_directories );
+
+    std::shared_ptr<const SpectralDatabase> database;
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+
+        auto iter = databases.find( search_directories );
+        if ( iter != databases.end() )
+            database = iter->second;
+    }
+
+    // The directories get checked and the index gets built without holding
+    // the lock, so the callers using other databases or an unchanged one
+    // never wait on the file system.
+    if ( database &&
+         database->_directory_times ==
+             list_directory_times( search_directories ) )
+        return database;
+
+    database = std::make_shared<const SpectralDatabase>( search_directories );
+
+    std::lock_guard<std::mutex> lock( mutex );
+    databases[search_directories] = database;
+    return database;
+}
+
+std::shared_ptr<const SpectralData>
+SpectralDatabase::load( const Entry &entry ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    if ( !entry.data )
+    {
+        auto data = std::make_shared<SpectralData>();
+        if ( entry.binary )
+            entry.binary->decode( entry.binary_index, *data );
+        else if ( !data->load( entry.path ) )
+            return nullptr;
+        entry.data = data;
+    }
+    return entry.data;
+}
+
+std::shared_ptr<const SpectralData> SpectralDatabase::find_camera(
+    const std::string &make, const std::string &model ) const
+{
+    auto iter = _cameras.find( camera_key( make, model ) );
+    if ( iter == _cameras.end() )
+        return nullptr;
+    return load( _entries[iter->second] );
+}
+
+std::shared_ptr<const SpectralData>
+SpectralDatabase::find_illuminant( const std::string &type ) const
+{
+    auto iter = _illuminants.find( to_lower( type ) );
+    if ( iter == _illuminants.end() )
+        return nullptr;
+    return load( _entries[iter->second] );
+}
+
+std::vector<std::shared_ptr<const SpectralData>>
+SpectralDatabase::illuminants() const
+{
+    std::vector<std::shared_ptr<const SpectralData>> result;
+
+    for ( const auto &entry: _entries )
+    {
+        if ( entry.data_type != "illuminant" )
+            continue;
+
+        auto data = load( entry );
+        if ( data )
+            result.push_back( data );
+    }
+    return result;
+}
+
+std::shared_ptr<const SpectralData>
+SpectralDatabase::find_file( const std::string &relative_path ) const
+{
+    auto iter = _paths.find( relative_path );
+    if ( iter == _paths.end() )
+        return nullptr;
+    return load( _entries[iter->second] );
+}
+
+bool SpectralDatabase::is_up_to_date() const
+{
+    return list_files( _search_directories ) == _files;
+}
+
+bool SpectralDatabase::write_index( const std::string &directory )
+{
+    SpectralDatabase database( { directory } );
+
+    nlohmann::json files = nlohmann::json::array();
+    for ( const auto &entry: database._entries )
+    {
+        auto file = std::find_if(
+            database._files.begin(),
+            database._files.end(),
+            [&entry]( const FileState &state ) {
+                return state.path == entry.path;
+            } );
+        if ( file == database._files.end() )
+            continue;
+
+        nlohmann::json item;
+        item["path"]         = relative_path( entry.data_type, entry.path );
+        item["size"]         = file->size;
+        item["time"]         = file->time;
+        item["manufacturer"] = entry.manufacturer;
+        item["model"]        = entry.model;
+        item["type"]         = entry.type;
+        files.push_back( item );
+    }
+
+    nlohmann::json index;
+    index["files"] = files;
+
+    std::filesystem::path index_path( directory );
+    index_path.append( index_filename );
+
+    std::ofstream file( index_path );
+    if ( !file.is_open() )
+    {
+        std::cerr << "ERROR: Failed to write the database index "
+                  << index_path.string() << "." << std::endl;
+        return false;
+    }
+
+    file << index.dump( 4 ) << std::endl;
+    return static_cast<bool>( file );
+}
+
+bool SpectralDatabase::write_binary( const std::string &directory )
+{
+    SpectralDatabase database( { directory } );
+
+    std::vector<MappedDatabase::Item> items;
+    for ( const auto &entry: database._entries )
+    {
+        auto file = std::find_if(
+            database._files.begin(),
+            database._files.end(),
+            [&entry]( const FileState &state ) {
+                return state.path == entry.path;
+            } );
+        if ( file == database._files.end() )
+            continue;
+
+        auto data = database.load( entry );
+        if ( !data )
+            continue;
+
+        MappedDatabase::Item &item = items.emplace_back();
+        item.path      = relative_path( entry.data_type, entry.path );
+        item.data_type = entry.data_type;
+        item.size      = file->size;
+        item.time      = file->time;
+        item.data      = *data;
+    }
+
+    std::filesystem::path binary_path( directory );
+    binary_path.append( binary_filename );
+    return MappedDatabase::write( binary_path.string(), items );
+}
+
+} // namespace core
+} // namespace rta
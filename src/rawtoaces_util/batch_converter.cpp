@@ -0,0 +1,927 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include <rawtoaces/batch_converter.h>
+
+#include "bounded_queue.h"
+#include "job_manifest.h"
+#include "rawtoaces_util_priv.h"
+#include "transform_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <OpenImageIO/imageio.h>
+
+namespace rta
+{
+namespace util
+{
+
+/// Run `stage` of converting the file of `result`, treating an exception as
+/// a failure.
+bool run_stage( const BatchResult &result, const std::function<bool()> &stage )
+{
+    try
+    {
+        return stage();
+    }
+    catch ( const std::exception &e )
+    {
+        std::cerr << "ERROR: Exception while processing file '"
+                  << result.input_filename << "': " << e.what() << std::endl;
+        return false;
+    }
+}
+
+/// Store the transform solved by `converter` in `result`.
+void record_transform( const ImageConverter &converter, BatchResult &result )
+{
+    result.WB_multipliers = converter.get_WB_multipliers();
+    result.IDT_matrix     = converter.get_IDT_matrix();
+    result.CAT_matrix     = converter.get_CAT_matrix();
+}
+
+/// Convert a single file using the given `converter` and store the outcome
+/// in `result`. The solved transform is only recorded on success, as the
+/// converter may still hold the transform of the previous file otherwise.
+void convert_file( ImageConverter &converter, BatchResult &result )
+{
+    result.success = run_stage( result, [&]() {
+        return converter.process_image( result.input_filename );
+    } );
+
+    if ( result.success )
+    {
+        record_transform( converter, result );
+        result.output_filename = converter.get_output_filename();
+    }
+}
+
+/// Run `task` for every index below `count` on up to `jobs` threads,
+/// including the calling thread.
+void parallel_for(
+    size_t count, size_t jobs, const std::function<void( size_t )> &task )
+{
+    std::atomic<size_t> next_index( 0 );
+
+    auto worker = [&]() {
+        for ( size_t index = next_index++; index < count; index = next_index++ )
+            task( index );
+    };
+
+    std::vector<std::thread> workers;
+    for ( size_t i = 1; i < std::min( jobs, count ); i++ )
+    {
+        workers.emplace_back( worker );
+    }
+    worker();
+
+    for ( auto &thread: workers )
+    {
+        thread.join();
+    }
+}
+
+/// The number of threads to read the metadata of the files on. Reading the
+/// metadata is mostly waiting for storage, so use all hardware threads
+/// unless the number of jobs is given.
+size_t metadata_jobs( const ImageConverter::Settings &settings )
+{
+    size_t jobs = settings.jobs > 1 ? static_cast<size_t>( settings.jobs )
+                                    : std::thread::hardware_concurrency();
+    return std::max<size_t>( jobs, 1 );
+}
+
+/// The hit and miss counts of the colour transform caches, by cache name.
+std::vector<std::tuple<std::string, uint64_t, uint64_t>> cache_counts()
+{
+    std::vector<std::tuple<std::string, uint64_t, uint64_t>> counts;
+    auto add = [&counts]( const auto &cache ) {
+        counts.emplace_back( cache.name, cache.hits, cache.misses );
+    };
+
+    add( cache::get_WB_from_illuminant_cache() );
+    add( cache::get_illuminant_from_WB_cache() );
+    add( cache::get_matrix_from_illuminant_cache() );
+    add( cache::get_matrix_from_dng_metadata_cache() );
+    add( cache::get_CCT_table_cache() );
+    return counts;
+}
+
+/// Solves the colour transforms of the files of a batch on background
+/// threads, in the order of the files, skipping the files the conversion has
+/// already reached, see `reached()`, and the files sharing the transform key
+/// of a file solved before, see `ImageConverter::read_transform_key()`. The
+/// transforms land in the caches shared within the process, where the
+/// conversions find them. A conversion reaching a file being solved waits
+/// for the cache entry instead of solving it again.
+class SolveAhead
+{
+public:
+    /// Start solving.
+    /// @param files the paths of the files of the batch, empty for the files
+    ///     not to solve.
+    /// @param settings the conversion settings.
+    /// @param tracer the tracer to record the spans into, or `nullptr`.
+    /// @param threads the number of the background threads.
+    SolveAhead(
+        const std::vector<std::string> &files,
+        const ImageConverter::Settings &settings,
+        const std::shared_ptr<Tracer>  &tracer,
+        size_t                          threads )
+        : _files( files )
+    {
+        for ( size_t i = 0; i < threads; i++ )
+        {
+            _threads.emplace_back( [this, settings, tracer]() {
+                ImageConverter converter;
+                converter.settings = settings;
+                converter.tracer   = tracer;
+
+                // The conversion reports the errors of the file.
+                converter.settings.verbosity = 0;
+
+                for ( size_t index = _next++;
+                      index < _files.size() && !_stopping;
+                      index = _next++ )
+                {
+                    solve( converter, index );
+                }
+            } );
+        }
+    }
+
+    /// Stop solving, and wait for the solves in progress.
+    ~SolveAhead()
+    {
+        _stopping = true;
+        for ( auto &thread: _threads )
+            thread.join();
+    }
+
+    SolveAhead( const SolveAhead & )            = delete;
+    SolveAhead &operator=( const SolveAhead & ) = delete;
+
+    /// Tell that the conversion has reached the file at `index`, so neither
+    /// the file nor the files before need solving ahead any more.
+    void reached( size_t index )
+    {
+        size_t current = _reached;
+        while ( current <= index &&
+                !_reached.compare_exchange_weak( current, index + 1 ) )
+        {
+        }
+    }
+
+private:
+    void solve( ImageConverter &converter, size_t index )
+    {
+        const auto &file = _files[index];
+        if ( file.empty() || index < _reached )
+            return;
+
+        try
+        {
+            std::string key;
+            if ( !converter.read_transform_key( file, key ) )
+                return;
+
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                if ( !_keys.insert( key ).second )
+                    return;
+            }
+
+            Tracer::Scope trace_scope( converter.tracer.get(), file );
+            TraceSpan     trace_span( "solve_ahead", "solver" );
+            converter.solve_transform( file );
+        }
+        catch ( const std::exception & )
+        {
+            // The conversion of the file reports the error.
+        }
+    }
+
+    const std::vector<std::string> _files;
+
+    std::atomic<size_t> _next     = 0;
+    std::atomic<size_t> _reached  = 0;
+    std::atomic<bool>   _stopping = false;
+
+    std::mutex            _mutex;
+    std::set<std::string> _keys;
+
+    std::vector<std::thread> _threads;
+};
+
+/// A file travelling through the stages of `BatchConverter::process_pipelined`.
+struct PipelineItem
+{
+    size_t                          index = 0;
+    std::unique_ptr<ImageConverter> converter;
+    std::string                     output_filename;
+    OIIO::ImageBuf                  buffer;
+    bool                            success = false;
+};
+
+std::vector<ScanResult> scan_metadata(
+    const std::vector<std::string> &files,
+    const ImageConverter::Settings &settings,
+    bool                            solve )
+{
+    const size_t jobs = metadata_jobs( settings );
+
+    std::vector<ScanResult>  results( files.size() );
+    std::vector<std::string> keys( files.size() );
+    parallel_for( files.size(), jobs, [&]( size_t index ) {
+        ImageConverter converter;
+        converter.settings = settings;
+
+        BatchResult file_result;
+        file_result.input_filename = files[index];
+
+        auto &result          = results[index];
+        result.input_filename = files[index];
+
+        OIIO::ImageSpec spec;
+        result.success = run_stage( file_result, [&]() {
+            return converter.read_metadata( files[index], spec );
+        } );
+        if ( !result.success )
+            return;
+
+        keys[index]         = ImageConverter::transform_key( spec );
+        result.camera_make  = spec.get_string_attribute( "cameraMake" );
+        result.camera_model = spec.get_string_attribute( "cameraModel" );
+        result.width        = spec.width;
+        result.height       = spec.height;
+        result.DNG_version  = spec.get_int_attribute( "raw:dng:version" );
+
+        auto pre_mul = spec.find_attribute(
+            "raw:pre_mul", OIIO::TypeDesc( OIIO::TypeDesc::FLOAT, 4 ) );
+        if ( pre_mul )
+        {
+            for ( int i = 0; i < 4; i++ )
+                result.pre_mul.push_back( pre_mul->get_float_indexed( i ) );
+        }
+
+        for ( int i = 0; i < 2; i++ )
+        {
+            result.calibration_illuminants[i] = spec.get_int_attribute(
+                "raw:dng:calibration_illuminant" + std::to_string( i + 1 ) );
+        }
+    } );
+
+    std::map<std::string, size_t> setups;
+    std::vector<size_t>           first_files;
+    for ( size_t i = 0; i < results.size(); i++ )
+    {
+        if ( !results[i].success )
+            continue;
+
+        auto iter = setups.emplace( keys[i], first_files.size() ).first;
+        if ( iter->second == first_files.size() )
+            first_files.push_back( i );
+        results[i].setup = iter->second;
+    }
+
+    if ( solve )
+    {
+        std::vector<char> solved( first_files.size(), false );
+        parallel_for( first_files.size(), jobs, [&]( size_t setup ) {
+            ImageConverter converter;
+            converter.settings = settings;
+
+            BatchResult file_result;
+            file_result.input_filename = files[first_files[setup]];
+
+            solved[setup] = run_stage( file_result, [&]() {
+                return converter.solve_transform( file_result.input_filename );
+            } );
+        } );
+
+        for ( auto &result: results )
+            result.solved = result.success && solved[result.setup];
+    }
+
+    return results;
+}
+
+void write_scan_table(
+    std::ostream                  &stream,
+    const std::vector<ScanResult> &results,
+    bool                           solve )
+{
+    stream << "file\tmake\tmodel\twidth\theight\tpre_mul\tdng_version"
+           << "\tdng_illuminants\tsetup";
+    if ( solve )
+        stream << "\tsolved";
+    stream << std::endl;
+
+    for ( const auto &result: results )
+    {
+        stream << result.input_filename;
+        if ( !result.success )
+        {
+            stream << "\terror" << std::endl;
+            continue;
+        }
+
+        stream << "\t" << result.camera_make << "\t" << result.camera_model
+               << "\t" << result.width << "\t" << result.height << "\t";
+        for ( size_t i = 0; i < result.pre_mul.size(); i++ )
+            stream << ( i ? "," : "" ) << result.pre_mul[i];
+        stream << "\t" << result.DNG_version << "\t"
+               << result.calibration_illuminants[0] << ","
+               << result.calibration_illuminants[1] << "\t"
+               << result.setup + 1;
+        if ( solve )
+            stream << "\t" << ( result.solved ? "yes" : "no" );
+        stream << std::endl;
+    }
+}
+
+std::vector<std::string> select_shard(
+    const std::vector<std::string> &files, size_t index, size_t count )
+{
+    std::vector<std::string> shard;
+    for ( const auto &file: files )
+    {
+        // A stable hash, so all nodes get the same partition.
+        if ( count < 2 || fnv1a( file ) % count == index )
+            shard.push_back( file );
+    }
+    return shard;
+}
+
+std::string
+shard_filename( const std::string &path, size_t index, size_t count )
+{
+    if ( count < 2 || path.empty() )
+        return path;
+
+    std::filesystem::path result( path );
+    std::filesystem::path extension = result.extension();
+    result.replace_extension();
+    result += ".shard-" + std::to_string( index ) + "-of-" +
+              std::to_string( count );
+    result += extension;
+    return result.string();
+}
+
+bool BatchConverter::process( const std::vector<std::string> &files )
+{
+    const auto start_time = std::chrono::steady_clock::now();
+
+    if ( settings.shard_count < 1 || settings.shard_index < 0 ||
+         settings.shard_index >= settings.shard_count )
+    {
+        std::cerr << "ERROR: Invalid shard " << settings.shard_index << "/"
+                  << settings.shard_count << "." << std::endl;
+        return false;
+    }
+
+    const size_t shard_index = static_cast<size_t>( settings.shard_index );
+    const size_t shard_count = static_cast<size_t>( settings.shard_count );
+    const auto   shard       = select_shard( files, shard_index, shard_count );
+    const size_t total       = shard.size();
+
+    _results.assign( total, BatchResult() );
+    for ( size_t i = 0; i < total; i++ )
+    {
+        _results[i].input_filename = shard[i];
+    }
+
+    if ( !metrics && !settings.metrics_file.empty() )
+        metrics = std::make_shared<Metrics>();
+    if ( !tracer && !settings.trace_file.empty() )
+        tracer = std::make_shared<Tracer>();
+
+    if ( !check_manifest() )
+        return false;
+
+    const auto counts_before = cache_counts();
+
+    // Size the thread pool of OpenImageIO, shared within the process, to the
+    // threads of all concurrent conversions, see `conversion_threads()`.
+    if ( size_thread_pool && ( settings.threads > 0 || settings.jobs > 1 ) )
+    {
+        OIIO::attribute(
+            "threads",
+            conversion_threads( settings ) * std::max( settings.jobs, 1 ) );
+    }
+
+    plan_transforms();
+
+    // The planned transforms are solved already.
+    if ( settings.solve_ahead > 0 && !settings.group_transforms &&
+         !settings.disable_cache )
+    {
+        std::vector<std::string> files_to_solve;
+        for ( const auto &file_result: _results )
+        {
+            files_to_solve.push_back(
+                file_result.up_to_date ? "" : file_result.input_filename );
+        }
+        _solve_ahead = std::make_shared<SolveAhead>(
+            files_to_solve,
+            settings,
+            tracer,
+            static_cast<size_t>( settings.solve_ahead ) );
+    }
+
+    bool result = process_files();
+    _solve_ahead.reset();
+    _transforms.clear();
+    _manifest.reset();
+
+    if ( metrics )
+    {
+        for ( auto &file_result: _results )
+            file_result.stage_times =
+                metrics->get_times( file_result.input_filename );
+
+        // The caches are shared within the process, only count the lookups
+        // of this batch.
+        const auto counts_after = cache_counts();
+        for ( size_t i = 0; i < counts_after.size(); i++ )
+        {
+            const auto &[name, hits, misses] = counts_after[i];
+            const Metrics::Labels labels     = { { "cache", name } };
+
+            metrics->add_count(
+                "cache_hits", labels, hits - std::get<1>( counts_before[i] ) );
+            metrics->add_count(
+                "cache_misses",
+                labels,
+                misses - std::get<2>( counts_before[i] ) );
+        }
+
+        // The summary of the shard, so the shards running behind can be
+        // told apart from the metrics files of all shards.
+        if ( shard_count > 1 )
+        {
+            const Metrics::Labels labels = {
+                { "shard",
+                  std::to_string( shard_index ) + "/" +
+                      std::to_string( shard_count ) }
+            };
+
+            uint64_t converted = 0, failed = 0, up_to_date = 0;
+            for ( const auto &file_result: _results )
+            {
+                if ( file_result.up_to_date )
+                    up_to_date++;
+                else if ( file_result.success )
+                    converted++;
+                else if ( !file_result.skipped )
+                    failed++;
+            }
+
+            const auto wall_time =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start_time );
+
+            metrics->add_count( "shard_files", labels, total );
+            metrics->add_count( "shard_converted_files", labels, converted );
+            metrics->add_count( "shard_failed_files", labels, failed );
+            metrics->add_count( "shard_up_to_date_files", labels, up_to_date );
+            metrics->add_count(
+                "shard_wall_time_milliseconds", labels, wall_time.count() );
+        }
+
+        if ( !settings.metrics_file.empty() )
+        {
+            result &= metrics->save( shard_filename(
+                settings.metrics_file, shard_index, shard_count ) );
+        }
+    }
+
+    if ( tracer && !settings.trace_file.empty() )
+    {
+        result &= tracer->save(
+            shard_filename( settings.trace_file, shard_index, shard_count ) );
+    }
+
+    return result;
+}
+
+bool BatchConverter::check_manifest()
+{
+    _manifest.reset();
+    if ( settings.manifest_file.empty() )
+        return true;
+
+    // Every shard keeps its own manifest, so the nodes never write to the
+    // same file.
+    auto manifest = std::make_shared<JobManifest>();
+    if ( !manifest->open( shard_filename(
+             settings.manifest_file,
+             static_cast<size_t>( settings.shard_index ),
+             static_cast<size_t>( settings.shard_count ) ) ) )
+    {
+        return false;
+    }
+
+    _manifest  = manifest;
+    _signature = settings_signature( settings );
+
+    // Only the metadata of the files get looked at.
+    const size_t jobs = metadata_jobs( settings );
+
+    std::atomic<uint64_t> up_to_date( 0 );
+    parallel_for( _results.size(), jobs, [&]( size_t index ) {
+        auto &result = _results[index];
+        if ( _manifest->is_up_to_date(
+                 result.input_filename, _signature, result.output_filename ) )
+        {
+            result.up_to_date = true;
+            result.success    = true;
+            up_to_date++;
+        }
+    } );
+
+    if ( metrics )
+        metrics->add_count( "up_to_date_files", {}, up_to_date );
+    return true;
+}
+
+void BatchConverter::record_file( const BatchResult &result )
+{
+    if ( _manifest )
+    {
+        _manifest->record(
+            result.input_filename,
+            _signature,
+            result.output_filename,
+            result.success );
+    }
+}
+
+void BatchConverter::plan_transforms()
+{
+    const size_t total = _results.size();
+
+    _transforms.assign( total, nullptr );
+    if ( !settings.group_transforms || total < 2 )
+        return;
+
+    const size_t jobs = metadata_jobs( settings );
+
+    // The files failing to read get left out of the groups, and report the
+    // error when converted.
+    std::vector<std::string> keys( total );
+    std::vector<char>        valid( total, false );
+    parallel_for( total, jobs, [&]( size_t index ) {
+        ImageConverter converter;
+        converter.settings = settings;
+
+        const auto &result = _results[index];
+        if ( result.up_to_date )
+            return;
+
+        valid[index] = run_stage( result, [&]() {
+            return converter.read_transform_key(
+                result.input_filename, keys[index] );
+        } );
+    } );
+
+    // Every group gets solved for its first file.
+    std::map<std::string, size_t> groups;
+    std::vector<size_t>           group_of_file( total, total );
+    std::vector<size_t>           first_files;
+    for ( size_t i = 0; i < total; i++ )
+    {
+        if ( !valid[i] )
+            continue;
+
+        auto iter = groups.emplace( keys[i], first_files.size() ).first;
+        if ( iter->second == first_files.size() )
+            first_files.push_back( i );
+        group_of_file[i] = iter->second;
+    }
+
+    // The files failing to solve get left out as well, so the error gets
+    // reported in the order of the files. Solving only needs the metadata,
+    // so the sensor data do not get read here.
+    std::vector<std::shared_ptr<const ImageConverter::Transform>> transforms(
+        first_files.size() );
+    parallel_for( first_files.size(), jobs, [&]( size_t group ) {
+        ImageConverter converter;
+        converter.settings = settings;
+        converter.tracer   = tracer;
+
+        const auto &result  = _results[first_files[group]];
+        bool        success = run_stage( result, [&]() {
+            return converter.solve_transform( result.input_filename );
+        } );
+        if ( success )
+        {
+            transforms[group] = std::make_shared<ImageConverter::Transform>(
+                converter.get_transform() );
+        }
+    } );
+
+    for ( size_t i = 0; i < total; i++ )
+    {
+        if ( group_of_file[i] < transforms.size() )
+            _transforms[i] = transforms[group_of_file[i]];
+    }
+
+    if ( metrics )
+        metrics->add_count( "transform_groups", {}, first_files.size() );
+}
+
+bool BatchConverter::process_files()
+{
+    const size_t total = _results.size();
+
+    auto report = [&]( size_t index ) {
+        if ( on_file_started )
+            on_file_started( index, total, _results[index] );
+        if ( on_file_finished )
+            on_file_finished( index, total, _results[index] );
+    };
+
+    size_t jobs = settings.jobs > 1 ? static_cast<size_t>( settings.jobs ) : 1;
+    jobs        = std::min( jobs, total );
+
+    if ( jobs <= 1 && settings.pipeline_depth > 0 &&
+         settings.memory_limit <= 0 && settings.outputs.empty() )
+    {
+        return process_pipelined();
+    }
+
+    if ( jobs <= 1 )
+    {
+        ImageConverter converter;
+        converter.settings = settings;
+        converter.metrics  = metrics;
+        converter.tracer   = tracer;
+
+        bool result = true;
+        for ( size_t i = 0; i < total; i++ )
+        {
+            auto &file_result = _results[i];
+            if ( file_result.up_to_date )
+                continue;
+
+            if ( !result && !settings.continue_on_error )
+            {
+                file_result.skipped = true;
+                continue;
+            }
+
+            if ( on_file_started )
+                on_file_started( i, total, file_result );
+
+            if ( _solve_ahead )
+                _solve_ahead->reached( i );
+            converter.transform = _transforms[i];
+            convert_file( converter, file_result );
+            record_file( file_result );
+
+            if ( on_file_finished )
+                on_file_finished( i, total, file_result );
+
+            result &= file_result.success;
+        }
+        return result;
+    }
+
+    std::mutex              mutex;
+    std::condition_variable condition;
+    std::vector<bool>       done( total, false );
+    std::atomic<size_t>     next_index( 0 );
+
+    // No file with an index greater than this one gets started. Only updated
+    // on failure when `continue_on_error` is not set.
+    size_t stop_index = total;
+
+    auto worker = [&]() {
+        ImageConverter converter;
+        converter.settings = settings;
+        converter.metrics  = metrics;
+        converter.tracer   = tracer;
+
+        while ( true )
+        {
+            const size_t index = next_index++;
+            if ( index >= total )
+                break;
+
+            bool skip;
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                skip = index > stop_index;
+            }
+
+            auto &file_result = _results[index];
+            if ( skip )
+            {
+                file_result.skipped = !file_result.up_to_date;
+            }
+            else if ( !file_result.up_to_date )
+            {
+                if ( _solve_ahead )
+                    _solve_ahead->reached( index );
+                converter.transform = _transforms[index];
+                convert_file( converter, file_result );
+                record_file( file_result );
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                if ( !skip && !file_result.success &&
+                     !settings.continue_on_error )
+                {
+                    stop_index = std::min( stop_index, index );
+                }
+                done[index] = true;
+            }
+            condition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for ( size_t i = 0; i < jobs; i++ )
+    {
+        workers.emplace_back( worker );
+    }
+
+    // Report the results in the order of the input files.
+    bool result = true;
+    for ( size_t i = 0; i < total; i++ )
+    {
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            condition.wait( lock, [&]() { return done[i]; } );
+        }
+
+        if ( _results[i].skipped || _results[i].up_to_date )
+            continue;
+
+        report( i );
+        result &= _results[i].success;
+    }
+
+    for ( auto &thread: workers )
+    {
+        thread.join();
+    }
+
+    return result;
+}
+
+bool BatchConverter::process_pipelined()
+{
+    const size_t total = _results.size();
+    const size_t depth = static_cast<size_t>( settings.pipeline_depth );
+
+    BoundedQueue<PipelineItem> loaded( depth );
+    BoundedQueue<PipelineItem> converted( depth );
+
+    std::mutex mutex;
+
+    // No file with an index greater than this one gets processed any further.
+    // Only updated on failure when `continue_on_error` is not set.
+    size_t stop_index = total;
+
+    auto fail = [&]( size_t index ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        if ( !settings.continue_on_error )
+            stop_index = std::min( stop_index, index );
+    };
+
+    auto stopped = [&]( size_t index ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        return index > stop_index;
+    };
+
+    std::thread reader( [&]() {
+        for ( size_t i = 0; i < total && !stopped( i ); i++ )
+        {
+            if ( _results[i].up_to_date )
+                continue;
+
+            if ( _solve_ahead )
+                _solve_ahead->reached( i );
+
+            PipelineItem item;
+            item.index               = i;
+            item.converter           = std::make_unique<ImageConverter>();
+            item.converter->settings  = settings;
+            item.converter->metrics   = metrics;
+            item.converter->tracer    = tracer;
+            item.converter->transform = _transforms[i];
+
+            const auto &result = _results[i];
+            item.success       = run_stage( result, [&]() {
+                return item.converter->read_image(
+                    result.input_filename, item.output_filename, item.buffer );
+            } );
+            if ( !item.success )
+                fail( i );
+
+            if ( !loaded.push( std::move( item ) ) )
+                break;
+        }
+        loaded.close();
+    } );
+
+    std::thread processor( [&]() {
+        PipelineItem item;
+        while ( loaded.pop( item ) )
+        {
+            if ( item.success && !stopped( item.index ) )
+            {
+                const auto &result = _results[item.index];
+                item.success       = run_stage( result, [&]() {
+                    return item.converter->convert_image(
+                        result.input_filename, item.buffer );
+                } );
+                if ( !item.success )
+                    fail( item.index );
+            }
+
+            if ( !converted.push( std::move( item ) ) )
+                break;
+        }
+        converted.close();
+    } );
+
+    // Write the files on the calling thread, so the results get reported
+    // in the order of the input files.
+    bool         result = true;
+    PipelineItem item;
+    while ( converted.pop( item ) )
+    {
+        auto &file_result = _results[item.index];
+        if ( !stopped( item.index ) )
+        {
+            if ( item.success )
+            {
+                item.success = run_stage( file_result, [&]() {
+                    return item.converter->write_image(
+                        file_result.input_filename,
+                        item.output_filename,
+                        item.buffer );
+                } );
+            }
+
+            file_result.success = item.success;
+            if ( file_result.success )
+            {
+                record_transform( *item.converter, file_result );
+                file_result.output_filename = item.output_filename;
+            }
+            else
+            {
+                fail( item.index );
+            }
+            record_file( file_result );
+
+            if ( on_file_started )
+                on_file_started( item.index, total, file_result );
+            if ( on_file_finished )
+                on_file_finished( item.index, total, file_result );
+
+            result &= file_result.success;
+        }
+
+        // Release the pixels before waiting for the next file.
+        item = PipelineItem();
+    }
+
+    reader.join();
+    processor.join();
+
+    // The files after the first failure have either not been read, or
+    // have been dropped, see `stopped`.
+    for ( size_t i = stop_index + 1; i < total; i++ )
+    {
+        if ( !_results[i].up_to_date )
+            _results[i].skipped = true;
+    }
+
+    return result;
+}
+
+const std::vector<BatchResult> &BatchConverter::get_results() const
+{
+    return _results;
+}
+
+} // namespace util
+} // namespace rta
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace rta
+{
+namespace util
+{
+
+/// A first-in-first-out queue holding at most `capacity` items, passing the
+/// items between threads. Pushing into a full queue blocks until an item
+/// gets popped, which limits how far the producer can run ahead of the
+/// consumer.
+template <class T> class BoundedQueue
+{
+public:
+    BoundedQueue( size_t capacity ) : _capacity( capacity ? capacity : 1 ) {}
+
+    /// Add an item at the end of the queue, waiting while the queue is full.
+    /// @param item the item to add.
+    /// @result `false` if the queue has been closed, the item is dropped.
+    bool push( T &&item )
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _not_full.wait(
+            lock, [this]() { return _closed || _items.size() < _capacity; } );
+        if ( _closed )
+            return false;
+
+        _items.push_back( std::move( item ) );
+        _not_empty.notify_one();
+        return true;
+    }
+
+    /// Remove the item at the front of the queue, waiting while the queue is
+    /// empty.
+    /// @param item receives the removed item.
+    /// @result `false` if the queue has been closed and no items are left.
+    bool pop( T &item )
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _not_empty.wait(
+            lock, [this]() { return _closed || !_items.empty(); } );
+        if ( _items.empty() )
+            return false;
+
+        item = std::move( _items.front() );
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    /// Close the queue. The items already in the queue can still be popped,
+    /// no new items get accepted.
+    void close()
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _closed = true;
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+private:
+    const size_t            _capacity;
+    std::mutex              _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+    std::deque<T>           _items;
+    bool                    _closed = false;
+};
+
+} // namespace util
+} // namespace rta
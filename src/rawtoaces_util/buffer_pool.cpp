@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "buffer_pool.h"
+
+#include <new>
+
+#if defined( __linux__ )
+#    include <sys/mman.h>
+#endif
+
+namespace rta
+{
+namespace util
+{
+
+/// The alignment of the blocks, a cache line, enough for any SIMD loads.
+static const std::align_val_t block_alignment = std::align_val_t( 64 );
+
+#if defined( __linux__ ) && defined( MADV_HUGEPAGE )
+/// The size of a transparent huge page on x86 and most ARM64 systems.
+static const size_t huge_page_size = size_t( 2 ) << 20;
+
+static size_t mapped_size( size_t size )
+{
+    return ( size + huge_page_size - 1 ) / huge_page_size * huge_page_size;
+}
+#endif
+
+BufferPool::~BufferPool()
+{
+    clear();
+}
+
+BufferPool &BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::Block BufferPool::allocate( size_t size, bool huge_pages )
+{
+    Block block;
+    block.size = size;
+
+#if defined( __linux__ ) && defined( MADV_HUGEPAGE )
+    // Anonymous mappings are page aligned, and can be rounded up to whole
+    // huge pages for the kernel to back them with. This is only a hint, the
+    // mapping works with the regular pages all the same.
+    if ( huge_pages && size > 0 )
+    {
+        void *data = mmap(
+            nullptr,
+            mapped_size( size ),
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0 );
+        if ( data != MAP_FAILED )
+        {
+            madvise( data, mapped_size( size ), MADV_HUGEPAGE );
+            block.data   = data;
+            block.mapped = true;
+            return block;
+        }
+    }
+#else
+    (void)huge_pages;
+#endif
+
+    block.data = ::operator new( size, block_alignment );
+    return block;
+}
+
+void BufferPool::free( const Block &block )
+{
+#if defined( __linux__ ) && defined( MADV_HUGEPAGE )
+    if ( block.mapped )
+    {
+        munmap( block.data, mapped_size( block.size ) );
+        return;
+    }
+#endif
+    ::operator delete( block.data, block_alignment );
+}
+
+std::shared_ptr<void> BufferPool::borrow( size_t size, bool huge_pages )
+{
+    Block block;
+    bool  found = false;
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        // Prefer the most recently returned block, which is the most likely
+        // to still be in the cache.
+        for ( size_t i = _idle.size(); i-- > 0; )
+        {
+            if ( _idle[i].size == size )
+            {
+                block = _idle[i];
+                _idle.erase( _idle.begin() + static_cast<ptrdiff_t>( i ) );
+                _idle_size -= size;
+                found = true;
+                break;
+            }
+        }
+
+        if ( !found )
+            ++_allocation_count;
+    }
+
+    if ( !found )
+        block = allocate( size, huge_pages );
+
+    std::weak_ptr<BufferPool *> pool = _self;
+    return std::shared_ptr<void>( block.data, [pool, block]( void * ) {
+        if ( auto self = pool.lock() )
+            ( *self )->give_back( block );
+        else
+            free( block );
+    } );
+}
+
+std::shared_ptr<void> BufferPool::borrow(
+    const OIIO::ImageSpec &spec, OIIO::ImageBuf &buffer, bool huge_pages )
+{
+    auto block = borrow( spec.image_bytes(), huge_pages );
+    buffer.reset( spec, block.get() );
+    return block;
+}
+
+void BufferPool::give_back( const Block &block )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    _idle.push_back( block );
+    _idle_size += block.size;
+    trim();
+}
+
+void BufferPool::trim()
+{
+    size_t count = 0;
+    while ( _idle_size > _capacity && count < _idle.size() )
+    {
+        _idle_size -= _idle[count].size;
+        free( _idle[count] );
+        ++count;
+    }
+    _idle.erase(
+        _idle.begin(), _idle.begin() + static_cast<ptrdiff_t>( count ) );
+}
+
+void BufferPool::set_capacity( size_t capacity )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    _capacity = capacity;
+    trim();
+}
+
+void BufferPool::clear()
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    for ( const auto &block: _idle )
+        free( block );
+    _idle.clear();
+    _idle_size = 0;
+}
+
+size_t BufferPool::idle_size() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _idle_size;
+}
+
+size_t BufferPool::allocation_count() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _allocation_count;
+}
+
+} // namespace util
+} // namespace rta
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <OpenImageIO/imagebuf.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rta
+{
+namespace util
+{
+
+/// A pool of the memory blocks holding the pixels of the images, shared
+/// within the process, so the buffers freed after converting a file get
+/// reused for the next file of the same dimensions and format, instead of
+/// being allocated and faulted in again. The idle blocks are keyed by their
+/// size, and the least recently returned ones get freed once the idle blocks
+/// exceed the capacity of the pool, see `set_capacity()`.
+class BufferPool
+{
+public:
+    BufferPool() = default;
+    ~BufferPool();
+
+    BufferPool( const BufferPool & )            = delete;
+    BufferPool &operator=( const BufferPool & ) = delete;
+
+    /// The pool shared within the process.
+    static BufferPool &instance();
+
+    /// Borrow a block of at least `size` bytes, aligned to 64 bytes.
+    /// @param size the size of the block in bytes.
+    /// @param huge_pages back the block with transparent huge pages if it
+    ///     has to be allocated, where supported by the system.
+    /// @result the block, returned to the pool once the last copy of the
+    ///     pointer gets released.
+    std::shared_ptr<void> borrow( size_t size, bool huge_pages = false );
+
+    /// Borrow a block for the pixels of `spec`, and reset `buffer` to wrap it
+    /// without initialising the pixels.
+    /// @param spec the layout of the image.
+    /// @param buffer the image buffer to wrap the block. It must not be used
+    ///     after the block has been released.
+    /// @param huge_pages back the block with transparent huge pages if it
+    ///     has to be allocated, where supported by the system.
+    /// @result the block, returned to the pool once the last copy of the
+    ///     pointer gets released.
+    std::shared_ptr<void> borrow(
+        const OIIO::ImageSpec &spec,
+        OIIO::ImageBuf        &buffer,
+        bool                   huge_pages = false );
+
+    /// Set the maximum total size of the idle blocks kept for reuse. 0 frees
+    /// the blocks as soon as they get returned.
+    /// @param capacity the size in bytes.
+    void set_capacity( size_t capacity );
+
+    /// Free all idle blocks.
+    void clear();
+
+    /// The total size of the idle blocks in bytes.
+    size_t idle_size() const;
+
+    /// The number of the blocks allocated since the pool has been created,
+    /// as opposed to reused.
+    size_t allocation_count() const;
+
+private:
+    /// A block of memory, allocated by `allocate()`.
+    struct Block
+    {
+        void  *data   = nullptr;
+        size_t size   = 0;
+        bool   mapped = false;
+    };
+
+    static Block allocate( size_t size, bool huge_pages );
+    static void  free( const Block &block );
+
+    /// Take the block back, or free it if the pool is over its capacity.
+    void give_back( const Block &block );
+
+    /// Free the least recently returned blocks until the idle blocks fit into
+    /// the capacity. Must be called with `_mutex` locked.
+    void trim();
+
+    mutable std::mutex _mutex;
+
+    // The idle blocks, least recently returned first. There are only a few
+    // of them, as the blocks are large, so searching them is cheap.
+    std::vector<Block> _idle;
+
+    size_t _idle_size        = 0;
+    size_t _capacity         = 0;
+    size_t _allocation_count = 0;
+
+    // Keeps `give_back()` from touching a destroyed pool, as the borrowed
+    // blocks may outlive it.
+    std::shared_ptr<BufferPool *> _self =
+        std::make_shared<BufferPool *>( this );
+};
+
+} // namespace util
+} // namespace rta
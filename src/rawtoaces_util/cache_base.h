@@ -4,9 +4,18 @@
 #pragma once
 
 #include <iostream>
-#include <list>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace rta
 {
@@ -44,15 +53,119 @@ std::ostream &operator<<( std::ostream &os, const std::tuple<Ts...> &tuple )
     return println_tuple_impl( os, tuple, std::index_sequence_for<Ts...>{} );
 }
 
+template <typename T> size_t hash_value( const std::vector<T> &vector );
+template <typename T, size_t S>
+size_t hash_value( const std::array<T, S> &array );
+template <typename T1, typename T2>
+size_t hash_value( const std::pair<T1, T2> &pair );
+template <typename... Ts> size_t hash_value( const std::tuple<Ts...> &tuple );
+
+/// Mix the hash `value` into `seed`.
+inline void hash_combine( size_t &seed, size_t value )
+{
+    seed ^= value + 0x9e3779b97f4a7c15ull + ( seed << 6 ) + ( seed >> 2 );
+}
+
+inline size_t hash_value( const std::string &string )
+{
+    return std::hash<std::string>()( string );
+}
+
+inline size_t hash_value( double value )
+{
+    // Make sure 0.0 and -0.0 hash the same, as they compare equal.
+    return std::hash<double>()( value == 0.0 ? 0.0 : value );
+}
+
+inline size_t hash_value( unsigned short value )
+{
+    return std::hash<unsigned short>()( value );
+}
+
+inline size_t hash_value( bool value )
+{
+    return std::hash<bool>()( value );
+}
+
+template <typename T> size_t hash_value( const std::vector<T> &vector )
+{
+    size_t seed = vector.size();
+    for ( const auto &item: vector )
+        hash_combine( seed, hash_value( item ) );
+    return seed;
+}
+
+template <typename T, size_t S>
+size_t hash_value( const std::array<T, S> &array )
+{
+    size_t seed = 0;
+    for ( const auto &item: array )
+        hash_combine( seed, hash_value( item ) );
+    return seed;
+}
+
+template <typename T1, typename T2>
+size_t hash_value( const std::pair<T1, T2> &pair )
+{
+    size_t seed = hash_value( pair.first );
+    hash_combine( seed, hash_value( pair.second ) );
+    return seed;
+}
+
+template <typename... Ts> size_t hash_value( const std::tuple<Ts...> &tuple )
+{
+    size_t seed = 0;
+    std::apply(
+        [&seed]( const auto &...items ) {
+            ( hash_combine( seed, hash_value( items ) ), ... );
+        },
+        tuple );
+    return seed;
+}
+
 namespace cache
 {
 
+/// The hash function of the cache descriptors, dispatching to the
+/// `hash_value` overloads above.
+struct DescriptorHash
+{
+    template <typename T> size_t operator()( const T &descriptor ) const
+    {
+        return hash_value( descriptor );
+    }
+};
+
+/// The equality comparison of the cache descriptors. Unlike `std::equal_to`,
+/// this finds the comparison operators declared in the `rta` namespace.
+struct DescriptorEqual
+{
+    template <typename T> bool operator()( const T &a, const T &b ) const
+    {
+        return a == b;
+    }
+};
+
+/// A least-recently-used cache of solved data. The cache is safe to share
+/// between threads. The lookups are hashed and only take a shared lock, so
+/// concurrent readers do not block each other. The calculation of a new
+/// entry happens outside of the lock; the threads missing on an entry which
+/// is being calculated by another thread wait for that result instead of
+/// calculating it again.
 template <class Descriptor, class Data> class Cache
 {
 public:
+    using Result = std::pair<bool, Data>;
+
     Cache( const std::string &cache_name = "default" ) : name( cache_name ) {}
 
-    const std::pair<bool, Data> &fetch(
+    /// Look up the entry matching `descriptor`, or calculate it using `func`
+    /// if none is found.
+    /// @param descriptor the key of the entry.
+    /// @param func the function calculating the data of a new entry,
+    ///     returning `true` on success.
+    /// @result a copy of the entry, a pair of the success flag and the data.
+    Result fetch(
         const Descriptor                        &descriptor,
         const std::function<bool( Data &data )> &func )
     {
@@ -62,64 +175,166 @@ public:
             {
                 std::cerr << "Cache (" << name << "): disabled." << std::endl;
             }
-            _map.clear();
+
+            {
+                std::unique_lock<std::shared_mutex> lock( _mutex );
+                _map.clear();
+            }
+
+            misses++;
+
+            Result result;
+            result.first = func( result.second );
+            return result;
         }
-        else
+
+        if ( verbosity > 0 )
         {
+            std::cerr << "Cache (" << name << "): searching for an entry ["
+                      << descriptor << "]." << std::endl;
+        }
 
-            if ( verbosity > 0 )
+        std::shared_future<Result> future;
+
+        {
+            std::shared_lock<std::shared_mutex> lock( _mutex );
+            auto iter = _map.find( descriptor );
+            if ( iter != _map.end() )
             {
-                std::cerr << "Cache (" << name << "): searching for an entry ["
-                          << descriptor << "]." << std::endl;
+                iter->second.last_used = ++_tick;
+                future                 = iter->second.future;
             }
+        }
+
+        std::promise<Result> promise;
+        uint64_t             generation = 0;
 
-            for ( auto iter = _map.begin(); iter != _map.end(); ++iter )
+        if ( !future.valid() )
+        {
+            std::unique_lock<std::shared_mutex> lock( _mutex );
+
+            // Another thread may have added the entry in the meantime.
+            auto iter = _map.find( descriptor );
+            if ( iter != _map.end() )
             {
-                if ( std::get<0>( *iter ) == descriptor )
+                iter->second.last_used = ++_tick;
+                future                 = iter->second.future;
+            }
+            else
+            {
+                // Exceed the capacity rather than drop the entries still
+                // being calculated.
+                while ( _map.size() >= capacity &&
+                        evict_least_recently_used() )
                 {
-                    if ( iter != _map.begin() )
-                    {
-                        _map.splice(
-                            _map.begin(), _map, iter, std::next( iter ) );
-                    }
-
-                    if ( verbosity > 0 )
-                    {
-                        std::cerr << "Cache (" << name << "): found in cache!"
-                                  << std::endl;
-                    }
-                    return _map.front().second;
                 }
-            }
 
-            if ( _map.size() == capacity )
-            {
-                _map.pop_back();
+                auto &entry      = _map[descriptor];
+                entry.future     = promise.get_future().share();
+                entry.last_used  = ++_tick;
+                entry.generation = entry.last_used;
+                generation       = entry.generation;
             }
+        }
+
+        if ( future.valid() )
+        {
+            hits++;
 
             if ( verbosity > 0 )
             {
-                std::cerr << "Cache (" << name
-                          << "): not found. Calculating a new entry."
+                if ( future.wait_for( std::chrono::seconds( 0 ) ) !=
+                     std::future_status::ready )
+                {
+                    std::cerr << "Cache (" << name
+                              << "): waiting for the entry being calculated."
+                              << std::endl;
+                }
+                std::cerr << "Cache (" << name << "): found in cache!"
                           << std::endl;
             }
+            return future.get();
+        }
+
+        if ( verbosity > 0 )
+        {
+            std::cerr << "Cache (" << name
+                      << "): not found. Calculating a new entry." << std::endl;
+        }
+
+        misses++;
+
+        Result result;
+        try
+        {
+            result.first = func( result.second );
         }
+        catch ( ... )
+        {
+            // Let the waiting threads know, and retry on the next fetch.
+            promise.set_exception( std::current_exception() );
 
-        _map.emplace_front();
+            // The entry may have been cleared, and added again by another
+            // call, in the meantime.
+            std::unique_lock<std::shared_mutex> lock( _mutex );
+            auto iter = _map.find( descriptor );
+            if ( iter != _map.end() && iter->second.generation == generation )
+                _map.erase( iter );
+            throw;
+        }
 
-        auto &entry        = _map.front();
-        entry.first        = descriptor;
-        entry.second.first = func( entry.second.second );
-        return entry.second;
+        promise.set_value( result );
+        return result;
     };
 
-    bool        disabled  = false;
-    size_t      capacity  = 10;
-    int         verbosity = 0;
-    std::string name      = "default";
+    std::atomic<bool>   disabled  = false;
+    std::atomic<size_t> capacity  = 10;
+    std::atomic<int>    verbosity = 0;
+    std::string         name      = "default";
+
+    /// The number of the lookups served from the cache, including the ones
+    /// waiting for an entry being calculated by another thread.
+    std::atomic<uint64_t> hits = 0;
+
+    /// The number of the lookups which had to calculate the data, including
+    /// all lookups while the cache is disabled.
+    std::atomic<uint64_t> misses = 0;
 
 private:
-    std::list<std::pair<Descriptor, std::pair<bool, Data>>> _map;
+    struct Entry
+    {
+        std::shared_future<Result> future;
+        std::atomic<uint64_t>      last_used = 0;
+        // Identifies the call calculating the entry.
+        uint64_t generation = 0;
+    };
+
+    /// Remove the entry which has not been accessed for the longest time,
+    /// skipping the entries still being calculated. The caller must hold the
+    /// exclusive lock.
+    /// @result `true` if an entry has been removed.
+    bool evict_least_recently_used()
+    {
+        auto oldest = _map.end();
+        for ( auto iter = _map.begin(); iter != _map.end(); ++iter )
+        {
+            if ( iter->second.future.wait_for( std::chrono::seconds( 0 ) ) !=
+                 std::future_status::ready )
+                continue;
+            if ( oldest == _map.end() ||
+                 iter->second.last_used < oldest->second.last_used )
+                oldest = iter;
+        }
+        if ( oldest == _map.end() )
+            return false;
+        _map.erase( oldest );
+        return true;
+    }
+
+    std::shared_mutex     _mutex;
+    std::atomic<uint64_t> _tick = 0;
+    std::unordered_map<Descriptor, Entry, DescriptorHash, DescriptorEqual>
+        _map;
 };
 
 } // namespace cache
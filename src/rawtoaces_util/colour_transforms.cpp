@@ -3,8 +3,17 @@
 
 #include "colour_transforms.h"
 #include "transform_cache.h"
+#include "persistent_cache.h"
 
+#include <rawtoaces/usage_timer.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <assert.h>
 
 namespace rta
@@ -19,6 +28,17 @@ void print_data_error( const std::string &data_type )
               << "in RAWTOACES_DATABASE_PATH" << std::endl;
 }
 
+/// The outcome of a cache lookup recorded in the trace spans.
+/// @param fetched `true` if the entry was missing in the memory cache.
+/// @param solved `true` if the entry had to be solved, as opposed to read
+///     from the persistent cache.
+static const char *cache_outcome( bool fetched, bool solved )
+{
+    if ( !fetched )
+        return "hit";
+    return solved ? "miss" : "persistent hit";
+}
+
 bool configure_spectral_solver(
     core::SpectralSolver &solver,
     const std::string    &camera_make,
@@ -115,6 +135,7 @@ bool fetch_illuminant_from_multipliers(
     core::SpectralSolver      &solver,
     int                        verbosity,
     bool                       disable_cache,
+    cache::PersistentCache    *persistent_cache,
     std::string               &out_illuminant )
 {
     assert( wb_multipliers.size() == 3 );
@@ -129,11 +150,31 @@ bool fetch_illuminant_from_multipliers(
     illuminant_from_WB_cache.verbosity = verbosity;
     illuminant_from_WB_cache.disabled  = disable_cache;
 
+    TraceSpan trace_span( "fetch_illuminant_from_multipliers", "cache" );
+    bool      fetched = false;
+    bool      solved  = false;
+
     const auto &entry = illuminant_from_WB_cache.fetch(
         descriptor, [&]( cache::IlluminantAndWBData &cache_data ) {
-            return solve_illuminant_from_multipliers(
-                camera_make, camera_model, wb_multipliers, solver, cache_data );
+            fetched = true;
+            return cache::persistent_fetch(
+                persistent_cache,
+                illuminant_from_WB_cache.name,
+                descriptor,
+                cache_data,
+                [&]( cache::IlluminantAndWBData &data ) {
+                    TraceSpan solve_span( "solve_illuminant", "solver" );
+                    solved = true;
+                    return solve_illuminant_from_multipliers(
+                        camera_make,
+                        camera_model,
+                        wb_multipliers,
+                        solver,
+                        data );
+                },
+                verbosity );
         } );
+    trace_span.set_arg( "cache", cache_outcome( fetched, solved ) );
 
     bool success = entry.first;
 
@@ -177,13 +218,14 @@ bool solve_multipliers_from_illuminant(
 }
 
 bool fetch_multipliers_from_illuminant(
-    const std::string    &camera_make,
-    const std::string    &camera_model,
-    const std::string    &in_illuminant,
-    core::SpectralSolver &solver,
-    int                   verbosity,
-    bool                  disable_cache,
-    std::vector<double>  &out_multipliers )
+    const std::string      &camera_make,
+    const std::string      &camera_model,
+    const std::string      &in_illuminant,
+    core::SpectralSolver   &solver,
+    int                     verbosity,
+    bool                    disable_cache,
+    cache::PersistentCache *persistent_cache,
+    std::vector<double>    &out_multipliers )
 {
     cache::CameraAndIlluminantDescriptor descriptor = { camera_make,
                                                         camera_model,
@@ -193,11 +235,31 @@ bool fetch_multipliers_from_illuminant(
     WB_from_illuminant_cache.verbosity = verbosity;
     WB_from_illuminant_cache.disabled  = disable_cache;
 
+    TraceSpan trace_span( "fetch_multipliers_from_illuminant", "cache" );
+    bool      fetched = false;
+    bool      solved  = false;
+
     const auto &entry = WB_from_illuminant_cache.fetch(
         descriptor, [&]( cache::WBFromIlluminantData &cache_data ) {
-            return solve_multipliers_from_illuminant(
-                camera_make, camera_model, in_illuminant, solver, cache_data );
+            fetched = true;
+            return cache::persistent_fetch(
+                persistent_cache,
+                WB_from_illuminant_cache.name,
+                descriptor,
+                cache_data,
+                [&]( cache::WBFromIlluminantData &data ) {
+                    TraceSpan solve_span( "solve_multipliers", "solver" );
+                    solved = true;
+                    return solve_multipliers_from_illuminant(
+                        camera_make,
+                        camera_model,
+                        in_illuminant,
+                        solver,
+                        data );
+                },
+                verbosity );
         } );
+    trace_span.set_arg( "cache", cache_outcome( fetched, solved ) );
 
     bool success = entry.first;
 
@@ -229,6 +291,86 @@ bool fetch_multipliers_from_illuminant(
     return success;
 }
 
+/// The IDT matrices solved within the process, used as the starting points
+/// of fitting the matrices of the same camera under other illuminants.
+class WarmStartMatrices
+{
+public:
+    /// Find the matrix solved for the illuminant closest to the one having
+    /// the white balancing weights `WB_multipliers` for the given camera.
+    /// @result `false` if no matrices have been solved for the camera.
+    bool find(
+        const std::string                &camera_make,
+        const std::string                &camera_model,
+        const std::vector<double>        &WB_multipliers,
+        std::vector<std::vector<double>> &out_matrix ) const
+    {
+        const auto chromaticity = WB_chromaticity( WB_multipliers );
+
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        auto iter = _matrices.find( { camera_make, camera_model } );
+        if ( iter == _matrices.end() )
+            return false;
+
+        double                   best_distance = 0.0;
+        const cache::MatrixData *best_matrix   = nullptr;
+        for ( const auto &[key, matrix]: iter->second )
+        {
+            const double d0       = key.first - chromaticity.first;
+            const double d1       = key.second - chromaticity.second;
+            const double distance = d0 * d0 + d1 * d1;
+            if ( !best_matrix || distance < best_distance )
+            {
+                best_distance = distance;
+                best_matrix   = &matrix;
+            }
+        }
+
+        out_matrix.assign( 3, std::vector<double>( 3 ) );
+        for ( size_t row = 0; row < 3; row++ )
+            for ( size_t col = 0; col < 3; col++ )
+                out_matrix[row][col] = ( *best_matrix )[row][col];
+        return true;
+    }
+
+    /// Store a matrix solved for the illuminant having the white balancing
+    /// weights `WB_multipliers`.
+    void add(
+        const std::string         &camera_make,
+        const std::string         &camera_model,
+        const std::vector<double> &WB_multipliers,
+        const cache::MatrixData   &matrix )
+    {
+        const auto chromaticity = WB_chromaticity( WB_multipliers );
+
+        std::lock_guard<std::mutex> lock( _mutex );
+        _matrices[{ camera_make, camera_model }][chromaticity] = matrix;
+    }
+
+private:
+    /// The illuminant as seen by the camera, independent of the
+    /// normalisation of the white balancing weights.
+    static std::pair<double, double>
+    WB_chromaticity( const std::vector<double> &WB_multipliers )
+    {
+        return { std::log( WB_multipliers[0] / WB_multipliers[1] ),
+                 std::log( WB_multipliers[2] / WB_multipliers[1] ) };
+    }
+
+    mutable std::mutex _mutex;
+    std::map<
+        std::pair<std::string, std::string>,
+        std::map<std::pair<double, double>, cache::MatrixData>>
+        _matrices;
+};
+
+WarmStartMatrices &get_warm_start_matrices()
+{
+    static WarmStartMatrices warm_start_matrices;
+    return warm_start_matrices;
+}
+
 bool solve_matrix_from_illuminant(
     const std::string    &camera_make,
     const std::string    &camera_model,
@@ -247,9 +389,30 @@ bool solve_matrix_from_illuminant(
         return false;
     }
 
-    if ( !solver.calculate_IDT_matrix() )
+    const auto &WB_multipliers = solver.get_WB_multipliers();
+
+    // Warm-start the fast fit from the closest illuminant solved before.
+    const bool fast = solver.fit_mode == core::SpectralSolver::FitMode::Fast;
+
+    solver.IDT_start.clear();
+    if ( fast )
     {
-        return false;
+        bool found = get_warm_start_matrices().find(
+            camera_make, camera_model, WB_multipliers, solver.IDT_start );
+
+        if ( found && solver.verbosity > 0 )
+        {
+            std::cerr << "Fitting the IDT matrix starting from the matrix of "
+                      << "the closest illuminant solved." << std::endl;
+        }
+    }
+
+    {
+        TraceSpan trace_span( "curve_fit", "solver" );
+        if ( !solver.calculate_IDT_matrix() )
+        {
+            return false;
+        }
     }
 
     const auto &matrix = solver.get_IDT_matrix();
@@ -257,6 +420,12 @@ bool solve_matrix_from_illuminant(
         for ( size_t col = 0; col < 3; col++ )
             cache_data[row][col] = matrix[row][col];
 
+    if ( fast )
+    {
+        get_warm_start_matrices().add(
+            camera_make, camera_model, WB_multipliers, cache_data );
+    }
+
     return true;
 }
 
@@ -267,22 +436,46 @@ bool fetch_matrix_from_illuminant(
     core::SpectralSolver             &solver,
     int                               verbosity,
     bool                              disable_cache,
+    cache::PersistentCache           *persistent_cache,
     std::vector<std::vector<double>> &out_matrix )
 {
-    cache::CameraAndIlluminantDescriptor descriptor = { camera_make,
-                                                        camera_model,
-                                                        in_illuminant };
+    cache::CameraIlluminantAndFitDescriptor descriptor = {
+        camera_make,
+        camera_model,
+        in_illuminant,
+        solver.fit_mode == core::SpectralSolver::FitMode::Fast
+    };
 
     auto &matrix_from_illuminant_cache =
         cache::get_matrix_from_illuminant_cache();
     matrix_from_illuminant_cache.verbosity = verbosity;
     matrix_from_illuminant_cache.disabled  = disable_cache;
 
+    TraceSpan trace_span( "fetch_matrix_from_illuminant", "cache" );
+    bool      fetched = false;
+    bool      solved  = false;
+
     const auto &entry = matrix_from_illuminant_cache.fetch(
         descriptor, [&]( cache::MatrixData &cache_data ) {
-            return solve_matrix_from_illuminant(
-                camera_make, camera_model, in_illuminant, solver, cache_data );
+            fetched = true;
+            return cache::persistent_fetch(
+                persistent_cache,
+                matrix_from_illuminant_cache.name,
+                descriptor,
+                cache_data,
+                [&]( cache::MatrixData &data ) {
+                    TraceSpan solve_span( "solve_matrix", "solver" );
+                    solved = true;
+                    return solve_matrix_from_illuminant(
+                        camera_make,
+                        camera_model,
+                        in_illuminant,
+                        solver,
+                        data );
+                },
+                verbosity );
         } );
+    trace_span.set_arg( "cache", cache_outcome( fetched, solved ) );
 
     bool success = entry.first;
     if ( !success )
@@ -318,6 +511,163 @@ bool fetch_matrix_from_illuminant(
     return true;
 }
 
+bool equal_insensitive( const std::string &str1, const std::string &str2 )
+{
+    auto equal = []( char a, char b ) {
+        return std::tolower( static_cast<unsigned char>( a ) ) ==
+               std::tolower( static_cast<unsigned char>( b ) );
+    };
+    return std::equal(
+        str1.begin(), str1.end(), str2.begin(), str2.end(), equal );
+}
+
+/// The path of the colour temperature table file of a camera in
+/// `table_directory`.
+std::string CCT_table_path(
+    const std::string &table_directory,
+    const std::string &camera_make,
+    const std::string &camera_model )
+{
+    std::string name = camera_make + "_" + camera_model;
+    for ( char &c: name )
+    {
+        if ( std::isalnum( static_cast<unsigned char>( c ) ) )
+            c = static_cast<char>( std::tolower( c ) );
+        else
+            c = '_';
+    }
+
+    std::filesystem::path path( table_directory );
+    path.append( "cct_table_" + name + ".json" );
+    return path.string();
+}
+
+bool build_CCT_table(
+    const std::string    &camera_make,
+    const std::string    &camera_model,
+    const std::string    &table_directory,
+    core::SpectralSolver &solver,
+    int                   verbosity,
+    size_t                thread_count,
+    cache::CCTTableData  &cache_data )
+{
+    auto table = std::make_shared<core::CCTMatrixTable>();
+
+    std::string path;
+    if ( !table_directory.empty() )
+    {
+        path = CCT_table_path( table_directory, camera_make, camera_model );
+        if ( std::filesystem::exists( path ) && table->load( path ) &&
+             equal_insensitive( table->camera_make, camera_make ) &&
+             equal_insensitive( table->camera_model, camera_model ) &&
+             !table->entries.empty() )
+        {
+            if ( verbosity > 0 )
+            {
+                std::cerr << "Loaded the colour temperature table " << path
+                          << "." << std::endl;
+            }
+            cache_data = table;
+            return true;
+        }
+    }
+
+    if ( !configure_spectral_solver(
+             solver, camera_make, camera_model, "", true, true ) )
+    {
+        return false;
+    }
+
+    if ( verbosity > 0 )
+    {
+        std::cerr << "Building the colour temperature table for camera make: '"
+                  << camera_make << "', model: '" << camera_model << "'."
+                  << std::endl;
+    }
+
+    if ( !table->build(
+             solver,
+             camera_make,
+             camera_model,
+             2000,
+             12000,
+             100,
+             thread_count ) )
+        return false;
+
+    if ( !path.empty() && table->save( path ) && verbosity > 0 )
+    {
+        std::cerr << "Saved the colour temperature table " << path << "."
+                  << std::endl;
+    }
+
+    cache_data = table;
+    return true;
+}
+
+bool fetch_matrix_from_CCT_table(
+    const std::string                &camera_make,
+    const std::string                &camera_model,
+    const std::vector<double>        &wb_multipliers,
+    const std::string                &table_directory,
+    core::SpectralSolver             &solver,
+    int                               verbosity,
+    bool                              disable_cache,
+    std::vector<std::vector<double>> &out_matrix,
+    size_t                            thread_count )
+{
+    cache::CameraDescriptor descriptor = { camera_make, camera_model };
+
+    auto &CCT_table_cache     = cache::get_CCT_table_cache();
+    CCT_table_cache.verbosity = verbosity;
+    CCT_table_cache.disabled  = disable_cache;
+
+    TraceSpan trace_span( "fetch_matrix_from_CCT_table", "cache" );
+    bool      fetched = false;
+
+    const auto &entry = CCT_table_cache.fetch(
+        descriptor, [&]( cache::CCTTableData &cache_data ) {
+            TraceSpan build_span( "build_CCT_table", "solver" );
+            fetched = true;
+            return build_CCT_table(
+                camera_make,
+                camera_model,
+                table_directory,
+                solver,
+                verbosity,
+                thread_count,
+                cache_data );
+        } );
+    trace_span.set_arg( "cache", cache_outcome( fetched, fetched ) );
+
+    double CCT = 0.0;
+    if ( !entry.first ||
+         !entry.second->interpolate( wb_multipliers, out_matrix, &CCT ) )
+    {
+        std::cerr << "Failed to calculate the input transform matrix."
+                  << std::endl;
+        return false;
+    }
+
+    if ( verbosity > 0 )
+    {
+        std::cerr << "Interpolated the IDT matrix at " << CCT << "K."
+                  << std::endl;
+        std::cerr << "Input Device Transform (IDT) matrix:" << std::endl;
+        for ( auto &row: out_matrix )
+        {
+            std::cerr << "  ";
+            for ( auto &col: row )
+            {
+                std::cerr << col << " ";
+            }
+            std::cerr << std::endl;
+        }
+    }
+
+    return true;
+}
+
 void solve_matrix_from_metadata(
     const core::Metadata &metadata, cache::MatrixData &cache_data )
 {
@@ -342,11 +692,17 @@ void fetch_matrix_from_metadata(
     matrix_from_dng_metadata_cache.verbosity = verbosity;
     matrix_from_dng_metadata_cache.disabled  = disable_cache;
 
+    TraceSpan trace_span( "fetch_matrix_from_metadata", "cache" );
+    bool      fetched = false;
+
     const auto &entry = matrix_from_dng_metadata_cache.fetch(
         descriptor, [&]( cache::MatrixData &cache_data ) {
+            TraceSpan solve_span( "solve_matrix", "solver" );
+            fetched = true;
             solve_matrix_from_metadata( metadata, cache_data );
             return true;
         } );
+    trace_span.set_arg( "cache", cache_outcome( fetched, fetched ) );
 
     const auto &matrix = entry.second;
     out_matrix.resize( 3 );
@@ -10,6 +10,11 @@
 
 namespace rta
 {
+namespace cache
+{
+class PersistentCache;
+} // namespace cache
+
 namespace util
 {
 
@@ -20,16 +25,18 @@ bool fetch_illuminant_from_multipliers(
     core::SpectralSolver      &solver,
     int                        verbosity,
     bool                       disable_cache,
+    cache::PersistentCache    *persistent_cache,
     std::string               &out_illuminant );
 
 bool fetch_multipliers_from_illuminant(
-    const std::string    &camera_make,
-    const std::string    &camera_model,
-    const std::string    &in_illuminant,
-    core::SpectralSolver &solver,
-    int                   verbosity,
-    bool                  disable_cache,
-    std::vector<double>  &out_multipliers );
+    const std::string      &camera_make,
+    const std::string      &camera_model,
+    const std::string      &in_illuminant,
+    core::SpectralSolver   &solver,
+    int                     verbosity,
+    bool                    disable_cache,
+    cache::PersistentCache *persistent_cache,
+    std::vector<double>    &out_multipliers );
 
 bool fetch_matrix_from_illuminant(
     const std::string                &camera_make,
@@ -38,8 +45,26 @@ bool fetch_matrix_from_illuminant(
     core::SpectralSolver             &solver,
     int                               verbosity,
     bool                              disable_cache,
+    cache::PersistentCache           *persistent_cache,
     std::vector<std::vector<double>> &out_matrix );
 
+/// Interpolate the IDT matrix for the white balance from the colour
+/// temperature table of the camera, see `core::CCTMatrixTable`. The table
+/// gets loaded from `table_directory` if present there, otherwise built and
+/// saved there. The table is kept in memory for the following look-ups.
+/// The table gets built on `thread_count` threads, 0 for all hardware
+/// threads.
+bool fetch_matrix_from_CCT_table(
+    const std::string                &camera_make,
+    const std::string                &camera_model,
+    const std::vector<double>        &wb_multipliers,
+    const std::string                &table_directory,
+    core::SpectralSolver             &solver,
+    int                               verbosity,
+    bool                              disable_cache,
+    std::vector<std::vector<double>> &out_matrix,
+    size_t                            thread_count = 0 );
+
 void fetch_matrix_from_metadata(
     const core::Metadata             &metadata,
     int                               verbosity,
@@ -0,0 +1,593 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include <rawtoaces/conversion_server.h>
+
+#include "bounded_queue.h"
+#include "rawtoaces_util_priv.h"
+
+#include <rawtoaces/spectral_database.h>
+
+#include <OpenImageIO/argparse.h>
+#include <OpenImageIO/imageio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#ifndef WIN32
+#    include <poll.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#endif
+
+namespace rta
+{
+namespace util
+{
+
+ConversionServer::~ConversionServer()
+{
+    close_socket();
+}
+
+bool ConversionServer::serve( const std::string &path )
+{
+    if ( !listen( path ) )
+        return false;
+    run();
+    return true;
+}
+
+void ConversionServer::stop()
+{
+    _stopping = true;
+}
+
+#ifndef WIN32
+
+// The client sends the working directory and the arguments of a job, each
+// terminated by a null character, and shuts down its side of the connection.
+// The server replies with tab-separated lines, reporting the progress as
+//     started <index> <total> <path>
+//     finished <index> <total> <success> <path>
+//     skipped <up-to-date files> <total>
+//     error <message>
+// and finally
+//     exit <status>
+
+/// The options which print and exit the process, not allowed in a job.
+static const std::set<std::string> unsupported_job_options = {
+    "-h",
+    "--help",
+    "--version",
+    "--list-formats",
+    "--list-cameras",
+    "--list-illuminants"
+};
+
+/// Fill in the address of the socket at `path`.
+/// @result `false` if the path is too long for a socket address.
+static bool socket_address( const std::string &path, sockaddr_un &address )
+{
+    std::memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    if ( path.empty() || path.size() >= sizeof( address.sun_path ) )
+    {
+        std::cerr << "ERROR: Invalid socket path '" << path
+                  << "', must be between 1 and "
+                  << sizeof( address.sun_path ) - 1 << " characters long."
+                  << std::endl;
+        return false;
+    }
+    std::memcpy( address.sun_path, path.c_str(), path.size() );
+    return true;
+}
+
+/// Write all of `data` to `connection`.
+/// @result `false` if the peer has gone away.
+static bool send_all( int connection, const std::string &data )
+{
+#    ifdef MSG_NOSIGNAL
+    // A client going away must not kill the server with SIGPIPE.
+    const int flags = MSG_NOSIGNAL;
+#    else
+    const int flags = 0;
+#    endif
+
+    size_t sent = 0;
+    while ( sent < data.size() )
+    {
+        ssize_t result =
+            send( connection, data.data() + sent, data.size() - sent, flags );
+        if ( result < 0 && errno == EINTR )
+            continue;
+        if ( result <= 0 )
+            return false;
+        sent += static_cast<size_t>( result );
+    }
+    return true;
+}
+
+/// Read from `connection` until the peer shuts down its side.
+/// @result `false` if reading has failed.
+static bool receive_all( int connection, std::string &data )
+{
+    char buffer[4096];
+    while ( true )
+    {
+        ssize_t result = recv( connection, buffer, sizeof( buffer ), 0 );
+        if ( result < 0 && errno == EINTR )
+            continue;
+        if ( result < 0 )
+            return false;
+        if ( result == 0 )
+            return true;
+        data.append( buffer, static_cast<size_t>( result ) );
+    }
+}
+
+/// Make a relative `path` relative to `directory`.
+static std::string
+resolve_path( const std::string &path, const std::string &directory )
+{
+    if ( path.empty() || std::filesystem::path( path ).is_absolute() )
+        return path;
+    return ( std::filesystem::path( directory ) / path )
+        .lexically_normal()
+        .string();
+}
+
+bool ConversionServer::listen( const std::string &path )
+{
+    close_socket();
+
+    sockaddr_un address;
+    if ( !socket_address( path, address ) )
+        return false;
+
+    // Replace the socket of a server which has not removed it, but never
+    // anything else.
+    struct stat info;
+    if ( lstat( path.c_str(), &info ) == 0 )
+    {
+        if ( !S_ISSOCK( info.st_mode ) )
+        {
+            std::cerr << "ERROR: Failed to create the socket " << path
+                      << ", the file exists." << std::endl;
+            return false;
+        }
+        unlink( path.c_str() );
+    }
+
+    int listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( listener < 0 ||
+         bind( listener,
+               reinterpret_cast<const sockaddr *>( &address ),
+               sizeof( address ) ) != 0 ||
+         ::listen( listener, SOMAXCONN ) != 0 )
+    {
+        std::cerr << "ERROR: Failed to listen on the socket " << path << ": "
+                  << std::strerror( errno ) << std::endl;
+        if ( listener >= 0 )
+            close( listener );
+        return false;
+    }
+
+    _listener = listener;
+    _path     = path;
+    _stopping = false;
+
+    // Load the plugins and the default database now, rather than on the
+    // first job.
+    ImageConverter().get_supported_formats();
+    core::SpectralDatabase::get( database_paths() );
+
+    if ( verbosity > 0 )
+    {
+        std::cout << "Listening for conversion jobs on " << path << "."
+                  << std::endl;
+    }
+    return true;
+}
+
+void ConversionServer::close_socket()
+{
+    if ( _listener < 0 )
+        return;
+
+    close( _listener );
+    unlink( _path.c_str() );
+    _listener = -1;
+}
+
+void ConversionServer::run()
+{
+    if ( _listener < 0 )
+        return;
+
+    const size_t worker_count = std::max<size_t>( max_jobs, 1 );
+
+    // The thread pool of OpenImageIO is shared by the concurrent jobs, so it
+    // gets sized once here for the workers, the same way as for a batch of
+    // `max_jobs` files, and the jobs leave it alone.
+    ImageConverter::Settings budget;
+    budget.jobs = static_cast<int>( worker_count );
+    OIIO::attribute( "threads", conversion_threads( budget ) * budget.jobs );
+
+    // Holds the connections accepted while all workers are busy. Blocking
+    // on a full queue leaves the further connections waiting in the backlog
+    // of the socket.
+    BoundedQueue<int>        connections( worker_count );
+    std::vector<std::thread> workers;
+    for ( size_t i = 0; i < worker_count; i++ )
+    {
+        workers.emplace_back( [this, &connections]() {
+            int connection;
+            while ( connections.pop( connection ) )
+            {
+                run_job( connection );
+                close( connection );
+            }
+        } );
+    }
+
+    while ( !_stopping )
+    {
+        // Wake up regularly to notice `stop()`.
+        pollfd request = { _listener, POLLIN, 0 };
+        int    result  = poll( &request, 1, 100 );
+        if ( result < 0 && errno != EINTR )
+        {
+            std::cerr << "ERROR: Failed to wait for connections: "
+                      << std::strerror( errno ) << std::endl;
+            break;
+        }
+        if ( result <= 0 )
+            continue;
+
+        int connection = accept( _listener, nullptr, nullptr );
+        if ( connection >= 0 )
+        {
+#    if !defined( MSG_NOSIGNAL ) && defined( SO_NOSIGPIPE )
+            int enable = 1;
+            setsockopt(
+                connection,
+                SOL_SOCKET,
+                SO_NOSIGPIPE,
+                &enable,
+                sizeof( enable ) );
+#    endif
+            connections.push( std::move( connection ) );
+        }
+    }
+
+    connections.close();
+    for ( auto &worker: workers )
+        worker.join();
+
+    close_socket();
+}
+
+void ConversionServer::run_job( int connection )
+{
+    auto reply = [connection]( const std::string &line ) {
+        return send_all( connection, line + "\n" );
+    };
+
+    auto fail = [&reply]( const std::string &message ) {
+        reply( "error\t" + message );
+        reply( "exit\t1" );
+    };
+
+    std::string request;
+    if ( !receive_all( connection, request ) )
+        return;
+
+    std::vector<std::string> fields;
+    size_t                   begin = 0;
+    size_t                   end;
+    while ( ( end = request.find( '\0', begin ) ) != std::string::npos )
+    {
+        fields.push_back( request.substr( begin, end - begin ) );
+        begin = end + 1;
+    }
+    if ( fields.empty() )
+    {
+        fail( "Malformed job request." );
+        return;
+    }
+
+    const std::string directory = fields[0];
+    fields.erase( fields.begin() );
+
+    for ( const auto &field: fields )
+    {
+        if ( unsupported_job_options.count( field ) )
+        {
+            fail(
+                "The option " + field +
+                " is not supported in a job submitted to a server." );
+            return;
+        }
+    }
+
+    // Parse the job into a fresh converter, the same way as the command line.
+    ImageConverter converter;
+    OIIO::ArgParse arg_parser;
+    arg_parser.arg( "filename" ).action( OIIO::ArgParse::append() ).hidden();
+    converter.init_parser( arg_parser );
+    arg_parser.exit_on_error( false );
+
+    std::vector<const char *> argv = { "rawtoaces" };
+    for ( const auto &field: fields )
+        argv.push_back( field.c_str() );
+
+    if ( arg_parser.parse_args( static_cast<int>( argv.size() ), argv.data() ) <
+         0 )
+    {
+        fail( arg_parser.geterror() );
+        return;
+    }
+    if ( !converter.parse_parameters( arg_parser ) )
+    {
+        fail( "Invalid parameters, see the log of the server." );
+        return;
+    }
+
+    auto &settings = converter.settings;
+    for ( auto &database_directory: settings.database_directories )
+        database_directory = resolve_path( database_directory, directory );
+    settings.output_dir = resolve_path( settings.output_dir, directory );
+    settings.CCT_table_directory =
+        resolve_path( settings.CCT_table_directory, directory );
+    settings.cache_file    = resolve_path( settings.cache_file, directory );
+    settings.manifest_file = resolve_path( settings.manifest_file, directory );
+    settings.metrics_file  = resolve_path( settings.metrics_file, directory );
+    settings.trace_file    = resolve_path( settings.trace_file, directory );
+
+    auto files = arg_parser["filename"].as_vec<std::string>();
+    if ( files.empty() || ( files.size() == 1 && files[0] == "" ) )
+    {
+        fail( "No input files given." );
+        return;
+    }
+    for ( auto &file: files )
+        file = resolve_path( file, directory );
+
+    std::vector<std::string> input_files;
+    for ( auto const &batch:
+          collect_image_files( files, settings.recursive, 0 ) )
+    {
+        input_files.insert( input_files.end(), batch.begin(), batch.end() );
+    }
+
+    if ( verbosity > 0 )
+    {
+        std::cout << "Converting a job of " << input_files.size()
+                  << " files from " << directory << "." << std::endl;
+    }
+
+    BatchConverter batch_converter;
+    batch_converter.settings         = settings;
+    batch_converter.size_thread_pool = false;
+
+    batch_converter.on_file_started =
+        [&reply]( size_t index, size_t total, const BatchResult &result ) {
+            reply(
+                "started\t" + std::to_string( index ) + "\t" +
+                std::to_string( total ) + "\t" + result.input_filename );
+        };
+
+    batch_converter.on_file_finished =
+        [&reply]( size_t index, size_t total, const BatchResult &result ) {
+            reply(
+                "finished\t" + std::to_string( index ) + "\t" +
+                std::to_string( total ) + "\t" +
+                ( result.success ? "1" : "0" ) + "\t" +
+                result.input_filename );
+        };
+
+    bool result = batch_converter.process( input_files );
+
+    size_t up_to_date = 0;
+    for ( auto const &file_result: batch_converter.get_results() )
+    {
+        if ( file_result.up_to_date )
+            ++up_to_date;
+    }
+    if ( up_to_date > 0 )
+    {
+        reply(
+            "skipped\t" + std::to_string( up_to_date ) + "\t" +
+            std::to_string( batch_converter.get_results().size() ) );
+    }
+
+    reply( result ? "exit\t0" : "exit\t1" );
+}
+
+int submit_job(
+    const std::string              &path,
+    const std::vector<std::string> &arguments,
+    const BatchConverter::Callback &on_file_started,
+    const BatchConverter::Callback &on_file_finished )
+{
+    sockaddr_un address;
+    if ( !socket_address( path, address ) )
+        return -1;
+
+    int connection = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( connection < 0 ||
+         connect(
+             connection,
+             reinterpret_cast<const sockaddr *>( &address ),
+             sizeof( address ) ) != 0 )
+    {
+        std::cerr << "ERROR: Failed to connect to the server at " << path
+                  << ": " << std::strerror( errno ) << std::endl;
+        if ( connection >= 0 )
+            close( connection );
+        return -1;
+    }
+
+#    if !defined( MSG_NOSIGNAL ) && defined( SO_NOSIGPIPE )
+    int enable = 1;
+    setsockopt(
+        connection, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof( enable ) );
+#    endif
+
+    std::error_code error;
+    std::string     request = std::filesystem::current_path( error ).string();
+    request.push_back( '\0' );
+    for ( const auto &argument: arguments )
+    {
+        request += argument;
+        request.push_back( '\0' );
+    }
+
+    if ( !send_all( connection, request ) )
+    {
+        std::cerr << "ERROR: Failed to submit the job to the server at "
+                  << path << "." << std::endl;
+        close( connection );
+        return -1;
+    }
+    shutdown( connection, SHUT_WR );
+
+    // Split a reply line into `count` fields, the last one holding the rest
+    // of the line, so the paths may contain tabs.
+    auto split = []( const std::string &line, size_t count ) {
+        std::vector<std::string> fields;
+        size_t                   begin = 0;
+        while ( fields.size() + 1 < count )
+        {
+            size_t end = line.find( '\t', begin );
+            if ( end == std::string::npos )
+                break;
+            fields.push_back( line.substr( begin, end - begin ) );
+            begin = end + 1;
+        }
+        fields.push_back( line.substr( begin ) );
+        return fields;
+    };
+
+    int         status = -1;
+    size_t      failed = 0;
+    size_t      total  = 0;
+    std::string pending;
+    char        buffer[4096];
+    while ( status < 0 )
+    {
+        ssize_t count = recv( connection, buffer, sizeof( buffer ), 0 );
+        if ( count < 0 && errno == EINTR )
+            continue;
+        if ( count <= 0 )
+            break;
+        pending.append( buffer, static_cast<size_t>( count ) );
+
+        size_t end;
+        while ( ( end = pending.find( '\n' ) ) != std::string::npos )
+        {
+            const std::string line = pending.substr( 0, end );
+            pending.erase( 0, end + 1 );
+
+            const std::string type = line.substr( 0, line.find( '\t' ) );
+            if ( type == "started" || type == "finished" )
+            {
+                const bool finished = type == "finished";
+                auto       fields   = split( line, finished ? 5 : 4 );
+                if ( fields.size() != ( finished ? 5u : 4u ) )
+                    continue;
+
+                BatchResult result;
+                result.input_filename = fields.back();
+                result.success        = finished && fields[3] == "1";
+
+                const size_t index = std::stoul( fields[1] );
+                total              = std::stoul( fields[2] );
+                if ( finished && !result.success )
+                    ++failed;
+
+                const auto &callback =
+                    finished ? on_file_finished : on_file_started;
+                if ( callback )
+                    callback( index, total, result );
+            }
+            else if ( type == "skipped" )
+            {
+                auto fields = split( line, 3 );
+                if ( fields.size() == 3 )
+                {
+                    std::cout << "Skipped " << fields[1] << " of " << fields[2]
+                              << " files, as they are up to date."
+                              << std::endl;
+                }
+            }
+            else if ( type == "error" )
+            {
+                std::cerr << "ERROR: " << split( line, 2 ).back()
+                          << std::endl;
+            }
+            else if ( type == "exit" )
+            {
+                status = std::stoi( split( line, 2 ).back() );
+                break;
+            }
+        }
+    }
+    close( connection );
+
+    if ( status < 0 )
+    {
+        std::cerr << "ERROR: The server at " << path
+                  << " has closed the connection before finishing the job."
+                  << std::endl;
+        return -1;
+    }
+
+    if ( failed > 0 )
+    {
+        std::cerr << failed << " of " << total << " files failed to convert."
+                  << std::endl;
+    }
+
+    return status;
+}
+
+#else
+
+bool ConversionServer::listen( const std::string & )
+{
+    std::cerr << "ERROR: The conversion server is not supported on Windows."
+              << std::endl;
+    return false;
+}
+
+void ConversionServer::run() {}
+
+void ConversionServer::run_job( int ) {}
+
+void ConversionServer::close_socket() {}
+
+int submit_job(
+    const std::string &,
+    const std::vector<std::string> &,
+    const BatchConverter::Callback &,
+    const BatchConverter::Callback & )
+{
+    std::cerr << "ERROR: The conversion server is not supported on Windows."
+              << std::endl;
+    return -1;
+}
+
+#endif
+
+} // namespace util
+} // namespace rta
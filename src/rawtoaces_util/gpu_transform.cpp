@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "gpu_transform.h"
+
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#if defined( RTA_HAS_OPENCL )
+#    define CL_TARGET_OPENCL_VERSION 120
+#    if defined( __APPLE__ )
+#        include <OpenCL/opencl.h>
+#    else
+#        include <CL/cl.h>
+#    endif
+#endif
+
+namespace rta
+{
+namespace util
+{
+
+#if defined( RTA_HAS_OPENCL )
+
+/// The kernel transforming one pixel per work item. The contraction into
+/// fused multiply-adds is disabled, so the results match the CPU kernel.
+static const char *kernel_source = R"(
+#pragma OPENCL FP_CONTRACT OFF
+
+__kernel void transform_to_half(
+    __constant float     *m,
+    __global const float *src,
+    uint                  src_row_stride,
+    __global half        *dst,
+    uint                  dst_row_stride,
+    uint                  channels )
+{
+    const size_t x = get_global_id( 0 );
+    const size_t y = get_global_id( 1 );
+
+    __global const float *pixel = src + y * src_row_stride + x * channels;
+    const size_t          out   = y * dst_row_stride + x * channels;
+
+    const float r = pixel[0];
+    const float g = pixel[1];
+    const float b = pixel[2];
+
+    vstore_half_rte( m[0] * r + m[1] * g + m[2] * b, out, dst );
+    vstore_half_rte( m[3] * r + m[4] * g + m[5] * b, out + 1, dst );
+    vstore_half_rte( m[6] * r + m[7] * g + m[8] * b, out + 2, dst );
+    if ( channels > 3 )
+        vstore_half_rte( pixel[3], out + 3, dst );
+}
+)";
+
+struct GPUTransform::Impl
+{
+    cl_context       context = nullptr;
+    cl_command_queue queue   = nullptr;
+    cl_program       program = nullptr;
+    cl_kernel        kernel  = nullptr;
+
+    ~Impl()
+    {
+        if ( kernel )
+            clReleaseKernel( kernel );
+        if ( program )
+            clReleaseProgram( program );
+        if ( queue )
+            clReleaseCommandQueue( queue );
+        if ( context )
+            clReleaseContext( context );
+    }
+
+    /// Set up the first GPU found, and build the kernel for it.
+    /// @result `true` if initialised successfully.
+    bool init( std::string &device_name );
+};
+
+/// Releases an OpenCL buffer when going out of scope.
+struct BufferGuard
+{
+    cl_mem buffer = nullptr;
+
+    ~BufferGuard()
+    {
+        if ( buffer )
+            clReleaseMemObject( buffer );
+    }
+};
+
+bool GPUTransform::Impl::init( std::string &device_name )
+{
+    cl_uint platform_count = 0;
+    if ( clGetPlatformIDs( 0, nullptr, &platform_count ) != CL_SUCCESS ||
+         platform_count == 0 )
+    {
+        return false;
+    }
+
+    std::vector<cl_platform_id> platforms( platform_count );
+    if ( clGetPlatformIDs( platform_count, platforms.data(), nullptr ) !=
+         CL_SUCCESS )
+    {
+        return false;
+    }
+
+    cl_device_id device = nullptr;
+    for ( auto platform: platforms )
+    {
+        cl_uint device_count = 0;
+        if ( clGetDeviceIDs(
+                 platform, CL_DEVICE_TYPE_GPU, 1, &device, &device_count ) ==
+                 CL_SUCCESS &&
+             device_count > 0 )
+        {
+            break;
+        }
+        device = nullptr;
+    }
+    if ( !device )
+        return false;
+
+    char   name[256] = {};
+    size_t size      = 0;
+    if ( clGetDeviceInfo(
+             device, CL_DEVICE_NAME, sizeof( name ) - 1, name, &size ) ==
+         CL_SUCCESS )
+    {
+        device_name = name;
+    }
+
+    cl_int error;
+    context = clCreateContext( nullptr, 1, &device, nullptr, nullptr, &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    queue = clCreateCommandQueue( context, device, 0, &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    program = clCreateProgramWithSource(
+        context, 1, &kernel_source, nullptr, &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    if ( clBuildProgram( program, 1, &device, "", nullptr, nullptr ) !=
+         CL_SUCCESS )
+    {
+        size_t log_size = 0;
+        clGetProgramBuildInfo(
+            program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size );
+        std::string log( log_size, '\0' );
+        clGetProgramBuildInfo(
+            program,
+            device,
+            CL_PROGRAM_BUILD_LOG,
+            log_size,
+            log.data(),
+            nullptr );
+        std::cerr << "WARNING: Failed to build the OpenCL kernel for "
+                  << device_name << ": " << log << std::endl;
+        return false;
+    }
+
+    kernel = clCreateKernel( program, "transform_to_half", &error );
+    return error == CL_SUCCESS;
+}
+
+GPUTransform *GPUTransform::instance()
+{
+    static std::once_flag                once;
+    static std::unique_ptr<GPUTransform> transform;
+
+    std::call_once( once, []() {
+        std::unique_ptr<GPUTransform> result( new GPUTransform );
+        result->_impl = std::make_unique<Impl>();
+        if ( result->_impl->init( result->_device_name ) )
+            transform = std::move( result );
+    } );
+
+    return transform.get();
+}
+
+bool GPUTransform::apply(
+    const float matrix[3][3],
+    const float *src,
+    size_t       src_row_stride,
+    uint16_t    *dst,
+    size_t       dst_row_stride,
+    size_t       width,
+    size_t       height,
+    int          channels )
+{
+    if ( width == 0 || height == 0 )
+        return true;
+
+    const size_t limit = std::numeric_limits<cl_uint>::max();
+    if ( src_row_stride > limit || dst_row_stride > limit )
+        return false;
+
+    const size_t pixels_size = width * static_cast<size_t>( channels );
+    const size_t src_size =
+        ( ( height - 1 ) * src_row_stride + pixels_size ) * sizeof( float );
+    const size_t dst_size =
+        ( ( height - 1 ) * dst_row_stride + pixels_size ) * sizeof( uint16_t );
+
+    std::lock_guard<std::mutex> guard( _mutex );
+
+    // Use the pixel buffers directly, so the driver can pin them for the
+    // transfers instead of staging them through another copy.
+    cl_int      error;
+    BufferGuard matrix_buffer;
+    matrix_buffer.buffer = clCreateBuffer(
+        _impl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        9 * sizeof( float ),
+        const_cast<float *>( &matrix[0][0] ),
+        &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    BufferGuard src_buffer;
+    src_buffer.buffer = clCreateBuffer(
+        _impl->context,
+        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        src_size,
+        const_cast<float *>( src ),
+        &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    BufferGuard dst_buffer;
+    dst_buffer.buffer = clCreateBuffer(
+        _impl->context,
+        CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,
+        dst_size,
+        dst,
+        &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    const cl_uint src_stride = static_cast<cl_uint>( src_row_stride );
+    const cl_uint dst_stride = static_cast<cl_uint>( dst_row_stride );
+    const cl_uint count      = static_cast<cl_uint>( channels );
+
+    cl_kernel kernel = _impl->kernel;
+    if ( clSetKernelArg(
+             kernel, 0, sizeof( cl_mem ), &matrix_buffer.buffer ) !=
+             CL_SUCCESS ||
+         clSetKernelArg( kernel, 1, sizeof( cl_mem ), &src_buffer.buffer ) !=
+             CL_SUCCESS ||
+         clSetKernelArg( kernel, 2, sizeof( cl_uint ), &src_stride ) !=
+             CL_SUCCESS ||
+         clSetKernelArg( kernel, 3, sizeof( cl_mem ), &dst_buffer.buffer ) !=
+             CL_SUCCESS ||
+         clSetKernelArg( kernel, 4, sizeof( cl_uint ), &dst_stride ) !=
+             CL_SUCCESS ||
+         clSetKernelArg( kernel, 5, sizeof( cl_uint ), &count ) != CL_SUCCESS )
+    {
+        return false;
+    }
+
+    const size_t global_size[2] = { width, height };
+    if ( clEnqueueNDRangeKernel(
+             _impl->queue,
+             kernel,
+             2,
+             nullptr,
+             global_size,
+             nullptr,
+             0,
+             nullptr,
+             nullptr ) != CL_SUCCESS )
+    {
+        return false;
+    }
+
+    // Mapping the destination buffer synchronises its content with `dst`.
+    void *mapped = clEnqueueMapBuffer(
+        _impl->queue,
+        dst_buffer.buffer,
+        CL_TRUE,
+        CL_MAP_READ,
+        0,
+        dst_size,
+        0,
+        nullptr,
+        nullptr,
+        &error );
+    if ( error != CL_SUCCESS )
+        return false;
+
+    clEnqueueUnmapMemObject(
+        _impl->queue, dst_buffer.buffer, mapped, 0, nullptr, nullptr );
+    return clFinish( _impl->queue ) == CL_SUCCESS;
+}
+
+#else
+
+struct GPUTransform::Impl
+{
+};
+
+GPUTransform *GPUTransform::instance()
+{
+    return nullptr;
+}
+
+bool GPUTransform::apply(
+    const float[3][3],
+    const float *,
+    size_t,
+    uint16_t *,
+    size_t,
+    size_t,
+    size_t,
+    int )
+{
+    return false;
+}
+
+#endif
+
+GPUTransform::~GPUTransform() = default;
+
+const std::string &GPUTransform::device_name() const
+{
+    return _device_name;
+}
+
+} // namespace util
+} // namespace rta
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace rta
+{
+namespace util
+{
+
+/// The colour transform stage running on a GPU via OpenCL: multiplies the
+/// pixels by the pre-multiplied 3x3 matrix and stores them as half floats,
+/// rounding to the nearest, the same as `transform_to_half()`. Only
+/// available if rawtoaces was built with `RTA_ENABLE_OPENCL`, see
+/// `instance()`.
+class GPUTransform
+{
+public:
+    ~GPUTransform();
+
+    GPUTransform( const GPUTransform & )            = delete;
+    GPUTransform &operator=( const GPUTransform & ) = delete;
+
+    /// The transform shared within the process, running on the first GPU
+    /// found. The device gets initialised on the first call.
+    /// @result the shared transform, or `nullptr` if no OpenCL GPU is
+    ///     available, or rawtoaces was built without OpenCL.
+    static GPUTransform *instance();
+
+    /// Transform a region of pixels. The source and the destination rows
+    /// get pinned for the transfers, the calls get serialised.
+    /// @param matrix the 3x3 matrix to multiply the pixels by.
+    /// @param src the first source pixel, interleaved.
+    /// @param src_row_stride the distance between the source rows in floats.
+    /// @param dst receives the bits of the half float pixels, interleaved.
+    /// @param dst_row_stride the distance between the destination rows in
+    ///     half floats.
+    /// @param width the number of pixels per row.
+    /// @param height the number of rows.
+    /// @param channels the number of channels per pixel, 3 or 4.
+    /// @result `true` if transformed successfully.
+    bool apply(
+        const float matrix[3][3],
+        const float *src,
+        size_t       src_row_stride,
+        uint16_t    *dst,
+        size_t       dst_row_stride,
+        size_t       width,
+        size_t       height,
+        int          channels );
+
+    /// The name of the device used.
+    const std::string &device_name() const;
+
+private:
+    struct Impl;
+
+    GPUTransform() = default;
+
+    std::unique_ptr<Impl> _impl;
+    std::string           _device_name;
+    std::mutex            _mutex;
+};
+
+} // namespace util
+} // namespace rta
@@ -7,13 +7,26 @@
 
 #include "transform_cache.h"
 #include "colour_transforms.h"
-
+#include "persistent_cache.h"
+#include "raw_reader.h"
+#include "pixel_kernels.h"
+#include "gpu_transform.h"
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <set>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/imagebufalgo_util.h>
 
 namespace rta
 {
@@ -136,40 +149,199 @@ void check_and_add_file(
     batch.push_back( path.string() );
 }
 
-std::vector<std::vector<std::string>>
-collect_image_files( const std::vector<std::string> &paths )
+/// List the image files of `directory`, and its subdirectories if
+/// `recursive` is set. The names get filtered by `extensions` before looking
+/// at the types of the entries, and the types come from the directory
+/// entries, which avoids a `stat` call per entry where the file system
+/// reports the types along with the names.
+static void list_directory(
+    const std::filesystem::path        &directory,
+    const std::set<std::string>        &extensions,
+    bool                                recursive,
+    std::vector<std::string>           &files,
+    std::vector<std::filesystem::path> &subdirectories )
 {
-    std::vector<std::vector<std::string>> batches( 1 );
+    static const std::set<std::string> ignore_filenames = { ".DS_Store" };
+
+    std::error_code                     error;
+    std::filesystem::directory_iterator iter( directory, error );
+    if ( error )
+    {
+        std::cerr << "Failed to read directory: " << directory << ": "
+                  << error.message() << std::endl;
+        return;
+    }
+
+    for ( ; iter != std::filesystem::directory_iterator();
+          iter.increment( error ) )
+    {
+        const auto &entry = *iter;
+        const auto &path  = entry.path();
+
+        std::string filename = path.filename().string();
+        if ( ignore_filenames.count( filename ) )
+            continue;
+
+        std::string extension =
+            OIIO::Strutil::lower( path.extension().string() );
+        bool candidate = extensions.count( extension ) > 0;
+        if ( !candidate && !recursive )
+            continue;
+
+        std::error_code type_error;
+        bool            is_symlink = entry.is_symlink( type_error );
+
+        if ( candidate &&
+             ( is_symlink || entry.is_regular_file( type_error ) ) )
+        {
+            files.push_back( path.string() );
+        }
+        else if ( recursive && !is_symlink &&
+                  entry.is_directory( type_error ) )
+        {
+            subdirectories.push_back( path );
+        }
+        else if ( candidate )
+        {
+            std::cerr << "Not a regular file: " << path << std::endl;
+        }
+    }
+
+    if ( error )
+    {
+        std::cerr << "Failed to read directory: " << directory << ": "
+                  << error.message() << std::endl;
+    }
+}
+
+size_t scan_image_files(
+    const std::vector<std::string> &paths,
+    const ScanCallback             &on_file,
+    bool                            recursive,
+    size_t                          thread_count )
+{
+    // The directories still to list, with the batch of each.
+    std::deque<std::pair<std::filesystem::path, size_t>> directories;
+    size_t                                               batch_count = 1;
 
     for ( const auto &path: paths )
     {
-        if ( !std::filesystem::exists( path ) )
+        std::error_code error;
+        auto            status = std::filesystem::status( path, error );
+        if ( !std::filesystem::exists( status ) )
         {
             std::cerr << "File or directory not found: " << path << std::endl;
             continue;
         }
 
-        auto canonical_filename = std::filesystem::canonical( path );
-
-        if ( std::filesystem::is_directory( path ) )
+        if ( std::filesystem::is_directory( status ) )
         {
-            std::vector<std::string> &curr_batch = batches.emplace_back();
-            auto it = std::filesystem::directory_iterator( path );
-
-            for ( auto filename: it )
-            {
-                check_and_add_file( filename, curr_batch );
-            }
+            directories.emplace_back( path, batch_count++ );
         }
         else
         {
-            check_and_add_file( path, batches[0] );
+            std::vector<std::string> batch;
+            check_and_add_file( path, batch );
+            for ( const auto &file: batch )
+                on_file( 0, file );
         }
     }
 
+    if ( directories.empty() )
+        return batch_count;
+
+    const auto raw_extensions = supported_raw_extensions();
+
+    std::mutex              mutex;
+    std::condition_variable condition;
+    size_t                  busy = 0;
+
+    // Every worker lists one directory at a time without holding the lock,
+    // then reports the files and queues the subdirectories found. The scan
+    // is done when the queue is empty and no directory is being listed.
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock( mutex );
+        while ( true )
+        {
+            condition.wait(
+                lock, [&]() { return !directories.empty() || busy == 0; } );
+            if ( directories.empty() )
+                break;
+
+            auto [directory, batch] = std::move( directories.front() );
+            directories.pop_front();
+            busy++;
+            lock.unlock();
+
+            std::vector<std::string>           files;
+            std::vector<std::filesystem::path> subdirectories;
+            list_directory(
+                directory, raw_extensions, recursive, files, subdirectories );
+
+            lock.lock();
+            for ( const auto &file: files )
+                on_file( batch, file );
+            for ( auto &subdirectory: subdirectories )
+                directories.emplace_back( std::move( subdirectory ), batch );
+            busy--;
+            condition.notify_all();
+        }
+    };
+
+    if ( thread_count == 0 )
+        thread_count = std::max( std::thread::hardware_concurrency(), 1u );
+
+    std::vector<std::thread> workers;
+    for ( size_t i = 1; i < thread_count; i++ )
+    {
+        workers.emplace_back( worker );
+    }
+    worker();
+
+    for ( auto &thread: workers )
+    {
+        thread.join();
+    }
+
+    return batch_count;
+}
+
+std::vector<std::vector<std::string>> collect_image_files(
+    const std::vector<std::string> &paths,
+    bool                            recursive,
+    size_t                          thread_count )
+{
+    std::vector<std::vector<std::string>> batches( 1 );
+
+    size_t batch_count = scan_image_files(
+        paths,
+        [&batches]( size_t batch, const std::string &path ) {
+            if ( batch >= batches.size() )
+                batches.resize( batch + 1 );
+            batches[batch].push_back( path );
+        },
+        recursive,
+        thread_count );
+
+    // The directories get listed concurrently, and the order of the
+    // entries within a directory is unspecified anyway.
+    batches.resize( batch_count );
+    for ( size_t i = 1; i < batches.size(); i++ )
+        std::sort( batches[i].begin(), batches[i].end() );
+
     return batches;
 }
 
+int conversion_threads( const ImageConverter::Settings &settings )
+{
+    if ( settings.threads > 0 )
+        return settings.threads;
+
+    const int hardware_threads =
+        static_cast<int>( std::thread::hardware_concurrency() );
+    return std::max( hardware_threads / std::max( settings.jobs, 1 ), 1 );
+}
+
 /// Gets the list of database paths for rawtoaces data files.
 ///
 /// Precedence:
@@ -294,6 +466,8 @@ bool prepare_transform_spectral(
     std::vector<std::vector<double>> &IDT_matrix,
     std::vector<std::vector<double>> &CAT_matrix )
 {
+    TraceSpan trace_span( "prepare_transform_spectral", "solver" );
+
     // Initialize and validate camera identification
     std::string lower_illuminant = OIIO::Strutil::lower( settings.illuminant );
 
@@ -307,6 +481,19 @@ bool prepare_transform_spectral(
     // Initialize spectral solver
     core::SpectralSolver solver( settings.database_directories );
     solver.verbosity = settings.verbosity;
+    solver.database  = core::SpectralDatabase::get(
+        settings.database_directories, settings.verbosity );
+    if ( settings.fast_fit )
+        solver.fit_mode = core::SpectralSolver::FitMode::Fast;
+    if ( settings.threads > 0 )
+        solver.thread_count = settings.threads;
+
+    std::shared_ptr<cache::PersistentCache> persistent_cache;
+    if ( !settings.disable_cache )
+    {
+        persistent_cache = cache::get_persistent_cache(
+            settings.cache_file, settings.database_directories );
+    }
 
     std::string found_illuminant = "";
 
@@ -347,6 +534,22 @@ bool prepare_transform_spectral(
             for ( int i = 0; i < 3; i++ )
                 tmp_wb_multipliers[i] /= min_val;
 
+        if ( settings.use_CCT_table )
+        {
+            // Interpolate the matrix instead of solving the illuminant.
+            CAT_matrix.resize( 0 );
+            return fetch_matrix_from_CCT_table(
+                camera_identifier.make,
+                camera_identifier.model,
+                tmp_wb_multipliers,
+                settings.CCT_table_directory,
+                solver,
+                settings.verbosity,
+                settings.disable_cache,
+                IDT_matrix,
+                conversion_threads( settings ) );
+        }
+
         success = fetch_illuminant_from_multipliers(
             camera_identifier.make,
             camera_identifier.model,
@@ -354,6 +557,7 @@ bool prepare_transform_spectral(
             solver,
             settings.verbosity,
             settings.disable_cache,
+            persistent_cache.get(),
             found_illuminant );
 
         // Expected to be true due to camera lookup success in the previous step,
@@ -371,6 +575,7 @@ bool prepare_transform_spectral(
             solver,
             settings.verbosity,
             settings.disable_cache,
+            persistent_cache.get(),
             WB_multipliers );
 
         if ( !success )
@@ -389,6 +594,7 @@ bool prepare_transform_spectral(
         solver,
         settings.verbosity,
         settings.disable_cache,
+        persistent_cache.get(),
         IDT_matrix );
 
     if ( !success )
@@ -421,6 +627,8 @@ bool prepare_transform_DNG(
     std::vector<std::vector<double>> &IDT_matrix,
     std::vector<std::vector<double>> &CAT_matrix )
 {
+    TraceSpan trace_span( "prepare_transform_DNG", "solver" );
+
     // Step 1: Extract basic DNG metadata
     core::Metadata metadata;
 
@@ -697,6 +905,30 @@ void ImageConverter::init_parser( OIIO::ArgParse &arg_parser )
         .metavar( "STR" )
         .action( OIIO::ArgParse::store() );
 
+    arg_parser.arg( "--fast-fit" )
+        .help(
+            "Fit the spectral IDT matrices using the analytic Jacobian and "
+            "looser tolerances, starting from the matrix of the closest "
+            "illuminant already solved for the camera. The matrices match "
+            "the reference fit within 1e-5." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--cct-table" )
+        .help(
+            "Interpolate the spectral IDT matrix for the white balance from a "
+            "table of the matrices solved for the camera over a range of "
+            "colour temperatures, instead of solving the matrix of the "
+            "closest illuminant. The table gets built once per camera. Only "
+            "used with --wb-method metadata and --mat-method spectral." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--cct-table-dir" )
+        .help(
+            "A directory to load the colour temperature tables from, and to "
+            "save the tables built to. See --cct-table." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
     arg_parser.arg( "--wb-box" )
         .help(
             "Box to use for white balancing. (default = (0,0,0,0) - full "
@@ -773,6 +1005,174 @@ void ImageConverter::init_parser( OIIO::ArgParse &arg_parser )
         .help( "Create output directories if they don't exist." )
         .action( OIIO::ArgParse::store_true() );
 
+    arg_parser.arg( "--recursive" )
+        .help(
+            "Also convert the files in the subdirectories of the input "
+            "directories. The subdirectories get listed concurrently, and "
+            "the output files get written relative to each subdirectory." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--output-profile" )
+        .help(
+            "Output file profile. Supported options: 'strict' (ACES Container "
+            "files conforming to SMPTE ST 2065-4, uncompressed), "
+            "'intermediate' (compressed OpenEXR files, using --compression, "
+            "--tile-size and --write-threads)." )
+        .metavar( "STR" )
+        .defaultval( "strict" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--compression" )
+        .help(
+            "OpenEXR compression for the 'intermediate' output profile. "
+            "Supported options: 'none', 'rle', 'zips', 'zip', 'piz', 'pxr24', "
+            "'b44', 'b44a', 'dwaa', 'dwab'. The compression level can be "
+            "appended, like 'dwaa:45'." )
+        .metavar( "STR" )
+        .defaultval( "zip" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--tile-size" )
+        .help(
+            "If not 0, write tiles of this size instead of scanlines in the "
+            "'intermediate' output profile." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--write-threads" )
+        .help(
+            "The number of threads used to compress each output file in the "
+            "'intermediate' output profile. 0 means the OpenImageIO "
+            "default." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--output" )
+        .help(
+            "Write an output file with this suffix instead of '_aces', "
+            "optionally followed by comma-separated options: 'region=WxH+X+Y' "
+            "to only write this region of the image, 'scale=N' to downscale "
+            "the output by an integer factor, 'compression=STR' to write it "
+            "compressed. Can be repeated, all outputs of a file get written "
+            "from a single decode, like --output _aces --output "
+            "_centre,region=1920x1080+960+540 --output _proxy,scale=4." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::append() );
+
+    arg_parser.arg( "--jobs" )
+        .help(
+            "The number of files to convert concurrently. The colour "
+            "transform caches are shared between the concurrent jobs." )
+        .metavar( "VAL" )
+        .defaultval( 1 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--threads" )
+        .help(
+            "The number of threads each file uses for decoding, processing "
+            "the pixels and solving the colour transforms. 0 splits the "
+            "hardware threads between the concurrent jobs." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--continue-on-error" )
+        .help(
+            "Keep converting the remaining files if a file fails to convert. "
+            "If not set, the processing stops at the first failure." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--manifest" )
+        .help(
+            "A file to record the outcome of every converted file in. When "
+            "run again with the same manifest, the files converted "
+            "successfully with the same settings since they last changed get "
+            "skipped. Use with --overwrite to redo the files whose outputs "
+            "are out of date." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--shard" )
+        .help(
+            "Only convert the shard I of N of the input files, given as I/N "
+            "with I from 0 to N-1. The files get assigned to the shards by "
+            "the hash of their paths, so N nodes given the same command line "
+            "split the work between them. The manifest and the metrics "
+            "files get suffixed with the shard." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--pipeline" )
+        .help(
+            "If not 0, read the next files and write the previous files "
+            "while converting the current one, holding at most this many "
+            "images between the stages. Only used when converting the files "
+            "sequentially, without a memory limit." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--group-transforms" )
+        .help(
+            "Read the metadata of all files first, and solve the colour "
+            "transform once per group of files sharing the camera, the "
+            "as-shot white balance and the DNG calibration, instead of once "
+            "per file." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--solve-ahead" )
+        .help(
+            "If not 0, solve the colour transforms of the upcoming files on "
+            "this many background threads ahead of converting them, so the "
+            "conversions do not wait for the spectral solver. Not used with "
+            "--group-transforms or --disable-cache." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--memory-limit" )
+        .help(
+            "The amount of memory in megabytes to use for the pixel buffers "
+            "of each image. If not 0, the images get converted in strips "
+            "streamed to the output files, instead of loading the whole "
+            "frames." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--buffer-pool" )
+        .help(
+            "The amount of memory in megabytes to keep the pixel buffers "
+            "freed between the files in for reuse. If not 0, a batch of "
+            "images of the same size only allocates its buffers once." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
+    arg_parser.arg( "--huge-pages" )
+        .help(
+            "Back the pooled pixel buffers with transparent huge pages where "
+            "supported. Only used with --buffer-pool." )
+        .action( OIIO::ArgParse::store_true() );
+
+    arg_parser.arg( "--io-mode" )
+        .help(
+            "The way of reading the raw files. Supported options: 'buffered' "
+            "(read each file into memory at once), 'mapped' (map each file "
+            "into memory, reading it ahead sequentially), 'direct' (let the "
+            "decoder read the files)." )
+        .metavar( "STR" )
+        .defaultval( "buffered" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--gpu" )
+        .help(
+            "Run the colour transform on a GPU via OpenCL if available, "
+            "falling back to the CPU otherwise." )
+        .action( OIIO::ArgParse::store_true() );
+
     arg_parser.separator( "Raw conversion options:" );
 
     arg_parser.arg( "--auto-bright" )
@@ -814,6 +1214,16 @@ void ImageConverter::init_parser( OIIO::ArgParse &arg_parser )
         .help( "If present, decode image at half size resolution." )
         .action( OIIO::ArgParse::store_true() );
 
+    arg_parser.arg( "--proxy" )
+        .help(
+            "If greater than 1, write a low resolution preview downscaled by "
+            "this integer factor, using the fastest decoding and the output "
+            "compression, ignoring --half-size, --demosaic and "
+            "--memory-limit." )
+        .metavar( "VAL" )
+        .defaultval( 0 )
+        .action( OIIO::ArgParse::store<int>() );
+
     arg_parser.arg( "--highlight-mode" )
         .help( "0 = clip, 1 = unclip, 2 = blend, 3..9 = rebuild." )
         .metavar( "VAL" )
@@ -883,6 +1293,34 @@ void ImageConverter::init_parser( OIIO::ArgParse &arg_parser )
         .help( "Disable the colour transform cache." )
         .action( OIIO::ArgParse::store_true() );
 
+    arg_parser.arg( "--cache-file" )
+        .help(
+            "A file to persistently store the solved colour transforms in. "
+            "The file can be shared between runs and concurrently running "
+            "processes, so the spectral solving only happens once for each "
+            "camera and illuminant." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--metrics-file" )
+        .help(
+            "Write the execution time of every processing stage of each file, "
+            "the aggregate histograms of the stages, and the cache hit and "
+            "miss counts to this file at the end of the batch. Files with "
+            "the .prom extension get written in the Prometheus text format, "
+            "other files in the JSON lines format." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
+    arg_parser.arg( "--trace-file" )
+        .help(
+            "Write the spans of the processing stages of each file, along "
+            "with the threads they have run on and the cache hits and "
+            "misses, to this file at the end of the batch, in the Chrome "
+            "trace event format, which can be viewed in the Perfetto UI." )
+        .metavar( "STR" )
+        .action( OIIO::ArgParse::store() );
+
     arg_parser.arg( "--verbose" )
         .help(
             "(-v) Print progress messages. "
@@ -895,6 +1333,94 @@ void ImageConverter::init_parser( OIIO::ArgParse &arg_parser )
         [&]( OIIO::cspan<const char *> /* argv */ ) { settings.verbosity++; } );
 }
 
+/// The OpenEXR compressions allowed in the intermediate output profile.
+const std::vector<std::string> supported_compressions = {
+    "none", "rle", "zips", "zip", "piz", "pxr24", "b44", "b44a", "dwaa", "dwab"
+};
+
+/// Parse the description of an output given to `--output`, see
+/// `ImageConverter::init_parser()`.
+/// @result `true` if parsed successfully.
+static bool parse_output(
+    const std::string &description, ImageConverter::Settings::Output &output )
+{
+    std::vector<std::string> parts;
+    OIIO::Strutil::split( description, parts, "," );
+    if ( parts.empty() )
+        parts.emplace_back();
+
+    output.suffix = parts[0];
+    for ( size_t i = 1; i < parts.size(); i++ )
+    {
+        const std::string &part  = parts[i];
+        const size_t       equal = part.find( '=' );
+        const std::string  name  = part.substr( 0, equal );
+        const std::string  value =
+            equal == std::string::npos ? "" : part.substr( equal + 1 );
+
+        bool valid = equal != std::string::npos;
+        if ( valid && name == "region" )
+        {
+            int  *region = output.region;
+            char  extra;
+            valid = std::sscanf(
+                        value.c_str(),
+                        "%dx%d+%d+%d%c",
+                        &region[2],
+                        &region[3],
+                        &region[0],
+                        &region[1],
+                        &extra ) == 4 &&
+                    region[2] > 0 && region[3] > 0 && region[0] >= 0 &&
+                    region[1] >= 0;
+        }
+        else if ( valid && name == "scale" )
+        {
+            valid = !value.empty() &&
+                    value.find_first_not_of( "0123456789" ) ==
+                        std::string::npos &&
+                    value.size() < 10;
+            if ( valid )
+                output.scale = std::stoi( value );
+            valid = valid && output.scale > 0;
+        }
+        else if ( valid && name == "compression" )
+        {
+            output.compression = value;
+
+            const std::string compression_name =
+                value.substr( 0, value.find( ':' ) );
+            if ( std::find(
+                     supported_compressions.begin(),
+                     supported_compressions.end(),
+                     compression_name ) == supported_compressions.end() )
+            {
+                std::cerr << "Unsupported compression of the output '"
+                          << description << "': '" << value
+                          << "'. The following compressions are supported: "
+                          << OIIO::Strutil::join( supported_compressions, ", " )
+                          << "." << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if ( !valid )
+        {
+            std::cerr << "Invalid option '" << part << "' of the output '"
+                      << description << "'. The supported options are "
+                      << "region=WxH+X+Y, scale=N and compression=STR."
+                      << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool ImageConverter::parse_parameters( const OIIO::ArgParse &arg_parser )
 {
     std::string data_dir = arg_parser["data-dir"].get();
@@ -1000,6 +1526,10 @@ bool ImageConverter::parse_parameters( const OIIO::ArgParse &arg_parser )
         return false;
     }
 
+    settings.fast_fit            = arg_parser["fast-fit"].get<int>();
+    settings.use_CCT_table       = arg_parser["cct-table"].get<int>();
+    settings.CCT_table_directory = arg_parser["cct-table-dir"].get();
+
     settings.illuminant        = arg_parser["illuminant"].get();
     bool is_illuminant_defined = !settings.illuminant.empty();
     bool is_WB_method_illuminant =
@@ -1110,6 +1640,70 @@ bool ImageConverter::parse_parameters( const OIIO::ArgParse &arg_parser )
         return false;
     }
 
+    std::string output_profile = arg_parser["output-profile"].get();
+
+    if ( output_profile == "strict" )
+    {
+        settings.output_profile = Settings::OutputProfile::Strict;
+    }
+    else if ( output_profile == "intermediate" )
+    {
+        settings.output_profile = Settings::OutputProfile::Intermediate;
+    }
+    else
+    {
+        std::cerr << std::endl
+                  << "Unsupported output profile: '" << output_profile << "'. "
+                  << "The following profiles are supported: strict, "
+                  << "intermediate." << std::endl;
+
+        return false;
+    }
+
+    settings.compression = arg_parser["compression"].get();
+
+    const std::string compression_name =
+        settings.compression.substr( 0, settings.compression.find( ':' ) );
+    if ( std::find(
+             supported_compressions.begin(),
+             supported_compressions.end(),
+             compression_name ) == supported_compressions.end() )
+    {
+        std::cerr << std::endl
+                  << "Unsupported compression: '" << settings.compression
+                  << "'. The following compressions are supported: "
+                  << OIIO::Strutil::join( supported_compressions, ", " ) << "."
+                  << std::endl;
+
+        return false;
+    }
+
+    settings.tile_size     = arg_parser["tile-size"].get<int>();
+    settings.write_threads = arg_parser["write-threads"].get<int>();
+    if ( settings.tile_size < 0 || settings.write_threads < 0 )
+    {
+        std::cerr << "The tile size and the number of write threads must not "
+                  << "be negative." << std::endl;
+        return false;
+    }
+
+    settings.outputs.clear();
+    std::set<std::string> output_suffixes;
+    for ( const auto &description: arg_parser["output"].as_vec<std::string>() )
+    {
+        Settings::Output output;
+        if ( !parse_output( description, output ) )
+            return false;
+
+        if ( !output_suffixes.insert( output.suffix ).second )
+        {
+            std::cerr << "The suffixes of the outputs must be distinct, got '"
+                      << output.suffix << "' more than once." << std::endl;
+            return false;
+        }
+        settings.outputs.push_back( output );
+    }
+
     auto chromatic_aberration =
         arg_parser["chromatic-aberration"].as_vec<float>();
     if ( chromatic_aberration.size() == 2 )
@@ -1153,27 +1747,153 @@ bool ImageConverter::parse_parameters( const OIIO::ArgParse &arg_parser )
     settings.highlight_mode   = arg_parser["highlight-mode"].get<int>();
     settings.flip             = arg_parser["flip"].get<int>();
 
+    settings.proxy = arg_parser["proxy"].get<int>();
+    if ( settings.proxy < 0 )
+    {
+        std::cerr << "The proxy factor must not be negative, got "
+                  << settings.proxy << "." << std::endl;
+        return false;
+    }
+
     settings.scale             = arg_parser["scale"].get<float>();
     settings.denoise_threshold = arg_parser["denoise-threshold"].get<float>();
 
     settings.overwrite     = arg_parser["overwrite"].get<int>();
     settings.create_dirs   = arg_parser["create-dirs"].get<int>();
     settings.output_dir    = arg_parser["output-dir"].get();
+    settings.recursive     = arg_parser["recursive"].get<int>();
     settings.use_timing    = arg_parser["use-timing"].get<int>();
     settings.disable_cache = arg_parser["disable-cache"].get<int>();
+    settings.cache_file    = arg_parser["cache-file"].get();
+    settings.metrics_file  = arg_parser["metrics-file"].get();
+    settings.trace_file    = arg_parser["trace-file"].get();
 
-    // If an illuminant was requested, confirm that we have it in the database
-    // an error out early, before we start loading any images.
-    if ( settings.WB_method == Settings::WBMethod::Illuminant )
+    settings.jobs              = arg_parser["jobs"].get<int>();
+    settings.continue_on_error = arg_parser["continue-on-error"].get<int>();
+    settings.manifest_file     = arg_parser["manifest"].get();
+
+    std::string shard = arg_parser["shard"].get();
+    if ( !shard.empty() )
     {
-        core::SpectralSolver solver( settings.database_directories );
-        if ( !solver.find_illuminant( settings.illuminant ) )
+        std::vector<std::string> parts;
+        OIIO::Strutil::split( shard, parts, "/" );
+
+        bool valid = parts.size() == 2;
+        try
         {
-            std::cerr << std::endl
-                      << "Error: No matching light source. "
-                      << "Please find available options by "
-                      << "\"rawtoaces --list-illuminants\"." << std::endl;
-            exit( -1 );
+            valid = valid && parts[0].find_first_not_of( "0123456789" ) ==
+                                 std::string::npos;
+            valid = valid && parts[1].find_first_not_of( "0123456789" ) ==
+                                 std::string::npos;
+            if ( valid )
+            {
+                settings.shard_index = std::stoi( parts[0] );
+                settings.shard_count = std::stoi( parts[1] );
+            }
+        }
+        catch ( const std::exception & )
+        {
+            valid = false;
+        }
+
+        if ( !valid || settings.shard_count < 1 ||
+             settings.shard_index >= settings.shard_count )
+        {
+            std::cerr << "The shard must be given as I/N, with I from 0 to "
+                      << "N-1, got '" << shard << "'." << std::endl;
+            return false;
+        }
+    }
+    if ( settings.jobs < 1 )
+    {
+        std::cerr << "The number of jobs must be a positive integer, got "
+                  << settings.jobs << "." << std::endl;
+        return false;
+    }
+
+    settings.threads = arg_parser["threads"].get<int>();
+    if ( settings.threads < 0 )
+    {
+        std::cerr << "The number of threads must not be negative, got "
+                  << settings.threads << "." << std::endl;
+        return false;
+    }
+
+    settings.pipeline_depth = arg_parser["pipeline"].get<int>();
+    if ( settings.pipeline_depth < 0 )
+    {
+        std::cerr << "The pipeline depth must not be negative, got "
+                  << settings.pipeline_depth << "." << std::endl;
+        return false;
+    }
+
+    settings.group_transforms = arg_parser["group-transforms"].get<int>();
+
+    settings.solve_ahead = arg_parser["solve-ahead"].get<int>();
+    if ( settings.solve_ahead < 0 )
+    {
+        std::cerr << "The number of the solve ahead threads must not be "
+                  << "negative, got " << settings.solve_ahead << "."
+                  << std::endl;
+        return false;
+    }
+
+    settings.memory_limit = arg_parser["memory-limit"].get<int>();
+    if ( settings.memory_limit < 0 )
+    {
+        std::cerr << "The memory limit must not be negative, got "
+                  << settings.memory_limit << "." << std::endl;
+        return false;
+    }
+
+    settings.buffer_pool = arg_parser["buffer-pool"].get<int>();
+    if ( settings.buffer_pool < 0 )
+    {
+        std::cerr << "The buffer pool size must not be negative, got "
+                  << settings.buffer_pool << "." << std::endl;
+        return false;
+    }
+
+    settings.huge_pages = arg_parser["huge-pages"].get<int>();
+
+    std::string io_mode = arg_parser["io-mode"].get();
+    if ( io_mode == "buffered" )
+    {
+        settings.io_mode = Settings::IOMode::Buffered;
+    }
+    else if ( io_mode == "mapped" )
+    {
+        settings.io_mode = Settings::IOMode::Mapped;
+    }
+    else if ( io_mode == "direct" )
+    {
+        settings.io_mode = Settings::IOMode::Direct;
+    }
+    else
+    {
+        std::cerr << std::endl
+                  << "Unsupported I/O mode: '" << io_mode << "'. "
+                  << "The following modes are supported: buffered, mapped, "
+                  << "direct." << std::endl;
+        return false;
+    }
+
+    settings.use_gpu = arg_parser["gpu"].get<int>();
+
+    // If an illuminant was requested, confirm that we have it in the database
+    // an error out early, before we start loading any images.
+    if ( settings.WB_method == Settings::WBMethod::Illuminant )
+    {
+        core::SpectralSolver solver( settings.database_directories );
+        solver.database =
+            core::SpectralDatabase::get( settings.database_directories );
+        if ( !solver.find_illuminant( settings.illuminant ) )
+        {
+            std::cerr << std::endl
+                      << "Error: No matching light source. "
+                      << "Please find available options by "
+                      << "\"rawtoaces --list-illuminants\"." << std::endl;
+            return false;
         }
     }
 
@@ -1186,6 +1906,67 @@ std::vector<std::string> ImageConverter::get_supported_formats() const
     return std::vector<std::string>( result.begin(), result.end() );
 }
 
+/// The modification times of the directories holding the data files of a
+/// given type in the database, 0 for the missing directories.
+static std::vector<long long> data_directory_times(
+    const std::vector<std::string> &directories, const std::string &data_type )
+{
+    std::vector<long long> result;
+    for ( const auto &directory: directories )
+    {
+        std::filesystem::path type_path( directory );
+        type_path.append( data_type );
+
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time( type_path, ec );
+        if ( ec )
+            result.push_back( 0 );
+        else
+            result.push_back( time.time_since_epoch().count() );
+    }
+    return result;
+}
+
+/// Collect the headers of the data files of a given type in the database.
+/// The listing gets cached within the process until the modification time
+/// of any of the data type directories changes, i.e. a file gets added,
+/// removed or renamed.
+static std::vector<core::SpectralData> list_data_headers(
+    const std::vector<std::string> &directories, const std::string &data_type )
+{
+    struct Listing
+    {
+        std::vector<long long>          times;
+        std::vector<core::SpectralData> headers;
+    };
+
+    static std::mutex mutex;
+    static std::map<std::pair<std::vector<std::string>, std::string>, Listing>
+        listings;
+
+    auto times = data_directory_times( directories, data_type );
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    auto iter = listings.find( { directories, data_type } );
+    if ( iter != listings.end() && iter->second.times == times )
+        return iter->second.headers;
+
+    Listing listing;
+    listing.times = times;
+
+    rta::core::SpectralSolver solver( directories );
+    for ( const auto &file: solver.collect_data_files( data_type ) )
+    {
+        core::SpectralData data;
+        if ( data.load_header( file ) )
+            listing.headers.push_back( data );
+    }
+
+    listings[{ directories, data_type }] = listing;
+    return listing.headers;
+}
+
 std::vector<std::string> ImageConverter::get_supported_illuminants() const
 {
     std::vector<std::string> result;
@@ -1193,15 +1974,10 @@ std::vector<std::string> ImageConverter::get_supported_illuminants() const
     result.push_back( "Day-light (e.g., D60, D6025)" );
     result.push_back( "Blackbody (e.g., 3200K)" );
 
-    rta::core::SpectralSolver solver( settings.database_directories );
-    auto                      files = solver.collect_data_files( "illuminant" );
-    for ( auto &file: files )
+    for ( const auto &data: list_data_headers(
+              settings.database_directories, "illuminant" ) )
     {
-        core::SpectralData data;
-        if ( data.load( file, false ) )
-        {
-            result.push_back( data.type );
-        }
+        result.push_back( data.type );
     }
 
     return result;
@@ -1211,16 +1987,11 @@ std::vector<std::string> ImageConverter::get_supported_cameras() const
 {
     std::vector<std::string> result;
 
-    rta::core::SpectralSolver solver( settings.database_directories );
-    auto                      files = solver.collect_data_files( "camera" );
-    for ( auto &file: files )
+    for ( const auto &data:
+          list_data_headers( settings.database_directories, "camera" ) )
     {
-        core::SpectralData data;
-        if ( data.load( file, false ) )
-        {
-            std::string name = data.manufacturer + " / " + data.model;
-            result.push_back( name );
-        }
+        std::string name = data.manufacturer + " / " + data.model;
+        result.push_back( name );
     }
 
     return result;
@@ -1258,28 +2029,161 @@ void fix_metadata( OIIO::ImageSpec &spec )
     }
 }
 
-bool ImageConverter::configure(
-    const std::string &input_filename, OIIO::ParamValueList &options )
+/// Set the decoding options needed to read the metadata of a raw image.
+/// @result the config to open the reader with.
+OIIO::ImageSpec raw_reader_config( OIIO::ParamValueList &options )
 {
     options["raw:ColorSpace"]    = "XYZ";
     options["raw:use_camera_wb"] = 0;
     options["raw:use_auto_wb"]   = 0;
 
-    OIIO::ImageSpec temp_spec;
-    temp_spec.extra_attribs = options;
+    OIIO::ImageSpec config;
+    config.extra_attribs = options;
+    return config;
+}
+
+bool ImageConverter::configure(
+    const std::string &input_filename, OIIO::ParamValueList &options )
+{
+    Tracer::Scope   trace_scope( tracer.get(), input_filename );
+    OIIO::ImageSpec config = raw_reader_config( options );
+
+    _raw_reader.reset();
 
+    // Keep the reader open for `load_image` to decode the pixels without
+    // reading the file from storage again.
     OIIO::ImageSpec image_spec;
-    auto image_input = OIIO::ImageInput::create( "raw", false, &temp_spec );
-    bool result = image_input->open( input_filename, image_spec, temp_spec );
+    auto raw_reader = std::make_shared<RawReader>();
+    raw_reader->set_thread_count( conversion_threads( settings ) );
+    raw_reader->set_io_mode( settings.io_mode );
+    bool result = raw_reader->open( input_filename, config, image_spec );
     if ( !result )
     {
         return false;
     }
 
+    return configure_reader( raw_reader, image_spec, options );
+}
+
+bool ImageConverter::configure(
+    const std::string    &name,
+    const void           *data,
+    size_t                size,
+    OIIO::ParamValueList &options )
+{
+    OIIO::ImageSpec config = raw_reader_config( options );
+
+    _raw_reader.reset();
+
+    OIIO::ImageSpec image_spec;
+    auto raw_reader = std::make_shared<RawReader>();
+    raw_reader->set_thread_count( conversion_threads( settings ) );
+    if ( !raw_reader->open_memory( name, data, size, config, image_spec ) )
+    {
+        return false;
+    }
+
+    return configure_reader( raw_reader, image_spec, options );
+}
+
+bool ImageConverter::configure_reader(
+    const std::shared_ptr<RawReader> &raw_reader,
+    OIIO::ImageSpec                  &image_spec,
+    OIIO::ParamValueList             &options )
+{
+    fix_metadata( image_spec );
+    if ( !configure( image_spec, options ) )
+    {
+        return false;
+    }
+
+    _raw_reader = raw_reader;
+    return true;
+}
+
+/// The metadata attributes the colour transforms get solved from, see
+/// `prepare_transform_spectral()` and `prepare_transform_DNG()`.
+static const std::vector<std::string> transform_attributes = {
+    "cameraMake",
+    "cameraModel",
+    "raw:cam_mul",
+    "raw:pre_mul",
+    "raw:dng:version",
+    "raw:dng:baseline_exposure",
+    "raw:dng:calibration_illuminant1",
+    "raw:dng:calibration_illuminant2",
+    "raw:dng:color_matrix1",
+    "raw:dng:color_matrix2",
+    "raw:dng:camera_calibration1",
+    "raw:dng:camera_calibration2"
+};
+
+bool ImageConverter::read_metadata(
+    const std::string &input_filename, OIIO::ImageSpec &image_spec ) const
+{
+    OIIO::ParamValueList options;
+    OIIO::ImageSpec      config = raw_reader_config( options );
+
+    // Only the metadata are needed, so let the decoder read the file
+    // directly instead of loading it all into memory via `RawReader`.
+    auto input = OIIO::ImageInput::create( "raw", false, &config );
+    if ( !input )
+        return false;
+
+    if ( !input->open( input_filename, image_spec, config ) )
+        return false;
+    input->close();
+
     fix_metadata( image_spec );
+    return true;
+}
+
+bool ImageConverter::read_transform_key(
+    const std::string &input_filename, std::string &key ) const
+{
+    OIIO::ImageSpec image_spec;
+    if ( !read_metadata( input_filename, image_spec ) )
+        return false;
+
+    key = transform_key( image_spec );
+    return true;
+}
+
+std::string ImageConverter::transform_key( const OIIO::ImageSpec &image_spec )
+{
+    std::string key;
+    for ( const auto &name: transform_attributes )
+    {
+        auto attribute = image_spec.find_attribute( name );
+        key += name + "=" + ( attribute ? attribute->get_string() : "" ) + "\n";
+    }
+    return key;
+}
+
+bool ImageConverter::solve_transform( const std::string &input_filename )
+{
+    Tracer::Scope trace_scope( tracer.get(), input_filename );
+
+    _raw_reader.reset();
+
+    OIIO::ImageSpec image_spec;
+    if ( !read_metadata( input_filename, image_spec ) )
+        return false;
+
+    OIIO::ParamValueList options;
     return configure( image_spec, options );
 }
 
+ImageConverter::Transform ImageConverter::get_transform() const
+{
+    Transform result;
+    result.matrix_method  = _matrix_method;
+    result.WB_multipliers = _wb_multipliers;
+    result.IDT_matrix     = _idt_matrix;
+    result.CAT_matrix     = _cat_matrix;
+    return result;
+}
+
 // TODO:
 // Removed options comparing to v1.1:
 // -P - bad pixels
@@ -1288,8 +2192,6 @@ bool ImageConverter::configure(
 // -m - median filter
 // -f - four-colour RGB
 // -T - print Libraw-supported cameras
-// -F - use big file
-// -E - mmap-ed IO
 // -s - image index in the file
 // -G - green_matching() filter
 
@@ -1309,6 +2211,14 @@ bool ImageConverter::configure(
     options["raw:Demosaic"]           = settings.demosaic_algorithm;
     options["raw:threshold"]          = settings.denoise_threshold;
 
+    if ( settings.proxy > 1 )
+    {
+        // Decoding at half size skips demosaicing altogether, so is the
+        // cheapest option when the factor allows for it.
+        options["raw:half_size"] = settings.proxy % 2 == 0 ? 1 : 0;
+        options["raw:Demosaic"]  = "linear";
+    }
+
     if ( settings.crop_box[2] != 0 && settings.crop_box[3] != 0 )
     {
         options.attribute(
@@ -1401,10 +2311,16 @@ bool ImageConverter::configure(
     }
 
     Settings::MatrixMethod matrix_method = settings.matrix_method;
-    if ( settings.matrix_method == Settings::MatrixMethod::Auto )
+    if ( transform )
+    {
+        matrix_method = transform->matrix_method;
+    }
+    else if ( settings.matrix_method == Settings::MatrixMethod::Auto )
     {
         core::SpectralSolver solver( settings.database_directories );
-        CameraIdentifier     camera_identifier =
+        solver.database =
+            core::SpectralDatabase::get( settings.database_directories );
+        CameraIdentifier camera_identifier =
             get_camera_identifier( image_spec, settings );
 
         if ( !camera_identifier.is_empty() &&
@@ -1468,7 +2384,13 @@ bool ImageConverter::configure(
 
     if ( is_spectral_white_balance || is_spectral_matrix )
     {
-        if ( !prepare_transform_spectral(
+        if ( transform )
+        {
+            _wb_multipliers = transform->WB_multipliers;
+            _idt_matrix     = transform->IDT_matrix;
+            _cat_matrix     = transform->CAT_matrix;
+        }
+        else if ( !prepare_transform_spectral(
                  image_spec,
                  settings,
                  _wb_multipliers,
@@ -1505,8 +2427,13 @@ bool ImageConverter::configure(
             options["raw:use_camera_matrix"] = 1;
             options["raw:use_camera_wb"]     = 1;
 
-            if ( !prepare_transform_DNG(
-                     image_spec, settings, _idt_matrix, _cat_matrix ) )
+            if ( transform )
+            {
+                _idt_matrix = transform->IDT_matrix;
+                _cat_matrix = transform->CAT_matrix;
+            }
+            else if ( !prepare_transform_DNG(
+                          image_spec, settings, _idt_matrix, _cat_matrix ) )
             {
                 std::cerr << "ERROR: the colour space transform has not been "
                           << "configured properly (metadata mode)."
@@ -1524,6 +2451,8 @@ bool ImageConverter::configure(
         prepare_transform_nonDNG( _idt_matrix, _cat_matrix );
     }
 
+    _matrix_method = matrix_method;
+
     if ( settings.verbosity > 1 )
     {
         std::cerr << "Configuration:" << std::endl;
@@ -1609,6 +2538,23 @@ bool ImageConverter::configure(
         }
 
         std::cerr << "  Demosaic: " << settings.demosaic_algorithm << std::endl;
+        if ( settings.proxy > 1 )
+            std::cerr << "  Proxy: 1/" << settings.proxy << std::endl;
+        for ( const auto &output: settings.outputs )
+        {
+            std::cerr << "  Output: " << output.suffix;
+            if ( output.region[2] > 0 && output.region[3] > 0 )
+            {
+                std::cerr << ", region [" << OIIO::Strutil::join(
+                                                 output.region, ", " )
+                          << "]";
+            }
+            if ( output.scale > 1 )
+                std::cerr << ", scale 1/" << output.scale;
+            if ( !output.compression.empty() )
+                std::cerr << ", compression " << output.compression;
+            std::cerr << std::endl;
+        }
         std::cerr << "  Headroom: " << settings.headroom << std::endl;
         std::cerr << "  Scale: " << settings.scale << std::endl;
         std::cerr << "  Output dir: "
@@ -1617,8 +2563,62 @@ bool ImageConverter::configure(
                   << std::endl;
         std::cerr << "  Overwrite: " << ( settings.overwrite ? "yes" : "no" )
                   << std::endl;
+        std::cerr << "  Recursive: " << ( settings.recursive ? "yes" : "no" )
+                  << std::endl;
         std::cerr << "  Create dirs: "
                   << ( settings.create_dirs ? "yes" : "no" ) << std::endl;
+        std::cerr << "  Output profile: ";
+        switch ( settings.output_profile )
+        {
+            case Settings::OutputProfile::Strict: std::cerr << "strict"; break;
+            case Settings::OutputProfile::Intermediate:
+                std::cerr << "intermediate";
+                break;
+        }
+        std::cerr << std::endl;
+        if ( settings.output_profile == Settings::OutputProfile::Intermediate )
+        {
+            std::cerr << "  Compression: " << settings.compression << std::endl;
+            std::cerr << "  Tile size: " << settings.tile_size << std::endl;
+            std::cerr << "  Write threads: " << settings.write_threads
+                      << std::endl;
+        }
+        if ( !settings.manifest_file.empty() )
+        {
+            std::cerr << "  Manifest file: " << settings.manifest_file
+                      << std::endl;
+        }
+        if ( !settings.trace_file.empty() )
+        {
+            std::cerr << "  Trace file: " << settings.trace_file << std::endl;
+        }
+        if ( settings.shard_count > 1 )
+        {
+            std::cerr << "  Shard: " << settings.shard_index << "/"
+                      << settings.shard_count << std::endl;
+        }
+        std::cerr << "  Threads: " << conversion_threads( settings )
+                  << std::endl;
+        std::cerr << "  Pipeline depth: " << settings.pipeline_depth
+                  << std::endl;
+        std::cerr << "  Group transforms: "
+                  << ( settings.group_transforms ? "yes" : "no" ) << std::endl;
+        std::cerr << "  Solve ahead threads: " << settings.solve_ahead
+                  << std::endl;
+        std::cerr << "  Memory limit: " << settings.memory_limit << std::endl;
+        std::cerr << "  Buffer pool: " << settings.buffer_pool << std::endl;
+        std::cerr << "  Huge pages: " << ( settings.huge_pages ? "yes" : "no" )
+                  << std::endl;
+        std::cerr << "  GPU: " << ( settings.use_gpu ? "yes" : "no" )
+                  << std::endl;
+        std::cerr << "  I/O mode: ";
+        switch ( settings.io_mode )
+        {
+            case Settings::IOMode::Buffered: std::cerr << "buffered"; break;
+            case Settings::IOMode::Mapped: std::cerr << "mapped"; break;
+            case Settings::IOMode::Direct: std::cerr << "direct"; break;
+        }
+        std::cerr << std::endl;
         std::cerr << "  Verbosity: " << settings.verbosity << std::endl;
     }
 
@@ -1630,93 +2630,383 @@ bool ImageConverter::load_image(
     const OIIO::ParamValueList &hints,
     OIIO::ImageBuf             &buffer )
 {
+    if ( _raw_reader && _raw_reader->path() == path )
+    {
+        auto raw_reader = std::move( _raw_reader );
+        return raw_reader->read(
+            hints,
+            buffer,
+            [this]( const OIIO::ImageSpec &spec, OIIO::ImageBuf &buffer ) {
+                allocate_buffer( spec, buffer );
+            } );
+    }
+
     OIIO::ImageSpec image_spec;
     image_spec.extra_attribs = hints;
     buffer = OIIO::ImageBuf( path, 0, 0, nullptr, &image_spec, nullptr );
+    buffer.threads( conversion_threads( settings ) );
 
     return buffer.read(
         0, 0, 0, buffer.nchannels(), true, OIIO::TypeDesc::FLOAT );
 }
 
-bool apply_matrix(
-    const std::vector<std::vector<double>> &matrix,
-    OIIO::ImageBuf                         &dst,
-    const OIIO::ImageBuf                   &src,
-    OIIO::ROI                               roi )
+void ImageConverter::allocate_buffer(
+    const OIIO::ImageSpec &spec, OIIO::ImageBuf &buffer )
 {
-    float M[4][4];
+    if ( settings.buffer_pool <= 0 )
+    {
+        buffer.reset( spec, OIIO::InitializePixels::No );
+        return;
+    }
 
-    size_t num_rows = matrix.size();
+    auto &pool = BufferPool::instance();
+    pool.set_capacity( static_cast<size_t>( settings.buffer_pool ) << 20 );
+    _buffers.push_back( pool.borrow( spec, buffer, settings.huge_pages ) );
+}
 
-    if ( num_rows )
+void ImageConverter::release_buffer( const OIIO::ImageBuf &buffer )
+{
+    // Dropping the detached memory returns it to the pool.
+    detach_buffer( buffer );
+}
+
+std::shared_ptr<void>
+ImageConverter::detach_buffer( const OIIO::ImageBuf &buffer )
+{
+    const void *pixels = buffer.localpixels();
+    if ( !pixels )
+        return nullptr;
+
+    auto iter = std::find_if(
+        _buffers.begin(), _buffers.end(), [pixels]( const auto &memory ) {
+            return memory.get() == pixels;
+        } );
+    if ( iter == _buffers.end() )
+        return nullptr;
+
+    std::shared_ptr<void> memory = std::move( *iter );
+    _buffers.erase( iter );
+    return memory;
+}
+
+void ImageConverter::release_buffers()
+{
+    _buffers.clear();
+}
+
+std::shared_ptr<void> ImageConverter::allocate_memory( size_t size )
+{
+    if ( settings.buffer_pool <= 0 )
     {
-        size_t num_columns = matrix[0].size();
+        return std::shared_ptr<void>(
+            new unsigned char[size], std::default_delete<unsigned char[]>() );
+    }
 
-        for ( size_t i = 0; i < num_rows; i++ )
-        {
-            for ( size_t j = 0; j < num_columns; j++ )
-            {
-                M[j][i] = static_cast<float>( matrix[i][j] );
-            }
+    auto &pool = BufferPool::instance();
+    pool.set_capacity( static_cast<size_t>( settings.buffer_pool ) << 20 );
+    return pool.borrow( size, settings.huge_pages );
+}
 
-            for ( size_t j = num_columns; j < 4; j++ )
-                M[j][i] = 0;
-        }
+// clang-format off
+const std::vector<std::vector<double>> XYZ_to_ACES = {
+    {  1.0498110175, 0.0000000000, -0.0000974845 },
+    { -0.4959030231, 1.3733130458,  0.0982400361 },
+    {  0.0000000000, 0.0000000000,  0.9912520182 }
+};
+// clang-format on
 
-        for ( size_t i = num_rows; i < 4; i++ )
+/// Multiply the matrices `a` and `b`. The resulting matrix is equivalent to
+/// applying `b` first, then `a`.
+std::vector<std::vector<double>> multiply_matrices(
+    const std::vector<std::vector<double>> &a,
+    const std::vector<std::vector<double>> &b )
+{
+    const size_t num_rows    = a.size();
+    const size_t num_columns = b.size() ? b[0].size() : 0;
+
+    std::vector<std::vector<double>> result(
+        num_rows, std::vector<double>( num_columns, 0.0 ) );
+
+    for ( size_t i = 0; i < num_rows; i++ )
+    {
+        const size_t depth = std::min( a[i].size(), b.size() );
+        for ( size_t j = 0; j < num_columns; j++ )
         {
-            for ( size_t j = 0; j < num_columns; j++ )
-                M[j][i] = 0;
-            for ( size_t j = num_columns; j < 4; j++ )
-                M[j][i] = 1;
+            for ( size_t k = 0; k < depth; k++ )
+                result[i][j] += a[i][k] * b[k][j];
         }
     }
 
-    return OIIO::ImageBufAlgo::colormatrixtransform( dst, src, M, false, roi );
+    return result;
 }
 
-bool ImageConverter::apply_matrix(
-    OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi )
+/// Check whether a kernel of `select_transform_kernel()` can apply `matrix`
+/// to the pixels of `src` in `roi`, writing them to `dst`: a 3x3 matrix,
+/// from float to float or half float buffers held in memory, with all 3 or
+/// 4 channels in `roi`. Only the floats can be transformed in place.
+static bool can_use_transform_kernel(
+    const std::vector<std::vector<double>> &matrix,
+    const OIIO::ImageBuf                   &dst,
+    const OIIO::ImageBuf                   &src,
+    const OIIO::ROI                        &roi )
 {
-    bool success = true;
+    if ( matrix.size() != 3 || matrix[0].size() != 3 ||
+         matrix[1].size() != 3 || matrix[2].size() != 3 )
+    {
+        return false;
+    }
 
-    if ( !roi.defined() )
-        roi = dst.roi();
+    const OIIO::ImageSpec &src_spec = src.spec();
+    const OIIO::ImageSpec &dst_spec = dst.spec();
+    const int              channels = dst_spec.nchannels;
 
-    if ( _idt_matrix.size() )
+    const bool half_output = dst_spec.format == OIIO::TypeDesc::HALF;
+    if ( ( !half_output && dst_spec.format != OIIO::TypeDesc::FLOAT ) ||
+         ( half_output && &dst == &src ) ||
+         src_spec.format != OIIO::TypeDesc::FLOAT ||
+         src_spec.nchannels != channels || ( channels != 3 && channels != 4 ) )
     {
-        success = rta::util::apply_matrix( _idt_matrix, dst, src, roi );
-        if ( !success )
-            return false;
+        return false;
     }
 
-    if ( _cat_matrix.size() )
+    // The kernels expect the pixels of each row to be contiguous.
+    if ( !dst.localpixels() || !src.localpixels() ||
+         dst.pixel_stride() !=
+             static_cast<OIIO::stride_t>(
+                 channels * dst_spec.format.size() ) ||
+         src.pixel_stride() !=
+             static_cast<OIIO::stride_t>( channels * sizeof( float ) ) )
     {
-        success = rta::util::apply_matrix( _cat_matrix, dst, dst, roi );
-        if ( !success )
-            return false;
-
-        // clang-format off
-        static const std::vector<std::vector<double>> XYZ_to_ACES = {
-            {  1.0498110175, 0.0000000000, -0.0000974845 },
-            { -0.4959030231, 1.3733130458,  0.0982400361 },
-            {  0.0000000000, 0.0000000000,  0.9912520182 }
-        };
-        // clang-format on
-
-        success = rta::util::apply_matrix( XYZ_to_ACES, dst, dst, roi );
-        if ( !success )
-            return false;
+        return false;
     }
 
-    return success;
+    OIIO::ROI region = roi;
+    region.chend     = channels;
+    return roi.chbegin == 0 && roi.chend >= channels &&
+           OIIO::roi_intersection( region, dst.roi() ) == region &&
+           OIIO::roi_intersection( region, src.roi() ) == region;
 }
 
-bool ImageConverter::apply_scale(
-    OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI /* roi */ )
+/// Convert a 3x3 matrix to single precision.
+static void
+to_float_matrix( const std::vector<std::vector<double>> &matrix, float M[3][3] )
 {
-    return OIIO::ImageBufAlgo::mul(
-        dst, src, settings.headroom * settings.scale );
+    for ( size_t i = 0; i < 3; i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            M[i][j] = static_cast<float>( matrix[i][j] );
+}
+
+/// Apply `matrix` on the GPU, see `GPUTransform`.
+/// @result `false` if the GPU is not available, or cannot apply the matrix
+///     to these buffers, so the CPU has to.
+static bool apply_matrix_gpu(
+    const std::vector<std::vector<double>> &matrix,
+    OIIO::ImageBuf                         &dst,
+    const OIIO::ImageBuf                   &src,
+    const OIIO::ROI                        &roi )
+{
+    if ( dst.spec().format != OIIO::TypeDesc::HALF ||
+         !can_use_transform_kernel( matrix, dst, src, roi ) ||
+         roi.depth() != 1 )
+    {
+        return false;
+    }
+
+    GPUTransform *gpu = GPUTransform::instance();
+    if ( !gpu )
+    {
+        static std::once_flag once;
+        std::call_once( once, []() {
+            std::cerr << "WARNING: No OpenCL GPU is available, the colour "
+                      << "transform runs on the CPU." << std::endl;
+        } );
+        return false;
+    }
+
+    float M[3][3];
+    to_float_matrix( matrix, M );
+
+    const bool success = gpu->apply(
+        M,
+        static_cast<const float *>(
+            src.pixeladdr( roi.xbegin, roi.ybegin, roi.zbegin ) ),
+        src.scanline_stride() / sizeof( float ),
+        static_cast<uint16_t *>(
+            dst.pixeladdr( roi.xbegin, roi.ybegin, roi.zbegin ) ),
+        dst.scanline_stride() / sizeof( uint16_t ),
+        roi.width(),
+        roi.height(),
+        dst.spec().nchannels );
+    if ( !success )
+    {
+        std::cerr << "WARNING: Failed to run the colour transform on "
+                  << gpu->device_name() << ", falling back to the CPU."
+                  << std::endl;
+    }
+    return success;
+}
+
+bool apply_matrix(
+    const std::vector<std::vector<double>> &matrix,
+    OIIO::ImageBuf                         &dst,
+    const OIIO::ImageBuf                   &src,
+    OIIO::ROI                               roi,
+    int                                     nthreads = 0 )
+{
+    // Use a kernel specialised for the channels and the output format,
+    // converting to half floats in the same pass, which is considerably
+    // faster than the generic algorithm of OIIO. The kernel gets selected
+    // once, so the loop over the pixels is free of branches.
+    if ( can_use_transform_kernel( matrix, dst, src, roi ) )
+    {
+        float M[3][3];
+        to_float_matrix( matrix, M );
+
+        const int channels = dst.spec().nchannels;
+        roi.chend          = channels;
+
+        const TransformKernel kernel = select_transform_kernel(
+            channels, dst.spec().format == OIIO::TypeDesc::HALF );
+
+        auto transform = [&]( OIIO::ROI block ) {
+            for ( int z = block.zbegin; z < block.zend; z++ )
+            {
+                for ( int y = block.ybegin; y < block.yend; y++ )
+                {
+                    kernel(
+                        M,
+                        static_cast<const float *>(
+                            src.pixeladdr( block.xbegin, y, z ) ),
+                        dst.pixeladdr( block.xbegin, y, z ),
+                        block.width() );
+                }
+            }
+        };
+        OIIO::ImageBufAlgo::parallel_image(
+            roi, OIIO::paropt( nthreads ), transform );
+        return true;
+    }
+
+    float M[4][4];
+
+    size_t num_rows = matrix.size();
+
+    if ( num_rows )
+    {
+        size_t num_columns = matrix[0].size();
+
+        for ( size_t i = 0; i < num_rows; i++ )
+        {
+            for ( size_t j = 0; j < num_columns; j++ )
+            {
+                M[j][i] = static_cast<float>( matrix[i][j] );
+            }
+
+            for ( size_t j = num_columns; j < 4; j++ )
+                M[j][i] = 0;
+        }
+
+        for ( size_t i = num_rows; i < 4; i++ )
+        {
+            for ( size_t j = 0; j < num_columns; j++ )
+                M[j][i] = 0;
+            for ( size_t j = num_columns; j < 4; j++ )
+                M[j][i] = 1;
+        }
+    }
+
+    return OIIO::ImageBufAlgo::colormatrixtransform(
+        dst, src, M, false, roi, nthreads );
+}
+
+bool ImageConverter::apply_matrix(
+    OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi )
+{
+    bool      success  = true;
+    const int nthreads = conversion_threads( settings );
+
+    if ( !roi.defined() )
+        roi = dst.roi();
+
+    if ( _idt_matrix.size() )
+    {
+        success =
+            rta::util::apply_matrix( _idt_matrix, dst, src, roi, nthreads );
+        if ( !success )
+            return false;
+    }
+
+    if ( _cat_matrix.size() )
+    {
+        success =
+            rta::util::apply_matrix( _cat_matrix, dst, dst, roi, nthreads );
+        if ( !success )
+            return false;
+
+        success =
+            rta::util::apply_matrix( XYZ_to_ACES, dst, dst, roi, nthreads );
+        if ( !success )
+            return false;
+    }
+
+    return success;
+}
+
+bool ImageConverter::apply_transform(
+    OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi )
+{
+    if ( !roi.defined() )
+        roi = dst.roi();
+
+    // Pre-multiply all stages into one matrix, so the pixels only get
+    // visited once.
+    std::vector<std::vector<double>> matrix = { { 1.0, 0.0, 0.0 },
+                                                { 0.0, 1.0, 0.0 },
+                                                { 0.0, 0.0, 1.0 } };
+
+    if ( _idt_matrix.size() )
+        matrix = _idt_matrix;
+
+    if ( _cat_matrix.size() )
+    {
+        matrix = multiply_matrices( _cat_matrix, matrix );
+        matrix = multiply_matrices( XYZ_to_ACES, matrix );
+    }
+
+    const double scale = settings.headroom * settings.scale;
+    for ( auto &row: matrix )
+    {
+        for ( auto &value: row )
+            value *= scale;
+    }
+
+    if ( settings.use_gpu && apply_matrix_gpu( matrix, dst, src, roi ) )
+        return true;
+
+    return rta::util::apply_matrix(
+        matrix, dst, src, roi, conversion_threads( settings ) );
+}
+
+bool ImageConverter::apply_scale(
+    OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI /* roi */ )
+{
+    return OIIO::ImageBufAlgo::mul(
+        dst,
+        src,
+        settings.headroom * settings.scale,
+        {},
+        conversion_threads( settings ) );
+}
+
+/// The area of an image of `spec` which is kept by `apply_crop()` in
+/// `crop_mode`. Restricting the conversion to this area saves processing the
+/// pixels which get discarded.
+OIIO::ROI crop_region(
+    ImageConverter::Settings::CropMode crop_mode, const OIIO::ImageSpec &spec )
+{
+    if ( crop_mode == ImageConverter::Settings::CropMode::Hard )
+        return OIIO::roi_intersection( spec.roi_full(), spec.roi() );
+    return spec.roi();
 }
 
 bool ImageConverter::apply_crop(
@@ -1724,7 +3014,15 @@ bool ImageConverter::apply_crop(
 {
     if ( settings.crop_mode == Settings::CropMode::Off )
     {
-        if ( !OIIO::ImageBufAlgo::copy( dst, src ) )
+        // Only the display window changes, so there is nothing to copy when
+        // cropping in place.
+        if ( &dst != &src &&
+             !OIIO::ImageBufAlgo::copy(
+                 dst,
+                 src,
+                 OIIO::TypeUnknown,
+                 {},
+                 conversion_threads( settings ) ) )
         {
             return false;
         }
@@ -1735,36 +3033,127 @@ bool ImageConverter::apply_crop(
     }
     else if ( settings.crop_mode == Settings::CropMode::Hard )
     {
-        // OIIO can not currently crop in place.
-        if ( &dst == &src )
-        {
-            OIIO::ImageBuf temp;
-            if ( !OIIO::ImageBufAlgo::copy( temp, src ) )
-            {
-                return false;
-            }
+        const OIIO::ROI region = crop_region( settings.crop_mode, src.spec() );
 
-            if ( !OIIO::ImageBufAlgo::crop( dst, temp, temp.roi_full() ) )
+        // If the source only holds the crop area, e.g. because only that
+        // area has been converted, re-windowing it is enough.
+        if ( &dst != &src || src.roi() != region )
+        {
+            OIIO::ImageBuf cropped;
+            if ( !OIIO::ImageBufAlgo::crop(
+                     cropped, src, region, conversion_threads( settings ) ) )
             {
                 return false;
             }
+            dst.swap( cropped );
         }
-        else
+        dst.specmod().x           = 0;
+        dst.specmod().y           = 0;
+        dst.specmod().full_x      = 0;
+        dst.specmod().full_y      = 0;
+        dst.specmod().full_width  = dst.specmod().width;
+        dst.specmod().full_height = dst.specmod().height;
+    }
+
+    return true;
+}
+
+bool ImageConverter::apply_downscale(
+    OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, int factor )
+{
+    if ( factor < 2 )
+    {
+        return &dst == &src || dst.copy( src, OIIO::TypeDesc::FLOAT );
+    }
+
+    const OIIO::ImageSpec &src_spec = src.spec();
+
+    OIIO::ImageSpec spec = src_spec;
+    spec.x               = src_spec.x / factor;
+    spec.y               = src_spec.y / factor;
+    spec.width           = src_spec.width / factor;
+    spec.height          = src_spec.height / factor;
+    spec.full_x          = src_spec.full_x / factor;
+    spec.full_y          = src_spec.full_y / factor;
+    spec.full_width      = src_spec.full_width / factor;
+    spec.full_height     = src_spec.full_height / factor;
+    spec.set_format( OIIO::TypeDesc::FLOAT );
+
+    if ( spec.width <= 0 || spec.height <= 0 )
+    {
+        std::cerr << "ERROR: The image of " << src_spec.width << "x"
+                  << src_spec.height << " pixels is too small to downscale "
+                  << "by the factor of " << factor << "." << std::endl;
+        return false;
+    }
+
+    const int    channels  = spec.nchannels;
+    const size_t row_width = static_cast<size_t>( spec.width ) * factor;
+    const float  weight    = 1.0f / static_cast<float>( factor * factor );
+
+    OIIO::ImageBuf result;
+    allocate_buffer( spec, result );
+
+    std::vector<float> rows( row_width * factor * channels );
+    std::vector<float> sums( static_cast<size_t>( spec.width ) * channels );
+
+    for ( int y = 0; y < spec.height; y++ )
+    {
+        const int src_y = src_spec.y + y * factor;
+        OIIO::ROI roi(
+            src_spec.x,
+            src_spec.x + static_cast<int>( row_width ),
+            src_y,
+            src_y + factor,
+            src_spec.z,
+            src_spec.z + 1,
+            0,
+            channels );
+        if ( !src.get_pixels( roi, OIIO::TypeDesc::FLOAT, rows.data() ) )
+            return false;
+
+        std::fill( sums.begin(), sums.end(), 0.0f );
+        for ( int row = 0; row < factor; row++ )
         {
-            if ( !OIIO::ImageBufAlgo::crop( dst, src, src.roi_full() ) )
+            const float *pixel = rows.data() + row * row_width * channels;
+            for ( size_t x = 0; x < row_width; x++ )
             {
-                return false;
+                float *sum = sums.data() + ( x / factor ) * channels;
+                for ( int c = 0; c < channels; c++ )
+                    sum[c] += *pixel++;
             }
         }
-        dst.specmod().x      = 0;
-        dst.specmod().y      = 0;
-        dst.specmod().full_x = 0;
-        dst.specmod().full_y = 0;
+
+        for ( auto &sum: sums )
+            sum *= weight;
+
+        OIIO::ROI dst_roi(
+            spec.x,
+            spec.x + spec.width,
+            spec.y + y,
+            spec.y + y + 1,
+            spec.z,
+            spec.z + 1,
+            0,
+            channels );
+        if ( !result.set_pixels( dst_roi, OIIO::TypeDesc::FLOAT, sums.data() ) )
+            return false;
     }
 
+    dst.swap( result );
+    release_buffer( result );
     return true;
 }
 
+/// The factor `apply_downscale()` has to scale a proxy by on top of the
+/// downscaling done by the decoder, see `Settings::proxy`.
+int proxy_downscale_factor( const ImageConverter::Settings &settings )
+{
+    if ( settings.proxy < 2 )
+        return 1;
+    return settings.proxy % 2 == 0 ? settings.proxy / 2 : settings.proxy;
+}
+
 bool ImageConverter::make_output_path(
     std::string &path, const std::string &suffix )
 {
@@ -1831,44 +3220,335 @@ bool ImageConverter::make_output_path(
     }
 }
 
-bool ImageConverter::save_image(
-    const std::string &output_filename, const OIIO::ImageBuf &buf )
+/// Make the spec of the output file holding an image of `spec`, as defined
+/// by the output profile in `settings`.
+OIIO::ImageSpec make_output_spec(
+    const ImageConverter::Settings &settings, const OIIO::ImageSpec &spec )
 {
-    // ST2065-4 demands these conditions met by an OpenEXR file:
-    // - ACES AP0 chromaticities,
-    // - acesImageContainerFlag present,
-    // - no compression.
-
     const float chromaticities[] = { 0.7347f, 0.2653f, 0.0f,     1.0f,
                                      0.0001f, -0.077f, 0.32168f, 0.33767f };
 
-    OIIO::ImageSpec image_spec = buf.spec();
+    OIIO::ImageSpec image_spec = spec;
     image_spec.set_format( OIIO::TypeDesc::HALF );
-    image_spec["acesImageContainerFlag"] = 1;
-    image_spec["compression"]            = "none";
     image_spec.attribute(
         "chromaticities",
         OIIO::TypeDesc( OIIO::TypeDesc::FLOAT, 8 ),
         chromaticities );
     image_spec["oiio:ColorSpace"] = "lin_ap0_scene";
 
-    auto image_output = OIIO::ImageOutput::create( "exr" );
-    bool result       = image_output->open( output_filename, image_spec );
-    if ( result )
+    image_spec.tile_width  = 0;
+    image_spec.tile_height = 0;
+    image_spec.tile_depth  = 0;
+
+    if ( settings.output_profile ==
+             ImageConverter::Settings::OutputProfile::Intermediate ||
+         settings.proxy > 1 )
     {
-        result = buf.write( image_output.get() );
+        image_spec["compression"] = settings.compression;
+        if ( settings.tile_size > 0 )
+        {
+            image_spec.tile_width  = settings.tile_size;
+            image_spec.tile_height = settings.tile_size;
+            image_spec.tile_depth  = 1;
+        }
     }
     else
     {
-        std::cerr << "ERROR: Failed to write file: " << output_filename
-                  << std::endl
+        // ST2065-4 demands these conditions met by an OpenEXR file:
+        // - ACES AP0 chromaticities,
+        // - acesImageContainerFlag present,
+        // - no compression.
+        image_spec["acesImageContainerFlag"] = 1;
+        image_spec["compression"]            = "none";
+    }
+
+    return image_spec;
+}
+
+/// Create an OpenEXR writer and open the file at `path` for writing an image
+/// of `spec`, using the number of writer threads given in `settings`.
+/// @result the open writer, or `nullptr` on failure.
+std::unique_ptr<OIIO::ImageOutput> open_output(
+    const ImageConverter::Settings &settings,
+    const std::string              &path,
+    const OIIO::ImageSpec          &spec )
+{
+    auto image_output = OIIO::ImageOutput::create( "exr" );
+    if ( !image_output )
+    {
+        std::cerr << "ERROR: Failed to create the OpenEXR writer."
+                  << std::endl;
+        return nullptr;
+    }
+
+    if ( ( settings.output_profile ==
+               ImageConverter::Settings::OutputProfile::Intermediate ||
+           settings.proxy > 1 ) &&
+         settings.write_threads > 0 )
+    {
+        image_output->threads( settings.write_threads );
+    }
+
+    if ( !image_output->open( path, spec ) )
+    {
+        std::cerr << "ERROR: Failed to write file: " << path << std::endl
                   << "Error: " << image_output->geterror() << std::endl;
+        return nullptr;
+    }
+
+    return image_output;
+}
+
+/// Write the file at `path` via `write` into a temporary file next to it,
+/// which only replaces `path` once written successfully, so an interrupted
+/// conversion never leaves a partial file under the final name. The
+/// temporary file gets removed on failure.
+/// @result `true` if written and renamed successfully.
+bool write_atomically(
+    const std::string                                &path,
+    const std::function<bool( const std::string & )> &write )
+{
+    const std::string temp_path = path + ".tmp";
+
+    bool            result = write( temp_path );
+    std::error_code error;
+    if ( result )
+    {
+        std::filesystem::rename( temp_path, path, error );
+        if ( error )
+        {
+            std::cerr << "ERROR: Failed to rename " << temp_path << " to "
+                      << path << ": " << error.message() << std::endl;
+            result = false;
+        }
     }
 
+    if ( !result )
+        std::filesystem::remove( temp_path, error );
     return result;
 }
 
-bool ImageConverter::process_image( const std::string &input_filename )
+/// Save `buf` at `output_filename` as defined by the output profile in
+/// `settings`, see `ImageConverter::save_image()`.
+/// @result `true` if saved successfully.
+static bool write_image_file(
+    const ImageConverter::Settings &settings,
+    const std::string              &output_filename,
+    const OIIO::ImageBuf           &buf )
+{
+    OIIO::ImageSpec image_spec = make_output_spec( settings, buf.spec() );
+
+    return write_atomically( output_filename, [&]( const std::string &path ) {
+        auto image_output = open_output( settings, path, image_spec );
+        if ( !image_output )
+            return false;
+
+        bool result =
+            buf.write( image_output.get() ) && image_output->close();
+        if ( !result )
+        {
+            std::cerr << "ERROR: Failed to write file: " << output_filename
+                      << std::endl
+                      << "Error: " << image_output->geterror() << std::endl;
+        }
+
+        return result;
+    } );
+}
+
+bool ImageConverter::save_image(
+    const std::string &output_filename, const OIIO::ImageBuf &buf )
+{
+    return write_image_file( settings, output_filename, buf );
+}
+
+bool ImageConverter::save_output(
+    const std::string      &output_filename,
+    const OIIO::ImageBuf   &buf,
+    const Settings::Output &output )
+{
+    if ( output.scale < 2 && output.compression.empty() )
+        return write_image_file( settings, output_filename, buf );
+
+    // The downscaled outputs are proxies, written the same way as
+    // `Settings::proxy`, and the compressed ones cannot be ACES Containers.
+    Settings output_settings       = settings;
+    output_settings.output_profile = Settings::OutputProfile::Intermediate;
+    if ( !output.compression.empty() )
+        output_settings.compression = output.compression;
+    return write_image_file( output_settings, output_filename, buf );
+}
+
+/// The default amount of memory for the strip buffers of `stream_image`.
+constexpr size_t default_strip_memory = 64 << 20;
+
+bool ImageConverter::stream_image(
+    const std::string          &input_filename,
+    const OIIO::ParamValueList &hints,
+    const std::string          &output_filename )
+{
+    std::shared_ptr<RawReader> raw_reader;
+    if ( _raw_reader && _raw_reader->path() == input_filename )
+    {
+        raw_reader = std::move( _raw_reader );
+    }
+    else
+    {
+        OIIO::ImageSpec config;
+        config.extra_attribs = hints;
+
+        OIIO::ImageSpec spec;
+        raw_reader = std::make_shared<RawReader>();
+        raw_reader->set_thread_count( conversion_threads( settings ) );
+        raw_reader->set_io_mode( settings.io_mode );
+        if ( !raw_reader->open( input_filename, config, spec ) )
+            return false;
+    }
+
+    OIIO::ImageSpec input_spec;
+    if ( !raw_reader->start_scanlines( hints, input_spec ) )
+        return false;
+
+    // The area to convert, and the layout of the output file, the same as
+    // produced by `apply_crop()`.
+    OIIO::ROI       region      = crop_region( settings.crop_mode, input_spec );
+    OIIO::ImageSpec output_spec = input_spec;
+    if ( settings.crop_mode == Settings::CropMode::Off )
+    {
+        output_spec.full_x      = output_spec.x;
+        output_spec.full_y      = output_spec.y;
+        output_spec.full_width  = output_spec.width;
+        output_spec.full_height = output_spec.height;
+    }
+    else if ( settings.crop_mode == Settings::CropMode::Hard )
+    {
+        output_spec.width       = region.width();
+        output_spec.height      = region.height();
+        output_spec.x           = 0;
+        output_spec.y           = 0;
+        output_spec.full_x      = 0;
+        output_spec.full_y      = 0;
+        output_spec.full_width  = region.width();
+        output_spec.full_height = region.height();
+    }
+
+    if ( region.height() <= 0 || region.width() <= 0 )
+    {
+        std::cerr << "ERROR: The crop area of the file " << input_filename
+                  << " is empty." << std::endl;
+        return false;
+    }
+
+    output_spec = make_output_spec( settings, output_spec );
+
+    // The source strips span the full width of the image, as the decoder
+    // can only read whole scanlines; the destination strips only cover the
+    // crop area.
+    const size_t row_size =
+        static_cast<size_t>( input_spec.width ) * input_spec.nchannels *
+            sizeof( float ) +
+        static_cast<size_t>( region.width() ) * output_spec.nchannels *
+            output_spec.format.size();
+    size_t memory = default_strip_memory;
+    if ( settings.memory_limit > 0 )
+        memory = static_cast<size_t>( settings.memory_limit ) << 20;
+
+    int strip_height = static_cast<int>( std::clamp<size_t>(
+        memory / row_size, 1, static_cast<size_t>( region.height() ) ) );
+
+    // Tiled files get written in whole rows of tiles.
+    const int tile_height = output_spec.tile_height;
+    if ( tile_height > 0 && strip_height < region.height() )
+        strip_height = std::max( strip_height / tile_height, 1 ) * tile_height;
+
+    OIIO::ImageSpec src_spec = input_spec;
+    src_spec.set_format( OIIO::TypeDesc::FLOAT );
+    src_spec.height = strip_height;
+
+    OIIO::ImageSpec dst_spec = output_spec;
+    dst_spec.x               = region.xbegin;
+    dst_spec.width           = region.width();
+    dst_spec.height          = strip_height;
+
+    auto src_memory = allocate_memory( src_spec.image_bytes() );
+    auto dst_memory = allocate_memory( dst_spec.image_bytes() );
+
+    float *src_pixels = static_cast<float *>( src_memory.get() );
+    void  *dst_pixels = dst_memory.get();
+
+    return write_atomically( output_filename, [&]( const std::string &path ) {
+        auto image_output = open_output( settings, path, output_spec );
+        if ( !image_output )
+            return false;
+
+        // The offset between the row numbers of the source and the output.
+        const int output_offset = output_spec.y - region.ybegin;
+
+        for ( int y = region.ybegin; y < region.yend; y += strip_height )
+        {
+            const int y_end = std::min( y + strip_height, region.yend );
+
+            src_spec.y = y;
+            dst_spec.y = y;
+            OIIO::ImageBuf src( src_spec, src_pixels );
+            OIIO::ImageBuf dst( dst_spec, dst_pixels );
+
+            OIIO::ROI roi = dst.roi();
+            roi.yend      = y_end;
+
+            if ( !raw_reader->read_scanlines( y, y_end, src_pixels ) )
+            {
+                std::cerr << "ERROR: Failed to read the scanlines " << y
+                          << ".." << y_end << " of the file: " << input_filename
+                          << std::endl;
+                return false;
+            }
+
+            if ( !apply_transform( dst, src, roi ) )
+                return false;
+
+            bool written;
+            if ( tile_height > 0 )
+            {
+                written = image_output->write_tiles(
+                    output_spec.x,
+                    output_spec.x + output_spec.width,
+                    y + output_offset,
+                    y_end + output_offset,
+                    0,
+                    1,
+                    output_spec.format,
+                    dst_pixels );
+            }
+            else
+            {
+                written = image_output->write_scanlines(
+                    y + output_offset,
+                    y_end + output_offset,
+                    0,
+                    output_spec.format,
+                    dst_pixels );
+            }
+
+            if ( !written )
+            {
+                std::cerr << "ERROR: Failed to write file: "
+                          << output_filename << std::endl
+                          << "Error: " << image_output->geterror()
+                          << std::endl;
+                return false;
+            }
+        }
+
+        raw_reader->close();
+        return image_output->close();
+    } );
+}
+
+bool ImageConverter::prepare_image(
+    const std::string    &input_filename,
+    std::string          &output_filename,
+    OIIO::ParamValueList &hints )
 {
     // Early validation: check if input file exists and is valid
     if ( input_filename.empty() )
@@ -1904,14 +3584,22 @@ bool ImageConverter::process_image( const std::string &input_filename )
         return false;
     }
 
-    std::string output_filename = input_filename;
-    if ( !make_output_path( output_filename ) )
+    // The first of the outputs stands for the image, e.g. in the manifest.
+    _output_filename.clear();
+    output_filename = input_filename;
+    if ( !make_output_path(
+             output_filename,
+             settings.outputs.empty() ? "_aces"
+                                      : settings.outputs.front().suffix ) )
     {
         return ( false );
     }
+    _output_filename = output_filename;
 
+    Tracer::Scope    trace_scope( tracer.get(), input_filename );
     util::UsageTimer usage_timer;
     usage_timer.enabled = settings.use_timing;
+    usage_timer.metrics = metrics.get();
 
     // ___ Configure transform ___
     if ( settings.verbosity > 0 )
@@ -1920,14 +3608,34 @@ bool ImageConverter::process_image( const std::string &input_filename )
                   << std::endl;
     }
     usage_timer.reset();
-    OIIO::ParamValueList hints;
     if ( !configure( input_filename, hints ) )
     {
         std::cerr << "Failed to configure the reader for the file: "
                   << input_filename << std::endl;
         return ( false );
     }
-    usage_timer.print( input_filename, "configuring reader" );
+    usage_timer.print( input_filename, "configuring reader", "configure" );
+
+    return ( true );
+}
+
+bool ImageConverter::read_image(
+    const std::string &input_filename,
+    std::string       &output_filename,
+    OIIO::ImageBuf    &buffer )
+{
+    release_buffers();
+
+    OIIO::ParamValueList hints;
+    if ( !prepare_image( input_filename, output_filename, hints ) )
+    {
+        return ( false );
+    }
+
+    Tracer::Scope    trace_scope( tracer.get(), input_filename );
+    util::UsageTimer usage_timer;
+    usage_timer.enabled = settings.use_timing;
+    usage_timer.metrics = metrics.get();
 
     // ___ Load image ___
     if ( settings.verbosity > 0 )
@@ -1935,55 +3643,200 @@ bool ImageConverter::process_image( const std::string &input_filename )
         std::cerr << "Loading image: " << input_filename << std::endl;
     }
     usage_timer.reset();
-    OIIO::ImageBuf buffer;
     if ( !load_image( input_filename, hints, buffer ) )
     {
         std::cerr << "Failed to read the file: " << input_filename << std::endl;
         return ( false );
     }
-    usage_timer.print( input_filename, "reading image" );
+    usage_timer.print( input_filename, "reading image", "read" );
+
+    return ( true );
+}
+
+bool ImageConverter::convert_image(
+    const std::string &input_filename, OIIO::ImageBuf &buffer )
+{
+    Tracer::Scope    trace_scope( tracer.get(), input_filename );
+    util::UsageTimer usage_timer;
+    usage_timer.enabled = settings.use_timing;
+    usage_timer.metrics = metrics.get();
+
+    // ___ Downscale a proxy ___
+    // The transform is linear, so downscaling first gives the same result
+    // while transforming fewer pixels.
+    const int downscale_factor = proxy_downscale_factor( settings );
+    if ( downscale_factor > 1 )
+    {
+        if ( settings.verbosity > 0 )
+        {
+            std::cerr << "Downscaling proxy by " << downscale_factor
+                      << std::endl;
+        }
+        usage_timer.reset();
+        if ( !apply_downscale( buffer, buffer, downscale_factor ) )
+        {
+            std::cerr << "Failed to downscale the file: " << input_filename
+                      << std::endl;
+            return ( false );
+        }
+        usage_timer.print( input_filename, "downscaling proxy", "downscale" );
+    }
 
-    // ___ Apply matrix/matrices ___
+    // ___ Apply matrix/matrices and scale ___
     if ( settings.verbosity > 0 )
     {
-        std::cerr << "Applying transform matrix" << std::endl;
+        std::cerr << "Applying transform matrix and scale" << std::endl;
     }
     usage_timer.reset();
-    if ( !apply_matrix( buffer, buffer ) )
     {
-        std::cerr << "Failed to apply colour space conversion to the file: "
-                  << input_filename << std::endl;
-        return ( false );
+        // Convert to half floats in the same pass, as this is what gets
+        // written to the output file anyway. Only convert the area kept by
+        // the crop, so the crop below does not need to copy the pixels.
+        OIIO::ImageSpec output_spec = buffer.spec();
+        OIIO::ROI       region = crop_region( settings.crop_mode, output_spec );
+
+        output_spec.x      = region.xbegin;
+        output_spec.y      = region.ybegin;
+        output_spec.width  = region.width();
+        output_spec.height = region.height();
+        output_spec.set_format( OIIO::TypeDesc::HALF );
+        OIIO::ImageBuf output;
+        allocate_buffer( output_spec, output );
+
+        if ( !apply_transform( output, buffer ) )
+        {
+            std::cerr << "Failed to apply colour space conversion to the file: "
+                      << input_filename << std::endl;
+            return ( false );
+        }
+        buffer.swap( output );
+        release_buffer( output );
     }
-    usage_timer.print( input_filename, "applying transform matrix" );
+    usage_timer.print(
+        input_filename,
+        "applying transform matrix and scale",
+        "transform" );
 
-    // ___ Apply scale ___
+    // ___ Apply crop ___
     if ( settings.verbosity > 0 )
     {
-        std::cerr << "Applying scale" << std::endl;
+        std::cerr << "Applying crop" << std::endl;
     }
     usage_timer.reset();
-    if ( !apply_scale( buffer, buffer ) )
+    if ( !apply_crop( buffer, buffer ) )
     {
-        std::cerr << "Failed to apply scale to the file: " << input_filename
+        std::cerr << "Failed to apply crop to the file: " << input_filename
                   << std::endl;
         return ( false );
     }
-    usage_timer.print( input_filename, "applying scale" );
+    usage_timer.print( input_filename, "applying crop", "crop" );
 
-    // ___ Apply crop ___
-    if ( settings.verbosity > 0 )
+    return ( true );
+}
+
+bool ImageConverter::convert_output(
+    const std::string      &input_filename,
+    const OIIO::ImageBuf   &buffer,
+    const Settings::Output &output,
+    OIIO::ImageBuf         &result )
+{
+    OIIO::ROI  region     = crop_region( settings.crop_mode, buffer.spec() );
+    const bool has_region = output.region[2] > 0 && output.region[3] > 0;
+    if ( has_region )
+    {
+        // The region is given in the pixels of the default output, which
+        // start at the corner of the crop area if cropping hard.
+        int x = output.region[0];
+        int y = output.region[1];
+        if ( settings.crop_mode == Settings::CropMode::Hard )
+        {
+            x += region.xbegin;
+            y += region.ybegin;
+        }
+
+        OIIO::ROI roi(
+            x,
+            x + output.region[2],
+            y,
+            y + output.region[3],
+            region.zbegin,
+            region.zend,
+            0,
+            buffer.nchannels() );
+        region = OIIO::roi_intersection( roi, region );
+        if ( region.width() <= 0 || region.height() <= 0 )
+        {
+            std::cerr << "ERROR: The region of the output '" << output.suffix
+                      << "' lies outside of the image: " << input_filename
+                      << std::endl;
+            return ( false );
+        }
+    }
+
+    // The transform is linear, so downscaling first gives the same result
+    // while transforming fewer pixels. Only the region gets downscaled.
+    const OIIO::ImageBuf *source = &buffer;
+    OIIO::ImageBuf        scaled;
+    if ( output.scale > 1 )
     {
-        std::cerr << "Applying crop" << std::endl;
+        OIIO::ImageBuf cropped;
+        if ( !OIIO::ImageBufAlgo::crop(
+                 cropped, buffer, region, conversion_threads( settings ) ) ||
+             !apply_downscale( scaled, cropped, output.scale ) )
+        {
+            std::cerr << "Failed to downscale the output '" << output.suffix
+                      << "' of the file: " << input_filename << std::endl;
+            return ( false );
+        }
+        source = &scaled;
+        region = scaled.roi();
     }
-    usage_timer.reset();
-    if ( !apply_crop( buffer, buffer ) )
+
+    // Convert to half floats in the same pass, only visiting the region.
+    OIIO::ImageSpec output_spec = source->spec();
+    output_spec.x               = region.xbegin;
+    output_spec.y               = region.ybegin;
+    output_spec.width           = region.width();
+    output_spec.height          = region.height();
+    output_spec.set_format( OIIO::TypeDesc::HALF );
+    allocate_buffer( output_spec, result );
+
+    if ( !apply_transform( result, *source ) )
+    {
+        std::cerr << "Failed to apply colour space conversion to the file: "
+                  << input_filename << std::endl;
+        return ( false );
+    }
+
+    if ( has_region )
+    {
+        OIIO::ImageSpec &spec = result.specmod();
+        spec.x                = 0;
+        spec.y                = 0;
+        spec.full_x           = 0;
+        spec.full_y           = 0;
+        spec.full_width       = spec.width;
+        spec.full_height      = spec.height;
+    }
+    else if ( !apply_crop( result, result ) )
     {
         std::cerr << "Failed to apply crop to the file: " << input_filename
                   << std::endl;
         return ( false );
     }
-    usage_timer.print( input_filename, "applying crop" );
+
+    return ( true );
+}
+
+bool ImageConverter::write_image(
+    const std::string    &input_filename,
+    const std::string    &output_filename,
+    const OIIO::ImageBuf &buffer )
+{
+    Tracer::Scope    trace_scope( tracer.get(), input_filename );
+    util::UsageTimer usage_timer;
+    usage_timer.enabled = settings.use_timing;
+    usage_timer.metrics = metrics.get();
 
     // ___ Save image ___
     if ( settings.verbosity > 0 )
@@ -1997,11 +3850,191 @@ bool ImageConverter::process_image( const std::string &input_filename )
                   << std::endl;
         return ( false );
     }
-    usage_timer.print( input_filename, "writing image" );
+    usage_timer.print( input_filename, "writing image", "write" );
+
+    return ( true );
+}
+
+bool ImageConverter::process_image( const std::string &input_filename )
+{
+    Tracer::Scope trace_scope( tracer.get(), input_filename );
+    TraceSpan     trace_span( "process_image", "file" );
+
+    if ( !settings.outputs.empty() )
+    {
+        bool result = process_outputs( input_filename );
+        release_buffers();
+        return result;
+    }
+
+    std::string output_filename;
+
+    if ( settings.memory_limit > 0 && settings.proxy < 2 )
+    {
+        OIIO::ParamValueList hints;
+        if ( !prepare_image( input_filename, output_filename, hints ) )
+        {
+            return ( false );
+        }
+
+        util::UsageTimer usage_timer;
+        usage_timer.enabled = settings.use_timing;
+        usage_timer.metrics = metrics.get();
+
+        // ___ Stream image ___
+        if ( settings.verbosity > 0 )
+        {
+            std::cerr << "Streaming image: " << input_filename << " to "
+                      << output_filename << std::endl;
+        }
+        usage_timer.reset();
+        if ( !stream_image( input_filename, hints, output_filename ) )
+        {
+            std::cerr << "Failed to convert the file: " << input_filename
+                      << std::endl;
+            return ( false );
+        }
+        usage_timer.print( input_filename, "streaming image", "stream" );
+
+        return ( true );
+    }
+
+    bool result;
+    {
+        OIIO::ImageBuf buffer;
+        result = read_image( input_filename, output_filename, buffer ) &&
+                 convert_image( input_filename, buffer ) &&
+                 write_image( input_filename, output_filename, buffer );
+    }
+
+    // The buffer is gone, so its memory can go back to the pool.
+    release_buffers();
+    return result;
+}
+
+bool ImageConverter::process_outputs( const std::string &input_filename )
+{
+    // Check that all outputs can be written before decoding the image. The
+    // path of the first output gets made by `read_image`.
+    std::vector<std::string> output_filenames(
+        settings.outputs.size(), input_filename );
+    for ( size_t i = 1; i < settings.outputs.size(); i++ )
+    {
+        if ( !make_output_path(
+                 output_filenames[i], settings.outputs[i].suffix ) )
+        {
+            return ( false );
+        }
+    }
+
+    OIIO::ImageBuf buffer;
+    if ( !read_image( input_filename, output_filenames[0], buffer ) )
+        return ( false );
+
+    util::UsageTimer usage_timer;
+    usage_timer.enabled = settings.use_timing;
+    usage_timer.metrics = metrics.get();
+
+    // ___ Downscale a proxy ___
+    const int downscale_factor = proxy_downscale_factor( settings );
+    if ( downscale_factor > 1 )
+    {
+        if ( settings.verbosity > 0 )
+        {
+            std::cerr << "Downscaling proxy by " << downscale_factor
+                      << std::endl;
+        }
+        usage_timer.reset();
+        if ( !apply_downscale( buffer, buffer, downscale_factor ) )
+        {
+            std::cerr << "Failed to downscale the file: " << input_filename
+                      << std::endl;
+            return ( false );
+        }
+        usage_timer.print( input_filename, "downscaling proxy", "downscale" );
+    }
+
+    for ( size_t i = 0; i < settings.outputs.size(); i++ )
+    {
+        const Settings::Output &output          = settings.outputs[i];
+        const std::string      &output_filename = output_filenames[i];
+
+        // ___ Convert output ___
+        if ( settings.verbosity > 0 )
+        {
+            std::cerr << "Converting output: " << output_filename
+                      << std::endl;
+        }
+        usage_timer.reset();
+        OIIO::ImageBuf result;
+        if ( !convert_output( input_filename, buffer, output, result ) )
+            return ( false );
+        usage_timer.print( input_filename, "converting output", "transform" );
+
+        // ___ Save output ___
+        if ( settings.verbosity > 0 )
+        {
+            std::cerr << "Saving output: " << output_filename << std::endl;
+        }
+        usage_timer.reset();
+        if ( !save_output( output_filename, result, output ) )
+        {
+            std::cerr << "Failed to save the file: " << output_filename
+                      << std::endl;
+            return ( false );
+        }
+        usage_timer.print( input_filename, "writing image", "write" );
+
+        release_buffer( result );
+    }
 
     return ( true );
 }
 
+bool ImageConverter::process_memory(
+    const std::string &name,
+    const void        *data,
+    size_t             size,
+    OIIO::ImageBuf    &buffer )
+{
+    release_buffers();
+
+    Tracer::Scope    trace_scope( tracer.get(), name );
+    util::UsageTimer usage_timer;
+    usage_timer.enabled = settings.use_timing;
+    usage_timer.metrics = metrics.get();
+
+    // ___ Configure transform ___
+    if ( settings.verbosity > 0 )
+    {
+        std::cerr << "Configuring transform for: " << name << std::endl;
+    }
+    usage_timer.reset();
+    OIIO::ParamValueList hints;
+    if ( !configure( name, data, size, hints ) )
+    {
+        std::cerr << "Failed to configure the reader for the image: " << name
+                  << std::endl;
+        return ( false );
+    }
+    usage_timer.print( name, "configuring reader", "configure" );
+
+    // ___ Load image ___
+    if ( settings.verbosity > 0 )
+    {
+        std::cerr << "Loading image: " << name << std::endl;
+    }
+    usage_timer.reset();
+    if ( !load_image( name, hints, buffer ) )
+    {
+        std::cerr << "Failed to read the image: " << name << std::endl;
+        return ( false );
+    }
+    usage_timer.print( name, "reading image", "read" );
+
+    return convert_image( name, buffer );
+}
+
 const std::vector<double> &ImageConverter::get_WB_multipliers() const
 {
     return _wb_multipliers;
@@ -2017,5 +4050,10 @@ const std::vector<std::vector<double>> &ImageConverter::get_CAT_matrix() const
     return _cat_matrix;
 }
 
+const std::string &ImageConverter::get_output_filename() const
+{
+    return _output_filename;
+}
+
 } //namespace util
 } //namespace rta
@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "job_manifest.h"
+#include "persistent_cache.h"
+#include "rawtoaces_util_priv.h"
+
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace rta
+{
+namespace util
+{
+
+/// The key of an input file in the manifest, so the same file given by a
+/// relative and an absolute path gets found either way.
+static std::string manifest_key( const std::string &path )
+{
+    std::error_code error;
+    auto            absolute = std::filesystem::absolute( path, error );
+    return error ? path : absolute.lexically_normal().string();
+}
+
+/// Get the size and the modification time of the file at `path`.
+/// @result `true` if the file exists.
+static bool
+file_state( const std::string &path, uintmax_t &size, long long &time )
+{
+    std::error_code error;
+    size = std::filesystem::file_size( path, error );
+    if ( error )
+        return false;
+
+    auto write_time = std::filesystem::last_write_time( path, error );
+    if ( error )
+        return false;
+
+    time = static_cast<long long>( write_time.time_since_epoch().count() );
+    return true;
+}
+
+bool JobManifest::open( const std::string &path )
+{
+    std::lock_guard<std::mutex> guard( _mutex );
+
+    _path = path;
+    _entries.clear();
+
+    std::string content;
+    {
+        std::ifstream file( path, std::ios::binary );
+        if ( file )
+        {
+            std::ostringstream stream;
+            stream << file.rdbuf();
+            content = stream.str();
+        }
+    }
+
+    // Each line contains the status, the signature, the size and the time
+    // of the input file, the input and the output paths, tab-separated. An
+    // incomplete last line left behind by an interrupted batch gets ignored.
+    size_t begin = 0;
+    size_t end;
+    while ( ( end = content.find( '\n', begin ) ) != std::string::npos )
+    {
+        std::vector<std::string> fields;
+        std::istringstream       line( content.substr( begin, end - begin ) );
+        std::string              field;
+        while ( std::getline( line, field, '\t' ) )
+            fields.push_back( field );
+        begin = end + 1;
+
+        if ( fields.size() != 6 )
+            continue;
+
+        Entry entry;
+        entry.success         = fields[0] == "done";
+        entry.signature       = fields[1];
+        entry.output_filename = fields[5];
+        try
+        {
+            entry.size = std::stoull( fields[2] );
+            entry.time = std::stoll( fields[3] );
+        }
+        catch ( const std::exception & )
+        {
+            continue;
+        }
+        _entries[fields[4]] = entry;
+    }
+
+    _file.open( path, std::ios::binary | std::ios::app );
+    if ( !_file )
+    {
+        std::cerr << "ERROR: Failed to open the manifest file " << path
+                  << " for writing." << std::endl;
+        return false;
+    }
+
+    // Terminate the incomplete line, so the next entry starts a new one.
+    if ( begin < content.size() )
+        _file << std::endl;
+
+    return true;
+}
+
+bool JobManifest::is_up_to_date(
+    const std::string &input_filename,
+    const std::string &signature,
+    std::string       &output_filename ) const
+{
+    const std::string key = manifest_key( input_filename );
+
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> guard( _mutex );
+
+        auto iter = _entries.find( key );
+        if ( iter == _entries.end() )
+            return false;
+        entry = iter->second;
+    }
+
+    uintmax_t size;
+    long long time;
+    if ( !entry.success || entry.signature != signature ||
+         !file_state( input_filename, size, time ) || size != entry.size ||
+         time != entry.time )
+    {
+        return false;
+    }
+
+    std::error_code error;
+    if ( !std::filesystem::exists( entry.output_filename, error ) )
+        return false;
+
+    output_filename = entry.output_filename;
+    return true;
+}
+
+bool JobManifest::record(
+    const std::string &input_filename,
+    const std::string &signature,
+    const std::string &output_filename,
+    bool               success )
+{
+    const std::string key = manifest_key( input_filename );
+
+    // The entries are stored one per line, tab-separated.
+    for ( const auto *field: { &key, &output_filename } )
+    {
+        if ( field->find_first_of( "\t\n" ) != std::string::npos )
+            return false;
+    }
+
+    Entry entry;
+    entry.success         = success;
+    entry.signature       = signature;
+    entry.output_filename = output_filename;
+    if ( !file_state( input_filename, entry.size, entry.time ) )
+        return false;
+
+    std::lock_guard<std::mutex> guard( _mutex );
+
+    _file << ( success ? "done" : "failed" ) << "\t" << signature << "\t"
+          << entry.size << "\t" << entry.time << "\t" << key << "\t"
+          << output_filename << std::endl;
+    if ( !_file )
+    {
+        std::cerr << "ERROR: Failed to write the manifest file " << _path
+                  << "." << std::endl;
+        return false;
+    }
+
+    _entries[key] = entry;
+    return true;
+}
+
+size_t JobManifest::size() const
+{
+    std::lock_guard<std::mutex> guard( _mutex );
+    return _entries.size();
+}
+
+std::string settings_signature( const ImageConverter::Settings &settings )
+{
+    std::ostringstream os;
+    os << std::setprecision( std::numeric_limits<float>::max_digits10 );
+
+    auto add_array = [&os]( const auto &values ) {
+        for ( const auto &value: values )
+            os << value << ",";
+        os << ";";
+    };
+
+    os << RAWTOACES_VERSION << ";";
+    os << static_cast<int>( settings.WB_method ) << ";"
+       << static_cast<int>( settings.matrix_method ) << ";"
+       << static_cast<int>( settings.crop_mode ) << ";" << settings.illuminant
+       << ";" << settings.fast_fit << ";" << settings.use_CCT_table << ";"
+       << settings.headroom << ";";
+    add_array( settings.WB_box );
+    add_array( settings.custom_WB );
+    for ( const auto &row: settings.custom_matrix )
+        add_array( row );
+    os << settings.custom_camera_make << ";" << settings.custom_camera_model
+       << ";";
+
+    os << settings.auto_bright << ";" << settings.adjust_maximum_threshold
+       << ";" << settings.black_level << ";" << settings.saturation_level
+       << ";" << settings.half_size << ";" << settings.proxy << ";"
+       << settings.highlight_mode << ";" << settings.flip << ";";
+    add_array( settings.crop_box );
+    add_array( settings.chromatic_aberration );
+    os << settings.denoise_threshold << ";" << settings.scale << ";"
+       << settings.demosaic_algorithm << ";";
+
+    add_array( settings.database_directories );
+    os << settings.output_dir << ";"
+       << static_cast<int>( settings.output_profile ) << ";"
+       << settings.compression << ";" << settings.tile_size << ";";
+    for ( const auto &output: settings.outputs )
+    {
+        os << output.suffix << ",";
+        add_array( output.region );
+        os << output.scale << "," << output.compression << ";";
+    }
+
+    os << cache::database_signature( settings.database_directories );
+
+    // A stable hash, so the signature is the same for all builds.
+    std::ostringstream result;
+    result << std::hex << std::setw( 16 ) << std::setfill( '0' )
+           << fnv1a( os.str() );
+    return result.str();
+}
+
+} // namespace util
+} // namespace rta
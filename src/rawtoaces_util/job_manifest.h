@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <rawtoaces/image_converter.h>
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace rta
+{
+namespace util
+{
+
+/// A record of the files converted by the previous runs of a batch, so an
+/// interrupted batch can resume where it stopped. The file is a plain text
+/// file with one line per converted file, lines only ever get appended, the
+/// last line of a file wins. Every line gets flushed as soon as the file has
+/// been converted, so the record survives the batch getting killed.
+///
+/// The manifest is meant to be used by one batch at a time.
+class JobManifest
+{
+public:
+    /// The outcome of the last conversion of an input file.
+    struct Entry
+    {
+        /// `true` if the file has been converted successfully.
+        bool success = false;
+
+        /// The signature of the settings used, see `settings_signature()`.
+        std::string signature;
+
+        /// The size of the input file when converted.
+        uintmax_t size = 0;
+
+        /// The modification time of the input file when converted.
+        long long time = 0;
+
+        /// The path of the output file written.
+        std::string output_filename;
+    };
+
+    /// Load the manifest file at `path`, and open it for appending. The file
+    /// gets created if missing.
+    /// @param path the path of the manifest file.
+    /// @result `true` if opened successfully.
+    bool open( const std::string &path );
+
+    /// Check whether `input_filename` has been converted successfully with
+    /// the settings of `signature`, has not changed since, and its output
+    /// file still exists. Only the file metadata get looked at, the files
+    /// do not get opened.
+    /// @param input_filename the path of the input file.
+    /// @param signature the signature of the current settings.
+    /// @param output_filename receives the path of the output file if up to
+    ///     date.
+    /// @result `true` if up to date.
+    bool is_up_to_date(
+        const std::string &input_filename,
+        const std::string &signature,
+        std::string       &output_filename ) const;
+
+    /// Record the outcome of converting a file. Can be called concurrently.
+    /// @param input_filename the path of the input file.
+    /// @param signature the signature of the settings used.
+    /// @param output_filename the path of the output file written.
+    /// @param success `true` if converted successfully.
+    /// @result `true` if recorded successfully.
+    bool record(
+        const std::string &input_filename,
+        const std::string &signature,
+        const std::string &output_filename,
+        bool               success );
+
+    /// The number of the input files recorded.
+    size_t size() const;
+
+private:
+    std::string                  _path;
+    std::ofstream                _file;
+    std::map<std::string, Entry> _entries;
+    mutable std::mutex           _mutex;
+};
+
+/// Calculate the signature of the settings affecting the content and the
+/// location of the output files, including the version of rawtoaces and the
+/// signature of the spectral database, see `cache::database_signature()`.
+/// The settings only affecting the speed of the conversion, like the number
+/// of jobs, do not change the signature.
+std::string settings_signature( const ImageConverter::Settings &settings );
+
+} // namespace util
+} // namespace rta
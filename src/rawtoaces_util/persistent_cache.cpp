@@ -0,0 +1,411 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "persistent_cache.h"
+#include "rawtoaces_util_priv.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <random>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#    include <io.h>
+#    include <share.h>
+#else
+#    include <sys/file.h>
+#    include <unistd.h>
+#endif
+
+namespace rta
+{
+namespace cache
+{
+
+// Thin wrappers over the platform file API, as the standard streams can
+// neither lock a file, nor guarantee atomic appends.
+
+#ifdef WIN32
+int file_open( const std::string &path )
+{
+    int fd = -1;
+    _sopen_s(
+        &fd,
+        path.c_str(),
+        _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY,
+        _SH_DENYNO,
+        _S_IREAD | _S_IWRITE );
+    return fd;
+}
+
+void file_close( int fd )
+{
+    _close( fd );
+}
+
+long long file_seek( int fd, long long offset )
+{
+    return _lseeki64( fd, offset, SEEK_SET );
+}
+
+long long file_read( int fd, char *buffer, size_t size )
+{
+    return _read( fd, buffer, static_cast<unsigned>( size ) );
+}
+
+long long file_write( int fd, const char *buffer, size_t size )
+{
+    return _write( fd, buffer, static_cast<unsigned>( size ) );
+}
+
+bool file_truncate( int fd )
+{
+    return _chsize_s( fd, 0 ) == 0;
+}
+
+bool file_lock( int fd, bool exclusive )
+{
+    HANDLE     handle     = reinterpret_cast<HANDLE>( _get_osfhandle( fd ) );
+    OVERLAPPED overlapped = {};
+    DWORD      flags      = exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+    return LockFileEx( handle, flags, 0, MAXDWORD, MAXDWORD, &overlapped );
+}
+
+void file_unlock( int fd )
+{
+    HANDLE     handle     = reinterpret_cast<HANDLE>( _get_osfhandle( fd ) );
+    OVERLAPPED overlapped = {};
+    UnlockFileEx( handle, 0, MAXDWORD, MAXDWORD, &overlapped );
+}
+#else
+int file_open( const std::string &path )
+{
+    return ::open( path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0666 );
+}
+
+void file_close( int fd )
+{
+    ::close( fd );
+}
+
+long long file_seek( int fd, long long offset )
+{
+    return ::lseek( fd, offset, SEEK_SET );
+}
+
+long long file_read( int fd, char *buffer, size_t size )
+{
+    return ::read( fd, buffer, size );
+}
+
+long long file_write( int fd, const char *buffer, size_t size )
+{
+    return ::write( fd, buffer, size );
+}
+
+bool file_truncate( int fd )
+{
+    return ::ftruncate( fd, 0 ) == 0;
+}
+
+bool file_lock( int fd, bool exclusive )
+{
+    return ::flock( fd, exclusive ? LOCK_EX : LOCK_SH ) == 0;
+}
+
+void file_unlock( int fd )
+{
+    ::flock( fd, LOCK_UN );
+}
+#endif
+
+PersistentCache::PersistentCache(
+    const std::string &path, const std::string &signature )
+    : _path( path ), _signature( signature )
+{
+    _fd = file_open( path );
+    if ( _fd < 0 )
+    {
+        std::cerr << "WARNING: Failed to open the cache file '" << path
+                  << "'. The persistent cache will not be used." << std::endl;
+    }
+}
+
+PersistentCache::~PersistentCache()
+{
+    if ( _fd >= 0 )
+        file_close( _fd );
+}
+
+bool PersistentCache::is_open() const
+{
+    return _fd >= 0;
+}
+
+bool PersistentCache::find( const std::string &key, std::string &value )
+{
+    std::lock_guard<std::mutex> guard( _mutex );
+
+    auto iter = _entries.find( key );
+    if ( iter == _entries.end() && lock( false ) )
+    {
+        read_new_entries();
+        unlock();
+        iter = _entries.find( key );
+    }
+
+    if ( iter == _entries.end() )
+        return false;
+
+    value = iter->second;
+    return true;
+}
+
+bool PersistentCache::store( const std::string &key, const std::string &value )
+{
+    // The entries are stored one per line, tab-separated.
+    for ( const auto *field: { &key, &value } )
+    {
+        if ( field->find_first_of( "\t\n" ) != std::string::npos )
+            return false;
+    }
+
+    std::lock_guard<std::mutex> guard( _mutex );
+
+    if ( !lock( true ) )
+        return false;
+
+    read_new_entries();
+
+    std::string line;
+    // Terminate an incomplete line left behind by an interrupted writer.
+    if ( !_pending.empty() )
+    {
+        line = "\n";
+        _pending.clear();
+    }
+    line += _signature + "\t" + key + "\t" + value + "\n";
+
+    bool result = file_write( _fd, line.data(), line.size() ) ==
+                  static_cast<long long>( line.size() );
+    if ( result )
+    {
+        _offset += static_cast<long long>( line.size() );
+        _entries[key] = value;
+
+        if ( _stale_lines >= min_stale_lines &&
+             _stale_lines > _entries.size() )
+        {
+            compact();
+        }
+    }
+
+    unlock();
+    return result;
+}
+
+const std::string &PersistentCache::path() const
+{
+    return _path;
+}
+
+bool PersistentCache::lock( bool exclusive )
+{
+    return _fd >= 0 && file_lock( _fd, exclusive );
+}
+
+void PersistentCache::unlock()
+{
+    file_unlock( _fd );
+}
+
+// The compacted files start with a header line holding a token unique to
+// the compaction, so the other processes notice the file has been rewritten.
+// The header has no signature, so gets skipped as an entry.
+static const std::string header_prefix = "#\t";
+
+std::string PersistentCache::read_header()
+{
+    if ( file_seek( _fd, 0 ) != 0 )
+        return "";
+
+    char      buffer[64];
+    long long size = file_read( _fd, buffer, sizeof( buffer ) );
+    if ( size <= 0 )
+        return "";
+
+    std::string line( buffer, static_cast<size_t>( size ) );
+    size_t      end = line.find( '\n' );
+    if ( end == std::string::npos || line.compare( 0, 2, header_prefix ) != 0 )
+        return "";
+    return line.substr( 0, end );
+}
+
+void PersistentCache::read_new_entries()
+{
+    // Start over if another process has compacted the file since. The
+    // entries already read stay valid.
+    const std::string header = read_header();
+    if ( header != _header )
+    {
+        _header      = header;
+        _offset      = 0;
+        _stale_lines = 0;
+        _pending.clear();
+    }
+
+    if ( file_seek( _fd, _offset ) != _offset )
+        return;
+
+    char      buffer[4096];
+    long long size;
+    while ( ( size = file_read( _fd, buffer, sizeof( buffer ) ) ) > 0 )
+    {
+        _offset += size;
+        _pending.append( buffer, static_cast<size_t>( size ) );
+    }
+
+    size_t begin = 0;
+    size_t end;
+    while ( ( end = _pending.find( '\n', begin ) ) != std::string::npos )
+    {
+        // Each line contains the signature, the key and the value.
+        size_t tab1 = _pending.find( '\t', begin );
+        size_t tab2 = tab1 < end ? _pending.find( '\t', tab1 + 1 ) : end;
+
+        if ( tab2 < end &&
+             _pending.compare( begin, tab1 - begin, _signature ) == 0 )
+        {
+            auto result = _entries.insert_or_assign(
+                _pending.substr( tab1 + 1, tab2 - tab1 - 1 ),
+                _pending.substr( tab2 + 1, end - tab2 - 1 ) );
+            if ( !result.second )
+                _stale_lines++;
+        }
+        else if ( _pending.compare( begin, 2, header_prefix ) != 0 )
+        {
+            _stale_lines++;
+        }
+
+        begin = end + 1;
+    }
+    _pending.erase( 0, begin );
+}
+
+void PersistentCache::compact()
+{
+    std::random_device device;
+    const uint64_t     token =
+        ( static_cast<uint64_t>( device() ) << 32 ) ^ device() ^
+        static_cast<uint64_t>(
+            std::chrono::steady_clock::now().time_since_epoch().count() );
+
+    std::ostringstream header;
+    header << header_prefix << std::hex << std::setw( 16 )
+           << std::setfill( '0' ) << token;
+
+    std::string content = header.str() + "\n";
+    for ( const auto &[key, value]: _entries )
+        content += _signature + "\t" + key + "\t" + value + "\n";
+
+    // The caller holds the exclusive lock, so no other process reads the
+    // file in the meantime. Should the rewrite fail, the entries lost only
+    // get calculated again.
+    if ( !file_truncate( _fd ) )
+        return;
+
+    _pending.clear();
+    _stale_lines = 0;
+    if ( file_write( _fd, content.data(), content.size() ) ==
+         static_cast<long long>( content.size() ) )
+    {
+        _header = header.str();
+        _offset = static_cast<long long>( content.size() );
+    }
+    else
+    {
+        _header.clear();
+        _offset = 0;
+    }
+}
+
+std::string database_signature( const std::vector<std::string> &directories )
+{
+    // A stable hash, so the signature is the same for all builds. Every
+    // string gets terminated by a byte never found in the text.
+    uint64_t hash = util::fnv1a( "" );
+    auto     add  = [&hash]( const std::string &text ) {
+        hash = util::fnv1a( text, hash );
+        hash = util::fnv1a( "\xff", hash );
+    };
+
+    for ( const auto &directory: directories )
+    {
+        add( directory );
+
+        std::error_code error;
+        auto iter = std::filesystem::recursive_directory_iterator(
+            directory, error );
+        if ( error )
+            continue;
+
+        // Sort the files, as the order of the iteration is unspecified.
+        std::map<std::string, std::string> files;
+        for ( const auto &entry: iter )
+        {
+            if ( !entry.is_regular_file( error ) )
+                continue;
+
+            auto path = entry.path().string();
+            auto size = entry.file_size( error );
+            auto time = entry.last_write_time( error ).time_since_epoch();
+
+            files[path] = std::to_string( size ) + ":" +
+                          std::to_string( time.count() );
+        }
+
+        for ( const auto &[path, state]: files )
+        {
+            add( path );
+            add( state );
+        }
+    }
+
+    std::ostringstream os;
+    os << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash;
+    return os.str();
+}
+
+std::shared_ptr<PersistentCache> get_persistent_cache(
+    const std::string              &path,
+    const std::vector<std::string> &database_directories )
+{
+    if ( path.empty() )
+        return nullptr;
+
+    static std::mutex mutex;
+    static std::map<
+        std::pair<std::string, std::vector<std::string>>,
+        std::shared_ptr<PersistentCache>>
+        caches;
+
+    std::lock_guard<std::mutex> guard( mutex );
+
+    auto &cache = caches[{ path, database_directories }];
+    if ( !cache )
+    {
+        cache = std::make_shared<PersistentCache>(
+            path, database_signature( database_directories ) );
+    }
+
+    return cache->is_open() ? cache : nullptr;
+}
+
+} // namespace cache
+} // namespace rta
@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include "cache_base.h"
+
+#include <array>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rta
+{
+namespace cache
+{
+
+/// A cache of solved data backed by a file, shared across runs and
+/// processes. The file is a plain text file with one entry per line, the
+/// new entries get appended. All file access is guarded by an advisory lock
+/// on the file, so many processes can safely use the same file at once.
+///
+/// Every entry is tagged with a signature of the spectral database, so
+/// the entries calculated from a different version of the database get
+/// ignored. Once the ignored and the superseded lines outnumber the current
+/// entries, `store()` rewrites the file with the current entries only, see
+/// `min_stale_lines`.
+class PersistentCache
+{
+public:
+    /// Open or create the cache file at `path`.
+    /// @param path the path to the cache file.
+    /// @param signature the signature of the spectral database.
+    PersistentCache( const std::string &path, const std::string &signature );
+    ~PersistentCache();
+
+    PersistentCache( const PersistentCache & )            = delete;
+    PersistentCache &operator=( const PersistentCache & ) = delete;
+
+    /// `true` if the cache file has been opened successfully.
+    bool is_open() const;
+
+    /// Look up the entry matching `key`. The entries added to the file by
+    /// other processes since the last call are picked up as well.
+    /// @param key the key of the entry.
+    /// @param value the value of the entry if found.
+    /// @result `true` if found.
+    bool find( const std::string &key, std::string &value );
+
+    /// Append a new entry to the cache file, compacting the file if needed.
+    /// @param key the key of the entry.
+    /// @param value the value of the entry.
+    /// @result `true` if stored successfully.
+    bool store( const std::string &key, const std::string &value );
+
+    /// The path of the cache file.
+    const std::string &path() const;
+
+    /// The number of the ignored and the superseded lines in the file,
+    /// below which the file never gets compacted.
+    size_t min_stale_lines = 256;
+
+private:
+    bool        lock( bool exclusive );
+    void        unlock();
+    std::string read_header();
+    void        read_new_entries();
+    void        compact();
+
+    std::string                                  _path;
+    std::string                                  _signature;
+    int                                          _fd     = -1;
+    long long                                    _offset = 0;
+    std::string                                  _pending;
+    std::unordered_map<std::string, std::string> _entries;
+    std::mutex                                   _mutex;
+
+    // The header of the file when last read, changed by every compaction.
+    std::string _header;
+
+    // The number of the lines read not holding a current entry.
+    size_t _stale_lines = 0;
+};
+
+/// Calculate the signature of the spectral database located in the given
+/// `directories`. The signature changes when the files in the database get
+/// added, removed or modified.
+std::string
+database_signature( const std::vector<std::string> &directories );
+
+/// Get the persistent cache stored at `path` for the spectral database
+/// located in `database_directories`. The instances are shared within the
+/// process.
+/// @result the cache, or `nullptr` if `path` is empty or the file can not
+///     be opened.
+std::shared_ptr<PersistentCache> get_persistent_cache(
+    const std::string              &path,
+    const std::vector<std::string> &database_directories );
+
+// -----------------------------------------------------------------------------
+// Serialisation of the cached data
+// -----------------------------------------------------------------------------
+
+inline void serialize( std::ostream &os, double value )
+{
+    os << std::setprecision( std::numeric_limits<double>::max_digits10 )
+       << value << " ";
+}
+
+inline bool deserialize( std::istream &is, double &value )
+{
+    return static_cast<bool>( is >> value );
+}
+
+inline void serialize( std::ostream &os, const std::string &value )
+{
+    os << value.size() << ":" << value << " ";
+}
+
+inline bool deserialize( std::istream &is, std::string &value )
+{
+    size_t size;
+    char   separator;
+    if ( !( is >> size ) || !is.get( separator ) || separator != ':' )
+        return false;
+
+    value.resize( size );
+    return static_cast<bool>( is.read( value.data(), size ) );
+}
+
+template <typename T, size_t S>
+void serialize( std::ostream &os, const std::array<T, S> &value )
+{
+    for ( const auto &item: value )
+        serialize( os, item );
+}
+
+template <typename T, size_t S>
+bool deserialize( std::istream &is, std::array<T, S> &value )
+{
+    for ( auto &item: value )
+    {
+        if ( !deserialize( is, item ) )
+            return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+void serialize( std::ostream &os, const std::pair<T1, T2> &value )
+{
+    serialize( os, value.first );
+    serialize( os, value.second );
+}
+
+template <typename T1, typename T2>
+bool deserialize( std::istream &is, std::pair<T1, T2> &value )
+{
+    return deserialize( is, value.first ) && deserialize( is, value.second );
+}
+
+/// Look up the entry matching `descriptor` in `persistent_cache`, or
+/// calculate it using `func` and store it there if none is found. Only the
+/// successfully calculated entries get stored.
+/// @param persistent_cache the cache to use, if `nullptr`, `func` gets
+///     called directly.
+/// @param name the name of the in-memory cache, used to tell the entries of
+///     different caches apart.
+/// @param descriptor the key of the entry.
+/// @param data the data of the entry.
+/// @param func the function calculating the data of a new entry,
+///     returning `true` on success.
+/// @param verbosity the verbosity level.
+/// @result `true` if found or calculated successfully.
+template <class Descriptor, class Data, class Func>
+bool persistent_fetch(
+    PersistentCache   *persistent_cache,
+    const std::string &name,
+    const Descriptor  &descriptor,
+    Data              &data,
+    const Func        &func,
+    int                verbosity )
+{
+    if ( !persistent_cache )
+        return func( data );
+
+    std::ostringstream key;
+    key << std::setprecision( std::numeric_limits<double>::max_digits10 )
+        << name << ": " << descriptor;
+
+    std::string value;
+    if ( persistent_cache->find( key.str(), value ) )
+    {
+        std::istringstream is( value );
+        if ( deserialize( is, data ) )
+        {
+            if ( verbosity > 0 )
+            {
+                std::cerr << "Cache (" << name
+                          << "): found in the persistent cache!" << std::endl;
+            }
+            return true;
+        }
+    }
+
+    if ( !func( data ) )
+        return false;
+
+    std::ostringstream os;
+    serialize( os, data );
+    persistent_cache->store( key.str(), os.str() );
+    return true;
+}
+
+} // namespace cache
+} // namespace rta
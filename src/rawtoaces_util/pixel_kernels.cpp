@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "pixel_kernels.h"
+
+#include <OpenImageIO/half.h>
+
+#include <algorithm>
+
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) &&                        \
+    ( defined( __GNUC__ ) || defined( __clang__ ) )
+#    define RTA_HAS_F16C 1
+#    include <immintrin.h>
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#    define RTA_HAS_NEON 1
+#    include <arm_neon.h>
+#endif
+
+namespace rta
+{
+namespace util
+{
+
+/// The number of floats transformed at a time by `transform_to_half()`,
+/// small enough for the block to stay in the L1 cache.
+static const size_t block_size = 1024;
+
+static void convert_to_half_scalar( const float *src, uint16_t *dst, size_t n )
+{
+    for ( size_t i = 0; i < n; i++ )
+        dst[i] = half( src[i] ).bits();
+}
+
+#if defined( RTA_HAS_F16C )
+
+__attribute__( ( target( "avx,f16c" ) ) ) static void
+convert_to_half_f16c( const float *src, uint16_t *dst, size_t n )
+{
+    size_t i = 0;
+    for ( ; i + 8 <= n; i += 8 )
+    {
+        const __m256  values = _mm256_loadu_ps( src + i );
+        const __m128i halves =
+            _mm256_cvtps_ph( values, _MM_FROUND_TO_NEAREST_INT );
+        _mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i ), halves );
+    }
+    convert_to_half_scalar( src + i, dst + i, n - i );
+}
+
+#elif defined( RTA_HAS_NEON )
+
+static void convert_to_half_neon( const float *src, uint16_t *dst, size_t n )
+{
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 )
+    {
+        const float16x4_t halves = vcvt_f16_f32( vld1q_f32( src + i ) );
+        vst1_u16( dst + i, vreinterpret_u16_f16( halves ) );
+    }
+    convert_to_half_scalar( src + i, dst + i, n - i );
+}
+
+#endif
+
+/// An implementation of `convert_to_half()`.
+struct Conversion
+{
+    const char *name;
+    void ( *function )( const float *src, uint16_t *dst, size_t n );
+};
+
+/// Pick the fastest implementation supported by the processor, once.
+static const Conversion &conversion()
+{
+    static const Conversion result = []() -> Conversion {
+#if defined( RTA_HAS_F16C )
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports( "avx" ) &&
+             __builtin_cpu_supports( "f16c" ) )
+        {
+            return { "f16c", convert_to_half_f16c };
+        }
+#elif defined( RTA_HAS_NEON )
+        return { "neon", convert_to_half_neon };
+#endif
+        return { "scalar", convert_to_half_scalar };
+    }();
+    return result;
+}
+
+void convert_to_half( const float *src, uint16_t *dst, size_t count )
+{
+    conversion().function( src, dst, count );
+}
+
+/// Multiply the pixels by the matrix, storing floats. Reads all channels of
+/// a pixel before writing any, so it can transform in place.
+template <int Channels>
+static void transform_to_float_kernel(
+    const float matrix[3][3], const float *src, void *dst, size_t count )
+{
+    const float m00 = matrix[0][0], m01 = matrix[0][1], m02 = matrix[0][2];
+    const float m10 = matrix[1][0], m11 = matrix[1][1], m12 = matrix[1][2];
+    const float m20 = matrix[2][0], m21 = matrix[2][1], m22 = matrix[2][2];
+
+    float *out = static_cast<float *>( dst );
+    for ( size_t i = 0; i < count; i++ )
+    {
+        const float *pixel = src + i * Channels;
+        float       *value = out + i * Channels;
+
+        const float r = pixel[0];
+        const float g = pixel[1];
+        const float b = pixel[2];
+
+        value[0] = m00 * r + m01 * g + m02 * b;
+        value[1] = m10 * r + m11 * g + m12 * b;
+        value[2] = m20 * r + m21 * g + m22 * b;
+        if constexpr ( Channels > 3 )
+            value[3] = pixel[3];
+    }
+}
+
+/// Multiply the pixels by the matrix, storing half floats.
+template <int Channels>
+static void transform_to_half_kernel(
+    const float matrix[3][3], const float *src, void *dst, size_t count )
+{
+    // Transform a block of pixels into a buffer staying in the cache, then
+    // convert the whole block at once, so the conversion can be vectorised
+    // regardless of the number of channels.
+    const size_t step    = block_size / Channels;
+    const auto  &convert = conversion();
+
+    uint16_t *out = static_cast<uint16_t *>( dst );
+    float     block[block_size];
+    for ( size_t begin = 0; begin < count; begin += step )
+    {
+        const size_t pixels = std::min( step, count - begin );
+
+        transform_to_float_kernel<Channels>(
+            matrix, src + begin * Channels, block, pixels );
+        convert.function( block, out + begin * Channels, pixels * Channels );
+    }
+}
+
+TransformKernel select_transform_kernel( int channels, bool half_output )
+{
+    switch ( channels )
+    {
+        case 3:
+            return half_output ? transform_to_half_kernel<3>
+                               : transform_to_float_kernel<3>;
+        case 4:
+            return half_output ? transform_to_half_kernel<4>
+                               : transform_to_float_kernel<4>;
+        default: return nullptr;
+    }
+}
+
+void transform_to_half(
+    const float matrix[3][3],
+    const float *src,
+    uint16_t    *dst,
+    size_t       count,
+    int          channels )
+{
+    select_transform_kernel( channels, true )( matrix, src, dst, count );
+}
+
+const char *half_conversion_implementation()
+{
+    return conversion().name;
+}
+
+} // namespace util
+} // namespace rta
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rta
+{
+namespace util
+{
+
+/// Convert `count` floats to half floats, rounding to the nearest, the same
+/// way as `half( value )`. Uses the F16C instructions on the x86 processors
+/// supporting them, detected at run time, and NEON on ARM64.
+/// @param src the floats to convert.
+/// @param dst receives the bits of the half floats.
+/// @param count the number of values to convert.
+void convert_to_half( const float *src, uint16_t *dst, size_t count );
+
+/// Multiply the first three channels of `count` pixels by `matrix` and
+/// store the result as half floats, in a single pass. The fourth channel,
+/// if any, gets converted unchanged.
+/// @param matrix the 3x3 matrix to multiply the pixels by.
+/// @param src the source pixels, interleaved.
+/// @param dst receives the bits of the half float pixels, interleaved.
+/// @param count the number of pixels.
+/// @param channels the number of channels per pixel, 3 or 4.
+void transform_to_half(
+    const float matrix[3][3],
+    const float *src,
+    uint16_t    *dst,
+    size_t       count,
+    int          channels );
+
+/// A kernel multiplying the first three channels of `count` interleaved
+/// float pixels by a 3x3 matrix, specialised for a channel layout and an
+/// output format at compile time, see `select_transform_kernel()`. The
+/// fourth channel, if any, gets copied unchanged.
+/// @param matrix the 3x3 matrix to multiply the pixels by.
+/// @param src the source pixels, interleaved.
+/// @param dst receives the pixels, interleaved: floats, which may be the
+///     same memory as `src`, or the bits of the half floats.
+/// @param count the number of pixels.
+using TransformKernel = void ( * )(
+    const float  matrix[3][3],
+    const float *src,
+    void        *dst,
+    size_t       count );
+
+/// Select the kernel for the pixels of an image, once, so the loop over the
+/// pixels holds no branches on the layout.
+/// @param channels the number of channels per pixel.
+/// @param half_output whether the kernel writes half floats, or floats.
+/// @result the kernel, or `nullptr` if `channels` is not 3 or 4.
+TransformKernel select_transform_kernel( int channels, bool half_output );
+
+/// The name of the implementation used by `convert_to_half()` on this
+/// machine: `f16c`, `neon` or `scalar`.
+const char *half_conversion_implementation();
+
+} // namespace util
+} // namespace rta
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#include "raw_reader.h"
+
+#include <fstream>
+#include <iostream>
+
+namespace rta
+{
+namespace util
+{
+
+/// Read the whole content of the file at `path` into `data`.
+bool read_file( const std::string &path, std::vector<unsigned char> &data )
+{
+    std::ifstream file( path, std::ios::binary | std::ios::ate );
+    if ( !file )
+        return false;
+
+    std::streamsize size = file.tellg();
+    if ( size <= 0 )
+        return false;
+
+    data.resize( static_cast<size_t>( size ) );
+    file.seekg( 0 );
+    return static_cast<bool>(
+        file.read( reinterpret_cast<char *>( data.data() ), size ) );
+}
+
+bool RawReader::open(
+    const std::string     &path,
+    const OIIO::ImageSpec &config,
+    OIIO::ImageSpec       &spec )
+{
+    close();
+
+    _input = OIIO::ImageInput::create( "raw", false, &config );
+    if ( !_input )
+        return false;
+
+    _path = path;
+
+    // Fall back to letting the decoder read the file directly if it can not
+    // read from memory, or the file can not be read or mapped.
+    using IOMode = ImageConverter::Settings::IOMode;
+    if ( _input->supports( "ioproxy" ) )
+    {
+        if ( _io_mode == IOMode::Buffered && read_file( path, _data ) )
+        {
+            _proxy = std::make_unique<OIIO::Filesystem::IOMemReader>(
+                _data.data(), _data.size() );
+        }
+        else if ( _io_mode == IOMode::Mapped && _mapping.open( path, true ) )
+        {
+            // Some versions of OpenImageIO take a non-const pointer,
+            // although the reader never writes to the memory.
+            _proxy = std::make_unique<OIIO::Filesystem::IOMemReader>(
+                const_cast<unsigned char *>( _mapping.data() ),
+                _mapping.size() );
+        }
+    }
+
+    return reopen( config, spec );
+}
+
+bool RawReader::open_memory(
+    const std::string     &name,
+    const void            *data,
+    size_t                 size,
+    const OIIO::ImageSpec &config,
+    OIIO::ImageSpec       &spec )
+{
+    close();
+
+    if ( data == nullptr || size == 0 )
+    {
+        std::cerr << "ERROR: The raw image " << name << " is empty."
+                  << std::endl;
+        return false;
+    }
+
+    _input = OIIO::ImageInput::create( "raw", false, &config );
+    if ( !_input )
+        return false;
+
+    if ( !_input->supports( "ioproxy" ) )
+    {
+        std::cerr << "ERROR: The raw image reader of this OpenImageIO build "
+                  << "can not read images from memory." << std::endl;
+        _input.reset();
+        return false;
+    }
+
+    // Some versions of OpenImageIO take a non-const pointer, although the
+    // reader never writes to the memory.
+    _path  = name;
+    _proxy = std::make_unique<OIIO::Filesystem::IOMemReader>(
+        const_cast<void *>( data ), size );
+
+    return reopen( config, spec );
+}
+
+bool RawReader::read(
+    const OIIO::ParamValueList &hints,
+    OIIO::ImageBuf             &buffer,
+    const std::function<void( const OIIO::ImageSpec &, OIIO::ImageBuf & )>
+        &allocate )
+{
+    if ( !_input )
+        return false;
+
+    OIIO::ImageSpec config;
+    config.extra_attribs = hints;
+
+    OIIO::ImageSpec spec;
+    if ( !reopen( config, spec ) )
+        return false;
+
+    OIIO::ImageSpec buffer_spec = spec;
+    buffer_spec.set_format( OIIO::TypeDesc::FLOAT );
+    if ( allocate )
+        allocate( buffer_spec, buffer );
+    else
+        buffer.reset( buffer_spec, OIIO::InitializePixels::No );
+
+    bool result = _input->read_image(
+        0,
+        0,
+        0,
+        spec.nchannels,
+        OIIO::TypeDesc::FLOAT,
+        buffer.localpixels() );
+
+    close();
+    return result;
+}
+
+bool RawReader::start_scanlines(
+    const OIIO::ParamValueList &hints, OIIO::ImageSpec &spec )
+{
+    if ( !_input )
+        return false;
+
+    OIIO::ImageSpec config;
+    config.extra_attribs = hints;
+
+    if ( !reopen( config, spec ) )
+        return false;
+
+    _nchannels = spec.nchannels;
+    return true;
+}
+
+bool RawReader::read_scanlines( int ybegin, int yend, float *data )
+{
+    if ( !_is_open )
+        return false;
+
+    return _input->read_scanlines(
+        0, 0, ybegin, yend, 0, 0, _nchannels, OIIO::TypeDesc::FLOAT, data );
+}
+
+void RawReader::close()
+{
+    if ( _input && _is_open )
+    {
+        _input->close();
+    }
+    _is_open   = false;
+    _nchannels = 0;
+    _input.reset();
+    _proxy.reset();
+    _data.clear();
+    _data.shrink_to_fit();
+    _mapping.close();
+    _path.clear();
+}
+
+void RawReader::set_thread_count( int thread_count )
+{
+    _thread_count = thread_count;
+}
+
+void RawReader::set_io_mode( ImageConverter::Settings::IOMode io_mode )
+{
+    _io_mode = io_mode;
+}
+
+const std::string &RawReader::path() const
+{
+    return _path;
+}
+
+bool RawReader::reopen( const OIIO::ImageSpec &config, OIIO::ImageSpec &spec )
+{
+    if ( _is_open )
+    {
+        _input->close();
+        _is_open = false;
+    }
+
+    _input->threads( _thread_count );
+
+    OIIO::ImageSpec open_config = config;
+    if ( _proxy )
+    {
+        _proxy->seek( 0 );
+        OIIO::Filesystem::IOProxy *proxy = _proxy.get();
+        open_config.attribute( "oiio:ioproxy", OIIO::TypeDesc::PTR, &proxy );
+    }
+
+    _is_open = _input->open( _path, spec, open_config );
+    return _is_open;
+}
+
+} // namespace util
+} // namespace rta
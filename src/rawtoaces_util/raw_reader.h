@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright Contributors to the rawtoaces Project.
+
+#pragma once
+
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/filesystem.h>
+
+#include <rawtoaces/image_converter.h>
+#include <rawtoaces/mapped_file.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rta
+{
+namespace util
+{
+
+/// An open raw image reader. The reader keeps the content of the file in
+/// memory, or maps it, see `set_io_mode()`, so the file gets read from
+/// storage only once, even though the raw decoder needs to be re-opened when
+/// the decoding hints change between reading the metadata and decoding the
+/// pixels.
+class RawReader
+{
+public:
+    /// Open the file at `path` and read its metadata.
+    /// @param path the path to the raw image file.
+    /// @param config the decoding hints to open the file with.
+    /// @param spec the image spec to receive the metadata.
+    /// @result `true` if opened successfully.
+    bool open(
+        const std::string     &path,
+        const OIIO::ImageSpec &config,
+        OIIO::ImageSpec       &spec );
+
+    /// Open a raw image held in memory and read its metadata. The memory is
+    /// not copied, so it must stay valid until the reader gets closed.
+    /// @param name the name to identify the image by, returned by `path()`.
+    /// @param data the content of the raw image file.
+    /// @param size the size of `data` in bytes.
+    /// @param config the decoding hints to open the image with.
+    /// @param spec the image spec to receive the metadata.
+    /// @result `true` if opened successfully.
+    bool open_memory(
+        const std::string     &name,
+        const void            *data,
+        size_t                 size,
+        const OIIO::ImageSpec &config,
+        OIIO::ImageSpec       &spec );
+
+    /// Decode the pixels of the open file into `buffer` using the given
+    /// `hints`. The reader gets re-opened with the new hints from the
+    /// in-memory copy of the file.
+    /// @param hints the decoding hints.
+    /// @param buffer the image buffer to receive the pixels as floats.
+    /// @param allocate if given, gets called to allocate the pixels of
+    ///     `buffer` for the decoded layout, instead of `buffer` allocating
+    ///     them itself.
+    /// @result `true` if decoded successfully.
+    bool read(
+        const OIIO::ParamValueList &hints,
+        OIIO::ImageBuf             &buffer,
+        const std::function<void( const OIIO::ImageSpec &, OIIO::ImageBuf & )>
+            &allocate = nullptr );
+
+    /// Re-open the decoder with the given `hints` to read the pixels in
+    /// strips using `read_scanlines()`, instead of decoding them all into
+    /// one buffer.
+    /// @param hints the decoding hints.
+    /// @param spec the image spec to receive the decoded image layout.
+    /// @result `true` if re-opened successfully.
+    bool
+    start_scanlines( const OIIO::ParamValueList &hints, OIIO::ImageSpec &spec );
+
+    /// Read the scanlines `ybegin` to `yend` (exclusive) of all channels as
+    /// floats into `data`, which must have space for the full width of the
+    /// requested scanlines. Must be preceded by `start_scanlines()`.
+    /// @param ybegin the first scanline to read.
+    /// @param yend one past the last scanline to read.
+    /// @param data the memory to receive the pixels.
+    /// @result `true` if read successfully.
+    bool read_scanlines( int ybegin, int yend, float *data );
+
+    /// Close the reader and release the in-memory copy of the file.
+    void close();
+
+    /// The path of the open file, the name of the image opened from memory,
+    /// or an empty string.
+    const std::string &path() const;
+
+    /// Set the number of the threads the decoder may use for converting the
+    /// pixels, see `OIIO::ImageInput::threads()`. Applies to the following
+    /// reads. 0 means the OpenImageIO default.
+    /// @param thread_count the number of the threads.
+    void set_thread_count( int thread_count );
+
+    /// Set the way of reading the files opened by the following calls to
+    /// `open()`, see `ImageConverter::Settings::IOMode`. If the decoder can
+    /// not read from memory, it reads the file itself in all modes.
+    /// @param io_mode the way of reading the files.
+    void set_io_mode( ImageConverter::Settings::IOMode io_mode );
+
+private:
+    bool reopen( const OIIO::ImageSpec &config, OIIO::ImageSpec &spec );
+
+    std::string                                    _path;
+    std::vector<unsigned char>                     _data;
+    core::MappedFile                               _mapping;
+    std::unique_ptr<OIIO::Filesystem::IOMemReader> _proxy;
+    std::unique_ptr<OIIO::ImageInput>              _input;
+    int                                            _nchannels    = 0;
+    int                                            _thread_count = 0;
+    bool                                           _is_open      = false;
+    ImageConverter::Settings::IOMode               _io_mode =
+        ImageConverter::Settings::IOMode::Buffered;
+};
+
+} // namespace util
+} // namespace rta
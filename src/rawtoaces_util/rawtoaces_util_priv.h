@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <set>
 #include <string>
@@ -24,6 +25,24 @@ std::vector<std::string>
      database_paths( const std::string &override_path = "" );
 void fix_metadata( OIIO::ImageSpec &spec );
 
+/// The 64-bit FNV-1a hash of `text`. Unlike `std::hash`, the hash is the
+/// same for all builds and platforms, so can be stored, or shared between
+/// the nodes of a batch.
+/// @param text the bytes to hash.
+/// @param hash the hash to continue from, for hashing several strings as
+///     one.
+/// @result the hash.
+inline uint64_t
+fnv1a( const std::string &text, uint64_t hash = 14695981039346656037ull )
+{
+    for ( unsigned char c: text )
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 bool prepare_transform_spectral(
     const OIIO::ImageSpec            &image_spec,
     const ImageConverter::Settings   &settings,
@@ -39,9 +39,45 @@ bool operator==(
     return true;
 }
 
+size_t hash_value( const rta::core::Metadata &data )
+{
+    // Must only use the fields compared by operator== above.
+    size_t seed = hash_value( data.baseline_exposure );
+    hash_combine( seed, hash_value( data.neutral_RGB ) );
+    for ( size_t i = 0; i < 2; i++ )
+    {
+        const auto &c = data.calibration[i];
+        hash_combine( seed, hash_value( c.illuminant ) );
+        hash_combine( seed, hash_value( c.camera_calibration_matrix ) );
+        hash_combine( seed, hash_value( c.XYZ_to_RGB_matrix ) );
+    }
+    return seed;
+}
+
 namespace cache
 {
 
+MetadataDescriptor::MetadataDescriptor( const rta::core::Metadata &data )
+    : metadata( data ), hash( rta::hash_value( data ) )
+{}
+
+std::ostream &operator<<( std::ostream &os, const MetadataDescriptor &data )
+{
+    return rta::operator<<( os, data.metadata );
+}
+
+bool operator==(
+    const MetadataDescriptor &data1, const MetadataDescriptor &data2 )
+{
+    return data1.hash == data2.hash &&
+           rta::operator==( data1.metadata, data2.metadata );
+}
+
+size_t hash_value( const MetadataDescriptor &data )
+{
+    return data.hash;
+}
+
 cache::Cache<CameraAndIlluminantDescriptor, WBFromIlluminantData> &
 get_WB_from_illuminant_cache()
 {
@@ -58,10 +94,10 @@ get_illuminant_from_WB_cache()
     return illuminant_from_WB_cache;
 }
 
-cache::Cache<CameraAndIlluminantDescriptor, MatrixData> &
+cache::Cache<CameraIlluminantAndFitDescriptor, MatrixData> &
 get_matrix_from_illuminant_cache()
 {
-    static cache::Cache<CameraAndIlluminantDescriptor, MatrixData>
+    static cache::Cache<CameraIlluminantAndFitDescriptor, MatrixData>
         matrix_from_illuminant_cache( "matrix from illuminant" );
     return matrix_from_illuminant_cache;
 }
@@ -74,5 +110,12 @@ get_matrix_from_dng_metadata_cache()
     return matrix_from_dng_metadata_cache;
 }
 
+cache::Cache<CameraDescriptor, CCTTableData> &get_CCT_table_cache()
+{
+    static cache::Cache<CameraDescriptor, CCTTableData> CCT_table_cache(
+        "colour temperature table" );
+    return CCT_table_cache;
+}
+
 } // namespace cache
 } // namespace rta
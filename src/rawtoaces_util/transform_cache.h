@@ -4,6 +4,9 @@
 #pragma once
 
 #include <rawtoaces/rawtoaces_core.h>
+#include <rawtoaces/cct_matrix_table.h>
+
+#include <memory>
 
 // These need to be declared before including cache_base.h
 namespace rta
@@ -11,6 +14,7 @@ namespace rta
 std::ostream &operator<<( std::ostream &os, const rta::core::Metadata &data );
 bool          operator==(
     const rta::core::Metadata &data1, const rta::core::Metadata &data2 );
+size_t        hash_value( const rta::core::Metadata &data );
 } // namespace rta
 
 #include "cache_base.h"
@@ -57,21 +61,62 @@ get_illuminant_from_WB_cache();
 // Matrix from illuminant cache
 // -----------------------------------------------------------------------------
 
+/// The fast fit gets warm-started and uses looser tolerances, so its
+/// matrices are kept apart from the reference ones, see
+/// `core::SpectralSolver::FitMode`.
+using CameraIlluminantAndFitDescriptor = std::tuple<
+    std::string, // camera make
+    std::string, // camera model
+    std::string, // illuminant
+    bool         // fitted using `core::SpectralSolver::FitMode::Fast`
+    >;
+
 using MatrixData = std::array<std::array<double, 3>, 3>;
 
-cache::Cache<CameraAndIlluminantDescriptor, MatrixData> &
+cache::Cache<CameraIlluminantAndFitDescriptor, MatrixData> &
 get_matrix_from_illuminant_cache();
 
 // -----------------------------------------------------------------------------
 // Matrix from DNG metadata
 // -----------------------------------------------------------------------------
 
-using MetadataDescriptor = rta::core::Metadata;
+/// The key of the DNG metadata cache. The hash of the metadata gets
+/// calculated once on construction, instead of on every lookup of the cache,
+/// and compared before the metadata itself, so the lookups of the frames
+/// carrying different neutral RGB values rarely compare their matrices.
+/// The operators are friends, only found via the argument type, so they do
+/// not hide the ones of the other descriptors declared in `rta`.
+struct MetadataDescriptor
+{
+    MetadataDescriptor( const rta::core::Metadata &data );
+
+    rta::core::Metadata metadata;
+    size_t              hash;
+
+    friend std::ostream &
+    operator<<( std::ostream &os, const MetadataDescriptor &data );
+    friend bool operator==(
+        const MetadataDescriptor &data1, const MetadataDescriptor &data2 );
+    friend size_t hash_value( const MetadataDescriptor &data );
+};
 
 using MatrixData = std::array<std::array<double, 3>, 3>;
 
 cache::Cache<MetadataDescriptor, MatrixData> &
 get_matrix_from_dng_metadata_cache();
 
+// -----------------------------------------------------------------------------
+// Colour temperature table cache
+// -----------------------------------------------------------------------------
+
+using CameraDescriptor = std::tuple<
+    std::string, // camera make
+    std::string  // camera model
+    >;
+
+using CCTTableData = std::shared_ptr<const rta::core::CCTMatrixTable>;
+
+cache::Cache<CameraDescriptor, CCTTableData> &get_CCT_table_cache();
+
 } // namespace cache
 } // namespace rta
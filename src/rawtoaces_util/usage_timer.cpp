@@ -3,60 +3,447 @@
 
 #include <rawtoaces/usage_timer.h>
 
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
-
-#ifndef WIN32
-#    include <sys/time.h>
-#else
-#    define WIN32_LEAN_AND_MEAN
-#    include <windows.h>
-#endif
+#include <sstream>
 
 namespace rta
 {
 namespace util
 {
 
+const std::vector<double> Metrics::bucket_bounds = {
+    1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+
+const std::string Metrics::total_stage = "total";
+
+void Metrics::Histogram::add( double value )
+{
+    auto bucket = std::lower_bound(
+        bucket_bounds.begin(), bucket_bounds.end(), value );
+    buckets[bucket - bucket_bounds.begin()]++;
+
+    min = count ? std::min( min, value ) : value;
+    max = count ? std::max( max, value ) : value;
+    sum += value;
+    count++;
+}
+
+void Metrics::add_time(
+    const std::string &path, const std::string &stage, double msec )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    auto iter = _times.find( path );
+    if ( iter == _times.end() )
+    {
+        _files.push_back( path );
+        iter = _times.emplace( path, std::map<std::string, double>() ).first;
+    }
+    iter->second[stage] += msec;
+}
+
+void Metrics::add_count(
+    const std::string &name, const Labels &labels, uint64_t value )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    _counts[{ name, labels }] += value;
+}
+
+std::map<std::string, Metrics::Histogram> Metrics::aggregate() const
+{
+    std::map<std::string, Histogram> histograms;
+    for ( const auto &file: _files )
+    {
+        double total = 0.0;
+        for ( const auto &[stage, msec]: _times.at( file ) )
+        {
+            histograms[stage].add( msec );
+            total += msec;
+        }
+        histograms[total_stage].add( total );
+    }
+    return histograms;
+}
+
+Metrics::Histogram Metrics::get_histogram( const std::string &stage ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    auto histograms = aggregate();
+    auto iter       = histograms.find( stage );
+    return iter != histograms.end() ? iter->second : Histogram();
+}
+
+std::map<std::string, double>
+Metrics::get_times( const std::string &path ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    auto iter = _times.find( path );
+    return iter != _times.end() ? iter->second
+                                : std::map<std::string, double>();
+}
+
+uint64_t
+Metrics::get_count( const std::string &name, const Labels &labels ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    auto iter = _counts.find( { name, labels } );
+    return iter != _counts.end() ? iter->second : 0;
+}
+
+/// Quote and escape a string for JSON and the Prometheus label values.
+static std::string quote( const std::string &string )
+{
+    std::ostringstream stream;
+    stream << '"';
+    for ( char c: string )
+    {
+        switch ( c )
+        {
+            case '"': stream << "\\\""; break;
+            case '\\': stream << "\\\\"; break;
+            case '\n': stream << "\\n"; break;
+            default:
+                if ( static_cast<unsigned char>( c ) < 0x20 )
+                {
+                    stream << "\\u" << std::hex << std::setw( 4 )
+                           << std::setfill( '0' ) << static_cast<int>( c );
+                }
+                else
+                {
+                    stream << c;
+                }
+        }
+    }
+    stream << '"';
+    return stream.str();
+}
+
+/// Format the counter labels, using `separator` between the key and the
+/// value, e.g. `"cache":"dng"` for JSON or `cache="dng"` for Prometheus.
+static std::string
+format_labels( const Metrics::Labels &labels, const std::string &separator )
+{
+    std::string result;
+    for ( const auto &[key, value]: labels )
+    {
+        if ( !result.empty() )
+            result += ",";
+        result += ( separator == ":" ? quote( key ) : key ) + separator +
+                  quote( value );
+    }
+    return result;
+}
+
+void Metrics::write_json_lines( std::ostream &stream ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    for ( const auto &file: _files )
+    {
+        stream << "{\"file\":" << quote( file ) << ",\"stages\":{";
+
+        const char *separator = "";
+        for ( const auto &[stage, msec]: _times.at( file ) )
+        {
+            stream << separator << quote( stage ) << ":" << msec;
+            separator = ",";
+        }
+        stream << "}}" << std::endl;
+    }
+
+    for ( const auto &[stage, histogram]: aggregate() )
+    {
+        stream << "{\"stage\":" << quote( stage )
+               << ",\"count\":" << histogram.count
+               << ",\"sum\":" << histogram.sum << ",\"min\":" << histogram.min
+               << ",\"max\":" << histogram.max
+               << ",\"mean\":" << histogram.sum / histogram.count
+               << ",\"buckets\":[";
+
+        for ( size_t i = 0; i < histogram.buckets.size(); i++ )
+        {
+            stream << ( i ? "," : "" ) << "{\"le\":";
+            if ( i < bucket_bounds.size() )
+                stream << bucket_bounds[i];
+            else
+                stream << "null";
+            stream << ",\"count\":" << histogram.buckets[i] << "}";
+        }
+        stream << "]}" << std::endl;
+    }
+
+    for ( const auto &[key, value]: _counts )
+    {
+        stream << "{\"counter\":" << quote( key.first );
+        if ( !key.second.empty() )
+            stream << "," << format_labels( key.second, ":" );
+        stream << ",\"value\":" << value << "}" << std::endl;
+    }
+}
+
+void Metrics::write_prometheus( std::ostream &stream ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    const std::string histogram_name = "rawtoaces_stage_duration_milliseconds";
+
+    auto histograms = aggregate();
+    if ( !histograms.empty() )
+    {
+        stream << "# HELP " << histogram_name
+               << " The execution time of the image processing stages per file."
+               << std::endl;
+        stream << "# TYPE " << histogram_name << " histogram" << std::endl;
+    }
+
+    for ( const auto &[stage, histogram]: histograms )
+    {
+        const std::string label = "stage=" + quote( stage );
+
+        uint64_t cumulative = 0;
+        for ( size_t i = 0; i < histogram.buckets.size(); i++ )
+        {
+            cumulative += histogram.buckets[i];
+
+            stream << histogram_name << "_bucket{" << label << ",le=\"";
+            if ( i < bucket_bounds.size() )
+                stream << bucket_bounds[i];
+            else
+                stream << "+Inf";
+            stream << "\"} " << cumulative << std::endl;
+        }
+        stream << histogram_name << "_sum{" << label << "} " << histogram.sum
+               << std::endl;
+        stream << histogram_name << "_count{" << label << "} "
+               << histogram.count << std::endl;
+    }
+
+    std::string last_name;
+    for ( const auto &[key, value]: _counts )
+    {
+        const std::string name = "rawtoaces_" + key.first + "_total";
+        if ( name != last_name )
+        {
+            stream << "# TYPE " << name << " counter" << std::endl;
+            last_name = name;
+        }
+
+        stream << name;
+        if ( !key.second.empty() )
+            stream << "{" << format_labels( key.second, "=" ) << "}";
+        stream << " " << value << std::endl;
+    }
+}
+
+bool Metrics::save( const std::string &path ) const
+{
+    std::ofstream file( path );
+    if ( !file )
+    {
+        std::cerr << "ERROR: Failed to open the metrics file " << path
+                  << " for writing." << std::endl;
+        return false;
+    }
+
+    if ( std::filesystem::path( path ).extension() == ".prom" )
+        write_prometheus( file );
+    else
+        write_json_lines( file );
+
+    file.close();
+    if ( !file )
+    {
+        std::cerr << "ERROR: Failed to write the metrics file " << path << "."
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Metrics::clear()
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    _files.clear();
+    _times.clear();
+    _counts.clear();
+}
+
+/// The tracer of the calling thread, and the file it processes, see
+/// `Tracer::Scope`.
+static thread_local Tracer     *thread_tracer = nullptr;
+static thread_local std::string thread_file;
+
+Tracer::Scope::Scope( Tracer *tracer, const std::string &file )
+    : _tracer( thread_tracer ), _file( thread_file )
+{
+    thread_tracer = tracer;
+    thread_file   = file;
+}
+
+Tracer::Scope::~Scope()
+{
+    thread_tracer = _tracer;
+    thread_file   = _file;
+}
+
+Tracer::Tracer() : _start_time( std::chrono::steady_clock::now() ) {}
+
+Tracer *Tracer::current()
+{
+    return thread_tracer;
+}
+
+const std::string &Tracer::current_file()
+{
+    return thread_file;
+}
+
+uint64_t Tracer::thread_id()
+{
+    static std::atomic<uint64_t> next_id( 1 );
+    static thread_local uint64_t id = next_id++;
+    return id;
+}
+
+double Tracer::timestamp( std::chrono::steady_clock::time_point time ) const
+{
+    return std::chrono::duration<double, std::micro>( time - _start_time )
+        .count();
+}
+
+void Tracer::add( Span span )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    _spans.push_back( std::move( span ) );
+}
+
+std::vector<Tracer::Span> Tracer::get_spans() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _spans;
+}
+
+void Tracer::write_json( std::ostream &stream ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    const auto precision = stream.precision();
+    stream << "{\"traceEvents\":[";
+
+    const char *separator = "";
+    for ( const auto &span: _spans )
+    {
+        Metrics::Labels args = { { "file", span.file } };
+        args.insert( args.end(), span.args.begin(), span.args.end() );
+
+        stream << separator << std::endl
+               << "{\"name\":" << quote( span.name )
+               << ",\"cat\":" << quote( span.category )
+               << ",\"ph\":\"X\",\"ts\":" << std::fixed
+               << std::setprecision( 3 ) << span.start
+               << ",\"dur\":" << span.duration << std::defaultfloat
+               << ",\"pid\":1,\"tid\":" << span.thread << ",\"args\":{"
+               << format_labels( args, ":" ) << "}}";
+        separator = ",";
+    }
+
+    stream << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    stream.precision( precision );
+}
+
+bool Tracer::save( const std::string &path ) const
+{
+    std::ofstream file( path );
+    if ( !file )
+    {
+        std::cerr << "ERROR: Failed to open the trace file " << path
+                  << " for writing." << std::endl;
+        return false;
+    }
+
+    write_json( file );
+
+    file.close();
+    if ( !file )
+    {
+        std::cerr << "ERROR: Failed to write the trace file " << path << "."
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    _spans.clear();
+}
+
+TraceSpan::TraceSpan( const std::string &name, const std::string &category )
+    : _tracer( Tracer::current() )
+{
+    if ( _tracer )
+    {
+        _span.name     = name;
+        _span.category = category;
+        _span.file     = Tracer::current_file();
+        _start_time    = std::chrono::steady_clock::now();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if ( _tracer )
+    {
+        const auto end_time = std::chrono::steady_clock::now();
+
+        _span.thread   = Tracer::thread_id();
+        _span.start    = _tracer->timestamp( _start_time );
+        _span.duration = _tracer->timestamp( end_time ) - _span.start;
+        _tracer->add( std::move( _span ) );
+    }
+}
+
+void TraceSpan::set_arg( const std::string &key, const std::string &value )
+{
+    if ( _tracer )
+        _span.args.emplace_back( key, value );
+}
+
 void UsageTimer::reset()
 {
-    if ( enabled )
-    {
-#ifndef WIN32
-        struct timeval start_timeval;
-        gettimeofday( &start_timeval, NULL );
-        _start_time = (double)start_timeval.tv_sec * 1000.0 +
-                      (double)start_timeval.tv_usec / 1000.0;
-#else
-        LARGE_INTEGER unit, start_timeval;
-        QueryPerformanceCounter( &start_timeval );
-        QueryPerformanceFrequency( &unit );
-        _start_time =
-            (double)start_timeval.QuadPart * 1000.0 / (double)unit.QuadPart;
-#endif
+    if ( enabled || metrics || Tracer::current() )
+    {
+        _start_time  = std::chrono::steady_clock::now();
         _initialized = true;
     }
 }
 
+double UsageTimer::elapsed() const
+{
+    if ( !_initialized )
+        return 0.0;
+
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - _start_time )
+        .count();
+}
+
 void UsageTimer::print(
     const std::string &path, const std::string &message ) const
 {
     if ( enabled && _initialized )
     {
-#ifndef WIN32
-        struct timeval end_timeval;
-        gettimeofday( &end_timeval, NULL );
-        double end_time = (double)end_timeval.tv_sec * 1000.0 +
-                          (double)end_timeval.tv_usec / 1000.0;
-#else
-        LARGE_INTEGER unit, end_timeval;
-        QueryPerformanceCounter( &end_timeval );
-        QueryPerformanceFrequency( &unit );
-        double end_time =
-            (double)end_timeval.QuadPart * 1000.0 / (double)unit.QuadPart;
-#endif
-
-        double diff_msec = end_time - _start_time;
+        double diff_msec = elapsed();
 
         std::cerr << "Timing: " << path << "/" << message << ": " << std::fixed
                   << std::setprecision( 3 ) << diff_msec << std::defaultfloat
@@ -65,5 +452,30 @@ void UsageTimer::print(
     }
 }
 
+void UsageTimer::print(
+    const std::string &path,
+    const std::string &message,
+    const std::string &stage ) const
+{
+    if ( metrics && _initialized )
+        metrics->add_time( path, stage, elapsed() );
+
+    Tracer *tracer = Tracer::current();
+    if ( tracer && _initialized )
+    {
+        Tracer::Span span;
+        span.name     = stage;
+        span.category = "stage";
+        span.file     = path;
+        span.thread   = Tracer::thread_id();
+        span.start    = tracer->timestamp( _start_time );
+        span.duration =
+            tracer->timestamp( std::chrono::steady_clock::now() ) - span.start;
+        tracer->add( std::move( span ) );
+    }
+
+    print( path, message );
+}
+
 } //namespace util
 } //namespace rta
@@ -25,6 +25,8 @@ class TestImageConverter:
         """Test that ImageConverter has helper functions"""
         assert hasattr(rawtoaces, "collect_image_files")
         assert callable(rawtoaces.collect_image_files)
+        assert hasattr(rawtoaces, "convert_batch")
+        assert callable(rawtoaces.convert_batch)
 
     def test_collect_image_files(self):
         """Test that collect_image_files returns some images"""
@@ -62,6 +64,12 @@ class TestImageConverter:
         
         assert hasattr(converter, "configure")
         assert callable(converter.configure)
+
+        assert hasattr(converter, "convert")
+        assert callable(converter.convert)
+
+        assert hasattr(converter, "convert_memory")
+        assert callable(converter.convert_memory)
                 
         assert hasattr(converter, "get_WB_multipliers")
         assert callable(converter.get_WB_multipliers)
@@ -163,6 +171,79 @@ class TestImageConverter:
         converter.settings.overwrite = True
         assert converter.process_image(path)
 
+    def test_convert_DNG(self):
+        """Test convert() returns the converted pixels as a NumPy array, and convert_memory() matches it"""
+        import os
+        np = pytest.importorskip("numpy")
+        path = os.path.join('.', 'tests', 'materials', 'blackmagic_cinema_camera_cinemadng.dng')
+        converter = rawtoaces.ImageConverter()
+        pixels = np.asarray(converter.convert(path))
+        assert pixels.dtype == np.float16
+        assert pixels.ndim == 3
+        assert pixels.shape[2] == 3
+        assert np.isfinite(pixels).all()
+
+        with open(path, 'rb') as file:
+            data = file.read()
+        from_memory = np.asarray(converter.convert_memory(data, "dng"))
+        assert from_memory.shape == pixels.shape
+        assert np.array_equal(from_memory, pixels)
+
+        with pytest.raises(RuntimeError):
+            converter.convert_memory(b"", "empty")
+
+    def test_convert_memory_buffer_pool(self):
+        """Test an array returned by convert_memory() keeps its pixels after the next conversion borrowing from the buffer pool"""
+        import os
+        np = pytest.importorskip("numpy")
+        path = os.path.join('.', 'tests', 'materials', 'blackmagic_cinema_camera_cinemadng.dng')
+        with open(path, 'rb') as file:
+            data = file.read()
+
+        converter = rawtoaces.ImageConverter()
+        converter.settings.buffer_pool = 1024
+        first = np.asarray(converter.convert_memory(data, "first"))
+        expected = first.copy()
+
+        # A second image of the same size would get the same memory from
+        # the pool, if the first array did not hold on to it.
+        converter.settings.scale = 2.0
+        second = np.asarray(converter.convert_memory(data, "second"))
+        third = np.asarray(converter.convert(path))
+        assert second.shape == first.shape
+        assert np.array_equal(first, expected)
+        assert not np.array_equal(second, first)
+        assert np.array_equal(third, second)
+
+    def test_convert_batch(self):
+        """Test convert_batch() converts all files and returns the per-file results"""
+        import os
+        import shutil
+        import tempfile
+        path = os.path.join('.', 'tests', 'materials', 'blackmagic_cinema_camera_cinemadng.dng')
+        with tempfile.TemporaryDirectory() as directory:
+            files = []
+            for name in ["a.dng", "b.dng", "c.dng"]:
+                files.append(os.path.join(directory, name))
+                shutil.copyfile(path, files[-1])
+            files.append(os.path.join(directory, "missing.dng"))
+
+            settings = rawtoaces.ImageConverter.Settings()
+            settings.continue_on_error = True
+            results = rawtoaces.convert_batch(files, settings, jobs=2)
+
+            assert len(results) == 4
+            for result, file in zip(results[:3], files[:3]):
+                assert result.input_filename == file
+                assert result.success
+                assert not result.skipped
+                assert len(result.WB_multipliers) == 4
+                assert not result.up_to_date
+                assert "read" in result.stage_times
+                assert result.output_filename == os.path.splitext(file)[0] + "_aces.exr"
+                assert os.path.exists(result.output_filename)
+            assert not results[3].success
+
     def test_converter_get_WB_multipliers(self):
         """Test uninitialised ImageConverter returns empty WB multipliers"""
         import os
@@ -286,6 +367,13 @@ class TestSettings:
         
         converter.settings.illuminant = "illuminant"
         assert converter.settings.illuminant == "illuminant"
+
+        converter.settings.fast_fit = True
+        assert converter.settings.fast_fit == True
+        converter.settings.use_CCT_table = True
+        assert converter.settings.use_CCT_table == True
+        converter.settings.CCT_table_directory = "/tmp/tables"
+        assert converter.settings.CCT_table_directory == "/tmp/tables"
                 
         converter.settings.headroom = 1.5
         assert converter.settings.headroom == 1.5
@@ -310,6 +398,8 @@ class TestSettings:
                         
         converter.settings.half_size = True
         assert converter.settings.half_size == True
+        converter.settings.proxy = 4
+        assert converter.settings.proxy == 4
                         
         converter.settings.highlight_mode = 2
         assert converter.settings.highlight_mode == 2
@@ -338,8 +428,71 @@ class TestSettings:
         converter.settings.output_dir = "output_dir"
         assert converter.settings.output_dir == "output_dir"
                                         
+        converter.settings.recursive = True
+        assert converter.settings.recursive == True
+                                        
+        converter.settings.manifest_file = "manifest.txt"
+        assert converter.settings.manifest_file == "manifest.txt"
+                                        
+        converter.settings.threads = 4
+        assert converter.settings.threads == 4
+                                        
+        converter.settings.shard_index = 1
+        assert converter.settings.shard_index == 1
+                                        
+        converter.settings.shard_count = 4
+        assert converter.settings.shard_count == 4
+                                        
+        converter.settings.output_profile = rawtoaces.ImageConverter.Settings.OutputProfile.Intermediate
+        assert converter.settings.output_profile == rawtoaces.ImageConverter.Settings.OutputProfile.Intermediate
+
+        converter.settings.compression = "dwaa:45"
+        assert converter.settings.compression == "dwaa:45"
+
+        converter.settings.tile_size = 64
+        assert converter.settings.tile_size == 64
+
+        converter.settings.write_threads = 4
+        assert converter.settings.write_threads == 4
+
+        output = rawtoaces.ImageConverter.Settings.Output()
+        output.suffix = "_centre"
+        output.region = [10, 20, 30, 40]
+        output.scale = 2
+        output.compression = "dwaa"
+        converter.settings.outputs = [output]
+        assert len(converter.settings.outputs) == 1
+        assert converter.settings.outputs[0].suffix == "_centre"
+        assert converter.settings.outputs[0].region == [10, 20, 30, 40]
+        assert converter.settings.outputs[0].scale == 2
+        assert converter.settings.outputs[0].compression == "dwaa"
+
+        converter.settings.group_transforms = True
+        assert converter.settings.group_transforms == True
+
+        converter.settings.solve_ahead = 2
+        assert converter.settings.solve_ahead == 2
+                                        
+        converter.settings.use_gpu = True
+        assert converter.settings.use_gpu == True
+                                        
+        converter.settings.io_mode = rawtoaces.ImageConverter.Settings.IOMode.Mapped
+        assert converter.settings.io_mode == rawtoaces.ImageConverter.Settings.IOMode.Mapped
+                                        
+        converter.settings.buffer_pool = 1024
+        assert converter.settings.buffer_pool == 1024
+                                        
+        converter.settings.huge_pages = True
+        assert converter.settings.huge_pages == True
+                                        
         converter.settings.use_timing = True
         assert converter.settings.use_timing == True
+
+        converter.settings.metrics_file = "metrics.prom"
+        assert converter.settings.metrics_file == "metrics.prom"
+
+        converter.settings.trace_file = "trace.json"
+        assert converter.settings.trace_file == "trace.json"
                                                 
         converter.settings.verbosity = 3
         assert converter.settings.verbosity == 3
@@ -9,8 +9,15 @@
 #include "test_utils.h"
 #include <OpenImageIO/unittest.h>
 
-#include "../src/rawtoaces_util/cache_base.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// transform_cache.h declares the Metadata helpers used by cache_base.h,
+// so must be included first.
 #include "../src/rawtoaces_util/transform_cache.h"
+#include "../src/rawtoaces_util/cache_base.h"
+#include "../src/rawtoaces_util/persistent_cache.h"
 
 using Descriptor = std::string;
 using Data       = int;
@@ -90,6 +97,27 @@ void testCache_present()
     ASSERT_CONTAINS_ALL( output, expected_output );
 }
 
+void testCache_hit_counts()
+{
+    rta::cache::Cache<std::string, int> cache( "cache_name" );
+
+    int  value;
+    bool success;
+    fetch( cache, "first", 1, value, success );
+    fetch( cache, "first", 1, value, success );
+    fetch( cache, "first", 1, value, success );
+    fetch( cache, "second", 2, value, success );
+
+    OIIO_CHECK_EQUAL( cache.hits, 2 );
+    OIIO_CHECK_EQUAL( cache.misses, 2 );
+
+    // Every lookup is a miss while disabled.
+    cache.disabled = true;
+    fetch( cache, "first", 1, value, success );
+    OIIO_CHECK_EQUAL( cache.hits, 2 );
+    OIIO_CHECK_EQUAL( cache.misses, 3 );
+}
+
 void testCache_failed()
 {
     rta::cache::Cache<std::string, int> cache( "cache_name" );
@@ -268,7 +296,7 @@ void testCache_transform_caches()
             rta::cache::WBFromIlluminantData>
             cache1;
         rta::cache::Cache<
-            rta::cache::CameraAndIlluminantDescriptor,
+            rta::cache::CameraIlluminantAndFitDescriptor,
             rta::cache::MatrixData>
             cache2;
         rta::cache::Cache<
@@ -287,17 +315,383 @@ void testCache_transform_caches()
     }
 }
 
+void testCache_persistent_round_trip()
+{
+    TestDirectory     test_dir;
+    const std::string path = test_dir.path() + "/cache.txt";
+
+    {
+        rta::cache::PersistentCache cache( path, "signature" );
+        OIIO_CHECK_ASSERT( cache.is_open() );
+
+        std::string value;
+        OIIO_CHECK_ASSERT( !cache.find( "key", value ) );
+        OIIO_CHECK_ASSERT( cache.store( "key", "value" ) );
+        OIIO_CHECK_ASSERT( cache.find( "key", value ) );
+        OIIO_CHECK_EQUAL( value, "value" );
+
+        // The separators can not be stored.
+        OIIO_CHECK_ASSERT( !cache.store( "a\tb", "value" ) );
+        OIIO_CHECK_ASSERT( !cache.store( "key2", "a\nb" ) );
+    }
+
+    // A new instance, e.g. in another process, reads the stored entries.
+    rta::cache::PersistentCache cache1( path, "signature" );
+    std::string                 value;
+    OIIO_CHECK_ASSERT( cache1.find( "key", value ) );
+    OIIO_CHECK_EQUAL( value, "value" );
+    OIIO_CHECK_ASSERT( !cache1.find( "key2", value ) );
+
+    // Entries stored by another instance after opening get picked up too.
+    rta::cache::PersistentCache cache2( path, "signature" );
+    OIIO_CHECK_ASSERT( cache2.store( "key3", "value3" ) );
+    OIIO_CHECK_ASSERT( cache1.find( "key3", value ) );
+    OIIO_CHECK_EQUAL( value, "value3" );
+
+    // Entries of a different database are ignored.
+    rta::cache::PersistentCache cache3( path, "other signature" );
+    OIIO_CHECK_ASSERT( !cache3.find( "key", value ) );
+}
+
+void testCache_persistent_compaction()
+{
+    TestDirectory     test_dir;
+    const std::string path = test_dir.path() + "/cache.txt";
+
+    auto count_lines = [&path]() {
+        std::ifstream file( path );
+        std::string   line;
+        size_t        count = 0;
+        while ( std::getline( file, line ) )
+            count++;
+        return count;
+    };
+
+    // Fill the file with the entries of an older database.
+    {
+        rta::cache::PersistentCache old_cache( path, "old signature" );
+        for ( int i = 0; i < 4; i++ )
+            old_cache.store( "old key " + std::to_string( i ), "value" );
+    }
+
+    rta::cache::PersistentCache reader( path, "signature" );
+    rta::cache::PersistentCache writer( path, "signature" );
+    reader.min_stale_lines = 4;
+    writer.min_stale_lines = 4;
+
+    std::string value;
+    OIIO_CHECK_ASSERT( !reader.find( "key1", value ) );
+
+    // The stale lines outnumber the current entry, so only the header and
+    // the current entry are left.
+    OIIO_CHECK_ASSERT( writer.store( "key1", "value1" ) );
+    OIIO_CHECK_EQUAL( count_lines(), 2 );
+
+    // The other instances notice the rewritten file.
+    OIIO_CHECK_ASSERT( reader.find( "key1", value ) );
+    OIIO_CHECK_EQUAL( value, "value1" );
+    OIIO_CHECK_ASSERT( writer.store( "key2", "value2" ) );
+    OIIO_CHECK_ASSERT( reader.find( "key2", value ) );
+    OIIO_CHECK_EQUAL( value, "value2" );
+    OIIO_CHECK_ASSERT( reader.store( "key3", "value3" ) );
+    OIIO_CHECK_EQUAL( count_lines(), 4 );
+
+    // A new instance reads the compacted file.
+    rta::cache::PersistentCache cache( path, "signature" );
+    for ( const char *key: { "key1", "key2", "key3" } )
+        OIIO_CHECK_ASSERT( cache.find( key, value ) );
+    OIIO_CHECK_ASSERT( !cache.find( "old key 0", value ) );
+}
+
+void testCache_persistent_fetch()
+{
+    TestDirectory     test_dir;
+    const std::string path = test_dir.path() + "/cache.txt";
+
+    rta::cache::CameraAndWBDescriptor descriptor = {
+        "make", "model", { 1.0 / 3.0, 1.0, 2.0 / 3.0 }
+    };
+    rta::cache::IlluminantAndWBData expected = {
+        "d55", { 0.1, 1.0 / 7.0, 123456.789012345 }
+    };
+
+    int  calls = 0;
+    auto func  = [&]( rta::cache::IlluminantAndWBData &data ) {
+        calls++;
+        data = expected;
+        return true;
+    };
+
+    rta::cache::IlluminantAndWBData data;
+    {
+        rta::cache::PersistentCache cache( path, "signature" );
+        OIIO_CHECK_ASSERT( rta::cache::persistent_fetch(
+            &cache, "name", descriptor, data, func, 0 ) );
+        OIIO_CHECK_EQUAL( calls, 1 );
+    }
+
+    // The data gets restored exactly, without calling `func`.
+    rta::cache::PersistentCache     cache( path, "signature" );
+    rta::cache::IlluminantAndWBData restored;
+    std::string                     output = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( rta::cache::persistent_fetch(
+            &cache, "name", descriptor, restored, func, 1 ) );
+    } );
+    OIIO_CHECK_EQUAL( calls, 1 );
+    OIIO_CHECK_EQUAL( restored.first, expected.first );
+    OIIO_CHECK_ASSERT( restored.second == expected.second );
+    ASSERT_CONTAINS( output, "Cache (name): found in the persistent cache!" );
+
+    // A slightly different descriptor is a different entry.
+    descriptor = { "make", "model", { 1.0 / 3.0 + 1e-12, 1.0, 2.0 / 3.0 } };
+    OIIO_CHECK_ASSERT( rta::cache::persistent_fetch(
+        &cache, "name", descriptor, restored, func, 0 ) );
+    OIIO_CHECK_EQUAL( calls, 2 );
+
+    // The failed calculations are not stored.
+    auto failing_func = [&]( rta::cache::IlluminantAndWBData & ) {
+        calls++;
+        return false;
+    };
+    descriptor = { "make", "model", { 2.0, 2.0, 2.0 } };
+    for ( int i = 0; i < 2; i++ )
+    {
+        OIIO_CHECK_ASSERT( !rta::cache::persistent_fetch(
+            &cache, "name", descriptor, restored, failing_func, 0 ) );
+    }
+    OIIO_CHECK_EQUAL( calls, 4 );
+
+    // Without a cache `func` gets called directly.
+    OIIO_CHECK_ASSERT( rta::cache::persistent_fetch(
+        nullptr, "name", descriptor, restored, func, 0 ) );
+    OIIO_CHECK_EQUAL( calls, 5 );
+}
+
+void testCache_persistent_shared_instances()
+{
+    TestDirectory     test_dir;
+    const std::string path = test_dir.path() + "/cache.txt";
+
+    OIIO_CHECK_ASSERT( !rta::cache::get_persistent_cache( "", {} ) );
+
+    auto cache1 = rta::cache::get_persistent_cache( path, {} );
+    auto cache2 = rta::cache::get_persistent_cache( path, {} );
+    OIIO_CHECK_ASSERT( cache1 );
+    OIIO_CHECK_ASSERT( cache1 == cache2 );
+
+    // The signature changes when the database content changes.
+    const std::string signature1 =
+        rta::cache::database_signature( { test_dir.get_database_path() } );
+    test_dir.create_test_data_file( "camera" );
+    const std::string signature2 =
+        rta::cache::database_signature( { test_dir.get_database_path() } );
+    OIIO_CHECK_NE( signature1, signature2 );
+    OIIO_CHECK_EQUAL(
+        signature2,
+        rta::cache::database_signature( { test_dir.get_database_path() } ) );
+
+    // A missing file can not be opened.
+    std::string missing_path = test_dir.path() + "/missing/cache.txt";
+    std::string output       = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT(
+            !rta::cache::get_persistent_cache( missing_path, {} ) );
+    } );
+    ASSERT_CONTAINS( output, "Failed to open the cache file" );
+}
+
+void testCache_concurrent_deduplication()
+{
+    rta::cache::Cache<Descriptor, Data> cache( "cache_name" );
+
+    std::atomic<int> calls( 0 );
+    auto             func = [&]( Data &data ) {
+        calls++;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        data = 42;
+        return true;
+    };
+
+    // All threads miss on the same entry at once, only one calculates it.
+    const size_t             num_threads = 8;
+    std::vector<int>         values( num_threads, 0 );
+    std::vector<std::thread> threads;
+    for ( size_t i = 0; i < num_threads; i++ )
+    {
+        threads.emplace_back( [&, i]() {
+            auto result = cache.fetch( "key", func );
+            values[i]   = result.first ? result.second : -1;
+        } );
+    }
+    for ( auto &thread: threads )
+        thread.join();
+
+    OIIO_CHECK_EQUAL( calls, 1 );
+    for ( auto value: values )
+        OIIO_CHECK_EQUAL( value, 42 );
+}
+
+void testCache_exception()
+{
+    rta::cache::Cache<Descriptor, Data> cache( "cache_name" );
+
+    bool thrown = false;
+    try
+    {
+        cache.fetch( "key", []( Data & ) -> bool {
+            throw std::runtime_error( "failed" );
+        } );
+    }
+    catch ( const std::runtime_error & )
+    {
+        thrown = true;
+    }
+    OIIO_CHECK_ASSERT( thrown );
+
+    // The entry gets calculated again on the next fetch.
+    int  value;
+    bool success;
+    fetch( cache, "key", 42, value, success );
+    OIIO_CHECK_ASSERT( success );
+    OIIO_CHECK_EQUAL( value, 42 );
+}
+
+void testCache_pending_not_evicted()
+{
+    rta::cache::Cache<Descriptor, Data> cache( "cache_name" );
+    cache.capacity = 1;
+
+    // Fetch another entry into the full cache while the first one is still
+    // being calculated.
+    int  value;
+    bool success;
+    cache.fetch( "pending", [&]( Data &data ) {
+        fetch( cache, "other", 2, value, success );
+        data = 1;
+        return true;
+    } );
+
+    // The pending entry has been kept over the capacity.
+    fetch( cache, "pending", -1, value, success );
+    OIIO_CHECK_EQUAL( value, 1 );
+    OIIO_CHECK_EQUAL( cache.misses, 2 );
+}
+
+void testCache_exception_keeps_newer_entry()
+{
+    rta::cache::Cache<Descriptor, Data> cache( "cache_name" );
+
+    int  value;
+    bool success;
+    try
+    {
+        cache.fetch( "key", [&]( Data & ) -> bool {
+            // Clear the cache, and add the entry again from another call
+            // before failing.
+            cache.disabled = true;
+            fetch( cache, "other", 0, value, success );
+            cache.disabled = false;
+            fetch( cache, "key", 42, value, success );
+            throw std::runtime_error( "failed" );
+        } );
+    }
+    catch ( const std::runtime_error & )
+    {
+    }
+
+    // The failure has not removed the entry of the other call.
+    fetch( cache, "key", -1, value, success );
+    OIIO_CHECK_ASSERT( success );
+    OIIO_CHECK_EQUAL( value, 42 );
+}
+
+void testCache_large_capacity()
+{
+    rta::cache::Cache<Descriptor, Data> cache( "cache_name" );
+    cache.capacity = 1000;
+
+    int  value;
+    bool success;
+    for ( int i = 0; i < 1000; i++ )
+        fetch( cache, std::to_string( i ), i, value, success );
+
+    // All entries are still present.
+    for ( int i = 0; i < 1000; i++ )
+    {
+        fetch( cache, std::to_string( i ), -1, value, success );
+        OIIO_CHECK_EQUAL( value, i );
+    }
+}
+
+void testCache_hash_value()
+{
+    using rta::hash_value;
+
+    OIIO_CHECK_EQUAL( hash_value( 0.0 ), hash_value( -0.0 ) );
+
+    rta::cache::CameraAndWBDescriptor descriptor1 = { "make",
+                                                      "model",
+                                                      { 1.0, 2.0, 3.0 } };
+    rta::cache::CameraAndWBDescriptor descriptor2 = descriptor1;
+    OIIO_CHECK_EQUAL( hash_value( descriptor1 ), hash_value( descriptor2 ) );
+    std::get<2>( descriptor2 )[1] = 2.5;
+    OIIO_CHECK_NE( hash_value( descriptor1 ), hash_value( descriptor2 ) );
+
+    rta::core::Metadata metadata1;
+    metadata1.baseline_exposure                = 1.5;
+    metadata1.neutral_RGB                      = { 0.5, 1.0, 0.7 };
+    metadata1.calibration[0].illuminant        = 17;
+    metadata1.calibration[1].XYZ_to_RGB_matrix = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+
+    rta::core::Metadata metadata2 = metadata1;
+    OIIO_CHECK_EQUAL( hash_value( metadata1 ), hash_value( metadata2 ) );
+    metadata2.calibration[0].illuminant = 21;
+    OIIO_CHECK_NE( hash_value( metadata1 ), hash_value( metadata2 ) );
+
+    // The descriptors keep the hash of the metadata calculated on
+    // construction, and compare unequal if the metadata differs.
+    rta::cache::MetadataDescriptor metadata_descriptor1 = metadata1;
+    rta::cache::MetadataDescriptor metadata_descriptor2 = metadata2;
+    OIIO_CHECK_EQUAL(
+        hash_value( metadata_descriptor1 ), hash_value( metadata1 ) );
+    OIIO_CHECK_ASSERT( !( metadata_descriptor1 == metadata_descriptor2 ) );
+    metadata_descriptor2 = metadata1;
+    OIIO_CHECK_ASSERT( metadata_descriptor1 == metadata_descriptor2 );
+
+    // Metadata descriptors get looked up by value.
+    rta::cache::Cache<rta::cache::MetadataDescriptor, int> cache;
+    int                                                    calls = 0;
+    auto func = [&]( int &data ) {
+        data = ++calls;
+        return true;
+    };
+    metadata2 = metadata1;
+    OIIO_CHECK_EQUAL( cache.fetch( metadata1, func ).second, 1 );
+    OIIO_CHECK_EQUAL( cache.fetch( metadata2, func ).second, 1 );
+    OIIO_CHECK_EQUAL( calls, 1 );
+}
+
 int main( int, char ** )
 {
     testCache_disabled();
     testCache_missing();
     testCache_present();
+    testCache_hit_counts();
     testCache_failed();
     testCache_full();
     testCache_bump();
+    testCache_concurrent_deduplication();
+    testCache_exception();
+    testCache_pending_not_evicted();
+    testCache_exception_keeps_newer_entry();
+    testCache_large_capacity();
     testCache_print_helpers();
     testCache_metadata_comparison();
     testCache_transform_caches();
+    testCache_hash_value();
+    testCache_persistent_round_trip();
+    testCache_persistent_compaction();
+    testCache_persistent_fetch();
+    testCache_persistent_shared_instances();
 
     return unit_test_failures;
 }
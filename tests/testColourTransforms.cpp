@@ -10,13 +10,118 @@
 #include <OpenImageIO/unittest.h>
 
 #include "../src/rawtoaces_util/colour_transforms.h"
+#include "../src/rawtoaces_util/transform_cache.h"
+
+#include <rawtoaces/cct_matrix_table.h>
 
 void test_configure_spectral_solver()
 {}
 
+void test_matrix_cache_fit_mode()
+{
+    const std::vector<std::vector<double>> fast_matrix = { { 0.9, 0.2, -0.1 },
+                                                           { 0.1, 1.1, -0.2 },
+                                                           { 0.0, -0.3, 1.3 } };
+
+    // Cache a matrix as fitted in the fast mode.
+    rta::cache::CameraIlluminantAndFitDescriptor descriptor = {
+        "Test Make", "Fast Model", "d65", true
+    };
+    rta::cache::get_matrix_from_illuminant_cache().fetch(
+        descriptor, [&]( rta::cache::MatrixData &cache_data ) {
+            for ( size_t row = 0; row < 3; row++ )
+                for ( size_t col = 0; col < 3; col++ )
+                    cache_data[row][col] = fast_matrix[row][col];
+            return true;
+        } );
+
+    // The solver is not configured, so the matrix can only come from the
+    // cache, and only the fast fits find the cached fast matrix.
+    rta::core::SpectralSolver solver;
+
+    std::vector<std::vector<double>> matrix;
+    std::string                      output = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !rta::util::fetch_matrix_from_illuminant(
+            "Test Make",
+            "Fast Model",
+            "d65",
+            solver,
+            0,
+            false,
+            nullptr,
+            matrix ) );
+    } );
+    ASSERT_CONTAINS(
+        output, "Failed to calculate the input transform matrix." );
+
+    solver.fit_mode = rta::core::SpectralSolver::FitMode::Fast;
+    OIIO_CHECK_ASSERT( rta::util::fetch_matrix_from_illuminant(
+        "Test Make",
+        "Fast Model",
+        "d65",
+        solver,
+        0,
+        false,
+        nullptr,
+        matrix ) );
+    OIIO_CHECK_ASSERT( matrix == fast_matrix );
+}
+
+void test_fetch_matrix_from_CCT_table()
+{
+    TestDirectory test_dir;
+
+    rta::core::CCTMatrixTable table;
+    table.camera_make  = "Table Make";
+    table.camera_model = "Model-1";
+    for ( double CCT: { 3000.0, 6000.0 } )
+    {
+        rta::core::CCTMatrixTable::Entry entry;
+        entry.CCT            = CCT;
+        entry.WB_multipliers = { CCT / 2000.0, 1.0, 6000.0 / CCT };
+        entry.IDT_matrix     = { { CCT, 0.0, 0.0 },
+                                 { 0.0, 1.0, 0.0 },
+                                 { 0.0, 0.0, 1.0 } };
+        table.entries.push_back( entry );
+    }
+    OIIO_CHECK_ASSERT( table.save(
+        test_dir.path() + "/cct_table_table_make_model_1.json" ) );
+
+    // The solver is not configured, so the table can only come from the
+    // file.
+    rta::core::SpectralSolver solver;
+
+    std::vector<std::vector<double>> matrix;
+    OIIO_CHECK_ASSERT( rta::util::fetch_matrix_from_CCT_table(
+        "table make",
+        "model-1",
+        { 3.0, 1.0, 1.0 },
+        test_dir.path(),
+        solver,
+        0,
+        false,
+        matrix ) );
+    OIIO_CHECK_EQUAL( matrix[0][0], 6000.0 );
+
+    // The table stays in memory after the file is gone.
+    std::filesystem::remove_all( test_dir.path() );
+    OIIO_CHECK_ASSERT( rta::util::fetch_matrix_from_CCT_table(
+        "table make",
+        "model-1",
+        { 1.5, 1.0, 2.0 },
+        test_dir.path(),
+        solver,
+        0,
+        false,
+        matrix ) );
+    OIIO_CHECK_EQUAL( matrix[0][0], 3000.0 );
+}
+
 int main( int, char ** )
 {
     test_configure_spectral_solver();
+    test_matrix_cache_fit_mode();
+    test_fetch_matrix_from_CCT_table();
 
     return unit_test_failures;
 }
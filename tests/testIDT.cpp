@@ -7,11 +7,14 @@
 #endif
 
 #include <filesystem>
+#include <memory>
 #include <OpenImageIO/unittest.h>
 
 #include "../src/rawtoaces_core/mathOps.h"
 #include <rawtoaces/rawtoaces_core.h>
+#include <rawtoaces/cct_matrix_table.h>
 #include "../src/rawtoaces_core/rawtoaces_core_priv.h"
+#include "../src/rawtoaces_core/illuminant_bank.h"
 #include "test_utils.h"
 
 #define DATA_PATH "../_deps/rawtoaces_data-src/data/"
@@ -5237,7 +5240,11 @@ void testIDT_CalRGB()
             OIIO_CHECK_EQUAL_THRESH( RGB[i][j], RGB_test[i][j], 1e-5 );
 }
 
-void testIDT_CurveFit()
+/// Prepares the camera RGB and the target XYZ values of the training patches
+/// used by the curve fitting tests.
+void curve_fit_helper(
+    std::vector<std::array<double, 3>> &RGB,
+    std::vector<std::array<double, 3>> &XYZ )
 {
     rta::core::SpectralData camera;
     load_file( "camera/Nikon_D200_380_780_5.json", camera );
@@ -5252,10 +5259,16 @@ void testIDT_CurveFit()
     load_file( "cmf/cmf_1931.json", observer );
 
     scale_illuminant( camera, illuminant );
-    auto WB  = _calculate_WB( camera, illuminant );
-    auto TI  = calculate_TI( illuminant, training_data );
-    auto XYZ = calculate_XYZ( observer, illuminant, TI );
-    auto RGB = calculate_RGB( camera, WB, TI );
+    auto WB = _calculate_WB( camera, illuminant );
+    auto TI = calculate_TI( illuminant, training_data );
+    XYZ     = calculate_XYZ( observer, illuminant, TI );
+    RGB     = calculate_RGB( camera, WB, TI );
+}
+
+void testIDT_CurveFit()
+{
+    std::vector<std::array<double, 3>> RGB, XYZ;
+    curve_fit_helper( RGB, XYZ );
 
     double BStart[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
 
@@ -5272,6 +5285,119 @@ void testIDT_CurveFit()
             OIIO_CHECK_EQUAL_THRESH( IDT[i][j], IDT_test[i][j], 1e-5 );
 }
 
+/// Tests that the analytic Jacobian of the fast IDT cost matches the
+/// automatic differentiation of the reference cost
+void testIDT_CostJacobian()
+{
+    std::vector<std::array<double, 3>> RGB, XYZ;
+    curve_fit_helper( RGB, XYZ );
+    auto LAB = rta::core::XYZ_to_LAB( XYZ );
+
+    const size_t count = RGB.size() * 3;
+    OIIO_CHECK_EQUAL( count, 570 );
+
+    std::unique_ptr<ceres::CostFunction> reference(
+        rta::core::create_IDT_cost_function( RGB, LAB, false ) );
+    std::unique_ptr<ceres::CostFunction> fast(
+        rta::core::create_IDT_cost_function( RGB, LAB, true ) );
+    OIIO_CHECK_EQUAL( fast->num_residuals(), int( count ) );
+
+    const double  beta_params[6] = { 0.8, 0.15, 0.05, 1.0, 0.02, -0.1 };
+    const double *parameters[1]  = { beta_params };
+
+    std::vector<double> reference_residuals( count ), fast_residuals( count );
+    std::vector<double> reference_jacobian( count * 6 );
+    std::vector<double> fast_jacobian( count * 6 );
+    double             *reference_jacobians[1] = { reference_jacobian.data() };
+    double             *fast_jacobians[1]      = { fast_jacobian.data() };
+
+    OIIO_CHECK_ASSERT( reference->Evaluate(
+        parameters, reference_residuals.data(), reference_jacobians ) );
+    OIIO_CHECK_ASSERT(
+        fast->Evaluate( parameters, fast_residuals.data(), fast_jacobians ) );
+
+    for ( size_t i = 0; i < count; i++ )
+        OIIO_CHECK_EQUAL_THRESH(
+            fast_residuals[i], reference_residuals[i], 1e-9 );
+    for ( size_t i = 0; i < count * 6; i++ )
+        OIIO_CHECK_EQUAL_THRESH(
+            fast_jacobian[i], reference_jacobian[i], 1e-7 );
+}
+
+/// Tests that the residuals of the reference IDT cost, evaluated over the
+/// whole training set at once, match converting the patches via
+/// `getCalcXYZt` and `XYZ_to_LAB` one by one
+void testIDT_CostResiduals()
+{
+    std::vector<std::array<double, 3>> RGB, XYZ;
+    curve_fit_helper( RGB, XYZ );
+    auto LAB = rta::core::XYZ_to_LAB( XYZ );
+
+    const size_t count = RGB.size() * 3;
+
+    std::unique_ptr<ceres::CostFunction> cost(
+        rta::core::create_IDT_cost_function( RGB, LAB, false ) );
+
+    const double  beta_params[6] = { 0.8, 0.15, 0.05, 1.0, 0.02, -0.1 };
+    const double *parameters[1]  = { beta_params };
+
+    std::vector<double> residuals( count );
+    OIIO_CHECK_ASSERT(
+        cost->Evaluate( parameters, residuals.data(), nullptr ) );
+
+    std::vector<std::vector<double>> RGB_rows;
+    for ( const auto &rgb: RGB )
+        RGB_rows.push_back( rta::core::to_vector( rgb ) );
+
+    auto expected = rta::core::XYZ_to_LAB(
+        rta::core::getCalcXYZt( RGB_rows, beta_params ) );
+    for ( size_t i = 0; i < RGB.size(); i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            OIIO_CHECK_EQUAL_THRESH(
+                residuals[i * 3 + j], LAB[i][j] - expected[i][j], 1e-9 );
+
+    // Nothing gets fitted once the parameters match the target.
+    const double identity[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    std::vector<std::array<double, 3>> target;
+    for ( const auto &lab: rta::core::XYZ_to_LAB(
+              rta::core::getCalcXYZt( RGB_rows, identity ) ) )
+        target.push_back( rta::core::to_Vec3( lab ) );
+    cost.reset( rta::core::create_IDT_cost_function( RGB, target, false ) );
+
+    parameters[0] = identity;
+    OIIO_CHECK_ASSERT(
+        cost->Evaluate( parameters, residuals.data(), nullptr ) );
+    for ( size_t i = 0; i < count; i++ )
+        OIIO_CHECK_EQUAL_THRESH( residuals[i], 0.0, 1e-9 );
+}
+
+/// Tests that the fast curve fitting matches the reference matrix, when
+/// starting from the identity, and from the matrix of another illuminant
+void testIDT_CurveFit_Fast()
+{
+    std::vector<std::array<double, 3>> RGB, XYZ;
+    curve_fit_helper( RGB, XYZ );
+
+    float IDT[3][3] = { { 0.7447691479f, 0.1434200377f, 0.1118108144f },
+                        { 0.0451759890f, 1.0082622042f, -0.0534381932f },
+                        { 0.0247144012f, -0.1245524896f, 1.0998380884f } };
+
+    double identity_start[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    double warm_start[6]     = { 0.7, 0.2, 0.1, 0.95, 0.0, -0.1 };
+
+    for ( double *start: { identity_start, warm_start } )
+    {
+        std::vector<std::vector<double>> IDT_test(
+            3, std::vector<double>( 3 ) );
+        OIIO_CHECK_ASSERT(
+            rta::core::curveFit( RGB, XYZ, start, 0, IDT_test, true ) );
+
+        for ( size_t i = 0; i < 3; i++ )
+            for ( size_t j = 0; j < 3; j++ )
+                OIIO_CHECK_EQUAL_THRESH( IDT[i][j], IDT_test[i][j], 1e-5 );
+    }
+}
+
 void testIDT_CalIDT()
 {
     rta::core::SpectralSolver solver( { DATA_PATH } );
@@ -5290,6 +5416,267 @@ void testIDT_CalIDT()
             OIIO_CHECK_EQUAL_THRESH( IDT[i][j], IDT_test[i][j], 1e-4 );
 }
 
+/// Tests that the fast fit mode with a warm start solves the same matrix as
+/// the reference fit
+void testIDT_CalIDT_Fast()
+{
+    rta::core::SpectralSolver solver( { DATA_PATH } );
+    load_camera_helper( solver, "arri", "d21", "iso7589", true, true );
+    solver.calculate_WB();
+
+    solver.fit_mode  = rta::core::SpectralSolver::FitMode::Fast;
+    solver.IDT_start = { { 1.0, -0.2, 0.2 },
+                         { 0.0, 1.2, -0.2 },
+                         { -0.1, -0.7, 1.8 } };
+
+    OIIO_CHECK_ASSERT( solver.calculate_IDT_matrix() );
+    vector<vector<double>> IDT_test = solver.get_IDT_matrix();
+
+    float IDT[3][3] = { { 1.0915120600f, -0.2516916464f, 0.1601795864f },
+                        { -0.0089998772f, 1.2147199060f, -0.2057200288f },
+                        { -0.1312667887f, -0.7361633199f, 1.8674301085f } };
+
+    for ( size_t i = 0; i < 3; i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            OIIO_CHECK_EQUAL_THRESH( IDT[i][j], IDT_test[i][j], 1e-4 );
+
+    // A malformed starting matrix gets rejected.
+    solver.IDT_start = { { 1.0, 0.0 }, { 0.0, 1.0 } };
+
+    bool        success;
+    std::string output =
+        capture_stderr( [&]() { success = solver.calculate_IDT_matrix(); } );
+    OIIO_CHECK_ASSERT( !success );
+    ASSERT_CONTAINS( output, "ERROR: the starting IDT matrix must be 3x3." );
+}
+
+/// Tests that solving a batch of illuminants gives the same results as
+/// solving them one by one
+void testIDT_SolveIlluminants()
+{
+    const std::vector<std::string> illuminants = { "iso7589",
+                                                   "d55",
+                                                   "3200k",
+                                                   "d65" };
+
+    rta::core::SpectralSolver solver( { DATA_PATH } );
+    load_camera_helper( solver, "arri", "d21", "", true, true );
+
+    std::vector<rta::core::SpectralSolver::IlluminantSolution> solutions;
+    OIIO_CHECK_ASSERT( solver.solve_illuminants( illuminants, solutions, 2 ) );
+    OIIO_CHECK_EQUAL( solutions.size(), illuminants.size() );
+
+    for ( size_t index = 0; index < illuminants.size(); index++ )
+    {
+        const auto &solution = solutions[index];
+        OIIO_CHECK_EQUAL( solution.illuminant, illuminants[index] );
+        OIIO_CHECK_ASSERT( solution.success );
+
+        rta::core::SpectralSolver serial( { DATA_PATH } );
+        load_camera_helper(
+            serial, "arri", "d21", illuminants[index], true, true );
+        OIIO_CHECK_ASSERT( serial.calculate_WB() );
+        OIIO_CHECK_ASSERT( serial.calculate_IDT_matrix() );
+
+        for ( size_t i = 0; i < 3; i++ )
+        {
+            OIIO_CHECK_EQUAL_THRESH(
+                solution.WB_multipliers[i],
+                serial.get_WB_multipliers()[i],
+                1e-9 );
+            for ( size_t j = 0; j < 3; j++ )
+                OIIO_CHECK_EQUAL_THRESH(
+                    solution.IDT_matrix[i][j],
+                    serial.get_IDT_matrix()[i][j],
+                    1e-6 );
+        }
+    }
+
+    // The solver state does not change.
+    OIIO_CHECK_ASSERT( solver.illuminant.data.empty() );
+}
+
+/// Tests that the failures of a batch get reported per illuminant
+void testIDT_SolveIlluminants_Errors()
+{
+    rta::core::SpectralSolver solver( { DATA_PATH } );
+
+    std::vector<rta::core::SpectralSolver::IlluminantSolution> solutions;
+
+    bool        success;
+    std::string output = capture_stderr( [&]() {
+        success = solver.solve_illuminants( { "d55" }, solutions );
+    } );
+    OIIO_CHECK_ASSERT( !success );
+    ASSERT_CONTAINS(
+        output,
+        "ERROR: camera needs to be initialised prior to calling "
+        "SpectralSolver::solve_illuminants()" );
+
+    load_camera_helper( solver, "arri", "d21", "", true, true );
+
+    output = capture_stderr( [&]() {
+        success = solver.solve_illuminants( { "d55", "unknown" }, solutions );
+    } );
+    OIIO_CHECK_ASSERT( !success );
+    ASSERT_CONTAINS(
+        output, "ERROR: Failed to find the illuminant 'unknown'." );
+    OIIO_CHECK_EQUAL( solutions.size(), 2 );
+    OIIO_CHECK_ASSERT( solutions[0].success );
+    OIIO_CHECK_ASSERT( !solutions[1].success );
+}
+
+/// A colour temperature table of synthetic entries, the matrices being
+/// diagonal with the entry number on the diagonal.
+rta::core::CCTMatrixTable make_CCT_table()
+{
+    rta::core::CCTMatrixTable table;
+    table.camera_make  = "Make";
+    table.camera_model = "Model";
+
+    const double CCTs[3]              = { 3000, 5000, 7000 };
+    const double WB_multipliers[3][3] = { { 1.2, 1.0, 2.4 },
+                                          { 1.8, 1.0, 1.6 },
+                                          { 2.2, 1.0, 1.3 } };
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        rta::core::CCTMatrixTable::Entry entry;
+        entry.CCT            = CCTs[i];
+        entry.WB_multipliers = { WB_multipliers[i][0],
+                                 WB_multipliers[i][1],
+                                 WB_multipliers[i][2] };
+        entry.IDT_matrix     = { { i + 1.0, 0.0, 0.0 },
+                                 { 0.0, i + 1.0, 0.0 },
+                                 { 0.0, 0.0, i + 1.0 } };
+        table.entries.push_back( entry );
+    }
+    return table;
+}
+
+/// Tests interpolating the matrices of a colour temperature table
+void testCCTMatrixTable_Interpolate()
+{
+    rta::core::CCTMatrixTable table = make_CCT_table();
+
+    std::vector<std::vector<double>> matrix;
+    double                           CCT = 0.0;
+
+    // At an entry, scaling the multipliers does not matter.
+    OIIO_CHECK_ASSERT( table.interpolate( { 3.6, 2.0, 3.2 }, matrix, &CCT ) );
+    OIIO_CHECK_EQUAL_THRESH( CCT, 5000.0, 1e-6 );
+    OIIO_CHECK_EQUAL_THRESH( matrix[0][0], 2.0, 1e-9 );
+    OIIO_CHECK_EQUAL_THRESH( matrix[0][1], 0.0, 1e-9 );
+
+    // Half-way between the first two entries in the log chromaticities.
+    std::vector<double> half_way = { std::sqrt( 1.2 * 1.8 ),
+                                     1.0,
+                                     std::sqrt( 2.4 * 1.6 ) };
+    OIIO_CHECK_ASSERT( table.interpolate( half_way, matrix, &CCT ) );
+    OIIO_CHECK_EQUAL_THRESH( matrix[1][1], 1.5, 1e-9 );
+    OIIO_CHECK_EQUAL_THRESH( matrix[2][2], 1.5, 1e-9 );
+    OIIO_CHECK_EQUAL_THRESH( CCT, 1e6 / ( 0.5e6 / 3000 + 0.5e6 / 5000 ), 1e-6 );
+
+    // Beyond the ends of the table.
+    OIIO_CHECK_ASSERT( table.interpolate( { 0.5, 1.0, 4.0 }, matrix, &CCT ) );
+    OIIO_CHECK_EQUAL_THRESH( matrix[0][0], 1.0, 1e-9 );
+    OIIO_CHECK_EQUAL_THRESH( CCT, 3000.0, 1e-6 );
+    OIIO_CHECK_ASSERT( table.interpolate( { 4.0, 1.0, 0.8 }, matrix ) );
+    OIIO_CHECK_EQUAL_THRESH( matrix[0][0], 3.0, 1e-9 );
+
+    // Invalid inputs.
+    OIIO_CHECK_ASSERT( !table.interpolate( { 1.0, 0.0, 1.0 }, matrix ) );
+    OIIO_CHECK_ASSERT( !rta::core::CCTMatrixTable().interpolate(
+        { 1.0, 1.0, 1.0 }, matrix ) );
+}
+
+/// Tests saving and loading colour temperature tables
+void testCCTMatrixTable_SaveLoad()
+{
+    TestDirectory     test_dir;
+    const std::string path = test_dir.path() + "/table.json";
+
+    rta::core::CCTMatrixTable table = make_CCT_table();
+    std::swap( table.entries[0], table.entries[2] );
+    OIIO_CHECK_ASSERT( table.save( path ) );
+
+    rta::core::CCTMatrixTable loaded;
+    OIIO_CHECK_ASSERT( loaded.load( path ) );
+    OIIO_CHECK_EQUAL( loaded.camera_make, "Make" );
+    OIIO_CHECK_EQUAL( loaded.camera_model, "Model" );
+    OIIO_CHECK_EQUAL( loaded.entries.size(), 3 );
+
+    // The entries get sorted by the colour temperature.
+    const auto expected = make_CCT_table();
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        OIIO_CHECK_EQUAL( loaded.entries[i].CCT, expected.entries[i].CCT );
+        OIIO_CHECK_ASSERT(
+            loaded.entries[i].WB_multipliers ==
+            expected.entries[i].WB_multipliers );
+        OIIO_CHECK_ASSERT(
+            loaded.entries[i].IDT_matrix == expected.entries[i].IDT_matrix );
+    }
+
+    TestFile invalid( test_dir.path(), "invalid.json" );
+    invalid.write( "{ \"version\": 1, \"camera_make\": \"Make\" }" );
+
+    bool        success;
+    std::string output =
+        capture_stderr( [&]() { success = loaded.load( invalid.path() ); } );
+    OIIO_CHECK_ASSERT( !success );
+    ASSERT_CONTAINS(
+        output, "ERROR: Failed to parse the colour temperature table" );
+    OIIO_CHECK_EQUAL( loaded.entries.size(), 3 );
+}
+
+/// Tests building a colour temperature table from the spectral data
+void testCCTMatrixTable_Build()
+{
+    rta::core::SpectralSolver solver( { DATA_PATH } );
+    load_camera_helper( solver, "arri", "d21", "", true, true );
+
+    rta::core::CCTMatrixTable table;
+    OIIO_CHECK_ASSERT( table.build( solver, "arri", "d21", 3000, 5000, 1000 ) );
+    OIIO_CHECK_EQUAL( table.entries.size(), 3 );
+    OIIO_CHECK_EQUAL(
+        rta::core::CCTMatrixTable::illuminant_type( 3000 ), "3000k" );
+    OIIO_CHECK_EQUAL(
+        rta::core::CCTMatrixTable::illuminant_type( 5000 ), "d5000" );
+
+    // The entries match solving the illuminants one by one.
+    rta::core::SpectralSolver serial( { DATA_PATH } );
+    load_camera_helper( serial, "arri", "d21", "d5000", true, true );
+    OIIO_CHECK_ASSERT( serial.calculate_WB() );
+    OIIO_CHECK_ASSERT( serial.calculate_IDT_matrix() );
+
+    const auto &entry = table.entries[2];
+    OIIO_CHECK_EQUAL( entry.CCT, 5000.0 );
+
+    std::vector<std::vector<double>> matrix;
+    OIIO_CHECK_ASSERT(
+        table.interpolate( serial.get_WB_multipliers(), matrix ) );
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        for ( size_t j = 0; j < 3; j++ )
+        {
+            OIIO_CHECK_EQUAL_THRESH(
+                entry.IDT_matrix[i][j], serial.get_IDT_matrix()[i][j], 1e-6 );
+            OIIO_CHECK_EQUAL_THRESH(
+                matrix[i][j], serial.get_IDT_matrix()[i][j], 1e-6 );
+        }
+    }
+
+    bool        success;
+    std::string output = capture_stderr( [&]() {
+        success = table.build( solver, "arri", "d21", 1000, 5000, 1000 );
+    } );
+    OIIO_CHECK_ASSERT( !success );
+    ASSERT_CONTAINS(
+        output,
+        "ERROR: The colour temperature range of the table must be within "
+        "1500K to 25000K" );
+}
+
 /// Helper function to test that calculate_IDT_matrix returns false and prints expected error
 static void check_calculate_IDT_matrix_error(
     rta::core::SpectralSolver &solver, const std::string &expected_error )
@@ -5496,6 +5883,380 @@ void testIDT_CalIDT_Training_Data_Empty()
         solver, expected_error_training_data_not_initialized );
 }
 
+void testIDT_Database_FindCamera()
+{
+    std::cout << std::endl << "testIDT_Database_FindCamera()" << std::endl;
+
+    auto database = rta::core::SpectralDatabase::get( { DATA_PATH } );
+    OIIO_CHECK_ASSERT( database != nullptr );
+
+    // Look-ups are case-insensitive.
+    auto camera = database->find_camera( "ARRI", "D21" );
+    OIIO_CHECK_ASSERT( camera != nullptr );
+    OIIO_CHECK_EQUAL( camera->manufacturer, "ARRI" );
+    OIIO_CHECK_EQUAL( camera->model, "D21" );
+    OIIO_CHECK_ASSERT( database->find_camera( "arri", "no-such" ) == nullptr );
+
+    // The same instance is shared while the database is unchanged.
+    OIIO_CHECK_ASSERT(
+        database == rta::core::SpectralDatabase::get( { DATA_PATH } ) );
+
+    // The solver using the index finds the same data as the solver scanning
+    // the directories.
+    rta::core::SpectralSolver indexed_solver( { DATA_PATH } );
+    indexed_solver.database = database;
+    rta::core::SpectralSolver scanning_solver( { DATA_PATH } );
+
+    OIIO_CHECK_ASSERT( indexed_solver.find_camera( "nikon", "d200" ) );
+    OIIO_CHECK_ASSERT( scanning_solver.find_camera( "nikon", "d200" ) );
+    OIIO_CHECK_EQUAL(
+        indexed_solver.camera["R"].values.size(),
+        scanning_solver.camera["R"].values.size() );
+    for ( size_t i = 0; i < indexed_solver.camera["R"].values.size(); i++ )
+    {
+        OIIO_CHECK_EQUAL(
+            indexed_solver.camera["R"].values[i],
+            scanning_solver.camera["R"].values[i] );
+    }
+    OIIO_CHECK_ASSERT( !indexed_solver.find_camera( "nikon", "no-such" ) );
+}
+
+void testIDT_Database_FindIlluminant()
+{
+    std::cout << std::endl << "testIDT_Database_FindIlluminant()" << std::endl;
+
+    rta::core::SpectralSolver indexed_solver( { DATA_PATH } );
+    indexed_solver.database =
+        rta::core::SpectralDatabase::get( { DATA_PATH } );
+    rta::core::SpectralSolver scanning_solver( { DATA_PATH } );
+
+    OIIO_CHECK_ASSERT( indexed_solver.find_illuminant( "ISO7589" ) );
+    OIIO_CHECK_EQUAL( indexed_solver.illuminant.type, "iso7589" );
+    OIIO_CHECK_ASSERT( !indexed_solver.find_illuminant( "no-such" ) );
+
+    // The built-in illuminants do not need the database.
+    OIIO_CHECK_ASSERT( indexed_solver.find_illuminant( "d55" ) );
+    OIIO_CHECK_ASSERT( indexed_solver.find_illuminant( "3200k" ) );
+
+    // Matching the white-balancing weights gives the same result.
+    load_camera_helper( indexed_solver, "nikon", "d200", "", false, false );
+    load_camera_helper( scanning_solver, "nikon", "d200", "", false, false );
+
+    vector<double> wb = { 1.2, 1.0, 1.6 };
+    OIIO_CHECK_ASSERT( indexed_solver.find_illuminant( wb ) );
+    OIIO_CHECK_ASSERT( scanning_solver.find_illuminant( wb ) );
+    OIIO_CHECK_EQUAL(
+        indexed_solver.illuminant.type, scanning_solver.illuminant.type );
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        OIIO_CHECK_EQUAL_THRESH(
+            indexed_solver.get_WB_multipliers()[i],
+            scanning_solver.get_WB_multipliers()[i],
+            1e-12 );
+    }
+}
+
+void testIDT_Database_Invalidation()
+{
+    std::cout << std::endl << "testIDT_Database_Invalidation()" << std::endl;
+
+    TestDirectory test_dir;
+    std::string   database_path = test_dir.get_database_path();
+
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "First" } } );
+
+    auto database = rta::core::SpectralDatabase::get( { database_path } );
+    OIIO_CHECK_ASSERT( database->is_up_to_date() );
+    OIIO_CHECK_ASSERT( database->find_camera( "make", "first" ) != nullptr );
+    OIIO_CHECK_ASSERT( database->find_camera( "make", "second" ) == nullptr );
+
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Second" } } );
+    test_dir.create_test_data_file( "illuminant", { { "type", "Custom" } } );
+    OIIO_CHECK_ASSERT( !database->is_up_to_date() );
+
+    auto updated = rta::core::SpectralDatabase::get( { database_path } );
+    OIIO_CHECK_ASSERT( updated != database );
+    OIIO_CHECK_ASSERT( updated->find_camera( "make", "second" ) != nullptr );
+    OIIO_CHECK_ASSERT( updated->find_illuminant( "custom" ) != nullptr );
+    OIIO_CHECK_EQUAL( updated->illuminants().size(), 1 );
+}
+
+/// Verifies the shared database only checks the directories: adding or
+/// removing a file rebuilds it, editing one in place is only caught by
+/// `is_up_to_date()`.
+void testIDT_Database_DirectoryTimes()
+{
+    std::cout << std::endl << "testIDT_Database_DirectoryTimes()" << std::endl;
+
+    TestDirectory test_dir;
+    std::string   database_path = test_dir.get_database_path();
+
+    std::string first = test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "First" } } );
+    std::string second = test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Second" } } );
+
+    auto database = rta::core::SpectralDatabase::get( { database_path } );
+    OIIO_CHECK_ASSERT(
+        database == rta::core::SpectralDatabase::get( { database_path } ) );
+
+    {
+        std::ofstream file( first, std::ios::app );
+        file << std::endl;
+    }
+    OIIO_CHECK_ASSERT( !database->is_up_to_date() );
+    OIIO_CHECK_ASSERT(
+        database == rta::core::SpectralDatabase::get( { database_path } ) );
+
+    std::filesystem::remove( second );
+    auto updated = rta::core::SpectralDatabase::get( { database_path } );
+    OIIO_CHECK_ASSERT( updated != database );
+    OIIO_CHECK_ASSERT( updated->is_up_to_date() );
+    OIIO_CHECK_ASSERT( updated->find_camera( "make", "second" ) == nullptr );
+}
+
+void testIDT_Database_IndexFile()
+{
+    std::cout << std::endl << "testIDT_Database_IndexFile()" << std::endl;
+
+    TestDirectory test_dir;
+    std::string   database_path = test_dir.get_database_path();
+
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Model" } } );
+    test_dir.create_test_data_file( "illuminant", { { "type", "Custom" } } );
+
+    OIIO_CHECK_ASSERT(
+        rta::core::SpectralDatabase::write_index( database_path ) );
+
+    std::string index_path =
+        database_path + "/" + rta::core::SpectralDatabase::index_filename;
+    OIIO_CHECK_ASSERT( std::filesystem::exists( index_path ) );
+
+    nlohmann::json index;
+    {
+        std::ifstream file( index_path );
+        index = nlohmann::json::parse( file );
+    }
+    OIIO_CHECK_EQUAL( index["files"].size(), 2 );
+
+    // The headers come from the index file while the data files are
+    // unchanged, which we check by tampering with the index.
+    for ( auto &item: index["files"] )
+    {
+        if ( item["model"] == "Model" )
+            item["model"] = "Indexed";
+    }
+    {
+        std::ofstream file( index_path );
+        file << index.dump();
+    }
+
+    {
+        rta::core::SpectralDatabase database( { database_path } );
+        auto camera = database.find_camera( "make", "indexed" );
+        OIIO_CHECK_ASSERT( camera != nullptr );
+        OIIO_CHECK_EQUAL( camera->model, "Model" );
+        OIIO_CHECK_EQUAL( camera->data.at( "main" ).size(), 3 );
+        OIIO_CHECK_ASSERT( database.find_illuminant( "custom" ) != nullptr );
+    }
+
+    // The stale entries get ignored, and the file parsed instead.
+    for ( auto &item: index["files"] )
+    {
+        item["size"] = item["size"].get<uintmax_t>() + 1;
+    }
+    {
+        std::ofstream file( index_path );
+        file << index.dump();
+    }
+
+    {
+        rta::core::SpectralDatabase database( { database_path } );
+        OIIO_CHECK_ASSERT(
+            database.find_camera( "make", "indexed" ) == nullptr );
+        OIIO_CHECK_ASSERT( database.find_camera( "make", "model" ) != nullptr );
+    }
+}
+
+void testIDT_Database_BinaryFile()
+{
+    std::cout << std::endl << "testIDT_Database_BinaryFile()" << std::endl;
+
+    TestDirectory test_dir;
+    std::string   database_path = test_dir.get_database_path();
+
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Model" } } );
+    test_dir.create_test_data_file( "illuminant", { { "type", "Custom" } } );
+    std::string cmf_path = test_dir.create_test_data_file( "cmf" );
+
+    OIIO_CHECK_ASSERT(
+        rta::core::SpectralDatabase::write_binary( database_path ) );
+
+    std::string binary_path =
+        database_path + "/" + rta::core::SpectralDatabase::binary_filename;
+    OIIO_CHECK_ASSERT( std::filesystem::exists( binary_path ) );
+    OIIO_CHECK_ASSERT( !std::filesystem::exists( binary_path + ".tmp" ) );
+
+    // The compiled data matches the parsed files, with the spectra reshaped.
+    rta::core::SpectralData parsed;
+    OIIO_CHECK_ASSERT( parsed.load( cmf_path ) );
+    {
+        rta::core::SpectralDatabase database( { database_path } );
+        auto camera = database.find_camera( "make", "model" );
+        OIIO_CHECK_ASSERT( camera != nullptr );
+        OIIO_CHECK_EQUAL( camera->data.at( "main" ).size(), 3 );
+        OIIO_CHECK_ASSERT(
+            camera->data.at( "main" )[0].second.shape ==
+            rta::core::Spectrum::ReferenceShape );
+        OIIO_CHECK_ASSERT( database.find_illuminant( "custom" ) != nullptr );
+
+        auto cmf = database.find_file( "cmf/cmf_1931.json" );
+        OIIO_CHECK_ASSERT( cmf != nullptr );
+        OIIO_CHECK_EQUAL( cmf->data.size(), parsed.data.size() );
+        const auto &channels = parsed.data.at( "main" );
+        for ( size_t i = 0; i < channels.size(); i++ )
+        {
+            const auto &channel = cmf->data.at( "main" )[i];
+            OIIO_CHECK_EQUAL( channel.first, channels[i].first );
+            OIIO_CHECK_ASSERT(
+                channel.second.values == channels[i].second.values );
+        }
+        OIIO_CHECK_ASSERT(
+            database.find_file( "cmf/no-such.json" ) == nullptr );
+    }
+
+    // The solver loads the observer through the database.
+    {
+        rta::core::SpectralSolver solver( { database_path } );
+        solver.database = std::make_shared<rta::core::SpectralDatabase>(
+            std::vector<std::string>{ database_path } );
+        OIIO_CHECK_ASSERT(
+            solver.load_spectral_data( "cmf/cmf_1931.json", solver.observer ) );
+        OIIO_CHECK_EQUAL( solver.observer.data.size(), parsed.data.size() );
+    }
+
+    // The data come from the compiled database while the data files are
+    // unchanged, which we check by replacing the data files with invalid
+    // ones of the same size and modification time.
+    for ( const auto &entry: std::filesystem::recursive_directory_iterator(
+              database_path ) )
+    {
+        if ( entry.path().extension() != ".json" )
+            continue;
+
+        auto size = std::filesystem::file_size( entry.path() );
+        auto time = std::filesystem::last_write_time( entry.path() );
+        {
+            std::ofstream file( entry.path() );
+            file << std::string( size, ' ' );
+        }
+        std::filesystem::last_write_time( entry.path(), time );
+    }
+    {
+        rta::core::SpectralDatabase database( { database_path } );
+        OIIO_CHECK_ASSERT( database.find_camera( "make", "model" ) != nullptr );
+        OIIO_CHECK_ASSERT(
+            database.find_file( "cmf/cmf_1931.json" ) != nullptr );
+    }
+
+    // The stale entries get ignored, and the files parsed instead. The
+    // touched observer file is not valid any more, so it fails to load.
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Other" } } );
+    std::filesystem::last_write_time(
+        cmf_path, std::filesystem::file_time_type::clock::now() );
+    {
+        rta::core::SpectralDatabase database( { database_path } );
+        OIIO_CHECK_ASSERT( database.find_camera( "make", "model" ) != nullptr );
+        OIIO_CHECK_ASSERT( database.find_camera( "make", "other" ) != nullptr );
+
+        std::string output = capture_stderr( [&database]() {
+            OIIO_CHECK_ASSERT(
+                database.find_file( "cmf/cmf_1931.json" ) == nullptr );
+        } );
+        ASSERT_CONTAINS( output, "cmf_1931.json failed" );
+    }
+
+    // The invalid compiled databases get ignored.
+    {
+        std::ofstream file( binary_path, std::ios::binary );
+        file << "RTASPDB";
+    }
+    std::string output = capture_stderr( [&database_path]() {
+        rta::core::SpectralDatabase database( { database_path } );
+        OIIO_CHECK_ASSERT( database.find_camera( "make", "other" ) != nullptr );
+    } );
+    ASSERT_CONTAINS( output, "Ignoring the compiled database" );
+}
+
+void testIDT_IlluminantBank()
+{
+    std::cout << std::endl << "testIDT_IlluminantBank()" << std::endl;
+
+    TestDirectory test_dir;
+    std::string   database_path = test_dir.get_database_path();
+
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Model" } } );
+    test_dir.create_test_data_file( "illuminant", { { "type", "Custom" } } );
+
+    auto database = rta::core::SpectralDatabase::get( { database_path } );
+    auto bank     = rta::core::IlluminantBank::get( database );
+
+    // 43 daylight, 5 blackbody, and the custom illuminant.
+    OIIO_CHECK_EQUAL( bank->illuminants().size(), 49 );
+    OIIO_CHECK_EQUAL( bank->illuminants().front().type, "d40" );
+    OIIO_CHECK_EQUAL( bank->illuminants().back().type, "Custom" );
+    OIIO_CHECK_ASSERT( bank == rta::core::IlluminantBank::get( database ) );
+
+    rta::core::SpectralSolver solver( { database_path } );
+    solver.database = database;
+    OIIO_CHECK_ASSERT( solver.find_camera( "make", "model" ) );
+
+    // The responses get calculated once per camera.
+    auto responses = bank->responses( solver.camera );
+    OIIO_CHECK_EQUAL( responses->size(), bank->illuminants().size() );
+    OIIO_CHECK_ASSERT( responses == bank->responses( solver.camera ) );
+
+    // The pre-integrated responses give the same weights as calculate_WB().
+    for ( size_t i = 0; i < bank->illuminants().size(); i++ )
+    {
+        solver.illuminant = bank->illuminants()[i];
+        OIIO_CHECK_ASSERT( solver.calculate_WB() );
+
+        const auto &wb = solver.get_WB_multipliers();
+        OIIO_CHECK_EQUAL_THRESH(
+            wb[0], ( *responses )[i][1] / ( *responses )[i][0], 1e-12 );
+        OIIO_CHECK_EQUAL_THRESH(
+            wb[2], ( *responses )[i][1] / ( *responses )[i][2], 1e-12 );
+    }
+
+    // Matching the weights of one of the illuminants finds that illuminant,
+    // scaled to the camera.
+    OIIO_CHECK_ASSERT( solver.find_illuminant( "custom" ) );
+    OIIO_CHECK_ASSERT( solver.calculate_WB() );
+    std::vector<double> wb       = solver.get_WB_multipliers();
+    std::vector<double> expected = solver.illuminant["power"].values;
+
+    OIIO_CHECK_ASSERT( solver.find_illuminant( "d65" ) );
+    OIIO_CHECK_ASSERT( solver.find_illuminant( wb ) );
+    OIIO_CHECK_EQUAL( solver.illuminant.type, "Custom" );
+    for ( size_t i = 0; i < expected.size(); i++ )
+    {
+        OIIO_CHECK_EQUAL_THRESH(
+            solver.illuminant["power"].values[i], expected[i], 1e-12 );
+    }
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        OIIO_CHECK_EQUAL_THRESH(
+            solver.get_WB_multipliers()[i], wb[i], 1e-12 );
+    }
+}
+
 int main( int, char ** )
 {
     testIDT_LoadCameraSpst();
@@ -5511,7 +6272,16 @@ int main( int, char ** )
     testIDT_CalXYZ();
     testIDT_CalRGB();
     testIDT_CurveFit();
+    testIDT_CostJacobian();
+    testIDT_CostResiduals();
+    testIDT_CurveFit_Fast();
     testIDT_CalIDT();
+    testIDT_CalIDT_Fast();
+    testIDT_SolveIlluminants();
+    testIDT_SolveIlluminants_Errors();
+    testCCTMatrixTable_Interpolate();
+    testCCTMatrixTable_SaveLoad();
+    testCCTMatrixTable_Build();
     testIDT_CalIDT_Camera_Not_Initialized();
     testIDT_CalIDT_Camera_Wrong_Size();
     testIDT_CalIDT_Illuminant_Not_Initialized();
@@ -5520,6 +6290,13 @@ int main( int, char ** )
     testIDT_CalIDT_Observer_Wrong_Size();
     testIDT_CalIDT_Training_Data_Not_Initialized();
     testIDT_CalIDT_Training_Data_Empty();
+    testIDT_Database_FindCamera();
+    testIDT_Database_FindIlluminant();
+    testIDT_Database_Invalidation();
+    testIDT_Database_DirectoryTimes();
+    testIDT_Database_IndexFile();
+    testIDT_Database_BinaryFile();
+    testIDT_IlluminantBank();
 
     return unit_test_failures;
 }
@@ -796,6 +796,68 @@ void test_GetCalcXYZt()
             OIIO_CHECK_EQUAL_THRESH( XYZ_test[i][j], XYZ[i][j], 1e-5 );
 }
 
+void test_Mat3()
+{
+    // The fixed-size types are usable in constant expressions.
+    constexpr Mat3<double> D = diagonal<double>( { 1.0, 2.0, 3.0 } );
+    constexpr Mat3<double> I = identity3<double>();
+    static_assert( multiply( I, D )[1][1] == 2.0 );
+    static_assert( determinant( D ) == 6.0 );
+    static_assert( transpose( D )[2][2] == 3.0 );
+
+    Mat3<double> M         = { { { 0.0188205, 8.59E-03, 9.58E-03 },
+                                 { 0.0440222, 0.0166118, 0.0258734 },
+                                 { 0.1561591, 0.046321, 0.1181466 } } };
+    double M_Inverse[3][3] = { { -844.264597, 631.004958, -69.728531 },
+                               { 1282.403375, -803.858096, 72.055546 },
+                               { 613.114494, -518.860936, 72.376689 } };
+
+    Mat3<double> M_Inverse_test = invert( M );
+    for ( size_t i = 0; i < 3; i++ )
+        for ( size_t j = 0; j < 3; j++ )
+            OIIO_CHECK_EQUAL_THRESH(
+                M_Inverse_test[i][j], M_Inverse[i][j], 1e-5 );
+
+    // Compare against the vector-based functions.
+    Mat3<double> N = { { { 1.0, 2.0, 3.0 },
+                         { -4.0, 5.0, 6.0 },
+                         { 7.0, 8.0, -9.0 } } };
+    Vec3<double> v = { 0.5, -1.5, 2.5 };
+
+    auto MN     = multiply( M, N );
+    auto MN_vec = mulVector( to_vector( M ), transposeVec( to_vector( N ) ) );
+    auto Mv     = multiply( M, v );
+    auto Mv_vec = mulVector( to_vector( M ), to_vector( v ) );
+    auto vM     = multiply( v, M );
+    auto NT     = transpose( N );
+
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        OIIO_CHECK_EQUAL_THRESH( Mv[i], Mv_vec[i], 1e-12 );
+        OIIO_CHECK_EQUAL_THRESH(
+            vM[i], M[0][i] * v[0] + M[1][i] * v[1] + M[2][i] * v[2], 1e-12 );
+        for ( size_t j = 0; j < 3; j++ )
+        {
+            OIIO_CHECK_EQUAL_THRESH( MN[i][j], MN_vec[i][j], 1e-12 );
+            OIIO_CHECK_EQUAL( NT[i][j], N[j][i] );
+        }
+    }
+
+    auto NL = lerp( N, I, 0.25 );
+    OIIO_CHECK_EQUAL_THRESH( NL[0][0], 1.0, 1e-12 );
+    OIIO_CHECK_EQUAL_THRESH( NL[1][0], -3.0, 1e-12 );
+    OIIO_CHECK_EQUAL_THRESH( sum( N ), 19.0, 1e-12 );
+
+    // The conversions round-trip.
+    auto flat = to_flat_vector( N );
+    OIIO_CHECK_EQUAL( flat.size(), 9 );
+    OIIO_CHECK_EQUAL( flat[3], -4.0 );
+    OIIO_CHECK_ASSERT( to_Mat3( flat ) == N );
+    OIIO_CHECK_ASSERT( to_Mat3( to_vector( N ) ) == N );
+    OIIO_CHECK_ASSERT(
+        to_Vec3( to_vector( v ) ) == v );
+}
+
 int main( int, char ** )
 {
     test_IsSquare();
@@ -819,6 +881,7 @@ int main( int, char ** )
     testIDT_GetCAT();
     test_XYZtoLAB();
     test_GetCalcXYZt();
+    test_Mat3();
 
     return unit_test_failures;
 }
@@ -229,6 +229,216 @@ void testUninitializedTimer()
     timer.print( "uninitialized", "test" );
 }
 
+void testElapsed()
+{
+    UsageTimer timer;
+    OIIO_CHECK_EQUAL( timer.elapsed(), 0.0 );
+
+    timer.enabled = true;
+    timer.reset();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    OIIO_CHECK_GE( timer.elapsed(), 10.0 );
+}
+
+void testMetricsRecording()
+{
+    Metrics    metrics;
+    UsageTimer timer;
+    timer.metrics = &metrics;
+
+    // Timing is only printed when enabled, but always recorded.
+    timer.reset();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+    std::string output =
+        capture_stderr( [&]() { timer.print( "file1", "reading", "read" ); } );
+    OIIO_CHECK_ASSERT( output.empty() );
+
+    auto times = metrics.get_times( "file1" );
+    OIIO_CHECK_EQUAL( times.size(), 1 );
+    OIIO_CHECK_GE( times["read"], 5.0 );
+
+    // The plain print does not record.
+    timer.print( "file1", "writing" );
+    OIIO_CHECK_EQUAL( metrics.get_times( "file1" ).size(), 1 );
+    OIIO_CHECK_ASSERT( metrics.get_times( "missing" ).empty() );
+}
+
+void testMetricsHistogram()
+{
+    Metrics metrics;
+    metrics.add_time( "file1", "read", 0.5 );
+    metrics.add_time( "file1", "write", 20.0 );
+    metrics.add_time( "file2", "read", 3.0 );
+    metrics.add_time( "file2", "read", 4.0 );
+    metrics.add_time( "file2", "write", 100000.0 );
+
+    // Same stage of the same file accumulates.
+    OIIO_CHECK_EQUAL( metrics.get_times( "file2" )["read"], 7.0 );
+
+    auto read = metrics.get_histogram( "read" );
+    OIIO_CHECK_EQUAL( read.count, 2 );
+    OIIO_CHECK_EQUAL( read.sum, 7.5 );
+    OIIO_CHECK_EQUAL( read.min, 0.5 );
+    OIIO_CHECK_EQUAL( read.max, 7.0 );
+    OIIO_CHECK_EQUAL( read.buckets[0], 1 ); // <= 1
+    OIIO_CHECK_EQUAL( read.buckets[3], 1 ); // <= 10
+
+    auto write = metrics.get_histogram( "write" );
+    OIIO_CHECK_EQUAL( write.count, 2 );
+    OIIO_CHECK_EQUAL( write.buckets.back(), 1 ); // beyond the last bound
+
+    auto total = metrics.get_histogram( Metrics::total_stage );
+    OIIO_CHECK_EQUAL( total.count, 2 );
+    OIIO_CHECK_EQUAL( total.min, 20.5 );
+    OIIO_CHECK_EQUAL( total.max, 100007.0 );
+
+    OIIO_CHECK_EQUAL( metrics.get_histogram( "missing" ).count, 0 );
+
+    const Metrics::Labels a = { { "cache", "a" } };
+    const Metrics::Labels b = { { "cache", "b" } };
+    metrics.add_count( "cache_hits", a, 2 );
+    metrics.add_count( "cache_hits", a, 3 );
+    metrics.add_count( "cache_hits", b, 1 );
+    OIIO_CHECK_EQUAL( metrics.get_count( "cache_hits", a ), 5 );
+    OIIO_CHECK_EQUAL( metrics.get_count( "cache_hits", b ), 1 );
+    OIIO_CHECK_EQUAL( metrics.get_count( "cache_hits" ), 0 );
+
+    metrics.clear();
+    OIIO_CHECK_EQUAL( metrics.get_histogram( "read" ).count, 0 );
+    OIIO_CHECK_EQUAL( metrics.get_count( "cache_hits", a ), 0 );
+}
+
+void testMetricsExport()
+{
+    Metrics metrics;
+    metrics.add_time( "dir/\"file\".raw", "read", 2.0 );
+    metrics.add_time( "dir/\"file\".raw", "write", 3.0 );
+    metrics.add_count(
+        "cache_misses", { { "cache", "WB from illuminant" } }, 4 );
+
+    std::ostringstream json;
+    metrics.write_json_lines( json );
+    std::vector<std::string> expected_json = {
+        "{\"file\":\"dir/\\\"file\\\".raw\","
+        "\"stages\":{\"read\":2,\"write\":3}}",
+        "{\"stage\":\"read\",\"count\":1,\"sum\":2,\"min\":2,\"max\":2",
+        "{\"stage\":\"total\",\"count\":1,\"sum\":5",
+        "{\"le\":2.5,\"count\":1}",
+        "{\"le\":null,\"count\":0}",
+        "{\"counter\":\"cache_misses\",\"cache\":\"WB from illuminant\","
+        "\"value\":4}"
+    };
+    ASSERT_CONTAINS_ALL( json.str(), expected_json );
+
+    std::ostringstream prometheus;
+    metrics.write_prometheus( prometheus );
+    const std::string        name = "rawtoaces_stage_duration_milliseconds";
+    std::vector<std::string> expected_prometheus = {
+        "# TYPE " + name + " histogram",
+        name + "_bucket{stage=\"read\",le=\"1\"} 0",
+        name + "_bucket{stage=\"read\",le=\"2.5\"} 1",
+        name + "_bucket{stage=\"read\",le=\"+Inf\"} 1",
+        name + "_sum{stage=\"total\"} 5",
+        name + "_count{stage=\"write\"} 1",
+        "# TYPE rawtoaces_cache_misses_total counter",
+        "rawtoaces_cache_misses_total{cache=\"WB from illuminant\"} 4"
+    };
+    ASSERT_CONTAINS_ALL( prometheus.str(), expected_prometheus );
+}
+
+void testTracerSpans()
+{
+    Tracer tracer;
+
+    // Nothing gets recorded outside of a scope.
+    {
+        TraceSpan span( "ignored", "test" );
+    }
+    OIIO_CHECK_ASSERT( Tracer::current() == nullptr );
+
+    {
+        Tracer::Scope scope( &tracer, "file1" );
+        OIIO_CHECK_ASSERT( Tracer::current() == &tracer );
+        OIIO_CHECK_EQUAL( Tracer::current_file(), "file1" );
+
+        {
+            Tracer::Scope inner( nullptr, "file2" );
+            TraceSpan     span( "ignored", "test" );
+        }
+        OIIO_CHECK_EQUAL( Tracer::current_file(), "file1" );
+
+        TraceSpan span( "outer", "test" );
+        span.set_arg( "cache", "hit" );
+
+        // The usage timer records its stages into the tracer of the thread.
+        UsageTimer timer;
+        timer.reset();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+        timer.print( "file1", "reading", "read" );
+    }
+    OIIO_CHECK_ASSERT( Tracer::current() == nullptr );
+
+    auto spans = tracer.get_spans();
+    OIIO_CHECK_EQUAL( spans.size(), 2 );
+    if ( spans.size() != 2 )
+        return;
+
+    OIIO_CHECK_EQUAL( spans[0].name, "read" );
+    OIIO_CHECK_EQUAL( spans[0].category, "stage" );
+    OIIO_CHECK_EQUAL( spans[0].file, "file1" );
+    OIIO_CHECK_GE( spans[0].duration, 5000.0 );
+
+    OIIO_CHECK_EQUAL( spans[1].name, "outer" );
+    OIIO_CHECK_EQUAL( spans[1].file, "file1" );
+    OIIO_CHECK_EQUAL( spans[1].args.size(), 1 );
+    OIIO_CHECK_LE( spans[1].start, spans[0].start );
+    OIIO_CHECK_GE( spans[1].duration, spans[0].duration );
+    OIIO_CHECK_EQUAL( spans[1].thread, Tracer::thread_id() );
+
+    // Every thread gets an id of its own.
+    uint64_t    other_id = 0;
+    std::thread thread( [&]() {
+        Tracer::Scope scope( &tracer, "file2" );
+        TraceSpan     span( "other", "test" );
+        other_id = Tracer::thread_id();
+    } );
+    thread.join();
+    OIIO_CHECK_NE( other_id, Tracer::thread_id() );
+
+    spans = tracer.get_spans();
+    OIIO_CHECK_EQUAL( spans.size(), 3 );
+    if ( spans.size() == 3 )
+        OIIO_CHECK_EQUAL( spans[2].thread, other_id );
+
+    tracer.clear();
+    OIIO_CHECK_ASSERT( tracer.get_spans().empty() );
+}
+
+void testTracerExport()
+{
+    Tracer       tracer;
+    Tracer::Span span;
+    span.name     = "read";
+    span.category = "stage";
+    span.file     = "dir/\"file\".raw";
+    span.thread   = 2;
+    span.start    = 10.0;
+    span.duration = 2.5;
+    span.args     = { { "cache", "miss" } };
+    tracer.add( span );
+
+    std::ostringstream json;
+    tracer.write_json( json );
+    std::vector<std::string> expected = {
+        "{\"traceEvents\":[",
+        "{\"name\":\"read\",\"cat\":\"stage\",\"ph\":\"X\","
+        "\"ts\":10.000,\"dur\":2.500,\"pid\":1,\"tid\":2,"
+        "\"args\":{\"file\":\"dir/\\\"file\\\".raw\",\"cache\":\"miss\"}}",
+        "],\"displayTimeUnit\":\"ms\"}"
+    };
+    ASSERT_CONTAINS_ALL( json.str(), expected );
+}
+
 int main( int, char ** )
 {
     testDefaultConstruction();
@@ -243,6 +453,12 @@ int main( int, char ** )
     testMultipleIndependentInstances();
     testTimingAccuracy();
     testUninitializedTimer();
+    testElapsed();
+    testMetricsRecording();
+    testMetricsHistogram();
+    testMetricsExport();
+    testTracerSpans();
+    testTracerExport();
 
     return unit_test_failures;
 }
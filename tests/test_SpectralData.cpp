@@ -547,6 +547,54 @@ void testSpectralData_Max()
     OIIO_CHECK_EQUAL( max_value_non_empty, 15.0 );
 }
 
+void testSpectralData_MultiplyIntegrate()
+{
+    /// Check both the reference shape, and an odd number of samples
+    /// exercising the remainder loops of the kernels.
+    for ( const auto &shape: { rta::core::Spectrum::ReferenceShape,
+                               rta::core::Spectrum::Shape{ 20, 80, 10 } } )
+    {
+        rta::core::Spectrum              spectrum1( 0, shape );
+        rta::core::Spectrum              spectrum2( 0, shape );
+        rta::core::Spectrum              spectrum3( 0, shape );
+        std::vector<rta::core::Spectrum> spectra( 5, spectrum1 );
+
+        for ( size_t i = 0; i < spectrum1.values.size(); i++ )
+        {
+            spectrum1.values[i] = 0.5 + 0.01 * i;
+            spectrum2.values[i] = 2.0 - 0.02 * i;
+            spectrum3.values[i] = 0.1 * ( i % 7 );
+            for ( size_t j = 0; j < spectra.size(); j++ )
+                spectra[j].values[i] = 1.0 / ( i + j + 1 );
+        }
+
+        OIIO_CHECK_EQUAL_THRESH(
+            rta::core::multiply_integrate( spectrum1, spectrum2 ),
+            ( spectrum1 * spectrum2 ).integrate(),
+            1e-12 );
+
+        std::vector<std::array<double, 3>> result;
+        rta::core::multiply_integrate(
+            spectra, spectrum1, spectrum2, spectrum3, result );
+        OIIO_CHECK_EQUAL( result.size(), spectra.size() );
+        for ( size_t j = 0; j < spectra.size(); j++ )
+        {
+            OIIO_CHECK_EQUAL_THRESH(
+                result[j][0], ( spectra[j] * spectrum1 ).integrate(), 1e-12 );
+            OIIO_CHECK_EQUAL_THRESH(
+                result[j][1], ( spectra[j] * spectrum2 ).integrate(), 1e-12 );
+            OIIO_CHECK_EQUAL_THRESH(
+                result[j][2], ( spectra[j] * spectrum3 ).integrate(), 1e-12 );
+        }
+
+        // The storage of the result gets reused.
+        const double *storage = result[0].data();
+        rta::core::multiply_integrate(
+            spectra, spectrum1, spectrum2, spectrum3, result );
+        OIIO_CHECK_EQUAL( result[0].data(), storage );
+    }
+}
+
 void testSpectralData_LoadFileNotFound()
 {
     /// Test load() function with a non-existent file
@@ -630,6 +678,58 @@ void testSpectralData_LoadJsonTypeError()
     ASSERT_CONTAINS( stderr_output, "type_error" );
 }
 
+void testSpectralData_LoadHeader()
+{
+    TestDirectory test_dir;
+    std::string   path = test_dir.create_test_data_file(
+        "camera",
+        { { "schema_version", "1.0.0" },
+          { "manufacturer", "Make" },
+          { "model", "Model" },
+          { "document_creation_date", "2025-01-01" } } );
+
+    rta::core::SpectralData full;
+    OIIO_CHECK_ASSERT( full.load( path ) );
+
+    rta::core::SpectralData data;
+    init_SpectralData( data );
+    OIIO_CHECK_ASSERT( data.load_header( path ) );
+    OIIO_CHECK_EQUAL( data.manufacturer, "Make" );
+    OIIO_CHECK_EQUAL( data.model, "Model" );
+    OIIO_CHECK_EQUAL( data.creation_date, "2025-01-01" );
+    OIIO_CHECK_EQUAL( data.type, full.type );
+    OIIO_CHECK_EQUAL( data.units, "" );
+    OIIO_CHECK_EQUAL( data.data.size(), 0 );
+
+    // The parsing stops at the end of the header.
+    TestFile truncated( test_dir.path(), "truncated.json" );
+    truncated.write(
+        "{ \"header\": { \"manufacturer\": \"Make\", \"model\": "
+        "{ \"nested\": \"value\" }, \"type\": \"Type\" },"
+        " \"spectral_data\": { invalid" );
+    OIIO_CHECK_ASSERT( data.load_header( truncated.path() ) );
+    OIIO_CHECK_EQUAL( data.manufacturer, "Make" );
+    OIIO_CHECK_EQUAL( data.model, "" );
+    OIIO_CHECK_EQUAL( data.type, "Type" );
+
+    // The version 0.1.0 illuminant files store the type under 'illuminant'.
+    TestFile legacy( test_dir.path(), "legacy.json" );
+    legacy.write(
+        "{ \"header\": { \"schema_version\": \"0.1.0\", "
+        "\"illuminant\": \"Legacy\" } }" );
+    OIIO_CHECK_ASSERT( data.load_header( legacy.path() ) );
+    OIIO_CHECK_EQUAL( data.type, "Legacy" );
+
+    TestFile invalid( test_dir.path(), "invalid.json" );
+    invalid.write( "{ \"header\": { invalid" );
+    std::string stderr_output = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !data.load_header( invalid.path() ) );
+    } );
+    ASSERT_CONTAINS(
+        stderr_output,
+        "Error: JSON parsing of " + invalid.path() + " failed with error:" );
+}
+
 void testSpectralData_GetUnknownSetThrows()
 {
     rta::core::SpectralData data;
@@ -675,10 +775,12 @@ int main( int, char ** )
     testSpectralData_ReshapeInterpolation();
     testSpectralData_ReshapeBeforeSourceRange();
     testSpectralData_Max();
+    testSpectralData_MultiplyIntegrate();
     testSpectralData_LoadFileNotFound();
     testSpectralData_LoadInconsistentWavelengthStep();
     testSpectralData_LoadInvalidJson();
     testSpectralData_LoadJsonTypeError();
+    testSpectralData_LoadHeader();
     testSpectralData_GetUnknownSetThrows();
     testSpectralData_GetUnknownChannelThrows();
 
@@ -8,19 +8,33 @@
 #endif
 
 #include "../src/rawtoaces_util/rawtoaces_util_priv.h"
+#include "../src/rawtoaces_util/job_manifest.h"
+#include "../src/rawtoaces_util/pixel_kernels.h"
+#include "../src/rawtoaces_util/gpu_transform.h"
+#include "../src/rawtoaces_util/raw_reader.h"
+#include "../src/rawtoaces_util/buffer_pool.h"
+#include "../src/rawtoaces_util/transform_cache.h"
 
 // must be before <OpenImageIO/unittest.h>
 #include <rawtoaces/image_converter.h>
+#include <rawtoaces/batch_converter.h>
+#include <rawtoaces/conversion_server.h>
 #include <rawtoaces/rawtoaces_core.h>
 
+#include <OpenImageIO/half.h>
+#include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/unittest.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <nlohmann/json.hpp>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <vector>
+#include <cstring>
 #include <ctime>
 #include <algorithm>
 
@@ -183,8 +197,7 @@ void assert_success_conversion( const std::string &output )
     ASSERT_CONTAINS( output, "Input Device Transform (IDT) matrix" );
 
     // Assert that image processing steps occurred
-    ASSERT_CONTAINS( output, "Applying transform matrix" );
-    ASSERT_CONTAINS( output, "Applying scale" );
+    ASSERT_CONTAINS( output, "Applying transform matrix and scale" );
     ASSERT_CONTAINS( output, "Applying crop" );
 
     // Assert that the correct input and output files were processed
@@ -398,6 +411,81 @@ void test_collect_image_files_mixed_valid_invalid_paths()
     OIIO_CHECK_EQUAL( batches[1].size(), 1 );
 }
 
+/// Verifies that collect_image_files descends into the subdirectories when
+/// scanning recursively, adding their files to the batch of the input
+/// directory in sorted order
+void test_collect_image_files_recursive()
+{
+    std::cout << std::endl
+              << "test_collect_image_files_recursive()" << std::endl;
+    TestDirectory test_dir;
+    test_dir.create_test_files();
+    std::filesystem::create_directories( test_dir.path() + "/subdir/nested" );
+    std::ofstream( test_dir.path() + "/subdir/nested/test9.nef" ).close();
+    std::ofstream( test_dir.path() + "/subdir/nested/test9.jpg" ).close();
+
+    std::vector<std::string>              paths = { test_dir.path() };
+    std::vector<std::vector<std::string>> batches =
+        collect_image_files( paths, true, 4 );
+
+    OIIO_CHECK_EQUAL( batches.size(), 2 );
+    OIIO_CHECK_EQUAL( batches[0].size(), 0 );
+    OIIO_CHECK_EQUAL( batches[1].size(), 7 );
+    OIIO_CHECK_ASSERT(
+        std::is_sorted( batches[1].begin(), batches[1].end() ) );
+
+    const std::filesystem::path root = test_dir.path();
+    for ( const auto &expected:
+          { root / "test1.raw",
+            root / "symlink.raw",
+            root / "subdir" / "test8.raw",
+            root / "subdir" / "nested" / "test9.nef" } )
+    {
+        OIIO_CHECK_EQUAL(
+            std::count(
+                batches[1].begin(), batches[1].end(), expected.string() ),
+            1 );
+    }
+
+    // Not recursive by default.
+    batches = collect_image_files( paths );
+    OIIO_CHECK_EQUAL( batches[1].size(), 5 );
+}
+
+/// Verifies that scan_image_files reports every file with the index of its
+/// batch while listing the directories on several threads
+void test_scan_image_files_callback()
+{
+    std::cout << std::endl
+              << "test_scan_image_files_callback()" << std::endl;
+    TestDirectory test_dir1;
+    TestDirectory test_dir2;
+    for ( int i = 0; i < 8; i++ )
+    {
+        const std::string subdir =
+            test_dir1.path() + "/dir" + std::to_string( i );
+        std::filesystem::create_directories( subdir );
+        std::ofstream( subdir + "/file.raw" ).close();
+        std::ofstream( subdir + "/file.txt" ).close();
+    }
+    test_dir2.create_valid_files( { "file1.dng", "file2.dng" } );
+
+    const std::string single_file = test_dir2.path() + "/file1.dng";
+
+    std::map<size_t, size_t> counts;
+    size_t                   batch_count = scan_image_files(
+        { test_dir1.path(), single_file, test_dir2.path() },
+        [&counts]( size_t batch, const std::string & ) { counts[batch]++; },
+        true,
+        3 );
+
+    OIIO_CHECK_EQUAL( batch_count, 3 );
+    OIIO_CHECK_EQUAL( counts.size(), 3 );
+    OIIO_CHECK_EQUAL( counts[0], 1 );
+    OIIO_CHECK_EQUAL( counts[1], 8 );
+    OIIO_CHECK_EQUAL( counts[2], 2 );
+}
+
 /// Tests parsing of RAW extensions from a mixed OIIO extension list
 void test_parse_raw_extensions()
 {
@@ -780,6 +868,50 @@ void test_parse_parameters_list_illuminants( bool use_dir_path_arg = false )
     OIIO_CHECK_EQUAL( lines[3], "my-illuminant" );
 }
 
+/// This test verifies that the camera listing is cached until the database
+/// directory changes
+void test_get_supported_cameras_cached()
+{
+    std::cout << std::endl << "test_get_supported_cameras_cached()" << std::endl;
+
+    TestDirectory test_dir;
+    std::string   camera_path = test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "First" } } );
+    std::filesystem::path camera_dir =
+        std::filesystem::path( camera_path ).parent_path();
+
+    rta::util::ImageConverter converter;
+    converter.settings.database_directories = { test_dir.get_database_path() };
+
+    auto cameras = converter.get_supported_cameras();
+    OIIO_CHECK_EQUAL( cameras.size(), 1 );
+    OIIO_CHECK_EQUAL( cameras[0], "Make / First" );
+
+    // The file modified in place is not noticed while the directory stays
+    // unchanged.
+    auto time = std::filesystem::last_write_time( camera_dir );
+    {
+        std::ofstream file( camera_path );
+        file << "{ invalid json";
+    }
+    std::filesystem::last_write_time( camera_dir, time );
+    OIIO_CHECK_ASSERT( converter.get_supported_cameras() == cameras );
+
+    // Adding a file invalidates the listing. The directory time gets set
+    // explicitly, as the file system timestamps may be coarser than the
+    // duration of the test.
+    test_dir.create_test_data_file(
+        "camera", { { "manufacturer", "Make" }, { "model", "Second" } } );
+    std::filesystem::last_write_time(
+        camera_dir, time + std::chrono::seconds( 1 ) );
+
+    std::string output = capture_stderr(
+        [&]() { cameras = converter.get_supported_cameras(); } );
+    ASSERT_CONTAINS( output, "Error: JSON parsing of " + camera_path );
+    OIIO_CHECK_EQUAL( cameras.size(), 1 );
+    OIIO_CHECK_EQUAL( cameras[0], "Make / Second" );
+}
+
 /// Tests that prepare_transform_spectral fails when no camera manufacturer information is available (should fail)
 void test_missing_camera_manufacturer()
 {
@@ -1305,7 +1437,7 @@ void test_all_illuminants_skips_invalid_files()
     bool found = solver.find_camera( "Blackmagic", "Cinema Camera" );
     OIIO_CHECK_ASSERT( found );
 
-    // Call find_illuminant with WB to trigger _all_illuminants population
+    // Call find_illuminant with WB to trigger the illuminant bank population
     std::vector<double> wb = { 1.5, 1.0, 1.2 };
 
     bool        success;
@@ -1314,7 +1446,7 @@ void test_all_illuminants_skips_invalid_files()
         success = solver.find_illuminant( wb );
     } );
 
-    // Should succeed (invalid file should be skipped during _all_illuminants population)
+    // Should succeed (invalid file should be skipped when building the illuminant bank)
     OIIO_CHECK_ASSERT( success );
 
     // Assert on expected message
@@ -2154,6 +2286,2196 @@ void test_main_no_files_processed()
     ASSERT_NOT_CONTAINS( output, "Processing file" );
 }
 
+/// Tests that with --continue-on-error all files get processed after a
+/// failure, and the failures get summarised
+void test_main_continue_on_error()
+{
+    std::cout << std::endl << "test_main_continue_on_error()" << std::endl;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "broken1.dng", "broken2.dng" } );
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .mat_method( "metadata" )
+                    .arg( "--jobs 2" )
+                    .arg( "--continue-on-error" )
+                    .input( test_dir.path() )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS( output, "[1/2] Processing file" );
+    ASSERT_CONTAINS( output, "[2/2] Processing file" );
+    ASSERT_CONTAINS( output, "Failed on file [1/2]" );
+    ASSERT_CONTAINS( output, "Failed on file [2/2]" );
+    ASSERT_CONTAINS( output, "2 of 2 files failed to convert." );
+}
+
+/// Tests that the processing stops at the first failure by default
+void test_main_stop_on_error()
+{
+    std::cout << std::endl << "test_main_stop_on_error()" << std::endl;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "broken1.dng", "broken2.dng" } );
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .mat_method( "metadata" )
+                    .input( test_dir.path() )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS( output, "[1/2] Processing file" );
+    ASSERT_CONTAINS( output, "Failed on file [1/2]" );
+    ASSERT_NOT_CONTAINS( output, "[2/2] Processing file" );
+}
+
+/// Tests that an invalid number of jobs gets rejected
+void test_main_invalid_jobs()
+{
+    std::cout << std::endl << "test_main_invalid_jobs()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--jobs 0" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS(
+        output, "The number of jobs must be a positive integer, got 0." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that a negative number of threads gets rejected
+void test_main_invalid_threads()
+{
+    std::cout << std::endl << "test_main_invalid_threads()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--threads -1" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS(
+        output, "The number of threads must not be negative, got -1." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that the hardware threads get split between the concurrent jobs
+/// unless the number of threads is given
+void test_conversion_threads()
+{
+    std::cout << std::endl << "test_conversion_threads()" << std::endl;
+
+    const int hardware_threads =
+        std::max( static_cast<int>( std::thread::hardware_concurrency() ), 1 );
+
+    ImageConverter::Settings settings;
+    OIIO_CHECK_EQUAL( conversion_threads( settings ), hardware_threads );
+
+    settings.jobs = 2;
+    OIIO_CHECK_EQUAL(
+        conversion_threads( settings ), std::max( hardware_threads / 2, 1 ) );
+
+    settings.jobs = hardware_threads * 4;
+    OIIO_CHECK_EQUAL( conversion_threads( settings ), 1 );
+
+    settings.threads = 3;
+    OIIO_CHECK_EQUAL( conversion_threads( settings ), 3 );
+}
+
+/// Tests that an invalid shard gets rejected
+void test_main_invalid_shard()
+{
+    std::cout << std::endl << "test_main_invalid_shard()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--shard 4/4" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS(
+        output,
+        "The shard must be given as I/N, with I from 0 to N-1, got '4/4'." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that the shards partition the files deterministically, and that
+/// the shard files get named after the shard
+void test_select_shard()
+{
+    std::cout << std::endl << "test_select_shard()" << std::endl;
+
+    std::vector<std::string> files;
+    for ( int i = 0; i < 100; i++ )
+        files.push_back( "/data/card/frame_" + std::to_string( i ) + ".dng" );
+
+    std::set<std::string> all_files;
+    for ( size_t index = 0; index < 4; index++ )
+    {
+        auto shard = rta::util::select_shard( files, index, 4 );
+        OIIO_CHECK_ASSERT( !shard.empty() );
+        OIIO_CHECK_ASSERT(
+            shard == rta::util::select_shard( files, index, 4 ) );
+        for ( const auto &file: shard )
+            OIIO_CHECK_ASSERT( all_files.insert( file ).second );
+    }
+    OIIO_CHECK_EQUAL( all_files.size(), files.size() );
+    OIIO_CHECK_ASSERT( rta::util::select_shard( files, 0, 1 ) == files );
+
+    // A file keeps its shard when other files get added.
+    auto shard = rta::util::select_shard( files, 2, 4 );
+    files.push_back( "/data/card/extra.dng" );
+    auto grown = rta::util::select_shard( files, 2, 4 );
+    for ( const auto &file: shard )
+        OIIO_CHECK_EQUAL( std::count( grown.begin(), grown.end(), file ), 1 );
+
+    OIIO_CHECK_EQUAL(
+        rta::util::shard_filename( "metrics.prom", 1, 4 ),
+        "metrics.shard-1-of-4.prom" );
+    OIIO_CHECK_EQUAL(
+        rta::util::shard_filename( "manifest", 0, 2 ),
+        "manifest.shard-0-of-2" );
+    OIIO_CHECK_EQUAL(
+        rta::util::shard_filename( "metrics.prom", 0, 1 ), "metrics.prom" );
+}
+
+/// Tests that the batch converter only converts the files of its shard, and
+/// writes the summary of the shard into a metrics file of its own
+void test_batch_converter_shard_metrics()
+{
+    std::cout << std::endl
+              << "test_batch_converter_shard_metrics()" << std::endl;
+
+    TestDirectory test_dir;
+
+    std::vector<std::string> files;
+    for ( int i = 0; i < 8; i++ )
+    {
+        files.push_back( test_dir.path() + "/" + std::to_string( i ) + ".dng" );
+        std::ofstream( files.back() ).close();
+    }
+    const auto shard = rta::util::select_shard( files, 1, 2 );
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.shard_index       = 1;
+    batch_converter.settings.shard_count       = 2;
+    batch_converter.settings.continue_on_error = true;
+    batch_converter.settings.metrics_file = test_dir.path() + "/metrics.prom";
+
+    bool result = true;
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+    OIIO_CHECK_ASSERT( !result );
+
+    const auto &results = batch_converter.get_results();
+    OIIO_CHECK_EQUAL( results.size(), shard.size() );
+    for ( size_t i = 0; i < results.size(); i++ )
+        OIIO_CHECK_EQUAL( results[i].input_filename, shard[i] );
+
+    OIIO_CHECK_ASSERT(
+        !std::filesystem::exists( batch_converter.settings.metrics_file ) );
+    std::ifstream     file( test_dir.path() + "/metrics.shard-1-of-2.prom" );
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    std::vector<std::string> expected = {
+        "rawtoaces_shard_files_total{shard=\"1/2\"} " +
+            std::to_string( shard.size() ),
+        "rawtoaces_shard_failed_files_total{shard=\"1/2\"} " +
+            std::to_string( shard.size() ),
+        "rawtoaces_shard_converted_files_total{shard=\"1/2\"} 0",
+        "rawtoaces_shard_wall_time_milliseconds_total{shard=\"1/2\"}"
+    };
+    ASSERT_CONTAINS_ALL( buffer.str(), expected );
+
+    // An out of range shard converts nothing.
+    batch_converter.settings.shard_index = 2;
+    std::string output                   = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !batch_converter.process( files ) );
+    } );
+    ASSERT_CONTAINS( output, "ERROR: Invalid shard 2/2." );
+}
+
+/// Tests that the batch converter reports all results in the input order
+/// when converting concurrently
+void test_batch_converter_results_in_order()
+{
+    std::cout << std::endl
+              << "test_batch_converter_results_in_order()" << std::endl;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "a.dng", "b.dng", "c.dng", "d.dng" } );
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng", "c.dng", "d.dng" } )
+        files.push_back( test_dir.path() + "/" + name );
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.jobs              = 3;
+    batch_converter.settings.continue_on_error = true;
+
+    std::vector<size_t> started;
+    std::vector<size_t> finished;
+    batch_converter.on_file_started =
+        [&]( size_t index, size_t total, const rta::util::BatchResult & ) {
+            OIIO_CHECK_EQUAL( total, 4 );
+            started.push_back( index );
+        };
+    batch_converter.on_file_finished =
+        [&]( size_t index, size_t, const rta::util::BatchResult & ) {
+            finished.push_back( index );
+        };
+
+    bool result = true;
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+
+    OIIO_CHECK_ASSERT( !result );
+    OIIO_CHECK_EQUAL( started.size(), 4 );
+    OIIO_CHECK_EQUAL( finished.size(), 4 );
+
+    const auto &results = batch_converter.get_results();
+    OIIO_CHECK_EQUAL( results.size(), 4 );
+    for ( size_t i = 0; i < results.size(); i++ )
+    {
+        OIIO_CHECK_EQUAL( started[i], i );
+        OIIO_CHECK_EQUAL( finished[i], i );
+        OIIO_CHECK_EQUAL( results[i].input_filename, files[i] );
+        OIIO_CHECK_ASSERT( !results[i].success );
+        OIIO_CHECK_ASSERT( !results[i].skipped );
+        OIIO_CHECK_ASSERT( results[i].IDT_matrix.empty() );
+    }
+}
+
+/// Tests that the batch converter skips the remaining files after a failure
+/// when `continue_on_error` is not set
+void test_batch_converter_stops_on_error()
+{
+    std::cout << std::endl
+              << "test_batch_converter_stops_on_error()" << std::endl;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "a.dng", "b.dng", "c.dng" } );
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng", "c.dng" } )
+        files.push_back( test_dir.path() + "/" + name );
+
+    rta::util::BatchConverter batch_converter;
+
+    size_t reported = 0;
+    batch_converter.on_file_finished =
+        [&]( size_t, size_t, const rta::util::BatchResult & ) {
+            reported++;
+        };
+
+    bool result = true;
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+
+    OIIO_CHECK_ASSERT( !result );
+    OIIO_CHECK_EQUAL( reported, 1 );
+
+    const auto &results = batch_converter.get_results();
+    OIIO_CHECK_EQUAL( results.size(), 3 );
+    OIIO_CHECK_ASSERT( !results[0].success );
+    OIIO_CHECK_ASSERT( !results[0].skipped );
+    OIIO_CHECK_ASSERT( results[1].skipped );
+    OIIO_CHECK_ASSERT( results[2].skipped );
+
+    // An empty batch succeeds without reporting anything.
+    reported = 0;
+    OIIO_CHECK_ASSERT( batch_converter.process( {} ) );
+    OIIO_CHECK_EQUAL( reported, 0 );
+    OIIO_CHECK_ASSERT( batch_converter.get_results().empty() );
+}
+
+/// Tests that the pipelined batch converter reports the results in order,
+/// and skips the remaining files after a failure when `continue_on_error` is
+/// not set
+void test_batch_converter_pipeline_errors()
+{
+    std::cout << std::endl
+              << "test_batch_converter_pipeline_errors()" << std::endl;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "a.dng", "b.dng", "c.dng", "d.dng" } );
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng", "c.dng", "d.dng" } )
+        files.push_back( test_dir.path() + "/" + name );
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.pipeline_depth    = 2;
+    batch_converter.settings.continue_on_error = true;
+
+    std::vector<size_t> finished;
+    batch_converter.on_file_finished =
+        [&]( size_t index, size_t total, const rta::util::BatchResult & ) {
+            OIIO_CHECK_EQUAL( total, 4 );
+            finished.push_back( index );
+        };
+
+    bool result = true;
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+
+    OIIO_CHECK_ASSERT( !result );
+    OIIO_CHECK_EQUAL( finished.size(), 4 );
+    for ( size_t i = 0; i < finished.size(); i++ )
+    {
+        OIIO_CHECK_EQUAL( finished[i], i );
+        OIIO_CHECK_ASSERT( !batch_converter.get_results()[i].success );
+        OIIO_CHECK_ASSERT( !batch_converter.get_results()[i].skipped );
+    }
+
+    batch_converter.settings.continue_on_error = false;
+    finished.clear();
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+
+    OIIO_CHECK_ASSERT( !result );
+    OIIO_CHECK_EQUAL( finished.size(), 1 );
+
+    const auto &results = batch_converter.get_results();
+    OIIO_CHECK_EQUAL( results.size(), 4 );
+    OIIO_CHECK_ASSERT( !results[0].success );
+    OIIO_CHECK_ASSERT( !results[0].skipped );
+    for ( size_t i = 1; i < results.size(); i++ )
+        OIIO_CHECK_ASSERT( results[i].skipped );
+}
+
+/// Tests that the pipelined batch converter writes all files and records
+/// their transforms
+void test_batch_converter_pipeline_success()
+{
+    std::cout << std::endl
+              << "test_batch_converter_pipeline_success()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng", "c.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.WB_method =
+        ImageConverter::Settings::WBMethod::Metadata;
+    batch_converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    batch_converter.settings.pipeline_depth = 1;
+
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+
+    for ( const auto &result: batch_converter.get_results() )
+    {
+        OIIO_CHECK_ASSERT( result.success );
+        OIIO_CHECK_ASSERT( !result.IDT_matrix.empty() );
+
+        std::string output_path = result.input_filename;
+        output_path.replace( output_path.size() - 4, 4, "_aces.exr" );
+        OIIO_CHECK_ASSERT( std::filesystem::exists( output_path ) );
+    }
+}
+
+/// Tests that the batch converter records the stage timings of every file
+/// and writes them into the metrics file at the end of the batch
+void test_batch_converter_metrics()
+{
+    std::cout << std::endl << "test_batch_converter_metrics()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    const std::string metrics_path = test_dir.path() + "/metrics.prom";
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.WB_method =
+        ImageConverter::Settings::WBMethod::Metadata;
+    batch_converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    batch_converter.settings.jobs         = 2;
+    batch_converter.settings.metrics_file = metrics_path;
+
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+    OIIO_CHECK_ASSERT( batch_converter.metrics != nullptr );
+    if ( !batch_converter.metrics )
+        return;
+
+    const std::vector<std::string> stages = {
+        "configure", "read", "transform", "crop", "write"
+    };
+    for ( const auto &result: batch_converter.get_results() )
+    {
+        auto times =
+            batch_converter.metrics->get_times( result.input_filename );
+        for ( const auto &stage: stages )
+            OIIO_CHECK_EQUAL( times.count( stage ), 1 );
+        OIIO_CHECK_ASSERT( result.stage_times == times );
+    }
+
+    auto total = batch_converter.metrics->get_histogram(
+        rta::util::Metrics::total_stage );
+    OIIO_CHECK_EQUAL( total.count, files.size() );
+
+    std::ifstream     file( metrics_path );
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    std::vector<std::string> expected = {
+        "rawtoaces_stage_duration_milliseconds_count{stage=\"read\"} 2",
+        "rawtoaces_stage_duration_milliseconds_count{stage=\"total\"} 2",
+        "rawtoaces_cache_hits_total{cache=\"matrix from DNG metadata\"}",
+        "rawtoaces_cache_misses_total{cache=\"matrix from DNG metadata\"}"
+    };
+    ASSERT_CONTAINS_ALL( buffer.str(), expected );
+}
+
+/// Tests that the batch converter records the spans of the stages of every
+/// file, including the cache lookups, and writes them into the trace file at
+/// the end of the batch
+void test_batch_converter_trace()
+{
+    std::cout << std::endl << "test_batch_converter_trace()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    const std::string trace_path = test_dir.path() + "/trace.json";
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.WB_method =
+        ImageConverter::Settings::WBMethod::Metadata;
+    batch_converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    batch_converter.settings.jobs       = 2;
+    batch_converter.settings.trace_file = trace_path;
+
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+    OIIO_CHECK_ASSERT( batch_converter.tracer != nullptr );
+    if ( !batch_converter.tracer )
+        return;
+
+    const std::vector<std::string> stages = {
+        "process_image", "configure",  "prepare_transform_DNG",
+        "read",          "transform",  "crop",
+        "write",         "fetch_matrix_from_metadata"
+    };
+    for ( const auto &file: files )
+    {
+        std::set<std::string> names;
+        for ( const auto &span: batch_converter.tracer->get_spans() )
+        {
+            if ( span.file != file )
+                continue;
+
+            names.insert( span.name );
+            if ( span.category == "cache" )
+            {
+                OIIO_CHECK_EQUAL( span.args.size(), 1 );
+                OIIO_CHECK_EQUAL( span.args[0].first, "cache" );
+            }
+        }
+        for ( const auto &stage: stages )
+            OIIO_CHECK_EQUAL( names.count( stage ), 1 );
+    }
+
+    std::ifstream file( trace_path );
+    auto          trace = nlohmann::json::parse( file, nullptr, false );
+    OIIO_CHECK_ASSERT( !trace.is_discarded() );
+    if ( trace.is_discarded() )
+        return;
+
+    const auto &events = trace["traceEvents"];
+    OIIO_CHECK_EQUAL(
+        events.size(), batch_converter.tracer->get_spans().size() );
+    for ( const auto &event: events )
+    {
+        OIIO_CHECK_EQUAL( event["ph"], "X" );
+        OIIO_CHECK_ASSERT( event["args"].contains( "file" ) );
+        OIIO_CHECK_ASSERT( event["dur"].get<double>() >= 0.0 );
+    }
+}
+
+/// Tests that the job manifest records the outcome of every file, and that
+/// the entries get looked up by the input path, the input file state and
+/// the settings signature
+void test_job_manifest()
+{
+    std::cout << std::endl << "test_job_manifest()" << std::endl;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "a.dng", "b.dng", "a_aces.exr" } );
+
+    const std::string manifest_path = test_dir.path() + "/manifest.txt";
+    const std::string input_a       = test_dir.path() + "/a.dng";
+    const std::string input_b       = test_dir.path() + "/b.dng";
+    const std::string output_a      = test_dir.path() + "/a_aces.exr";
+    const std::string output_b      = test_dir.path() + "/b_aces.exr";
+
+    {
+        rta::util::JobManifest manifest;
+        OIIO_CHECK_ASSERT( manifest.open( manifest_path ) );
+        OIIO_CHECK_ASSERT( manifest.record( input_a, "sig", output_a, true ) );
+        OIIO_CHECK_ASSERT(
+            manifest.record( input_b, "sig", output_b, false ) );
+        OIIO_CHECK_ASSERT( !manifest.record(
+            test_dir.path() + "/missing.dng", "sig", output_b, true ) );
+    }
+
+    // Simulate a batch killed while writing an entry.
+    std::ofstream( manifest_path, std::ios::app ) << "done\tsig\t0";
+
+    rta::util::JobManifest manifest;
+    OIIO_CHECK_ASSERT( manifest.open( manifest_path ) );
+    OIIO_CHECK_EQUAL( manifest.size(), 2 );
+
+    std::string output;
+    OIIO_CHECK_ASSERT( manifest.is_up_to_date( input_a, "sig", output ) );
+    OIIO_CHECK_EQUAL( output, output_a );
+    OIIO_CHECK_ASSERT( !manifest.is_up_to_date( input_a, "other", output ) );
+    OIIO_CHECK_ASSERT( !manifest.is_up_to_date( input_b, "sig", output ) );
+
+    // The relative path of the same file finds the same entry.
+    const std::string relative_a =
+        std::filesystem::relative( input_a ).string();
+    OIIO_CHECK_ASSERT( manifest.is_up_to_date( relative_a, "sig", output ) );
+
+    // A modified input is out of date.
+    std::ofstream( input_a ) << "modified";
+    OIIO_CHECK_ASSERT( !manifest.is_up_to_date( input_a, "sig", output ) );
+
+    // The entries appended after the incomplete line win.
+    OIIO_CHECK_ASSERT( manifest.record( input_a, "sig", output_a, true ) );
+    OIIO_CHECK_ASSERT( manifest.is_up_to_date( input_a, "sig", output ) );
+    {
+        rta::util::JobManifest reopened;
+        OIIO_CHECK_ASSERT( reopened.open( manifest_path ) );
+        OIIO_CHECK_ASSERT( reopened.is_up_to_date( input_a, "sig", output ) );
+
+        // A missing output is out of date.
+        std::filesystem::remove( output_a );
+        OIIO_CHECK_ASSERT(
+            !reopened.is_up_to_date( input_a, "sig", output ) );
+    }
+
+    // Only the settings affecting the output change the signature.
+    ImageConverter::Settings settings;
+    const std::string        signature = settings_signature( settings );
+    settings.jobs                      = 4;
+    settings.pipeline_depth            = 2;
+    OIIO_CHECK_EQUAL( settings_signature( settings ), signature );
+    settings.scale = 2.0f;
+    OIIO_CHECK_NE( settings_signature( settings ), signature );
+}
+
+/// Tests that a batch converted with a job manifest skips the files up to
+/// date on the next run, and converts the changed files again
+void test_batch_converter_manifest()
+{
+    std::cout << std::endl << "test_batch_converter_manifest()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings.WB_method =
+        ImageConverter::Settings::WBMethod::Metadata;
+    batch_converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    batch_converter.settings.manifest_file = test_dir.path() + "/manifest";
+    batch_converter.settings.overwrite     = true;
+    batch_converter.settings.jobs          = 2;
+
+    size_t reported                 = 0;
+    batch_converter.on_file_started = [&]( size_t, size_t, const auto & ) {
+        reported++;
+    };
+
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+    OIIO_CHECK_EQUAL( reported, 2 );
+    for ( const auto &result: batch_converter.get_results() )
+    {
+        OIIO_CHECK_ASSERT( result.success );
+        OIIO_CHECK_ASSERT( !result.up_to_date );
+        OIIO_CHECK_ASSERT( std::filesystem::exists( result.output_filename ) );
+    }
+
+    // Nothing to do on the second run.
+    reported = 0;
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+    OIIO_CHECK_EQUAL( reported, 0 );
+    for ( const auto &result: batch_converter.get_results() )
+    {
+        OIIO_CHECK_ASSERT( result.success );
+        OIIO_CHECK_ASSERT( result.up_to_date );
+        OIIO_CHECK_ASSERT( !result.output_filename.empty() );
+    }
+
+    // Only the modified file gets converted again, also when pipelining.
+    std::filesystem::last_write_time(
+        files[1],
+        std::filesystem::last_write_time( files[1] ) +
+            std::chrono::seconds( 10 ) );
+    batch_converter.settings.jobs           = 1;
+    batch_converter.settings.pipeline_depth = 2;
+
+    reported = 0;
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+    OIIO_CHECK_EQUAL( reported, 1 );
+    OIIO_CHECK_ASSERT( batch_converter.get_results()[0].up_to_date );
+    OIIO_CHECK_ASSERT( !batch_converter.get_results()[1].up_to_date );
+    OIIO_CHECK_ASSERT( batch_converter.get_results()[1].success );
+
+    // Changing the settings affecting the output converts all files.
+    batch_converter.settings.scale = 2.0f;
+
+    reported = 0;
+    OIIO_CHECK_ASSERT( batch_converter.process( files ) );
+    OIIO_CHECK_EQUAL( reported, 2 );
+}
+
+/// Tests that the files sharing the transform key get the transform solved
+/// once per group, and `configure()` applies a given transform as is
+void test_batch_converter_group_transforms()
+{
+    std::cout << std::endl
+              << "test_batch_converter_group_transforms()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "invalid.dng" } );
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "b.dng", "invalid.dng", "c.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        if ( !std::filesystem::exists( files.back() ) )
+            std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+
+    std::string key_a, key_b, key_invalid;
+    OIIO_CHECK_ASSERT( converter.read_transform_key( files[0], key_a ) );
+    OIIO_CHECK_ASSERT( converter.read_transform_key( files[1], key_b ) );
+    OIIO_CHECK_EQUAL( key_a, key_b );
+    ASSERT_CONTAINS( key_a, "cameraMake=" );
+    capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT(
+            !converter.read_transform_key( files[2], key_invalid ) );
+    } );
+
+    // A given transform gets applied without solving.
+    auto transform        = std::make_shared<ImageConverter::Transform>();
+    transform->IDT_matrix = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+    transform->matrix_method = converter.settings.matrix_method;
+    converter.transform      = transform;
+
+    OIIO::ParamValueList options;
+    OIIO_CHECK_ASSERT( converter.configure( files[0], options ) );
+    OIIO_CHECK_ASSERT( converter.get_IDT_matrix() == transform->IDT_matrix );
+    OIIO_CHECK_ASSERT(
+        converter.get_transform().matrix_method == transform->matrix_method );
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings                   = converter.settings;
+    batch_converter.settings.group_transforms  = true;
+    batch_converter.settings.continue_on_error = true;
+    batch_converter.settings.jobs              = 2;
+    batch_converter.settings.disable_cache     = true;
+    batch_converter.metrics = std::make_shared<rta::util::Metrics>();
+
+    bool result = true;
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+    OIIO_CHECK_ASSERT( !result );
+
+    const auto &results = batch_converter.get_results();
+    OIIO_CHECK_ASSERT( results[0].success );
+    OIIO_CHECK_ASSERT( results[1].success );
+    OIIO_CHECK_ASSERT( !results[2].success );
+    OIIO_CHECK_ASSERT( results[3].success );
+    OIIO_CHECK_ASSERT( !results[0].IDT_matrix.empty() );
+    OIIO_CHECK_ASSERT( results[1].IDT_matrix == results[0].IDT_matrix );
+    OIIO_CHECK_ASSERT( results[3].IDT_matrix == results[0].IDT_matrix );
+
+    // The valid files form a single group, solved once.
+    OIIO_CHECK_EQUAL(
+        batch_converter.metrics->get_count( "transform_groups" ), 1 );
+    const rta::util::Metrics::Labels labels = {
+        { "cache", "matrix from DNG metadata" }
+    };
+    OIIO_CHECK_EQUAL(
+        batch_converter.metrics->get_count( "cache_hits", labels ) +
+            batch_converter.metrics->get_count( "cache_misses", labels ),
+        1 );
+}
+
+/// Tests that solving the transforms ahead of the conversions solves every
+/// distinct transform once, gives the same transforms as solving them when
+/// converting, and that `solve_transform()` fills the caches
+void test_batch_converter_solve_ahead()
+{
+    std::cout << std::endl << "test_batch_converter_solve_ahead()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestFixture fixture;
+    auto       &test_dir =
+        fixture.with_camera( "Blackmagic", "Cinema Camera" ).build();
+    test_dir.create_valid_files( { "invalid.dng" } );
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "invalid.dng", "b.dng", "c.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        if ( !std::filesystem::exists( files.back() ) )
+            std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    // An illuminant no other test solves for, so the caches start empty.
+    auto settings = SettingsBuilder()
+                        .database( test_dir.get_database_path() )
+                        .wb_method( "illuminant" )
+                        .illuminant( "D57" )
+                        .mat_method( "spectral" )
+                        .build();
+
+    rta::util::BatchConverter batch_converter;
+    batch_converter.settings                   = settings;
+    batch_converter.settings.solve_ahead       = 2;
+    batch_converter.settings.continue_on_error = true;
+    batch_converter.metrics = std::make_shared<rta::util::Metrics>();
+
+    bool result = true;
+    capture_stderr( [&]() { result = batch_converter.process( files ); } );
+    OIIO_CHECK_ASSERT( !result );
+
+    const auto &results = batch_converter.get_results();
+    OIIO_CHECK_ASSERT( results[0].success );
+    OIIO_CHECK_ASSERT( !results[1].success );
+    OIIO_CHECK_ASSERT( results[2].success );
+    OIIO_CHECK_ASSERT( results[3].success );
+    OIIO_CHECK_ASSERT( !results[0].IDT_matrix.empty() );
+    OIIO_CHECK_ASSERT( results[2].IDT_matrix == results[0].IDT_matrix );
+    OIIO_CHECK_ASSERT( results[3].IDT_matrix == results[0].IDT_matrix );
+
+    // The valid files share the transform, solved once by either the
+    // background threads or the conversion getting there first.
+    const rta::util::Metrics::Labels labels = {
+        { "cache", "matrix from illuminant" }
+    };
+    OIIO_CHECK_EQUAL(
+        batch_converter.metrics->get_count( "cache_misses", labels ), 1 );
+
+    // The same transform gets solved by the converter without reading the
+    // pixels, and found in the cache.
+    auto &cache       = rta::cache::get_matrix_from_illuminant_cache();
+    auto  hits_before = cache.hits.load();
+
+    ImageConverter converter;
+    converter.settings = settings;
+    OIIO_CHECK_ASSERT( converter.solve_transform( files[0] ) );
+    OIIO_CHECK_ASSERT( converter.get_IDT_matrix() == results[0].IDT_matrix );
+    OIIO_CHECK_EQUAL( cache.hits.load(), hits_before + 1 );
+
+    capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !converter.solve_transform( files[1] ) );
+    } );
+}
+
+/// Tests that scanning reads the metadata of every file, groups the files by
+/// their setup, solves every setup once if asked to, and writes the table
+void test_scan_metadata()
+{
+    std::cout << std::endl << "test_scan_metadata()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+    test_dir.create_valid_files( { "invalid.dng" } );
+
+    std::vector<std::string> files;
+    for ( auto name: { "a.dng", "invalid.dng", "b.dng" } )
+    {
+        files.push_back( test_dir.path() + "/" + name );
+        if ( !std::filesystem::exists( files.back() ) )
+            std::filesystem::copy_file( dng_test_file, files.back() );
+    }
+
+    ImageConverter::Settings settings;
+    settings.WB_method     = ImageConverter::Settings::WBMethod::Metadata;
+    settings.matrix_method = ImageConverter::Settings::MatrixMethod::Metadata;
+    settings.jobs          = 2;
+
+    std::vector<rta::util::ScanResult> results;
+    capture_stderr( [&]() {
+        results = rta::util::scan_metadata( files, settings, true );
+    } );
+    OIIO_CHECK_EQUAL( results.size(), files.size() );
+    if ( results.size() != files.size() )
+        return;
+
+    OIIO_CHECK_ASSERT( results[0].success );
+    OIIO_CHECK_ASSERT( !results[1].success );
+    OIIO_CHECK_ASSERT( results[2].success );
+    OIIO_CHECK_EQUAL( results[0].input_filename, files[0] );
+    OIIO_CHECK_EQUAL( results[0].camera_make, "Blackmagic" );
+    OIIO_CHECK_EQUAL( results[0].camera_model, "Cinema Camera" );
+    OIIO_CHECK_GT( results[0].width, 0 );
+    OIIO_CHECK_GT( results[0].height, 0 );
+    OIIO_CHECK_EQUAL( results[0].pre_mul.size(), 4 );
+    OIIO_CHECK_GT( results[0].DNG_version, 0 );
+    OIIO_CHECK_EQUAL( results[0].setup, 0 );
+    OIIO_CHECK_EQUAL( results[2].setup, 0 );
+    OIIO_CHECK_ASSERT( results[0].solved );
+    OIIO_CHECK_ASSERT( results[2].solved );
+    OIIO_CHECK_ASSERT( !results[1].solved );
+
+    std::ostringstream table;
+    rta::util::write_scan_table( table, results, true );
+    std::vector<std::string> lines = get_output_lines( table.str() );
+    OIIO_CHECK_EQUAL( lines.size(), 4 );
+    if ( lines.size() != 4 )
+        return;
+
+    OIIO_CHECK_EQUAL(
+        lines[0],
+        "file\tmake\tmodel\twidth\theight\tpre_mul\tdng_version"
+        "\tdng_illuminants\tsetup\tsolved" );
+    ASSERT_CONTAINS( lines[1], files[0] + "\tBlackmagic\tCinema Camera\t" );
+    ASSERT_CONTAINS( lines[1], "\t1\tyes" );
+    OIIO_CHECK_EQUAL( lines[2], files[1] + "\terror" );
+}
+
+/// Tests that the scan mode prints the table without converting the files
+void test_main_scan()
+{
+    std::cout << std::endl << "test_main_scan()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory     test_dir;
+    const std::string input = test_dir.path() + "/a.dng";
+    std::filesystem::copy_file( dng_test_file, input );
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .mat_method( "metadata" )
+                    .arg( "--scan" )
+                    .input( input )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args );
+
+    ASSERT_CONTAINS( output, "file\tmake\tmodel\t" );
+    ASSERT_CONTAINS( output, input + "\tBlackmagic\tCinema Camera\t" );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+    OIIO_CHECK_ASSERT(
+        !std::filesystem::exists( test_dir.path() + "/a_aces.exr" ) );
+}
+
+/// Tests that a negative number of the solve ahead threads gets rejected
+void test_main_invalid_solve_ahead()
+{
+    std::cout << std::endl << "test_main_invalid_solve_ahead()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--solve-ahead -1" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS(
+        output,
+        "The number of the solve ahead threads must not be negative, got -1." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that loading the pixels of the file opened by `configure()` reuses
+/// the open reader, and produces the same image as reading the file afresh
+void test_load_image_reuses_configured_reader()
+{
+    std::cout << std::endl
+              << "test_load_image_reuses_configured_reader()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+
+    OIIO::ParamValueList hints;
+    OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+
+    OIIO::ImageBuf reused_buffer;
+    OIIO_CHECK_ASSERT(
+        converter.load_image( dng_test_file, hints, reused_buffer ) );
+
+    // The reader has been consumed, so this one reads the file directly.
+    OIIO::ImageBuf fresh_buffer;
+    OIIO_CHECK_ASSERT(
+        converter.load_image( dng_test_file, hints, fresh_buffer ) );
+
+    OIIO_CHECK_EQUAL(
+        reused_buffer.spec().format, OIIO::TypeDesc( OIIO::TypeDesc::FLOAT ) );
+    OIIO_CHECK_EQUAL( reused_buffer.nchannels(), fresh_buffer.nchannels() );
+    OIIO_CHECK_EQUAL( reused_buffer.roi(), fresh_buffer.roi() );
+
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( reused_buffer, fresh_buffer, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+    OIIO_CHECK_EQUAL( comparison.maxerror, 0.0 );
+}
+
+/// Tests that all the I/O modes decode the same pixels, both via the reader
+/// opened by `configure()` and when reading the file afresh
+void test_load_image_io_modes()
+{
+    std::cout << std::endl << "test_load_image_io_modes()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    auto load = []( ImageConverter::Settings::IOMode mode,
+                    OIIO::ImageBuf                  &configured,
+                    OIIO::ImageBuf                  &fresh ) {
+        ImageConverter converter;
+        converter.settings.WB_method =
+            ImageConverter::Settings::WBMethod::Metadata;
+        converter.settings.matrix_method =
+            ImageConverter::Settings::MatrixMethod::Metadata;
+        converter.settings.io_mode = mode;
+
+        OIIO::ParamValueList hints;
+        OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+        OIIO_CHECK_ASSERT(
+            converter.load_image( dng_test_file, hints, configured ) );
+        OIIO_CHECK_ASSERT(
+            converter.load_image( dng_test_file, hints, fresh ) );
+    };
+
+    OIIO::ImageBuf expected, unused;
+    load( ImageConverter::Settings::IOMode::Buffered, expected, unused );
+
+    for ( auto mode: { ImageConverter::Settings::IOMode::Mapped,
+                       ImageConverter::Settings::IOMode::Direct } )
+    {
+        OIIO::ImageBuf configured, fresh;
+        load( mode, configured, fresh );
+
+        for ( const auto *buffer: { &configured, &fresh } )
+        {
+            OIIO_CHECK_EQUAL( buffer->roi(), expected.roi() );
+            auto comparison =
+                OIIO::ImageBufAlgo::compare( *buffer, expected, 0.0f, 0.0f );
+            OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+        }
+    }
+}
+
+/// Tests that a file gets mapped with its whole content with the read-ahead
+/// hints used by the raw reader, and that mapping a missing file fails
+void test_file_mapping()
+{
+    std::cout << std::endl << "test_file_mapping()" << std::endl;
+
+    TestDirectory     test_dir;
+    const std::string path    = test_dir.path() + "/mapped.bin";
+    const std::string content = "mapped file content";
+    {
+        std::ofstream file( path, std::ios::binary );
+        file << content;
+    }
+
+    rta::core::MappedFile mapping;
+    OIIO_CHECK_ASSERT( mapping.open( path, true ) );
+    OIIO_CHECK_EQUAL( mapping.size(), content.size() );
+    OIIO_CHECK_ASSERT( mapping.data() != nullptr );
+    OIIO_CHECK_EQUAL(
+        std::string(
+            reinterpret_cast<const char *>( mapping.data() ), mapping.size() ),
+        content );
+
+    mapping.close();
+    OIIO_CHECK_ASSERT( mapping.data() == nullptr );
+    OIIO_CHECK_EQUAL( mapping.size(), 0u );
+
+    OIIO_CHECK_ASSERT( !mapping.open( test_dir.path() + "/missing.bin" ) );
+}
+
+/// Tests that an unsupported I/O mode gets rejected
+void test_main_invalid_io_mode()
+{
+    std::cout << std::endl << "test_main_invalid_io_mode()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--io-mode invalid" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS( output, "Unsupported I/O mode: 'invalid'." );
+    ASSERT_CONTAINS(
+        output,
+        "The following modes are supported: buffered, mapped, direct." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that the buffer pool reuses the returned blocks of the same size,
+/// frees the blocks beyond its capacity, and lets the blocks outlive it
+void test_buffer_pool()
+{
+    std::cout << std::endl << "test_buffer_pool()" << std::endl;
+
+    BufferPool pool;
+    pool.set_capacity( 1 << 20 );
+
+    auto  block = pool.borrow( 1000 );
+    void *data  = block.get();
+    OIIO_CHECK_ASSERT( data != nullptr );
+    OIIO_CHECK_EQUAL( reinterpret_cast<uintptr_t>( data ) % 64, 0 );
+    OIIO_CHECK_EQUAL( pool.allocation_count(), 1 );
+
+    block.reset();
+    OIIO_CHECK_EQUAL( pool.idle_size(), 1000 );
+
+    // The same size gets the returned block, another size a new one.
+    block = pool.borrow( 1000 );
+    OIIO_CHECK_EQUAL( block.get(), data );
+    OIIO_CHECK_EQUAL( pool.idle_size(), 0 );
+
+    auto other = pool.borrow( 2000 );
+    OIIO_CHECK_ASSERT( other.get() != data );
+    OIIO_CHECK_EQUAL( pool.allocation_count(), 2 );
+
+    // The buffer wraps the block, holding the pixels of the spec.
+    OIIO::ImageSpec spec( 16, 8, 3, OIIO::TypeDesc::HALF );
+    OIIO::ImageBuf  buffer;
+    auto            pixels = pool.borrow( spec, buffer );
+    OIIO_CHECK_EQUAL( buffer.localpixels(), pixels.get() );
+    OIIO_CHECK_EQUAL( buffer.spec().width, 16 );
+    OIIO_CHECK_EQUAL( buffer.spec().format, OIIO::TypeDesc::HALF );
+    OIIO_CHECK_EQUAL( pool.allocation_count(), 3 );
+
+    // The huge pages are only a hint, the block is usable either way.
+    auto huge = pool.borrow( 3 << 20, true );
+    std::memset( huge.get(), 0xff, 3 << 20 );
+    huge.reset();
+    OIIO_CHECK_EQUAL( pool.idle_size(), 0 );
+
+    block.reset();
+    other.reset();
+    OIIO_CHECK_EQUAL( pool.idle_size(), 3000 );
+
+    // The least recently returned block goes first.
+    pool.set_capacity( 2500 );
+    OIIO_CHECK_EQUAL( pool.idle_size(), 2000 );
+
+    pool.clear();
+    OIIO_CHECK_EQUAL( pool.idle_size(), 0 );
+
+    // A block returned after the pool is gone just gets freed.
+    std::shared_ptr<void> orphan;
+    {
+        BufferPool scoped;
+        orphan = scoped.borrow( 100 );
+    }
+    orphan.reset();
+}
+
+/// Tests that converting images with the buffer pool gives the same result
+/// as without it, and that the later images reuse the buffers of the first
+void test_process_image_buffer_pool()
+{
+    std::cout << std::endl << "test_process_image_buffer_pool()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    auto convert = [&]( const std::string &subdir,
+                        int                buffer_pool,
+                        int                memory_limit ) {
+        ImageConverter converter;
+        converter.settings.WB_method =
+            ImageConverter::Settings::WBMethod::Metadata;
+        converter.settings.matrix_method =
+            ImageConverter::Settings::MatrixMethod::Metadata;
+        converter.settings.output_dir   = test_dir.path() + "/" + subdir;
+        converter.settings.create_dirs  = true;
+        converter.settings.overwrite    = true;
+        converter.settings.buffer_pool  = buffer_pool;
+        converter.settings.huge_pages   = true;
+        converter.settings.memory_limit = memory_limit;
+        OIIO_CHECK_ASSERT( converter.process_image( dng_test_file ) );
+        return converter.settings.output_dir +
+               "/blackmagic_cinema_camera_cinemadng_aces.exr";
+    };
+
+    OIIO::ImageBuf expected( convert( "expected", 0, 0 ) );
+
+    auto &pool = BufferPool::instance();
+    for ( int memory_limit: { 0, 1 } )
+    {
+        const std::string subdir = "pooled" + std::to_string( memory_limit );
+
+        convert( subdir, 1024, memory_limit );
+        const size_t allocations = pool.allocation_count();
+        OIIO_CHECK_ASSERT( pool.idle_size() > 0 );
+
+        // The second image of the same size does not allocate any buffers.
+        OIIO::ImageBuf result( convert( subdir, 1024, memory_limit ) );
+        OIIO_CHECK_EQUAL( pool.allocation_count(), allocations );
+
+        auto comparison =
+            OIIO::ImageBufAlgo::compare( result, expected, 0.0f, 0.0f );
+        OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+    }
+
+    pool.clear();
+}
+
+/// Tests that the memory of a converted buffer taken over via
+/// `detach_buffer()` keeps its pixels when the converter converts the next
+/// image, and only goes back to the pool once released
+void test_detach_buffer()
+{
+    std::cout << std::endl << "test_detach_buffer()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    std::ifstream file( dng_test_file, std::ios::binary );
+    std::vector<char> data(
+        ( std::istreambuf_iterator<char>( file ) ),
+        std::istreambuf_iterator<char>() );
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    converter.settings.buffer_pool = 1024;
+
+    OIIO::ImageBuf first;
+    OIIO_CHECK_ASSERT( converter.process_memory(
+        "first", data.data(), data.size(), first ) );
+    auto memory = converter.detach_buffer( first );
+    OIIO_CHECK_ASSERT( memory != nullptr );
+    OIIO_CHECK_EQUAL( memory.get(), first.localpixels() );
+    OIIO_CHECK_ASSERT( converter.detach_buffer( first ) == nullptr );
+
+    OIIO::ImageBuf expected = OIIO::ImageBufAlgo::copy( first );
+
+    // The second image of the same size cannot get the detached memory, so
+    // scaling it leaves the first image intact.
+    converter.settings.scale = 2.0f;
+    OIIO::ImageBuf second;
+    OIIO_CHECK_ASSERT( converter.process_memory(
+        "second", data.data(), data.size(), second ) );
+    OIIO_CHECK_ASSERT( second.localpixels() != first.localpixels() );
+    converter.release_buffers();
+
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( first, expected, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // The buffers not borrowed from the pool own their pixels.
+    converter.settings.buffer_pool = 0;
+    OIIO::ImageBuf unpooled;
+    OIIO_CHECK_ASSERT( converter.process_memory(
+        "unpooled", data.data(), data.size(), unpooled ) );
+    OIIO_CHECK_ASSERT( converter.detach_buffer( unpooled ) == nullptr );
+
+    memory.reset();
+    BufferPool::instance().clear();
+}
+
+/// Tests that a negative buffer pool size gets rejected
+void test_main_invalid_buffer_pool()
+{
+    std::cout << std::endl << "test_main_invalid_buffer_pool()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--buffer-pool -1" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS(
+        output, "The buffer pool size must not be negative, got -1." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that the server converts the submitted jobs with their own
+/// settings, reports the progress to the client, rejects the options which
+/// would exit the server, keeps the thread pool sized for all jobs, and
+/// removes the socket when stopped
+void test_conversion_server()
+{
+    std::cout << std::endl << "test_conversion_server()" << std::endl;
+
+#ifndef WIN32
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory     test_dir;
+    const std::string socket_path = test_dir.path() + "/server.sock";
+    const std::string output_dir  = test_dir.path() + "/output";
+
+    ConversionServer server;
+    server.max_jobs = 2;
+    OIIO_CHECK_ASSERT( server.listen( socket_path ) );
+    OIIO_CHECK_ASSERT( std::filesystem::exists( socket_path ) );
+
+    std::thread thread( [&server]() { server.run(); } );
+
+    std::vector<std::string> started;
+    std::vector<bool>        finished;
+
+    // The thread pool gets sized for both workers, not for the job.
+    ImageConverter::Settings budget;
+    budget.jobs                = 2;
+    const int expected_threads = conversion_threads( budget ) * 2;
+
+    int status = submit_job(
+        socket_path,
+        { "--wb-method",
+          "metadata",
+          "--mat-method",
+          "metadata",
+          "--threads",
+          "3",
+          "--jobs",
+          "4",
+          "--overwrite",
+          "--create-dirs",
+          "--output-dir",
+          output_dir,
+          dng_test_file },
+        [&]( size_t, size_t, const BatchResult &result ) {
+            started.push_back( result.input_filename );
+        },
+        [&]( size_t, size_t, const BatchResult &result ) {
+            finished.push_back( result.success );
+        } );
+
+    OIIO_CHECK_EQUAL( status, 0 );
+    OIIO_CHECK_EQUAL( started.size(), 1 );
+    OIIO_CHECK_EQUAL( finished.size(), 1 );
+    if ( finished.size() == 1 )
+        OIIO_CHECK_ASSERT( finished[0] );
+    OIIO_CHECK_ASSERT( std::filesystem::exists(
+        output_dir + "/blackmagic_cinema_camera_cinemadng_aces.exr" ) );
+
+    int threads = 0;
+    OIIO::getattribute( "threads", threads );
+    OIIO_CHECK_EQUAL( threads, expected_threads );
+
+    // The settings of the previous job do not carry over: the output exists
+    // now, and this job does not allow overwriting it.
+    std::string output = capture_stderr( [&]() {
+        status = submit_job(
+            socket_path,
+            { "--output-dir", output_dir, dng_test_file } );
+    } );
+    OIIO_CHECK_EQUAL( status, 1 );
+    ASSERT_CONTAINS( output, "1 of 1 files failed to convert." );
+
+    output = capture_stderr( [&]() {
+        status = submit_job( socket_path, { "--list-cameras" } );
+    } );
+    OIIO_CHECK_EQUAL( status, 1 );
+    ASSERT_CONTAINS(
+        output,
+        "The option --list-cameras is not supported in a job submitted to a "
+        "server." );
+
+    output = capture_stderr(
+        [&]() { status = submit_job( socket_path, { "--overwrite" } ); } );
+    OIIO_CHECK_EQUAL( status, 1 );
+    ASSERT_CONTAINS( output, "No input files given." );
+
+    server.stop();
+    thread.join();
+    OIIO_CHECK_ASSERT( !std::filesystem::exists( socket_path ) );
+
+    output = capture_stderr(
+        [&]() { status = submit_job( socket_path, { dng_test_file } ); } );
+    OIIO_CHECK_EQUAL( status, -1 );
+    ASSERT_CONTAINS( output, "Failed to connect to the server" );
+#endif
+}
+
+/// Tests that submitting a job fails if no server is listening
+void test_main_submit_without_server()
+{
+    std::cout << std::endl
+              << "test_main_submit_without_server()" << std::endl;
+
+#ifndef WIN32
+    TestDirectory test_dir;
+
+    auto args = CommandBuilder()
+                    .arg( "--submit " + test_dir.path() + "/missing.sock" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+
+    ASSERT_CONTAINS( output, "Failed to connect to the server" );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+#endif
+}
+
+/// Tests that the fused transform produces the same result as applying the
+/// matrices and the scale in separate passes, including when converting to
+/// half floats in the same pass
+void test_apply_transform_matches_separate_passes()
+{
+    std::cout << std::endl
+              << "test_apply_transform_matches_separate_passes()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    converter.settings.headroom = 6.0f;
+    converter.settings.scale    = 0.5f;
+
+    // The metadata mode produces both the IDT and the CAT matrices.
+    OIIO::ParamValueList hints;
+    OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+    OIIO_CHECK_ASSERT( !converter.get_IDT_matrix().empty() );
+    OIIO_CHECK_ASSERT( !converter.get_CAT_matrix().empty() );
+
+    OIIO::ImageSpec spec( 8, 8, 3, OIIO::TypeDesc::FLOAT );
+    OIIO::ImageBuf  src( spec );
+    const float     color1[] = { 0.1f, 0.5f, 0.9f };
+    const float     color2[] = { 0.7f, 0.2f, 0.3f };
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( src, 2, 2, 1, color1, color2 ) );
+
+    OIIO::ImageBuf separate;
+    OIIO_CHECK_ASSERT( converter.apply_matrix( separate, src ) );
+    OIIO_CHECK_ASSERT( converter.apply_scale( separate, separate ) );
+
+    OIIO::ImageBuf fused;
+    OIIO_CHECK_ASSERT( converter.apply_transform( fused, src ) );
+
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( fused, separate, 1e-5f, 1e-5f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // An allocated float buffer gets transformed by the specialised kernel.
+    OIIO::ImageBuf fused_float( spec, OIIO::InitializePixels::No );
+    OIIO_CHECK_ASSERT( converter.apply_transform( fused_float, src ) );
+
+    comparison =
+        OIIO::ImageBufAlgo::compare( fused_float, separate, 1e-5f, 1e-5f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    spec.set_format( OIIO::TypeDesc::HALF );
+    OIIO::ImageBuf fused_half( spec, OIIO::InitializePixels::No );
+    OIIO_CHECK_ASSERT( converter.apply_transform( fused_half, src ) );
+    OIIO_CHECK_EQUAL(
+        fused_half.spec().format, OIIO::TypeDesc( OIIO::TypeDesc::HALF ) );
+
+    comparison =
+        OIIO::ImageBufAlgo::compare( fused_half, separate, 1e-2f, 1e-2f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+}
+
+/// Tests that the vectorised conversion to half floats rounds the same way as
+/// `half`, and that the fused kernel passes the alpha channel through
+void test_transform_to_half()
+{
+    std::cout << std::endl << "test_transform_to_half()" << std::endl;
+    std::cout << "Implementation: "
+              << rta::util::half_conversion_implementation() << std::endl;
+
+    // An odd count, so the values left over by the vector loop get covered.
+    const std::vector<float> values = { 0.0f,     -0.0f,   1.0f,   -2.5f,
+                                        0.1f,     1.0005f, 1.0015f, 65504.0f,
+                                        65520.0f, 1e9f,    -1e9f,   6e-8f,
+                                        3e-5f,    1e-10f,  0.3333f };
+
+    std::vector<uint16_t> bits( values.size() );
+    rta::util::convert_to_half( values.data(), bits.data(), values.size() );
+    for ( size_t i = 0; i < values.size(); i++ )
+        OIIO_CHECK_EQUAL( bits[i], half( values[i] ).bits() );
+
+    const float matrix[3][3] = { { 0.5f, 0.25f, 0.0f },
+                                 { 0.0f, 1.0f, 0.0f },
+                                 { 1.0f, -1.0f, 2.0f } };
+    const float pixels[] = { 1.0f, 2.0f, 3.0f, 0.75f, 4.0f, 5.0f, 6.0f, 0.25f };
+
+    uint16_t result[8];
+    rta::util::transform_to_half( matrix, pixels, result, 2, 4 );
+
+    const float expected[] = { 1.0f,  2.0f, 5.0f,  0.75f,
+                               3.25f, 5.0f, 11.0f, 0.25f };
+    for ( size_t i = 0; i < 8; i++ )
+        OIIO_CHECK_EQUAL( result[i], half( expected[i] ).bits() );
+}
+
+/// Tests that the specialised kernels of all the channel layouts and the
+/// output formats match the reference product, also when transforming in
+/// place, and that the unsupported layouts have no kernel
+void test_transform_kernels()
+{
+    std::cout << std::endl << "test_transform_kernels()" << std::endl;
+
+    const float matrix[3][3] = { { 0.5f, 0.25f, 0.0f },
+                                 { 0.0f, 1.0f, 0.0f },
+                                 { 1.0f, -1.0f, 2.0f } };
+
+    // More pixels than fit into a block of the half float kernel.
+    const size_t count = 1500;
+
+    for ( int channels: { 3, 4 } )
+    {
+        std::vector<float> src( count * channels );
+        for ( size_t i = 0; i < src.size(); i++ )
+            src[i] = static_cast<float>( i % 97 ) * 0.125f - 3.0f;
+
+        std::vector<float> expected( src.size() );
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const float *pixel = src.data() + i * channels;
+            float       *value = expected.data() + i * channels;
+            for ( int row = 0; row < 3; row++ )
+            {
+                value[row] = matrix[row][0] * pixel[0] +
+                             matrix[row][1] * pixel[1] +
+                             matrix[row][2] * pixel[2];
+            }
+            if ( channels > 3 )
+                value[3] = pixel[3];
+        }
+
+        auto to_float = rta::util::select_transform_kernel( channels, false );
+        auto to_half  = rta::util::select_transform_kernel( channels, true );
+        OIIO_CHECK_ASSERT( to_float != nullptr );
+        OIIO_CHECK_ASSERT( to_half != nullptr );
+        if ( !to_float || !to_half )
+            continue;
+
+        std::vector<float> floats( src.size() );
+        to_float( matrix, src.data(), floats.data(), count );
+        OIIO_CHECK_ASSERT( floats == expected );
+
+        std::vector<float> in_place = src;
+        to_float( matrix, in_place.data(), in_place.data(), count );
+        OIIO_CHECK_ASSERT( in_place == expected );
+
+        std::vector<uint16_t> halves( src.size() );
+        to_half( matrix, src.data(), halves.data(), count );
+        for ( size_t i = 0; i < src.size(); i++ )
+            OIIO_CHECK_EQUAL( halves[i], half( expected[i] ).bits() );
+    }
+
+    OIIO_CHECK_ASSERT( !rta::util::select_transform_kernel( 1, false ) );
+    OIIO_CHECK_ASSERT( !rta::util::select_transform_kernel( 5, true ) );
+}
+
+/// Tests that the fused conversion to half floats only writes the requested
+/// region, matching the float result there
+void test_apply_transform_half_region()
+{
+    std::cout << std::endl
+              << "test_apply_transform_half_region()" << std::endl;
+
+    ImageConverter converter;
+    converter.settings.headroom = 2.0f;
+
+    OIIO::ImageSpec spec( 16, 8, 3, OIIO::TypeDesc::FLOAT );
+    OIIO::ImageBuf  src( spec );
+    const float     color1[] = { 0.1f, 0.5f, 0.9f };
+    const float     color2[] = { 0.7f, 0.2f, 0.3f };
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( src, 3, 3, 1, color1, color2 ) );
+
+    OIIO::ImageBuf reference;
+    OIIO_CHECK_ASSERT( converter.apply_transform( reference, src ) );
+
+    // Only convert the area kept by a crop, like `convert_image()` does.
+    OIIO::ImageSpec half_spec = spec;
+    half_spec.x               = 3;
+    half_spec.y               = 2;
+    half_spec.width           = 10;
+    half_spec.height          = 5;
+    half_spec.set_format( OIIO::TypeDesc::HALF );
+    OIIO::ImageBuf output( half_spec, OIIO::InitializePixels::Yes );
+
+    OIIO::ROI roi = output.roi();
+    roi.yend      = 6;
+    OIIO_CHECK_ASSERT( converter.apply_transform( output, src, roi ) );
+
+    for ( int y = half_spec.y; y < half_spec.y + half_spec.height; y++ )
+    {
+        for ( int x = half_spec.x; x < half_spec.x + half_spec.width; x++ )
+        {
+            for ( int c = 0; c < 3; c++ )
+            {
+                const float value = output.getchannel( x, y, 0, c );
+                if ( y < roi.yend )
+                    OIIO_CHECK_EQUAL_THRESH(
+                        value, reference.getchannel( x, y, 0, c ), 2e-3f );
+                else
+                    OIIO_CHECK_EQUAL( value, 0.0f );
+            }
+        }
+    }
+}
+
+/// Tests that the GPU transform matches the CPU within the half float
+/// precision, or falls back to the CPU when no GPU is available
+void test_apply_transform_gpu()
+{
+    std::cout << std::endl << "test_apply_transform_gpu()" << std::endl;
+
+    ImageConverter converter;
+    converter.settings.headroom = 6.0f;
+
+    OIIO::ImageSpec spec( 37, 11, 3, OIIO::TypeDesc::FLOAT );
+    OIIO::ImageBuf  src( spec );
+    const float     color1[] = { 0.1f, 0.5f, 0.9f };
+    const float     color2[] = { 0.7f, 0.2f, 0.3f };
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( src, 4, 3, 1, color1, color2 ) );
+
+    spec.set_format( OIIO::TypeDesc::HALF );
+    OIIO::ImageBuf cpu( spec, OIIO::InitializePixels::No );
+    OIIO_CHECK_ASSERT( converter.apply_transform( cpu, src ) );
+
+    auto *gpu = rta::util::GPUTransform::instance();
+    std::cout << "GPU: " << ( gpu ? gpu->device_name() : "none" )
+              << std::endl;
+
+    converter.settings.use_gpu = true;
+    OIIO::ImageBuf result( spec, OIIO::InitializePixels::No );
+    capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( converter.apply_transform( result, src ) );
+    } );
+
+    auto comparison = OIIO::ImageBufAlgo::compare( result, cpu, 1e-2f, 1e-2f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+}
+
+/// Tests that streaming an image in strips produces the same file as loading
+/// the whole frame, for all crop modes
+void test_stream_image_matches_whole_frame()
+{
+    std::cout << std::endl
+              << "test_stream_image_matches_whole_frame()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    for ( auto crop_mode: { ImageConverter::Settings::CropMode::Off,
+                            ImageConverter::Settings::CropMode::Soft,
+                            ImageConverter::Settings::CropMode::Hard } )
+    {
+        ImageConverter converter;
+        converter.settings.WB_method =
+            ImageConverter::Settings::WBMethod::Metadata;
+        converter.settings.matrix_method =
+            ImageConverter::Settings::MatrixMethod::Metadata;
+        converter.settings.crop_mode = crop_mode;
+
+        // Small enough to split the test image into multiple strips.
+        converter.settings.memory_limit = 1;
+
+        const std::string whole_path    = test_dir.path() + "/whole.exr";
+        const std::string streamed_path = test_dir.path() + "/streamed.exr";
+
+        OIIO::ParamValueList hints;
+        OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+
+        OIIO::ImageBuf buffer;
+        OIIO_CHECK_ASSERT(
+            converter.load_image( dng_test_file, hints, buffer ) );
+        OIIO_CHECK_ASSERT( converter.apply_transform( buffer, buffer ) );
+        OIIO_CHECK_ASSERT( converter.apply_crop( buffer, buffer ) );
+        OIIO_CHECK_ASSERT( converter.save_image( whole_path, buffer ) );
+
+        OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+        OIIO_CHECK_ASSERT(
+            converter.stream_image( dng_test_file, hints, streamed_path ) );
+
+        OIIO::ImageBuf whole( whole_path );
+        OIIO::ImageBuf streamed( streamed_path );
+        OIIO_CHECK_ASSERT( whole.read() );
+        OIIO_CHECK_ASSERT( streamed.read() );
+
+        OIIO_CHECK_EQUAL( streamed.roi(), whole.roi() );
+        OIIO_CHECK_EQUAL( streamed.roi_full(), whole.roi_full() );
+        OIIO_CHECK_EQUAL(
+            streamed.spec().format, OIIO::TypeDesc( OIIO::TypeDesc::HALF ) );
+        OIIO_CHECK_EQUAL(
+            streamed.spec().get_int_attribute( "acesImageContainerFlag" ), 1 );
+
+        auto comparison =
+            OIIO::ImageBufAlgo::compare( streamed, whole, 1e-3f, 1e-3f );
+        OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+    }
+}
+
+/// Tests that the outputs of an image get written from one decode: the
+/// default output matches the single output conversion, the regions match
+/// the crops of it, and the downscaled and the compressed outputs get
+/// written in the intermediate profile
+void test_process_image_outputs()
+{
+    std::cout << std::endl << "test_process_image_outputs()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    converter.settings.output_dir = test_dir.path();
+    converter.settings.overwrite  = true;
+
+    OIIO_CHECK_ASSERT( converter.process_image( dng_test_file ) );
+    const std::string single_path = converter.get_output_filename();
+    const std::string whole_path  = test_dir.path() + "/whole.exr";
+    std::filesystem::rename( single_path, whole_path );
+
+    ImageConverter::Settings::Output whole;
+
+    ImageConverter::Settings::Output centre;
+    centre.suffix    = "_centre";
+    centre.region[0] = 16;
+    centre.region[1] = 8;
+    centre.region[2] = 64;
+    centre.region[3] = 32;
+
+    ImageConverter::Settings::Output proxy;
+    proxy.suffix      = "_proxy";
+    proxy.scale       = 2;
+    proxy.compression = "piz";
+
+    converter.settings.outputs = { whole, centre, proxy };
+    OIIO_CHECK_ASSERT( converter.process_image( dng_test_file ) );
+    OIIO_CHECK_EQUAL( converter.get_output_filename(), single_path );
+
+    OIIO::ImageBuf expected( whole_path );
+    OIIO::ImageBuf whole_output( single_path );
+    OIIO_CHECK_ASSERT( expected.read() );
+    OIIO_CHECK_ASSERT( whole_output.read() );
+    OIIO_CHECK_EQUAL( whole_output.roi(), expected.roi() );
+    OIIO_CHECK_EQUAL( whole_output.roi_full(), expected.roi_full() );
+    OIIO_CHECK_EQUAL(
+        whole_output.spec().get_int_attribute( "acesImageContainerFlag" ), 1 );
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( whole_output, expected, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // The region gets written as an image of its own.
+    std::string centre_path = dng_test_file;
+    OIIO_CHECK_ASSERT( converter.make_output_path( centre_path, "_centre" ) );
+    OIIO::ImageBuf centre_output( centre_path );
+    OIIO_CHECK_ASSERT( centre_output.read() );
+    OIIO_CHECK_EQUAL(
+        centre_output.roi(), OIIO::ROI( 0, 64, 0, 32, 0, 1, 0, 3 ) );
+    OIIO_CHECK_EQUAL( centre_output.roi_full(), centre_output.roi() );
+
+    OIIO::ImageBuf expected_centre = OIIO::ImageBufAlgo::crop(
+        expected, OIIO::ROI( 16, 80, 8, 40, 0, 1, 0, 3 ) );
+    expected_centre.specmod().x = 0;
+    expected_centre.specmod().y = 0;
+    comparison = OIIO::ImageBufAlgo::compare(
+        centre_output, expected_centre, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    std::string proxy_path = dng_test_file;
+    OIIO_CHECK_ASSERT( converter.make_output_path( proxy_path, "_proxy" ) );
+    OIIO::ImageBuf proxy_output( proxy_path );
+    OIIO_CHECK_ASSERT( proxy_output.read() );
+    OIIO_CHECK_EQUAL( proxy_output.spec().width, expected.spec().width / 2 );
+    OIIO_CHECK_EQUAL( proxy_output.spec().height, expected.spec().height / 2 );
+    OIIO_CHECK_EQUAL(
+        proxy_output.spec().get_string_attribute( "compression" ), "piz" );
+    OIIO_CHECK_EQUAL(
+        proxy_output.spec().get_int_attribute( "acesImageContainerFlag" ), 0 );
+
+    // A region outside of the image fails the conversion.
+    centre.region[0]           = 100000;
+    converter.settings.outputs = { centre };
+    std::string output         = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !converter.process_image( dng_test_file ) );
+    } );
+    ASSERT_CONTAINS(
+        output,
+        "The region of the output '_centre' lies outside of the image" );
+}
+
+/// Tests that the outputs with invalid options and the repeated suffixes
+/// get rejected
+void test_main_invalid_output()
+{
+    std::cout << std::endl << "test_main_invalid_output()" << std::endl;
+
+    auto args = CommandBuilder()
+                    .wb_method( "metadata" )
+                    .arg( "--output _centre,region=64x32" )
+                    .input( dng_test_file )
+                    .build();
+
+    std::string output = run_rawtoaces_command( args, true );
+    ASSERT_CONTAINS(
+        output,
+        "Invalid option 'region=64x32' of the output '_centre,region=64x32'." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+
+    args = CommandBuilder()
+               .wb_method( "metadata" )
+               .arg( "--output _proxy,compression=jpeg" )
+               .input( dng_test_file )
+               .build();
+
+    output = run_rawtoaces_command( args, true );
+    ASSERT_CONTAINS(
+        output,
+        "Unsupported compression of the output '_proxy,compression=jpeg'" );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+
+    args = CommandBuilder()
+               .wb_method( "metadata" )
+               .arg( "--output _proxy,scale=2" )
+               .arg( "--output _proxy,scale=4" )
+               .input( dng_test_file )
+               .build();
+
+    output = run_rawtoaces_command( args, true );
+    ASSERT_CONTAINS(
+        output,
+        "The suffixes of the outputs must be distinct, got '_proxy' more "
+        "than once." );
+    ASSERT_NOT_CONTAINS( output, "Processing file" );
+}
+
+/// Tests that the output files get written via a temporary file, which
+/// replaces an existing file once complete, and gets removed on failure
+void test_save_image_atomic()
+{
+    std::cout << std::endl << "test_save_image_atomic()" << std::endl;
+
+    TestDirectory test_dir;
+
+    OIIO::ImageSpec spec( 8, 4, 3, OIIO::TypeDesc::FLOAT );
+    OIIO::ImageBuf  src( spec );
+    const float     color[] = { 0.1f, 0.5f, 0.9f };
+    OIIO_CHECK_ASSERT( OIIO::ImageBufAlgo::fill( src, color ) );
+
+    ImageConverter converter;
+
+    const std::string path = test_dir.path() + "/output.exr";
+    std::ofstream( path ) << "partial";
+
+    OIIO_CHECK_ASSERT( converter.save_image( path, src ) );
+    OIIO_CHECK_ASSERT( !std::filesystem::exists( path + ".tmp" ) );
+
+    OIIO::ImageBuf output( path );
+    OIIO_CHECK_ASSERT( output.read() );
+    OIIO_CHECK_EQUAL( output.spec().width, 8 );
+
+    const std::string missing_path = test_dir.path() + "/missing/output.exr";
+    std::string       output_text  = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !converter.save_image( missing_path, src ) );
+    } );
+    ASSERT_CONTAINS( output_text, "ERROR: Failed to write file" );
+    OIIO_CHECK_ASSERT( !std::filesystem::exists( missing_path ) );
+    OIIO_CHECK_ASSERT( !std::filesystem::exists( missing_path + ".tmp" ) );
+}
+
+/// Tests that the output files follow the selected output profile, for both
+/// saving a buffer and streaming an image
+void test_output_profiles()
+{
+    std::cout << std::endl << "test_output_profiles()" << std::endl;
+
+    TestDirectory test_dir;
+
+    OIIO::ImageSpec spec( 40, 24, 3, OIIO::TypeDesc::FLOAT );
+    OIIO::ImageBuf  src( spec );
+    const float     color1[] = { 0.1f, 0.5f, 0.9f };
+    const float     color2[] = { 0.7f, 0.2f, 0.3f };
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( src, 4, 4, 1, color1, color2 ) );
+
+    ImageConverter converter;
+
+    const std::string strict_path = test_dir.path() + "/strict.exr";
+    OIIO_CHECK_ASSERT( converter.save_image( strict_path, src ) );
+
+    OIIO::ImageBuf strict( strict_path );
+    OIIO_CHECK_ASSERT( strict.read() );
+    OIIO_CHECK_EQUAL(
+        strict.spec().get_string_attribute( "compression" ), "none" );
+    OIIO_CHECK_EQUAL(
+        strict.spec().get_int_attribute( "acesImageContainerFlag" ), 1 );
+    OIIO_CHECK_EQUAL( strict.spec().tile_width, 0 );
+
+    converter.settings.output_profile =
+        ImageConverter::Settings::OutputProfile::Intermediate;
+    converter.settings.compression   = "piz";
+    converter.settings.tile_size     = 16;
+    converter.settings.write_threads = 2;
+
+    const std::string intermediate_path = test_dir.path() + "/piz.exr";
+    OIIO_CHECK_ASSERT( converter.save_image( intermediate_path, src ) );
+
+    OIIO::ImageBuf intermediate( intermediate_path );
+    OIIO_CHECK_ASSERT( intermediate.read() );
+    OIIO_CHECK_EQUAL(
+        intermediate.spec().get_string_attribute( "compression" ), "piz" );
+    OIIO_CHECK_EQUAL(
+        intermediate.spec().get_int_attribute( "acesImageContainerFlag" ),
+        0 );
+    OIIO_CHECK_EQUAL( intermediate.spec().tile_width, 16 );
+    OIIO_CHECK_EQUAL( intermediate.spec().tile_height, 16 );
+
+    // Both compressions are lossless for half floats.
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( intermediate, strict, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // This part fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    // Streaming writes whole rows of tiles.
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    converter.settings.memory_limit = 1;
+
+    const std::string streamed_path = test_dir.path() + "/streamed.exr";
+
+    OIIO::ParamValueList hints;
+    OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+    OIIO_CHECK_ASSERT(
+        converter.stream_image( dng_test_file, hints, streamed_path ) );
+
+    OIIO::ImageBuf buffer;
+    OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+    OIIO_CHECK_ASSERT( converter.load_image( dng_test_file, hints, buffer ) );
+    OIIO_CHECK_ASSERT( converter.convert_image( dng_test_file, buffer ) );
+
+    OIIO::ImageBuf streamed( streamed_path );
+    OIIO_CHECK_ASSERT( streamed.read() );
+    OIIO_CHECK_EQUAL( streamed.spec().tile_width, 16 );
+    OIIO_CHECK_EQUAL( streamed.roi(), buffer.roi() );
+
+    comparison = OIIO::ImageBufAlgo::compare( streamed, buffer, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+}
+
+/// Tests that the hard crop of a buffer already holding only the crop area
+/// re-windows it in place without copying the pixels, and that a full frame
+/// still gets cropped correctly
+void test_apply_crop_in_place()
+{
+    std::cout << std::endl << "test_apply_crop_in_place()" << std::endl;
+
+    ImageConverter converter;
+    converter.settings.crop_mode = ImageConverter::Settings::CropMode::Hard;
+
+    OIIO::ImageSpec spec( 16, 12, 3, OIIO::TypeDesc::FLOAT );
+    spec.full_x      = 2;
+    spec.full_y      = 3;
+    spec.full_width  = 10;
+    spec.full_height = 6;
+
+    OIIO::ImageBuf frame( spec );
+    const float    color1[] = { 0.1f, 0.5f, 0.9f };
+    const float    color2[] = { 0.7f, 0.2f, 0.3f };
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( frame, 3, 3, 1, color1, color2 ) );
+
+    OIIO::ImageBuf expected =
+        OIIO::ImageBufAlgo::crop( frame, spec.roi_full() );
+    expected.set_origin( 0, 0 );
+    expected.set_full( 0, 10, 0, 6, 0, 1 );
+
+    // The full frame gets cropped.
+    OIIO::ImageBuf cropped = OIIO::ImageBufAlgo::copy( frame );
+    OIIO_CHECK_ASSERT( converter.apply_crop( cropped, cropped ) );
+    OIIO_CHECK_EQUAL( cropped.roi(), expected.roi() );
+    OIIO_CHECK_EQUAL( cropped.roi_full(), expected.roi_full() );
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( cropped, expected, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // The buffer holding only the crop area gets re-windowed.
+    OIIO::ImageBuf window = OIIO::ImageBufAlgo::crop( frame, spec.roi_full() );
+    const void    *pixels = window.localpixels();
+    OIIO_CHECK_ASSERT( converter.apply_crop( window, window ) );
+    OIIO_CHECK_EQUAL( window.localpixels(), pixels );
+    OIIO_CHECK_EQUAL( window.roi(), expected.roi() );
+    OIIO_CHECK_EQUAL( window.roi_full(), expected.roi_full() );
+    comparison = OIIO::ImageBufAlgo::compare( window, expected, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // Disabling the crop only changes the display window.
+    converter.settings.crop_mode = ImageConverter::Settings::CropMode::Off;
+    OIIO::ImageBuf uncropped     = OIIO::ImageBufAlgo::copy( frame );
+    pixels                       = uncropped.localpixels();
+    OIIO_CHECK_ASSERT( converter.apply_crop( uncropped, uncropped ) );
+    OIIO_CHECK_EQUAL( uncropped.localpixels(), pixels );
+    OIIO_CHECK_EQUAL( uncropped.roi_full(), frame.roi() );
+}
+
+/// Tests that downscaling averages the blocks of pixels, scales both the
+/// data and the display windows, and rejects images smaller than a block
+void test_apply_downscale()
+{
+    std::cout << std::endl << "test_apply_downscale()" << std::endl;
+
+    ImageConverter converter;
+
+    OIIO::ImageSpec spec( 13, 10, 3, OIIO::TypeDesc::FLOAT );
+    spec.full_x      = 2;
+    spec.full_y      = 4;
+    spec.full_width  = 8;
+    spec.full_height = 6;
+
+    // Every 2x2 block of the checker has the same colour, so the averages
+    // match a checker of 1x1 squares.
+    OIIO::ImageBuf  src( spec );
+    const float     color1[] = { 0.1f, 0.5f, 0.9f };
+    const float     color2[] = { 0.7f, 0.2f, 0.3f };
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( src, 2, 2, 1, color1, color2 ) );
+
+    OIIO::ImageBuf dst;
+    OIIO_CHECK_ASSERT( converter.apply_downscale( dst, src, 2 ) );
+    OIIO_CHECK_EQUAL( dst.roi(), OIIO::ROI( 0, 6, 0, 5, 0, 1, 0, 3 ) );
+    OIIO_CHECK_EQUAL( dst.roi_full(), OIIO::ROI( 1, 5, 2, 5, 0, 1, 0, 3 ) );
+
+    OIIO::ImageBuf expected( dst.spec() );
+    OIIO_CHECK_ASSERT(
+        OIIO::ImageBufAlgo::checker( expected, 1, 1, 1, color1, color2 ) );
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( dst, expected, 1e-6f, 1e-6f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    // The blocks spanning both colours get averaged.
+    OIIO_CHECK_ASSERT( converter.apply_downscale( dst, src, 4 ) );
+    OIIO_CHECK_EQUAL( dst.roi(), OIIO::ROI( 0, 3, 0, 2, 0, 1, 0, 3 ) );
+    float pixel[3];
+    dst.getpixel( 0, 0, pixel, 3 );
+    OIIO_CHECK_EQUAL_THRESH( pixel[0], 0.4f, 1e-6f );
+    OIIO_CHECK_EQUAL_THRESH( pixel[1], 0.35f, 1e-6f );
+    OIIO_CHECK_EQUAL_THRESH( pixel[2], 0.6f, 1e-6f );
+
+    // Downscaling in place.
+    OIIO::ImageBuf in_place = OIIO::ImageBufAlgo::copy( src );
+    OIIO_CHECK_ASSERT( converter.apply_downscale( in_place, in_place, 2 ) );
+    comparison =
+        OIIO::ImageBufAlgo::compare( in_place, expected, 1e-6f, 1e-6f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+
+    std::string output = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT( !converter.apply_downscale( dst, src, 16 ) );
+    } );
+    ASSERT_CONTAINS( output, "is too small to downscale by the factor of 16" );
+}
+
+/// Tests that the proxy mode decodes at half size for the even factors, and
+/// writes a compressed file downscaled by the whole factor
+void test_proxy_mode()
+{
+    std::cout << std::endl << "test_proxy_mode()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    TestDirectory test_dir;
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+    converter.settings.crop_mode = ImageConverter::Settings::CropMode::Off;
+
+    OIIO::ParamValueList hints;
+    OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+    OIIO::ImageBuf full;
+    OIIO_CHECK_ASSERT( converter.load_image( dng_test_file, hints, full ) );
+
+    for ( int factor: { 3, 4 } )
+    {
+        converter.settings.proxy = factor;
+
+        hints.clear();
+        OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+        OIIO_CHECK_EQUAL(
+            hints.get_int( "raw:half_size" ), factor % 2 == 0 ? 1 : 0 );
+        OIIO_CHECK_EQUAL( hints.get_string( "raw:Demosaic" ), "linear" );
+
+        OIIO::ImageBuf buffer;
+        OIIO_CHECK_ASSERT(
+            converter.load_image( dng_test_file, hints, buffer ) );
+        OIIO_CHECK_ASSERT( converter.convert_image( dng_test_file, buffer ) );
+
+        // The decoder may round the odd sizes up when decoding at half size.
+        const int width  = full.spec().width / factor;
+        const int height = full.spec().height / factor;
+        OIIO_CHECK_ASSERT( std::abs( buffer.spec().width - width ) <= 1 );
+        OIIO_CHECK_ASSERT( std::abs( buffer.spec().height - height ) <= 1 );
+
+        const std::string path = test_dir.path() + "/proxy.exr";
+        OIIO_CHECK_ASSERT( converter.save_image( path, buffer ) );
+
+        OIIO::ImageBuf proxy( path );
+        OIIO_CHECK_ASSERT( proxy.read() );
+        OIIO_CHECK_EQUAL(
+            proxy.spec().get_string_attribute( "compression" ), "zip" );
+        OIIO_CHECK_EQUAL(
+            proxy.spec().get_int_attribute( "acesImageContainerFlag" ), 0 );
+    }
+}
+
+/// Tests that converting an image from memory produces the same pixels and
+/// transform as converting the file, and that no files get written
+void test_process_memory()
+{
+    std::cout << std::endl << "test_process_memory()" << std::endl;
+
+    // This test fails on CI runners having an old version of OIIO.
+    if ( OIIO::openimageio_version() < 30000 )
+        return;
+
+    std::ifstream file( dng_test_file, std::ios::binary );
+    std::vector<char> data(
+        ( std::istreambuf_iterator<char>( file ) ),
+        std::istreambuf_iterator<char>() );
+    OIIO_CHECK_ASSERT( !data.empty() );
+
+    ImageConverter converter;
+    converter.settings.WB_method = ImageConverter::Settings::WBMethod::Metadata;
+    converter.settings.matrix_method =
+        ImageConverter::Settings::MatrixMethod::Metadata;
+
+    OIIO::ParamValueList hints;
+    OIIO::ImageBuf       expected;
+    OIIO_CHECK_ASSERT( converter.configure( dng_test_file, hints ) );
+    OIIO_CHECK_ASSERT( converter.load_image( dng_test_file, hints, expected ) );
+    OIIO_CHECK_ASSERT( converter.convert_image( dng_test_file, expected ) );
+    const auto expected_IDT = converter.get_IDT_matrix();
+
+    TestDirectory  test_dir;
+    OIIO::ImageBuf buffer;
+    OIIO_CHECK_ASSERT( converter.process_memory(
+        test_dir.path() + "/object", data.data(), data.size(), buffer ) );
+
+    OIIO_CHECK_EQUAL(
+        buffer.spec().format, OIIO::TypeDesc( OIIO::TypeDesc::HALF ) );
+    OIIO_CHECK_EQUAL( buffer.roi(), expected.roi() );
+    OIIO_CHECK_EQUAL( buffer.roi_full(), expected.roi_full() );
+    OIIO_CHECK_ASSERT( converter.get_IDT_matrix() == expected_IDT );
+
+    auto comparison =
+        OIIO::ImageBufAlgo::compare( buffer, expected, 0.0f, 0.0f );
+    OIIO_CHECK_EQUAL( comparison.nfail, 0 );
+    OIIO_CHECK_ASSERT(
+        !std::filesystem::exists( test_dir.path() + "/object_aces.exr" ) );
+
+    std::string output = capture_stderr( [&]() {
+        OIIO_CHECK_ASSERT(
+            !converter.process_memory( "empty", data.data(), 0, buffer ) );
+    } );
+    ASSERT_CONTAINS( output, "ERROR: The raw image empty is empty." );
+    ASSERT_CONTAINS( output, "Failed to configure the reader for the image" );
+}
+
 int main( int, char ** )
 {
     try
@@ -2166,6 +4488,8 @@ int main( int, char ** )
         test_collect_image_files_directory_with_only_filtered_files();
         test_collect_image_files_multiple_paths();
         test_collect_image_files_mixed_valid_invalid_paths();
+        test_collect_image_files_recursive();
+        test_scan_image_files_callback();
 
         // Tests for raw extensions
         test_parse_raw_extensions();
@@ -2193,6 +4517,7 @@ int main( int, char ** )
         test_parse_parameters_list_cameras( true );
         test_parse_parameters_list_illuminants();
         test_parse_parameters_list_illuminants( true );
+        test_get_supported_cameras_cached();
 
         // Tests for prepare_transform_spectral parts
         test_missing_camera_manufacturer();
@@ -2240,6 +4565,73 @@ int main( int, char ** )
         test_main_parse_parameters_failure();
         test_main_no_files_provided();
         test_main_no_files_processed();
+        test_main_continue_on_error();
+        test_main_stop_on_error();
+        test_main_invalid_jobs();
+        test_main_invalid_threads();
+        test_conversion_threads();
+        test_main_invalid_shard();
+        test_select_shard();
+        test_batch_converter_shard_metrics();
+
+        // Tests for BatchConverter
+        test_batch_converter_results_in_order();
+        test_batch_converter_stops_on_error();
+        test_batch_converter_pipeline_errors();
+        test_batch_converter_pipeline_success();
+        test_batch_converter_metrics();
+        test_batch_converter_trace();
+        test_job_manifest();
+        test_batch_converter_manifest();
+        test_batch_converter_group_transforms();
+        test_batch_converter_solve_ahead();
+        test_main_invalid_solve_ahead();
+        test_scan_metadata();
+        test_main_scan();
+
+        // Tests for load_image
+        test_load_image_reuses_configured_reader();
+        test_load_image_io_modes();
+        test_file_mapping();
+        test_main_invalid_io_mode();
+
+        // Tests for apply_transform
+        test_apply_transform_matches_separate_passes();
+        test_transform_to_half();
+        test_transform_kernels();
+        test_apply_transform_half_region();
+        test_apply_transform_gpu();
+
+        // Tests for save_image
+        test_save_image_atomic();
+        test_output_profiles();
+
+        // Tests for the outputs
+        test_process_image_outputs();
+        test_main_invalid_output();
+
+        // Tests for apply_crop
+        test_apply_crop_in_place();
+
+        // Tests for the proxy mode
+        test_apply_downscale();
+        test_proxy_mode();
+
+        // Tests for stream_image
+        test_stream_image_matches_whole_frame();
+
+        // Tests for process_memory
+        test_process_memory();
+
+        // Tests for BufferPool
+        test_buffer_pool();
+        test_process_image_buffer_pool();
+        test_detach_buffer();
+        test_main_invalid_buffer_pool();
+
+        // Tests for ConversionServer
+        test_conversion_server();
+        test_main_submit_without_server();
     }
     catch ( const std::exception &e )
     {